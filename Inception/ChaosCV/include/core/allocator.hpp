@@ -3,8 +3,13 @@
 #include "core/def.hpp"
 
 #include <malloc.h>
+#include <memory>
 
-#define ALIGNMENT 16
+// default alignment in bytes, a cache line and wide enough for AVX-512 aligned loads
+// it can be changed at runtime with chaos::SetDefaultAlignment
+#ifndef ALIGNMENT
+#define ALIGNMENT 64
+#endif
 
 // exchange-add operation for atomic operations on reference counters
 // Just for windows, reference to ncnn
@@ -26,7 +31,7 @@
 #define ALIGNED_FREE(ptr) free(ptr)
 #endif
 
-#ifndef _WIN32
+#if not defined _WIN32 and not defined __cpp_lib_constexpr_dynamic_alloc
 namespace std
 {
 	template<class T, class...Args>
@@ -68,14 +73,17 @@ namespace chaos
 		return (sz + n - 1) & -n;
 	}
 
-	static inline void* FastMalloc(size_t capacity)
-	{
-		return ALIGNED_MALLOC(capacity, ALIGNMENT);
-	}
-	static inline void FastFree(void* data)
-	{
-		ALIGNED_FREE(data);
-	}
+	/// <summary>
+	/// <para>Set the alignment used by FastMalloc, ArenaAllocator and the padding of Tensor::Create</para>
+	/// <para>Call it before allocating, blocks cached by allocators keep their original alignment</para>
+	/// </summary>
+	/// <param name="alignment">Power of two and not less than sizeof(void*)</param>
+	CHAOS_API void SetDefaultAlignment(size_t alignment);
+	CHAOS_API size_t GetDefaultAlignment() noexcept;
+
+	/// <summary> Default aligned allocation, observable through SetDefaultTracker </summary>
+	CHAOS_API void* FastMalloc(size_t capacity);
+	CHAOS_API void FastFree(void* data);
 
 	class Allocator
 	{
@@ -84,4 +92,156 @@ namespace chaos
 		virtual void* FastMalloc(size_t) = 0;
 		virtual void FastFree(void*) = 0;
 	};
+
+	class SizeClassPool;
+
+	/// <summary>
+	/// <para>Thread-safe allocator that caches freed blocks in size-class free lists</para>
+	/// <para>Requests are rounded up to a size class (four classes per power of two),
+	/// so steady-state allocations of recurring sizes become free-list pops. The class of a block
+	/// is kept in a small header in front of it, so only its own blocks may be given back</para>
+	/// </summary>
+	class CHAOS_API PoolAllocator : public Allocator
+	{
+	public:
+		/// <param name="max_cached">Maximum bytes kept in the free lists, 0 means unlimited</param>
+		explicit PoolAllocator(size_t max_cached = 0);
+		~PoolAllocator();
+
+		PoolAllocator(const PoolAllocator&) = delete;
+		PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+		void* FastMalloc(size_t size) override;
+		void FastFree(void* ptr) override;
+
+		/// <summary> Release cached blocks until at most keep bytes remain cached </summary>
+		void Trim(size_t keep = 0);
+		void SetMaxCached(size_t max_cached);
+
+		size_t cached() const;
+		size_t in_use() const;
+
+	private:
+		SizeClassPool* pool;
+	};
+
+	/// <summary>
+	/// <para>Same as PoolAllocator but without locking</para>
+	/// <para>Only use it from one thread at a time, e.g. as a per-thread workspace allocator</para>
+	/// </summary>
+	class CHAOS_API UnlockedPoolAllocator : public Allocator
+	{
+	public:
+		/// <param name="max_cached">Maximum bytes kept in the free lists, 0 means unlimited</param>
+		explicit UnlockedPoolAllocator(size_t max_cached = 0);
+		~UnlockedPoolAllocator();
+
+		UnlockedPoolAllocator(const UnlockedPoolAllocator&) = delete;
+		UnlockedPoolAllocator& operator=(const UnlockedPoolAllocator&) = delete;
+
+		void* FastMalloc(size_t size) override;
+		void FastFree(void* ptr) override;
+
+		/// <summary> Release cached blocks until at most keep bytes remain cached </summary>
+		void Trim(size_t keep = 0);
+		void SetMaxCached(size_t max_cached);
+
+		size_t cached() const;
+		size_t in_use() const;
+
+	private:
+		SizeClassPool* pool;
+	};
+
+	class PageBlocks;
+
+	/// <summary>
+	/// <para>Allocator backed by anonymous memory mappings for large tensors</para>
+	/// <para>Blocks of at least threshold bytes are mapped directly, aligned to 2MB and
+	/// advised to use transparent huge pages, smaller ones go to FastMalloc</para>
+	/// </summary>
+	class CHAOS_API PageAllocator : public Allocator
+	{
+	public:
+		/// <param name="threshold">Minimum size to be mapped</param>
+		/// <param name="huge_pages">Request transparent huge pages</param>
+		/// <param name="prefault">Fault all the pages in when mapping, instead of on first touch</param>
+		explicit PageAllocator(size_t threshold = 2 << 20, bool huge_pages = true, bool prefault = false);
+		~PageAllocator();
+
+		PageAllocator(const PageAllocator&) = delete;
+		PageAllocator& operator=(const PageAllocator&) = delete;
+
+		void* FastMalloc(size_t size) override;
+		void FastFree(void* ptr) override;
+
+		size_t mapped() const;
+
+	private:
+		size_t threshold;
+		bool huge_pages;
+		bool prefault;
+
+		PageBlocks* blocks;
+	};
+
+	class ArenaChunks;
+
+	/// <summary>
+	/// <para>Bump-pointer allocator for short-lived scratch memory, not thread-safe</para>
+	/// <para>Slices are carved from large chunks and FastFree does nothing,
+	/// memory comes back all at once with Reset or when an ArenaScope ends.
+	/// Chunks are kept after a reset, so scratch stays warm across frames</para>
+	/// </summary>
+	class CHAOS_API ArenaAllocator : public Allocator
+	{
+	public:
+		struct Mark
+		{
+			size_t chunk = 0;
+			size_t offset = 0;
+		};
+
+		/// <param name="chunk_size">Size of each chunk, larger requests get a chunk of their own</param>
+		explicit ArenaAllocator(size_t chunk_size = 4 << 20);
+		~ArenaAllocator();
+
+		ArenaAllocator(const ArenaAllocator&) = delete;
+		ArenaAllocator& operator=(const ArenaAllocator&) = delete;
+
+		void* FastMalloc(size_t size) override;
+		void FastFree(void*) override {}
+
+		Mark GetMark() const noexcept;
+		/// <summary> Release everything allocated after the mark </summary>
+		void Reset(const Mark& mark);
+		void Reset() { Reset(Mark()); }
+		/// <summary> Free the chunks not used at the moment </summary>
+		void Trim();
+
+		size_t used() const noexcept;
+		size_t reserved() const noexcept;
+
+	private:
+		ArenaChunks* chunks;
+	};
+
+	/// <summary>
+	/// <para>Releases all the arena memory allocated during its lifetime, for example</para>
+	/// <para>{ ArenaScope scope(arena); ... } // scratch of this block is gone</para>
+	/// <para>Tensors allocated from the arena must not outlive the scope</para>
+	/// </summary>
+	class ArenaScope
+	{
+	public:
+		explicit ArenaScope(ArenaAllocator& arena) : arena(arena), mark(arena.GetMark()) {}
+		~ArenaScope() { arena.Reset(mark); }
+
+		ArenaScope(const ArenaScope&) = delete;
+		ArenaScope& operator=(const ArenaScope&) = delete;
+
+	private:
+		ArenaAllocator& arena;
+		ArenaAllocator::Mark mark;
+	};
 }
\ No newline at end of file
@@ -10,6 +10,8 @@
 #include <memory>
 #include <numeric>
 #include <type_traits>
+#include <utility>
+#include <cstring>
 
 namespace chaos
 {
@@ -49,12 +51,15 @@ namespace chaos
 		}
 
 		// move constructor
-		Array(Array<Type>&& arr) noexcept : size_(std::exchange(arr.size_, 0)), data_(std::exchange(arr.data_, nullptr)) {}
+		Array(Array<Type>&& arr) noexcept { Take(arr); }
 		// move assignment
 		Array<Type>& operator=(Array<Type>&& arr) noexcept
 		{
-			std::swap(size_, arr.size_);
-			std::swap(data_, arr.data_);
+			if (this != &arr)
+			{
+				Release();
+				Take(arr);
+			}
 			return *this;
 		}
 
@@ -62,8 +67,7 @@ namespace chaos
 		{
 			Array<Type> ori = std::move(*this);
 
-			size_ = new_size;
-			data_ = static_cast<Type*>(::operator new(size_ * sizeof(Type), std::align_val_t{ alignof(Type) }));
+			Allocate(new_size);
 			for (int i = 0; i < size_; i++)
 			{
 				std::construct_at(std::addressof(data_[i]), i < ori.size_ ? ori[i] : 0);
@@ -101,12 +105,52 @@ namespace chaos
 
 		//friend class Shape;
 	protected:
-		void Create(size_t new_size)
+		// arrays up to inline_capacity elements (e.g. Shape and Steps up to 8 dims)
+		// live in the object itself, larger ones fall back to the heap
+		static constexpr size_t inline_capacity = sizeof(Type) < 32 ? 32 / sizeof(Type) : 1;
+
+		Type* local() noexcept { return reinterpret_cast<Type*>(buffer_); }
+
+		// set size_ and point data_ to storage for new_size elements, without constructing them
+		void Allocate(size_t new_size)
 		{
 			size_ = new_size;
-			if (size_ > 0)
+			if (size_ == 0)
+			{
+				data_ = nullptr;
+			}
+			else if (size_ <= inline_capacity)
+			{
+				data_ = local();
+			}
+			else
 			{
 				data_ = static_cast<Type*>(::operator new(size_ * sizeof(Type), std::align_val_t{ alignof(Type) }));
+			}
+		}
+
+		// steal the heap block of arr, or copy its inline elements
+		void Take(Array<Type>& arr) noexcept
+		{
+			if (arr.data_ == arr.local())
+			{
+				Allocate(arr.size_);
+				memcpy(static_cast<void*>(data_), arr.data_, size_ * sizeof(Type));
+			}
+			else
+			{
+				size_ = arr.size_;
+				data_ = arr.data_;
+			}
+			arr.size_ = 0;
+			arr.data_ = nullptr;
+		}
+
+		void Create(size_t new_size)
+		{
+			Allocate(new_size);
+			if (size_ > 0)
+			{
 				for (size_t i = 0; i < size_; i++)
 				{
 					std::construct_at(std::addressof(data_[i]), 0);
@@ -115,10 +159,9 @@ namespace chaos
 		}
 		void Create(size_t new_size, const Type* data, size_t inc = 0)
 		{
-			size_ = new_size;
+			Allocate(new_size);
 			if (size_ > 0)
 			{
-				data_ = static_cast<Type*>(::operator new(size_ * sizeof(Type), std::align_val_t{ alignof(Type) }));
 				for (size_t i = 0; i < size_; i++, data += inc)
 				{
 					std::construct_at(std::addressof(data_[i]), *data);
@@ -134,7 +177,7 @@ namespace chaos
 				{
 					data_[i].~Type();
 				}
-				::operator delete (static_cast<void*>(data_), std::align_val_t{ alignof(Type) });
+				if (data_ != local()) ::operator delete (static_cast<void*>(data_), std::align_val_t{ alignof(Type) });
 			}
 			data_ = nullptr;
 			size_ = 0;
@@ -142,6 +185,8 @@ namespace chaos
 
 		Type* data_ = nullptr;
 		size_t size_ = 0;
+
+		alignas(Type) unsigned char buffer_[inline_capacity * sizeof(Type)];
 	};
 
 	// same with tensorflow ranges
@@ -211,8 +256,7 @@ namespace chaos
 		template<class Type, Integral<Type> = true>
 		Steps(const std::initializer_list<Type>& list)
 		{
-			size_ = list.size();
-			data_ = static_cast<int*>(::operator new(size_ * sizeof(int), std::align_val_t{ alignof(int) }));
+			Allocate(list.size());
 			for (size_t i = 0; const auto & data : list)
 			{
 				std::construct_at(std::addressof(data_[i++]), static_cast<int>(data));
@@ -233,8 +277,7 @@ namespace chaos
 		template<class Type, Integral<Type> = true>
 		Shape(const std::initializer_list<Type>& list)
 		{
-			size_ = list.size();
-			data_ = static_cast<int*>(::operator new(size_ * sizeof(int), std::align_val_t{ alignof(int) }));
+			Allocate(list.size());
 			for (size_t i = 0; const auto & data : list)
 			{
 				std::construct_at(std::addressof(data_[i++]), static_cast<int>(data));
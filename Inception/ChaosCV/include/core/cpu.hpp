@@ -0,0 +1,26 @@
+#pragma once
+
+#include "core/def.hpp"
+
+// lets a function use the instructions of an ISA without building the whole library for it,
+// the caller must check the matching CpuSupport* first
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CHAOS_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CHAOS_TARGET(isa)
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CHAOS_X86 1
+#endif
+
+namespace chaos
+{
+	/// <summary> Runtime CPU feature detection, the OS support of the wide registers is checked too </summary>
+	CHAOS_API bool CpuSupportSSE41() noexcept;
+	CHAOS_API bool CpuSupportAVX() noexcept;
+	CHAOS_API bool CpuSupportAVX2() noexcept;
+	CHAOS_API bool CpuSupportFMA() noexcept;
+	CHAOS_API bool CpuSupportF16C() noexcept;
+	CHAOS_API bool CpuSupportAVX512F() noexcept;
+}
\ No newline at end of file
@@ -0,0 +1,392 @@
+#pragma once
+
+#include "core/def.hpp"
+#include "core/log.hpp"
+#include "core/op.hpp"
+#include "core/tensor.hpp"
+#include "core/strided.hpp"
+#include "core/parallel.hpp"
+
+#include <array>
+#include <algorithm>
+#include <type_traits>
+
+namespace chaos
+{
+	// Lazy elementwise expressions: a + b * 2.f builds a tree of nodes without computing anything,
+	// Eval and Assign walk the broadcast output once and compute every node per block of a row.
+	// The nodes hold the data pointers of their operands, not a reference, so the operands must
+	// outlive the expression (like TensorView)
+
+	// scalars computed per node at once, the buffers of a deep expression stay in L1
+	constexpr int64_t expr_block = 256;
+
+	struct ExprBase {};
+
+	template<class Type>
+	struct IsExpr : std::is_base_of<ExprBase, Type> {};
+
+	// offset and inner step of every leaf for the row being computed
+	template<size_t N>
+	struct ExprRow
+	{
+		std::array<int64_t, N> offset = {};
+		std::array<int64_t, N> step = {};
+	};
+
+	// the broadcast shape, right-aligned in max_dims
+	struct ExprShape
+	{
+		static constexpr size_t max_dims = StridedLoop<1>::max_dims;
+
+		int shape[max_dims];
+		size_t dims = 0;
+
+		ExprShape() { std::fill(std::begin(shape), std::end(shape), 1); }
+
+		void Merge(const Shape& other)
+		{
+			CHECK_LE(other.size(), max_dims) << "too many dims";
+			for (size_t i = 0; i < other.size(); i++)
+			{
+				int& size = shape[max_dims - other.size() + i];
+				int val = other.data()[i];
+				CHECK(size == 1 || val == 1 || size == val) << "can not broadcast " << other << " with " << size << " at dim " << i;
+				if (size == 1) size = val;
+			}
+			dims = std::max(dims, other.size());
+		}
+		Shape get() const { return Shape(Array<int>(dims, const_cast<int*>(shape + max_dims - dims), 1)); }
+	};
+
+	/// <summary> A Tensor or an Array operand of an expression </summary>
+	template<class Type>
+	class LeafExpr : public ExprBase
+	{
+	public:
+		using value_type = Type;
+		static constexpr size_t leaves = 1;
+
+		LeafExpr(const Tensor& tensor) : data(static_cast<const Type*>(tensor.data)), shape(tensor.shape), steps(tensor.steps)
+		{
+			DCHECK_EQ(sizeof(Type), static_cast<size_t>(1 * tensor.depth * tensor.packing)) << "element size mismatch";
+		}
+		LeafExpr(const Array<Type>& arr) : data(arr.data()), shape(static_cast<int>(arr.size())), steps(1) {}
+
+		void MergeShape(ExprShape& out) const { out.Merge(shape); }
+
+		// steps against the output dims, 0 where the leaf is broadcast
+		template<size_t K>
+		void BroadcastSteps(int (*table)[ExprShape::max_dims], const Shape& out) const
+		{
+			size_t dims = out.size();
+			CHECK_LE(shape.size(), dims) << "can not broadcast " << shape << " to " << out;
+			size_t lead = dims - shape.size();
+			for (size_t d = 0; d < dims; d++)
+			{
+				table[K][d] = d < lead || shape.data()[d - lead] == 1 ? 0 : steps.data()[d - lead];
+			}
+		}
+
+		template<size_t K, size_t N>
+		const Type* Eval(const ExprRow<N>& row, int64_t i0, int64_t n, Type* buf) const
+		{
+			int64_t step = row.step[K];
+			const Type* ptr = data + row.offset[K] + i0 * step;
+			if (step == 1) return ptr;
+			for (int64_t i = 0; i < n; i++) buf[i] = ptr[i * step];
+			return buf;
+		}
+
+	private:
+		const Type* data;
+		Shape shape;
+		Steps steps;
+	};
+
+	template<class Type>
+	class ScalarExpr : public ExprBase
+	{
+	public:
+		using value_type = Type;
+		static constexpr size_t leaves = 0;
+
+		ScalarExpr(const Type& value) : value(value) {}
+
+		void MergeShape(ExprShape&) const {}
+		template<size_t K>
+		void BroadcastSteps(int (*)[ExprShape::max_dims], const Shape&) const {}
+
+		template<size_t K, size_t N>
+		const Type* Eval(const ExprRow<N>&, int64_t, int64_t n, Type* buf) const
+		{
+			std::fill_n(buf, n, value);
+			return buf;
+		}
+
+		Type value;
+	};
+
+	template<class Type>
+	struct IsScalarExpr : std::false_type {};
+	template<class Type>
+	struct IsScalarExpr<ScalarExpr<Type>> : std::true_type {};
+
+	template<class Op, class Lhs, class Rhs>
+	class BinaryExpr : public ExprBase
+	{
+	public:
+		using value_type = typename Lhs::value_type;
+		static_assert(std::is_same_v<value_type, typename Rhs::value_type>, "the operands should have the same type");
+		static constexpr size_t leaves = Lhs::leaves + Rhs::leaves;
+
+		BinaryExpr(const Lhs& lhs, const Rhs& rhs) : lhs(lhs), rhs(rhs) {}
+
+		void MergeShape(ExprShape& out) const
+		{
+			lhs.MergeShape(out);
+			rhs.MergeShape(out);
+		}
+		template<size_t K>
+		void BroadcastSteps(int (*table)[ExprShape::max_dims], const Shape& out) const
+		{
+			lhs.template BroadcastSteps<K>(table, out);
+			rhs.template BroadcastSteps<K + Lhs::leaves>(table, out);
+		}
+
+		// out doubles as the buffer of the left operand, every scalar is read before it is written
+		template<size_t K, size_t N>
+		const value_type* Eval(const ExprRow<N>& row, int64_t i0, int64_t n, value_type* out) const
+		{
+			Op op;
+			if constexpr (IsScalarExpr<Rhs>::value)
+			{
+				const value_type* a = lhs.template Eval<K>(row, i0, n, out);
+				const value_type b = rhs.value;
+				for (int64_t i = 0; i < n; i++) out[i] = op(a[i], b);
+			}
+			else if constexpr (IsScalarExpr<Lhs>::value)
+			{
+				const value_type a = lhs.value;
+				const value_type* b = rhs.template Eval<K + Lhs::leaves>(row, i0, n, out);
+				for (int64_t i = 0; i < n; i++) out[i] = op(a, b[i]);
+			}
+			else
+			{
+				value_type buf[expr_block];
+				const value_type* a = lhs.template Eval<K>(row, i0, n, out);
+				const value_type* b = rhs.template Eval<K + Lhs::leaves>(row, i0, n, buf);
+				for (int64_t i = 0; i < n; i++) out[i] = op(a[i], b[i]);
+			}
+			return out;
+		}
+
+	private:
+		Lhs lhs;
+		Rhs rhs;
+	};
+
+	template<class Func, class Operand>
+	class UnaryExpr : public ExprBase
+	{
+	public:
+		using value_type = typename Operand::value_type;
+		static constexpr size_t leaves = Operand::leaves;
+
+		UnaryExpr(const Operand& operand, const Func& func) : operand(operand), func(func) {}
+
+		void MergeShape(ExprShape& out) const { operand.MergeShape(out); }
+		template<size_t K>
+		void BroadcastSteps(int (*table)[ExprShape::max_dims], const Shape& out) const
+		{
+			operand.template BroadcastSteps<K>(table, out);
+		}
+
+		template<size_t K, size_t N>
+		const value_type* Eval(const ExprRow<N>& row, int64_t i0, int64_t n, value_type* out) const
+		{
+			const value_type* a = operand.template Eval<K>(row, i0, n, out);
+			for (int64_t i = 0; i < n; i++) out[i] = func(a[i]);
+			return out;
+		}
+
+	private:
+		Operand operand;
+		Func func;
+	};
+
+	/// <summary> Use a Tensor of Type, or an Array, as an operand, a bare Tensor is an operand of float </summary>
+	template<class Type = float>
+	LeafExpr<Type> Lazy(const Tensor& tensor) { return LeafExpr<Type>(tensor); }
+	template<class Type>
+	LeafExpr<Type> Lazy(const Array<Type>& arr) { return LeafExpr<Type>(arr); }
+
+	template<class Type, class Expr>
+	auto AsExpr(const Type& operand)
+	{
+		if constexpr (std::is_same_v<Type, Tensor>) return LeafExpr<float>(operand);
+		else if constexpr (IsExpr<Type>::value) return operand;
+		else return ScalarExpr<typename Expr::value_type>(static_cast<typename Expr::value_type>(operand));
+	}
+
+	template<class Type>
+	struct OperandOf { using type = std::conditional_t<std::is_same_v<Type, Tensor>, LeafExpr<float>, Type>; };
+
+	// at least one side is an expression or a Tensor, the other one may be a scalar
+	template<class Lhs, class Rhs>
+	using ExprOperands = std::enable_if_t<
+		(IsExpr<Lhs>::value or std::is_same_v<Lhs, Tensor> or std::is_arithmetic_v<Lhs> or std::is_same_v<Lhs, Complex>) and
+		(IsExpr<Rhs>::value or std::is_same_v<Rhs, Tensor> or std::is_arithmetic_v<Rhs> or std::is_same_v<Rhs, Complex>) and
+		(IsExpr<Lhs>::value or std::is_same_v<Lhs, Tensor> or IsExpr<Rhs>::value or std::is_same_v<Rhs, Tensor>), bool>;
+
+	template<template<class, auto...> class Op, class Lhs, class Rhs>
+	auto MakeBinary(const Lhs& lhs, const Rhs& rhs)
+	{
+		// the scalar side takes the type of the other side
+		using Left = typename OperandOf<Lhs>::type;
+		using Right = typename OperandOf<Rhs>::type;
+		if constexpr (IsExpr<Left>::value)
+		{
+			using Type = typename Left::value_type;
+			auto l = AsExpr<Lhs, Left>(lhs);
+			auto r = AsExpr<Rhs, Left>(rhs);
+			return BinaryExpr<Op<Type>, decltype(l), decltype(r)>(l, r);
+		}
+		else
+		{
+			using Type = typename Right::value_type;
+			auto l = AsExpr<Lhs, Right>(lhs);
+			auto r = AsExpr<Rhs, Right>(rhs);
+			return BinaryExpr<Op<Type>, decltype(l), decltype(r)>(l, r);
+		}
+	}
+
+	template<class Lhs, class Rhs, ExprOperands<Lhs, Rhs> = true>
+	auto operator+(const Lhs& lhs, const Rhs& rhs) { return MakeBinary<Add>(lhs, rhs); }
+	template<class Lhs, class Rhs, ExprOperands<Lhs, Rhs> = true>
+	auto operator-(const Lhs& lhs, const Rhs& rhs) { return MakeBinary<Sub>(lhs, rhs); }
+	template<class Lhs, class Rhs, ExprOperands<Lhs, Rhs> = true>
+	auto operator*(const Lhs& lhs, const Rhs& rhs) { return MakeBinary<Mul>(lhs, rhs); }
+	template<class Lhs, class Rhs, ExprOperands<Lhs, Rhs> = true>
+	auto operator/(const Lhs& lhs, const Rhs& rhs) { return MakeBinary<Div>(lhs, rhs); }
+
+	/// <summary> func(x) for every scalar of the expression, func should be cheap to copy </summary>
+	template<class Operand, class Func, ExprOperands<Operand, Operand> = true>
+	auto Apply(const Operand& operand, const Func& func)
+	{
+		auto expr = AsExpr<Operand, typename OperandOf<Operand>::type>(operand);
+		return UnaryExpr<Func, decltype(expr)>(expr, func);
+	}
+
+	template<class Operand, ExprOperands<Operand, Operand> = true>
+	auto operator-(const Operand& operand)
+	{
+		using Type = typename OperandOf<Operand>::type::value_type;
+		return Apply(operand, [](const Type& x) { return Type() - x; });
+	}
+
+	/// <summary>
+	/// <para>Compute the expression into dst in a single pass, the expression is broadcast to dst.shape</para>
+	/// <para>dst may have any steps, and may be an operand of the expression if it is read with the same steps</para>
+	/// </summary>
+	template<class Expr, std::enable_if_t<IsExpr<Expr>::value, bool> = true>
+	void Assign(Tensor& dst, const Expr& expr, int num_threads = 0, ThreadPool* pool = nullptr)
+	{
+		using Type = typename Expr::value_type;
+		constexpr size_t N = Expr::leaves;
+		DCHECK_EQ(sizeof(Type), static_cast<size_t>(1 * dst.depth * dst.packing)) << "element size mismatch";
+		if (dst.empty()) return;
+
+		ExprShape merged;
+		merged.Merge(dst.shape);
+		expr.MergeShape(merged);
+		CHECK_EQ(merged.get(), dst.shape) << "can not broadcast the expression to " << dst.shape;
+
+		// dst first, then the leaves from left to right
+		int table[N + 1][ExprShape::max_dims] = {};
+		std::array<const int*, N + 1> steps = {};
+		for (size_t d = 0; d < dst.shape.size(); d++) table[0][d] = dst.steps.data()[d];
+		expr.template BroadcastSteps<1>(table, dst.shape);
+		for (size_t k = 0; k <= N; k++) steps[k] = table[k];
+
+		StridedLoop<N + 1> loop(dst.shape, steps);
+		int64_t rows = loop.rows();
+		int64_t cols = loop.cols();
+		Type* data = static_cast<Type*>(dst.data);
+
+		auto compute = [&](int64_t r0, int64_t r1, int64_t c0, int64_t c1) {
+			loop.ForEachRow(r0, r1, [&](const int64_t* offset) {
+				ExprRow<N + 1> row;
+				for (size_t k = 0; k <= N; k++)
+				{
+					row.offset[k] = offset[k];
+					row.step[k] = loop.step(k);
+				}
+				Type* out = data + offset[0];
+				int64_t step = row.step[0];
+
+				// a block is complete before it is stored, so dst can be read by the expression too
+				Type buf[expr_block];
+				for (int64_t c = c0; c < c1; c += expr_block)
+				{
+					int64_t n = std::min(expr_block, c1 - c);
+					const Type* res = expr.template Eval<1>(row, c, n, buf);
+					if (step == 1)
+					{
+						std::copy_n(res, n, out + c);
+					}
+					else
+					{
+						for (int64_t i = 0; i < n; i++) out[(c + i) * step] = res[i];
+					}
+				}
+			});
+		};
+
+		// long rows (a dense Tensor is a single one) are cut into pieces, short rows are grouped
+		constexpr int64_t piece = 1 << 14;
+		int64_t pieces = (cols + piece - 1) / piece;
+		if (pieces > 1)
+		{
+			ParallelFor(0, rows * pieces, [&](int64_t first, int64_t last) {
+				for (int64_t t = first; t < last; t++)
+				{
+					int64_t r = t / pieces;
+					int64_t c = t % pieces * piece;
+					compute(r, r + 1, c, std::min(cols, c + piece));
+				}
+			}, 1, num_threads, pool);
+		}
+		else
+		{
+			ParallelFor(0, rows, [&](int64_t first, int64_t last) {
+				compute(first, last, 0, cols);
+			}, std::max<int64_t>(1, piece / cols), num_threads, pool);
+		}
+	}
+
+	/// <summary> Compute the expression into an Array of the broadcast size </summary>
+	template<class Type, class Expr, std::enable_if_t<IsExpr<Expr>::value, bool> = true>
+	void Assign(Array<Type>& dst, const Expr& expr, int num_threads = 0, ThreadPool* pool = nullptr)
+	{
+		static_assert(std::is_same_v<Type, typename Expr::value_type>, "the Array should have the type of the expression");
+		Tensor view = Tensor(Shape(static_cast<int>(dst.size())), static_cast<Depth>(sizeof(Type) / (std::is_same_v<Type, Complex> ? 2 : 1)),
+			std::is_same_v<Type, Complex> ? Packing::C2HW2 : Packing::CHW, dst.data());
+		Assign(view, expr, num_threads, pool);
+	}
+
+	/// <summary> Compute the expression into a new dense Tensor with the broadcast shape </summary>
+	template<class Expr, std::enable_if_t<IsExpr<Expr>::value, bool> = true>
+	Tensor Eval(const Expr& expr, Allocator* allocator = nullptr, int num_threads = 0, ThreadPool* pool = nullptr)
+	{
+		using Type = typename Expr::value_type;
+		ExprShape merged;
+		expr.MergeShape(merged);
+
+		// Complex is stored as 2 floats, the same as Tensor(const Array<Complex>&)
+		constexpr bool complex = std::is_same_v<Type, Complex>;
+		Tensor dst = Tensor(merged.get(), static_cast<Depth>(complex ? 4 : sizeof(Type)), complex ? Packing::C2HW2 : Packing::CHW, allocator);
+		Assign(dst, expr, num_threads, pool);
+		return dst;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "core/def.hpp"
+#include "core/tensor.hpp"
+
+namespace chaos
+{
+	// Discrete Fourier transforms of complex Tensors (Depth::D4, Packing::C2HW2, one Complex per element as made by
+	// Tensor(Array<Complex>)) and real Tensors (Depth::D4, Packing::CHW). The forward transform is unscaled and the
+	// inverse is scaled by 1/n, so IFFT(FFT(x)) == x. Any size works: sizes made of 2, 3, 5, 7, 11 and 13 run
+	// through a mixed-radix Stockham FFT, the others through Bluestein's algorithm on a power of 2.
+	// The plans (factors and twiddles) are made once per size and cached
+
+	/// <summary>
+	/// <para>1-D DFT along the last dim, the leading dims are a batch transformed in parallel</para>
+	/// <para>A real Tensor gives the full complex spectrum, computed from a complex FFT of half the size</para>
+	/// </summary>
+	/// <return>A new complex Tensor with the shape of tensor</return>
+	CHAOS_API Tensor FFT(const Tensor& tensor, Allocator* allocator = nullptr);
+	/// <param name="real_output">Keep only the real parts, e.g. for the spectrum of a real signal</param>
+	CHAOS_API Tensor IFFT(const Tensor& tensor, bool real_output = false, Allocator* allocator = nullptr);
+
+	/// <summary>
+	/// <para>2-D DFT over the last 2 dims: the rows and then the columns, both spread over threads</para>
+	/// <para>For a real Tensor only half of the columns are transformed, the others follow by symmetry</para>
+	/// </summary>
+	CHAOS_API Tensor FFT2(const Tensor& tensor, Allocator* allocator = nullptr);
+	CHAOS_API Tensor IFFT2(const Tensor& tensor, bool real_output = false, Allocator* allocator = nullptr);
+}
\ No newline at end of file
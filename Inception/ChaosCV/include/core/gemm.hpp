@@ -0,0 +1,30 @@
+#pragma once
+
+#include "core/def.hpp"
+#include "core/tensor.hpp"
+#include "core/parallel.hpp"
+
+#include <cstdint>
+
+namespace chaos
+{
+	/// <summary>
+	/// <para>C = alpha * op(A) * op(B) + beta * C on row-major float matrices, op(A) is m x k and op(B) is k x n</para>
+	/// <para>A and B are packed into panels sized for the caches and multiplied by an AVX-512 or AVX2 FMA
+	/// micro-kernel picked at runtime. C must not overlap A or B, with beta = 0 C is never read</para>
+	/// </summary>
+	/// <param name="lda">Distance between the rows of A as stored, i.e. before the transpose</param>
+	/// <param name="num_threads">Threads for the ParallelFor calls, 0 means all of the pool</param>
+	CHAOS_API void Gemm(bool trans_a, bool trans_b, int64_t m, int64_t n, int64_t k, float alpha,
+		const float* a, int64_t lda, const float* b, int64_t ldb, float beta, float* c, int64_t ldc,
+		int num_threads = 0, ThreadPool* pool = nullptr);
+
+	/// <summary>
+	/// <para>Matrix product of the last 2 dims of float CHW Tensors, the leading dims are batches
+	/// broadcast like the element-wise operators (a missing dim or a dim of 1 is repeated)</para>
+	/// <para>Rows may be strided (e.g. a Cut), the last dim should be contiguous or the Tensor is cloned first</para>
+	/// </summary>
+	CHAOS_API Tensor Matmul(const Tensor& a, const Tensor& b, bool trans_a = false, bool trans_b = false, Allocator* allocator = nullptr);
+	/// <summary> c = alpha * a x b + beta * c, c should already have the shape of the product </summary>
+	CHAOS_API void Matmul(const Tensor& a, const Tensor& b, Tensor& c, float alpha = 1.f, float beta = 0.f, bool trans_a = false, bool trans_b = false);
+}
\ No newline at end of file
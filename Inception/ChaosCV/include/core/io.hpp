@@ -105,9 +105,68 @@ namespace chaos
 		return stream << std::endl << "<Tensor " << tensor.shape << ">";
 	}
 }
-#else
+#endif
+
+#include <cstdio>
+
 namespace chaos
 {
+	/// <summary>
+	/// <para>Streaming writer of the binary tensor container</para>
+	/// <para>The file starts with a 64-byte header, each record is a 64-byte aligned header
+	/// holding depth, packing, shape and steps, followed by the dense payload padded to 64 bytes,
+	/// so that every payload can be memory-mapped with Tensor::Map</para>
+	/// </summary>
+	class CHAOS_API TensorWriter
+	{
+	public:
+		TensorWriter() = default;
+		/// <param name="append">Append records to an existing container instead of truncating it</param>
+		TensorWriter(const File& file, bool append = false);
+		~TensorWriter();
 
-}
-#endif
\ No newline at end of file
+		TensorWriter(const TensorWriter&) = delete;
+		TensorWriter& operator=(const TensorWriter&) = delete;
+
+		bool Open(const File& file, bool append = false);
+		void Close();
+
+		/// <summary> Append one tensor, strided tensors (e.g. from Cut) are compacted on the fly </summary>
+		bool Write(const Tensor& tensor);
+
+		bool opened() const noexcept { return fp != nullptr; }
+
+	private:
+		FILE* fp = nullptr;
+	};
+
+	/// <summary> Streaming reader of the container written by TensorWriter </summary>
+	class CHAOS_API TensorReader
+	{
+	public:
+		TensorReader() = default;
+		TensorReader(const File& file);
+		~TensorReader();
+
+		TensorReader(const TensorReader&) = delete;
+		TensorReader& operator=(const TensorReader&) = delete;
+
+		bool Open(const File& file);
+		void Close();
+
+		/// <summary> Read the next tensor into a new buffer, return false at the end of file </summary>
+		bool Read(Tensor& tensor, Allocator* allocator = nullptr);
+		/// <summary> Map the payload of the next tensor instead of reading it, see Tensor::Map </summary>
+		bool Map(Tensor& tensor);
+		/// <summary> Skip the next tensor without touching its payload </summary>
+		bool Skip();
+
+		bool opened() const noexcept { return fp != nullptr; }
+
+	private:
+		bool Next(Shape& shape, Steps& steps, Depth& depth, Packing& packing, size_t& payload);
+
+		File file;
+		FILE* fp = nullptr;
+	};
+}
\ No newline at end of file
@@ -6,6 +6,7 @@
 
 #include <numeric>
 #include <algorithm>
+#include <type_traits>
 
 namespace chaos
 {
@@ -23,42 +24,111 @@ namespace chaos
 
 	// can add other binary operators
 
+	enum class BinaryKind
+	{
+		Add,
+		Sub,
+		Mul,
+		Div,
+	};
+
+	/// <summary> Which side of a BinaryKernel is a single value </summary>
+	enum class Broadcast
+	{
+		None,
+		Lhs,
+		Rhs,
+	};
+
+	/// <summary>
+	/// <para>dst[i] = lhs[i] op rhs[i] for i in [0, n), the scalar side is read at [0] only</para>
+	/// <para>The loop is picked at the first call for the best of AVX-512, AVX2 and SSE4.1 the CPU has.
+	/// dst may be lhs or rhs, the int division by 0 is as undefined as with scalars</para>
+	/// </summary>
+	CHAOS_API void BinaryKernel(const BinaryKind& kind, const float* lhs, const float* rhs, float* dst, size_t n, const Broadcast& scalar = Broadcast::None);
+	CHAOS_API void BinaryKernel(const BinaryKind& kind, const int* lhs, const int* rhs, int* dst, size_t n, const Broadcast& scalar = Broadcast::None);
+	CHAOS_API void BinaryKernel(const BinaryKind& kind, const Complex* lhs, const Complex* rhs, Complex* dst, size_t n, const Broadcast& scalar = Broadcast::None);
+
+	/// <summary> Pairwise sum of n floats with SIMD accumulators, large inputs are split over the threads </summary>
+	CHAOS_API float SumKernel(const float* data, size_t n);
+	/// <summary> Pairwise sum of lhs[i] * rhs[i], never allocates </summary>
+	CHAOS_API float DotKernel(const float* lhs, const float* rhs, size_t n);
+
+	template<class Op>
+	struct BinaryKindOf { static constexpr bool known = false; };
+	template<class Type>
+	struct BinaryKindOf<Add<Type>> { static constexpr bool known = true; static constexpr BinaryKind kind = BinaryKind::Add; };
+	template<class Type>
+	struct BinaryKindOf<Sub<Type>> { static constexpr bool known = true; static constexpr BinaryKind kind = BinaryKind::Sub; };
+	template<class Type>
+	struct BinaryKindOf<Mul<Type>> { static constexpr bool known = true; static constexpr BinaryKind kind = BinaryKind::Mul; };
+	template<class Type>
+	struct BinaryKindOf<Div<Type>> { static constexpr bool known = true; static constexpr BinaryKind kind = BinaryKind::Div; };
+
+	// the BinaryKernel for the types it has, a plain loop on the pointers for the rest
 	template<class Type, class Op>
-	Array<Type> BinaryOp(const Array<Type>& lhs, const Array<Type>& rhs)
+	void BinaryOp(const Type* lhs, const Type* rhs, Type* dst, size_t size, const Broadcast& scalar)
 	{
-		Op op;
-		size_t size = lhs.size();
-		DCHECK_EQ(size, rhs.size());
-		
-		Array<Type> arr = Array<Type>(size);
-		for (size_t i = 0; i < size; i++)
+		constexpr bool vectorized = std::is_same_v<Type, float> or std::is_same_v<Type, int> or std::is_same_v<Type, Complex>;
+		if constexpr (vectorized and BinaryKindOf<Op>::known)
 		{
-			arr[i] = op(lhs[i], rhs[i]);
+			BinaryKernel(BinaryKindOf<Op>::kind, lhs, rhs, dst, size, scalar);
 		}
+		else
+		{
+			Op op;
+			for (size_t i = 0; i < size; i++)
+			{
+				dst[i] = op(scalar == Broadcast::Lhs ? lhs[0] : lhs[i], scalar == Broadcast::Rhs ? rhs[0] : rhs[i]);
+			}
+		}
+	}
+
+	// write to dst, which should have the size of the operands, dst may be an operand
+	template<class Type, class Op>
+	void BinaryOp(const Array<Type>& lhs, const Array<Type>& rhs, Array<Type>& dst)
+	{
+		size_t size = lhs.size();
+		DCHECK_EQ(size, rhs.size());
+		DCHECK_EQ(size, dst.size());
+		BinaryOp<Type, Op>(lhs.data(), rhs.data(), dst.data(), size, Broadcast::None);
+	}
+	template<class Type, class Op>
+	void BinaryOp(const Array<Type>& lhs, const Type& rhs, Array<Type>& dst)
+	{
+		size_t size = lhs.size();
+		DCHECK_EQ(size, dst.size());
+		const Type value = rhs; // rhs may be an element of dst
+		BinaryOp<Type, Op>(lhs.data(), &value, dst.data(), size, Broadcast::Rhs);
+	}
+	template<class Type, class Op>
+	void BinaryOp(const Type& lhs, const Array<Type>& rhs, Array<Type>& dst)
+	{
+		size_t size = rhs.size();
+		DCHECK_EQ(size, dst.size());
+		const Type value = lhs;
+		BinaryOp<Type, Op>(&value, rhs.data(), dst.data(), size, Broadcast::Lhs);
+	}
+
+	template<class Type, class Op>
+	Array<Type> BinaryOp(const Array<Type>& lhs, const Array<Type>& rhs)
+	{
+		Array<Type> arr = Array<Type>(lhs.size());
+		BinaryOp<Type, Op>(lhs, rhs, arr);
 		return arr;
 	}
 	template<class Type, class Op>
 	Array<Type> BinaryOp(const Array<Type>& lhs, const Type& rhs)
 	{
-		Op op;
-		size_t size = lhs.size();
-		Array<Type> arr = Array<Type>(size);
-		for (size_t i = 0; i < size; i++)
-		{
-			arr[i] = op(lhs[i], rhs);
-		}
+		Array<Type> arr = Array<Type>(lhs.size());
+		BinaryOp<Type, Op>(lhs, rhs, arr);
 		return arr;
 	}
 	template<class Type, class Op>
 	Array<Type> BinaryOp(const Type& lhs, const Array<Type>& rhs)
 	{
-		Op op;
-		size_t size = rhs.size();
-		Array<Type> arr = Array<Type>(size);
-		for (size_t i = 0; i < size; i++)
-		{
-			arr[i] = op(lhs, rhs[i]);
-		}
+		Array<Type> arr = Array<Type>(rhs.size());
+		BinaryOp<Type, Op>(lhs, rhs, arr);
 		return arr;
 	}
 
@@ -126,16 +196,71 @@ namespace chaos
 		return BinaryOp<Type, Div<Type>>(lhs, rhs);
 	}
 
+	template<class Type>
+	Array<Type>& operator+=(Array<Type>& lhs, const Array<Type>& rhs)
+	{
+		BinaryOp<Type, Add<Type>>(lhs, rhs, lhs);
+		return lhs;
+	}
+	template<class Type>
+	Array<Type>& operator+=(Array<Type>& lhs, const Type& rhs)
+	{
+		BinaryOp<Type, Add<Type>>(lhs, rhs, lhs);
+		return lhs;
+	}
+
+	template<class Type>
+	Array<Type>& operator-=(Array<Type>& lhs, const Array<Type>& rhs)
+	{
+		BinaryOp<Type, Sub<Type>>(lhs, rhs, lhs);
+		return lhs;
+	}
+	template<class Type>
+	Array<Type>& operator-=(Array<Type>& lhs, const Type& rhs)
+	{
+		BinaryOp<Type, Sub<Type>>(lhs, rhs, lhs);
+		return lhs;
+	}
+
+	template<class Type>
+	Array<Type>& operator*=(Array<Type>& lhs, const Array<Type>& rhs)
+	{
+		BinaryOp<Type, Mul<Type>>(lhs, rhs, lhs);
+		return lhs;
+	}
+	template<class Type>
+	Array<Type>& operator*=(Array<Type>& lhs, const Type& rhs)
+	{
+		BinaryOp<Type, Mul<Type>>(lhs, rhs, lhs);
+		return lhs;
+	}
+
+	template<class Type>
+	Array<Type>& operator/=(Array<Type>& lhs, const Array<Type>& rhs)
+	{
+		BinaryOp<Type, Div<Type>>(lhs, rhs, lhs);
+		return lhs;
+	}
+	template<class Type>
+	Array<Type>& operator/=(Array<Type>& lhs, const Type& rhs)
+	{
+		BinaryOp<Type, Div<Type>>(lhs, rhs, lhs);
+		return lhs;
+	}
+
 	template<class Type>
 	Type sum(const Array<Type>& arr)
 	{
-		return std::accumulate(begin(arr), end(arr), Type());
+		if constexpr (std::is_same_v<Type, float>) return SumKernel(arr.data(), arr.size());
+		else return std::accumulate(arr.data(), arr.data() + arr.size(), Type());
 	}
 
 	template<class Type>
-	Type dot(const Array<Type>& lhs, const Array<Type> rhs)
+	Type dot(const Array<Type>& lhs, const Array<Type>& rhs)
 	{
-		return sum(lhs * rhs);
+		DCHECK_EQ(lhs.size(), rhs.size());
+		if constexpr (std::is_same_v<Type, float>) return DotKernel(lhs.data(), rhs.data(), lhs.size());
+		else return std::inner_product(lhs.data(), lhs.data() + lhs.size(), rhs.data(), Type());
 	}
 
 	template<class Type>
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "core/def.hpp"
+
+#include <cstdint>
+#include <functional>
+
+namespace chaos
+{
+	class WorkerQueues;
+	class TaskGroupState;
+
+	/// <summary>
+	/// <para>Work-stealing thread pool, each worker owns a deque and steals from the others when idle</para>
+	/// <para>The thread calling ParallelFor takes part in the work instead of blocking, and a ParallelFor
+	/// called from inside a worker queues its tasks on that worker, so nesting never adds threads</para>
+	/// </summary>
+	class CHAOS_API ThreadPool
+	{
+	public:
+		/// <param name="num_threads">Threads taking part in a ParallelFor, including the caller, 0 means the number of cores</param>
+		explicit ThreadPool(int num_threads = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		/// <summary> Run func(begin, end) over sub-ranges of [begin, end) on up to num_threads threads </summary>
+		/// <param name="grain">Minimum size of a sub-range</param>
+		/// <param name="num_threads">Maximum threads working on this range, 0 means all of the pool</param>
+		void ParallelFor(int64_t begin, int64_t end, const std::function<void(int64_t, int64_t)>& func, int64_t grain = 1, int num_threads = 0);
+
+		/// <summary> The number of threads taking part in a ParallelFor, including the caller </summary>
+		int num_threads() const noexcept;
+
+		/// <summary> The pool shared by the library, with one thread per core </summary>
+		static ThreadPool* Global();
+
+	private:
+		friend class TaskGroup;
+		WorkerQueues* queues;
+	};
+
+	/// <summary>
+	/// <para>Tasks queued on a ThreadPool one by one, a task may add more tasks to its group while it runs</para>
+	/// <para>Wait takes part in the work like ParallelFor does, so it may be called from inside a worker</para>
+	/// </summary>
+	class CHAOS_API TaskGroup
+	{
+	public:
+		/// <param name="pool">nullptr means ThreadPool::Global()</param>
+		explicit TaskGroup(ThreadPool* pool = nullptr);
+		/// <summary> Waits for the tasks left </summary>
+		~TaskGroup();
+
+		TaskGroup(const TaskGroup&) = delete;
+		TaskGroup& operator=(const TaskGroup&) = delete;
+
+		void Run(const std::function<void()>& func);
+		/// <summary> Return once every task added so far, and every task they added, is done </summary>
+		void Wait();
+
+	private:
+		ThreadPool* pool;
+		TaskGroupState* state;
+	};
+
+	/// <summary> ParallelFor on pool, nullptr means ThreadPool::Global() </summary>
+	CHAOS_API void ParallelFor(int64_t begin, int64_t end, const std::function<void(int64_t, int64_t)>& func,
+		int64_t grain = 1, int num_threads = 0, ThreadPool* pool = nullptr);
+
+	/// <summary>
+	/// <para>Split rows x cols into tiles of tile_rows x tile_cols and run func(row_begin, row_end, col_begin, col_end) on each</para>
+	/// </summary>
+	CHAOS_API void ParallelFor2D(int64_t rows, int64_t cols, int64_t tile_rows, int64_t tile_cols,
+		const std::function<void(int64_t, int64_t, int64_t, int64_t)>& func, int num_threads = 0, ThreadPool* pool = nullptr);
+}
\ No newline at end of file
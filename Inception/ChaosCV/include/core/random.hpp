@@ -0,0 +1,60 @@
+#pragma once
+
+#include "core/def.hpp"
+#include "core/parallel.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+namespace chaos
+{
+	/// <summary>
+	/// <para>Philox4x32-10 counter-based generator: block i of a stream is a pure function of (seed, stream, i),
+	/// 4 random words each, so any part of a stream can be generated on any thread in any order</para>
+	/// <para>A fill reserves its blocks with an atomic add on the position, concurrent fills on one generator
+	/// never overlap, and a fill gives the same values for any number of threads and on every ISA</para>
+	/// </summary>
+	class CHAOS_API Philox
+	{
+	public:
+		static constexpr uint64_t default_seed = 0x853c49e6748fea9bull;
+
+		explicit Philox(uint64_t seed = default_seed, uint64_t stream = 0) noexcept;
+		Philox(const Philox& other) noexcept;
+		Philox& operator=(const Philox& other) noexcept;
+
+		/// <summary> Restart at the beginning of a stream, the streams of one seed are independent </summary>
+		void Seed(uint64_t seed, uint64_t stream = 0) noexcept;
+		/// <summary> Move forward by n values, rounded up to whole blocks of 4 </summary>
+		void Skip(uint64_t n) noexcept;
+
+		uint64_t seed() const noexcept { return key; }
+		uint64_t stream() const noexcept { return id; }
+		/// <summary> The next block to use </summary>
+		uint64_t position() const noexcept;
+
+		/// <summary> The 4 words of block counter of a stream </summary>
+		static std::array<uint32_t, 4> Block(uint64_t seed, uint64_t stream, uint64_t counter) noexcept;
+
+		/// <summary>
+		/// <para>Fill data with n floats uniform in [min, max), value j comes from word j % 4 of block position + j / 4</para>
+		/// </summary>
+		void Uniform(float* data, size_t n, float min = 0.f, float max = 1.f, int num_threads = 0, ThreadPool* pool = nullptr);
+		/// <summary>
+		/// <para>Fill data with n floats of a normal distribution, by Box-Muller on the word pairs of each block</para>
+		/// </summary>
+		void Normal(float* data, size_t n, float mu = 0.f, float sigma = 1.f, int num_threads = 0, ThreadPool* pool = nullptr);
+
+		/// <summary> The generator of Tensor::randn and Tensor::randu </summary>
+		static Philox& Global();
+
+	private:
+		// reserve the blocks for n values, returns the first
+		uint64_t Reserve(size_t n) noexcept;
+
+		uint64_t key;
+		uint64_t id;
+		mutable uint64_t counter = 0; // only accessed through std::atomic_ref
+	};
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "core/def.hpp"
+#include "core/op.hpp"
+#include "core/tensor.hpp"
+
+#include <cstdint>
+
+namespace chaos
+{
+	// Reductions of float Tensors (Depth::D4), over all the scalars or along axes.
+	// Sums are pairwise: blocks are summed with several SIMD accumulators, then the block sums are
+	// added in a binary tree, so the error grows with log(n) instead of n. Large inputs are cut into
+	// a fixed number of ranges reduced in parallel, the results do not depend on the thread count
+
+	enum class NormType
+	{
+		L1,
+		L2,
+	};
+
+	CHAOS_API float sum(const Tensor& tensor);
+	CHAOS_API float mean(const Tensor& tensor);
+	CHAOS_API float norm(const Tensor& tensor, const NormType& type = NormType::L2);
+	/// <summary> Sum of lhs * rhs over the scalars, the shapes should be the same, never allocates </summary>
+	CHAOS_API float dot(const Tensor& lhs, const Tensor& rhs);
+
+	/// <summary> NaN are skipped, NaN is returned only if every scalar is NaN </summary>
+	CHAOS_API float min(const Tensor& tensor);
+	CHAOS_API float max(const Tensor& tensor);
+	/// <summary> Index of the first min/max scalar in the row-major order of the shape (and the packing lanes), -1 if every scalar is NaN </summary>
+	CHAOS_API int64_t argmin(const Tensor& tensor);
+	CHAOS_API int64_t argmax(const Tensor& tensor);
+
+	/// <summary>
+	/// <para>Reduce along the axes (negative counts from the end), the result is a new dense Tensor</para>
+	/// <para>keep_dims leaves the reduced dims as 1, otherwise they are removed. The Tensor should be CHW, Repack the others first</para>
+	/// </summary>
+	CHAOS_API Tensor sum(const Tensor& tensor, const Array<int>& axis, bool keep_dims = false, Allocator* allocator = nullptr);
+	CHAOS_API Tensor mean(const Tensor& tensor, const Array<int>& axis, bool keep_dims = false, Allocator* allocator = nullptr);
+	CHAOS_API Tensor norm(const Tensor& tensor, const NormType& type, const Array<int>& axis, bool keep_dims = false, Allocator* allocator = nullptr);
+	CHAOS_API Tensor min(const Tensor& tensor, const Array<int>& axis, bool keep_dims = false, Allocator* allocator = nullptr);
+	CHAOS_API Tensor max(const Tensor& tensor, const Array<int>& axis, bool keep_dims = false, Allocator* allocator = nullptr);
+	/// <summary> The index along axis of the first min/max, as int32 in a Depth::D4 Tensor (read it with At&lt;int&gt;) </summary>
+	CHAOS_API Tensor argmin(const Tensor& tensor, int axis, bool keep_dims = false, Allocator* allocator = nullptr);
+	CHAOS_API Tensor argmax(const Tensor& tensor, int axis, bool keep_dims = false, Allocator* allocator = nullptr);
+}
\ No newline at end of file
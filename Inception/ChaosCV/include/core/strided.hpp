@@ -0,0 +1,99 @@
+#pragma once
+
+#include "core/log.hpp"
+#include "core/array.hpp"
+
+#include <array>
+#include <cstdint>
+
+namespace chaos
+{
+	/// <summary>
+	/// <para>Row iteration over N tensors with the same shape but their own steps</para>
+	/// <para>Dims of size 1 are dropped and adjacent dims that are contiguous in every tensor
+	/// are merged, so a dense tensor becomes a single long row and a Cut channel a few long rows.
+	/// Rows are visited with an odometer, the div/mod decomposition is done once per range</para>
+	/// </summary>
+	template<size_t N>
+	class StridedLoop
+	{
+	public:
+		static constexpr size_t max_dims = 32;
+
+		StridedLoop(const Shape& shape, const std::array<const int*, N>& steps)
+		{
+			CHECK_LE(shape.size(), max_dims) << "too many dims";
+			for (size_t d = shape.size(); d > 0; d--)
+			{
+				int64_t size = shape.data()[d - 1];
+				if (size == 1) continue;
+
+				// merge into the inner dim if it is contiguous with it in every tensor
+				bool merge = dims > 0;
+				for (size_t k = 0; merge && k < N; k++)
+				{
+					merge = steps[k][d - 1] == strides[k][dims - 1] * sizes[dims - 1];
+				}
+				if (merge)
+				{
+					sizes[dims - 1] *= size;
+					continue;
+				}
+
+				sizes[dims] = size;
+				for (size_t k = 0; k < N; k++) strides[k][dims] = steps[k][d - 1];
+				dims++;
+			}
+
+			if (dims == 0) // a single element
+			{
+				sizes[0] = 1;
+				for (size_t k = 0; k < N; k++) strides[k][0] = 1;
+				dims = 1;
+			}
+
+			// stored from inner to outer, dim 0 is the row
+			for (size_t d = 1; d < dims; d++) num_rows *= sizes[d];
+		}
+
+		int64_t cols() const noexcept { return sizes[0]; }
+		int64_t step(size_t k) const noexcept { return strides[k][0]; }
+		int64_t rows() const noexcept { return num_rows; }
+
+		/// <summary> func(const int64_t* offset) for rows [begin, end), offset[k] is the first element of tensor k </summary>
+		template<class Func>
+		void ForEachRow(int64_t begin, int64_t end, Func&& func) const
+		{
+			if (begin >= end) return;
+
+			int64_t index[max_dims] = {};
+			int64_t offset[N] = {};
+			int64_t idx = begin;
+			for (size_t d = 1; d < dims; d++)
+			{
+				index[d] = idx % sizes[d];
+				idx /= sizes[d];
+				for (size_t k = 0; k < N; k++) offset[k] += index[d] * strides[k][d];
+			}
+
+			for (int64_t r = begin; r < end; r++)
+			{
+				func(static_cast<const int64_t*>(offset));
+
+				for (size_t d = 1; d < dims; d++)
+				{
+					for (size_t k = 0; k < N; k++) offset[k] += strides[k][d];
+					if (++index[d] < sizes[d]) break;
+					for (size_t k = 0; k < N; k++) offset[k] -= strides[k][d] * sizes[d];
+					index[d] = 0;
+				}
+			}
+		}
+
+	private:
+		size_t dims = 0;
+		int64_t num_rows = 1;
+		int64_t sizes[max_dims] = {};
+		int64_t strides[N][max_dims] = {};
+	};
+}
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "core/def.hpp"
 #include "core/log.hpp"
+#include "core/file.hpp"
 #include "core/types.hpp"
 #include "core/array.hpp"
 #include "core/allocator.hpp"
@@ -28,6 +29,26 @@ namespace chaos
 		C8HW8 = 8,
 	};
 
+	/// <summary> The scalar type of the data, Depth only tells its size </summary>
+	enum class DataType
+	{
+		U8,
+		S8,
+		F16,
+		F32,
+		F64,
+	};
+	constexpr Depth DepthOf(const DataType& type) noexcept
+	{
+		switch (type)
+		{
+		case DataType::F16: return Depth::D2;
+		case DataType::F32: return Depth::D4;
+		case DataType::F64: return Depth::D8;
+		default: return Depth::D1;
+		}
+	}
+
 	template<class Type>
 	inline Type operator*(const Type& val, const Depth& depth)
 	{
@@ -40,6 +61,8 @@ namespace chaos
 		return val * static_cast<Type>(packing);
 	}
 
+	class Philox;
+
 	class CHAOS_API Tensor
 	{
 	public:
@@ -66,6 +89,12 @@ namespace chaos
 		Tensor(const Tensor& tensor);
 		Tensor& operator=(const Tensor& tensor);
 
+		// steal the reference, no atomic operation on ref_cnt
+		Tensor(Tensor&& tensor) noexcept;
+		Tensor& operator=(Tensor&& tensor) noexcept;
+
+		void swap(Tensor& tensor) noexcept;
+
 		void Create(const Shape& new_shape, const Steps& new_steps, const Depth& new_depth, const Packing& new_packing, Allocator* new_allocator = nullptr);
 
 		void CreateLike(const Tensor& tensor, Allocator* allocator = nullptr);
@@ -85,20 +114,49 @@ namespace chaos
 		// this wouldn't copy any data from the source Tensor
 		Tensor Cut(const Shape& new_shape, int at) const;
 
+		/// <summary>
+		/// <para>A Tensor on the same data that does not hold a reference, ref_cnt is untouched</para>
+		/// <para>Use it to pass weights around hot paths, the source must outlive the borrowed Tensor</para>
+		/// </summary>
+		Tensor Borrow() const noexcept;
+
+		/// <summary>
+		/// <para>Convert the layout between CHW and the packed CxHWx, e.g. CHW [C,H,W] to C4HW4 [ceil(C/4),H,W]</para>
+		/// <para>The packed axis is C of [..., C, H, W], or dim 0 of a Tensor with less than 3 dims.
+		/// The lanes past the real channels are zero-filled, and dropped again when unpacking</para>
+		/// </summary>
+		/// <param name="channels">The real number of channels, 0 means all the lanes of the packed axis</param>
+		/// <return>The Tensor itself if nothing changes, otherwise a new dense Tensor</return>
+		Tensor Repack(const Packing& packing, int channels = 0, Allocator* allocator = nullptr) const;
+
+		/// <summary>
+		/// <para>Convert the scalars from src_type to dst_type as dst = src * scale + shift</para>
+		/// <para>scale and shift hold a single value or one per channel, where the channels are C of [..., C, H, W]
+		/// times the packing lanes (only the lanes for less than 3 dims). Integer results are rounded to nearest
+		/// and saturated. The source steps are respected, so a Cut converts without a Clone</para>
+		/// </summary>
+		/// <param name="src_type">The type of this Tensor, it should match the depth</param>
+		/// <param name="scale">Empty means 1</param>
+		/// <param name="shift">Empty means 0</param>
+		/// <return>A new dense Tensor with the depth of dst_type</return>
+		Tensor Convert(const DataType& src_type, const DataType& dst_type, const Array<float>& scale = Array<float>(), const Array<float>& shift = Array<float>(), Allocator* allocator = nullptr) const;
+
 		/// <summary> ref_cnt++ </summary>
 		void AddRef() noexcept { if (ref_cnt) CHAOS_XADD(ref_cnt, 1); }
 
+		// for hot loops prefer TensorView in core/view.hpp, which caches shape and steps
 		template<class Type = float, class...Index, Arithmetic<Type> = true>
 		Type& At(Index&&...idx) const
 		{
-			Array<unsigned int> index = { static_cast<unsigned int>(idx)... };
-			DCHECK_EQ(shape.size(), index.size()) << "dims expect " << shape.size() << " but got " << index.size();
+			constexpr size_t dims = sizeof...(Index);
+			const size_t index[dims + 1] = { static_cast<size_t>(idx)... }; // never allocates
+			DCHECK_EQ(shape.size(), dims) << "dims expect " << shape.size() << " but got " << dims;
+			const int* step = steps.data();
 			size_t offset = 0;
-			for (size_t i = 0; i < index.size(); i++)
+			for (size_t i = 0; i < dims; i++)
 			{
-				//DCHECK_GE(index[i], 0) << "expect index[" << i << "] >= 0, but got " << index[i];
-				DCHECK_LT(index[i], shape[i]) << "expect index[" << i << "] < " << shape[i] << " but got " << index[i];
-				offset += static_cast<size_t>(steps[i]) * index[i];
+				DCHECK_LT(index[i], static_cast<size_t>(shape.data()[i])) << "expect index[" << i << "] < " << shape.data()[i] << " but got " << index[i];
+				offset += static_cast<size_t>(step[i]) * index[i];
 			}
 			return ((Type*)data)[offset];
 		}
@@ -113,11 +171,24 @@ namespace chaos
 
 		float& operator[](size_t idx) const noexcept { return ((float*)data)[idx]; }
 
+		/// <summary> Filled from Philox::Global(), safe to call from several threads </summary>
 		static Tensor randn(const Shape& shape, float mu = 0.f, float sigma = 1.f, Allocator* allocator = nullptr);
 		static Tensor randu(const Shape& shape, float min = 0.f, float max = 1.f, Allocator* allocator = nullptr);
+		/// <summary> Filled from generator, the values only depend on its seed, stream and position </summary>
+		static Tensor randn(const Shape& shape, Philox& generator, float mu = 0.f, float sigma = 1.f, Allocator* allocator = nullptr);
+		static Tensor randu(const Shape& shape, Philox& generator, float min = 0.f, float max = 1.f, Allocator* allocator = nullptr);
 		static Tensor zeros(const Shape& shape, Allocator* allocator = nullptr);
 		static Tensor eye(int h, int w, Allocator* allocator = nullptr);
 
+		/// <summary>
+		/// <para>Memory-map a file and return a read_only Tensor whose data points into the mapping</para>
+		/// <para>No data is copied, pages are loaded on first touch and shared between processes
+		/// mapping the same file. The mapping is released with the last reference of the Tensor</para>
+		/// </summary>
+		/// <param name="offset">Byte offset of the data in the file</param>
+		/// <return>An empty Tensor if the file can not be mapped or is too small</return>
+		static Tensor Map(const File& file, const Shape& shape, const Depth& depth = Depth::D4, const Packing& packing = Packing::CHW, size_t offset = 0, const Steps& steps = Steps());
+
 		void* data = nullptr;
 		Allocator* allocator = nullptr;
 		int* ref_cnt = nullptr;
@@ -127,5 +198,13 @@ namespace chaos
 
 		Depth depth = Depth::D1;
 		Packing packing = Packing::CHW;
+
+		/// <summary> The data must not be written, e.g. a Tensor::Map, copies and views of the Tensor keep it </summary>
+		bool read_only = false;
 	};
+
+	static inline void swap(Tensor& lhs, Tensor& rhs) noexcept
+	{
+		lhs.swap(rhs);
+	}
 }
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "core/def.hpp"
+#include "core/allocator.hpp"
+
+#include <map>
+#include <array>
+#include <string>
+#include <iostream>
+
+namespace chaos
+{
+	struct AllocationStats
+	{
+		struct TagStats
+		{
+			size_t live_bytes = 0;
+			size_t peak_bytes = 0;
+			size_t allocations = 0;
+		};
+
+		size_t live_bytes = 0;
+		size_t peak_bytes = 0;
+		size_t live_blocks = 0;
+		size_t allocations = 0;
+		size_t frees = 0;
+
+		// histogram[i] counts the allocations whose size is in [2^(i-1), 2^i)
+		std::array<size_t, 64> histogram = {};
+
+		std::map<std::string, TagStats> tags;
+	};
+
+	class AllocationRecords;
+
+	/// <summary>
+	/// <para>Records live/peak bytes, allocation counts, a size histogram and
+	/// the call-site tag (see AllocationTag) of each allocation</para>
+	/// <para>Thread-safe. Feed it from a TrackingAllocator or install it for the
+	/// default FastMalloc path with SetDefaultTracker</para>
+	/// </summary>
+	class CHAOS_API AllocationTracker
+	{
+	public:
+		/// <param name="name">Used in dump and leak report</param>
+		/// <param name="report_leaks">Log the blocks still alive on destruction</param>
+		explicit AllocationTracker(const std::string& name = "tracker", bool report_leaks = true);
+		~AllocationTracker();
+
+		AllocationTracker(const AllocationTracker&) = delete;
+		AllocationTracker& operator=(const AllocationTracker&) = delete;
+
+		void OnMalloc(void* ptr, size_t size);
+		void OnFree(void* ptr);
+
+		AllocationStats Snapshot() const;
+		void Dump(std::ostream& stream) const;
+		/// <summary> Write the blocks still alive, return the number of them </summary>
+		size_t ReportLeaks(std::ostream& stream) const;
+		void Reset();
+
+	private:
+		AllocationRecords* records;
+	};
+
+	/// <summary> Decorates another allocator (or the default path) with an AllocationTracker </summary>
+	class CHAOS_API TrackingAllocator : public Allocator
+	{
+	public:
+		/// <param name="allocator">The allocator to track, nullptr means FastMalloc/FastFree</param>
+		explicit TrackingAllocator(Allocator* allocator = nullptr, const std::string& name = "tracking allocator", bool report_leaks = true);
+
+		void* FastMalloc(size_t size) override;
+		void FastFree(void* ptr) override;
+
+		AllocationStats Snapshot() const { return tracker.Snapshot(); }
+		void Dump(std::ostream& stream) const { tracker.Dump(stream); }
+		size_t ReportLeaks(std::ostream& stream) const { return tracker.ReportLeaks(stream); }
+
+	private:
+		Allocator* allocator;
+		AllocationTracker tracker;
+	};
+
+	/// <summary>
+	/// <para>Tags the allocations made by this thread during its lifetime, tags can be nested</para>
+	/// <para>The tag should be a string literal or outlive the scope</para>
+	/// </summary>
+	class CHAOS_API AllocationTag
+	{
+	public:
+		explicit AllocationTag(const char* tag);
+		~AllocationTag();
+
+		AllocationTag(const AllocationTag&) = delete;
+		AllocationTag& operator=(const AllocationTag&) = delete;
+
+		static const char* Current() noexcept;
+
+	private:
+		const char* previous;
+	};
+
+	/// <summary>
+	/// <para>Install a tracker for the default FastMalloc/FastFree path, nullptr to uninstall</para>
+	/// <para>The tracker must outlive the installation, blocks allocated before it was
+	/// installed are ignored when they are freed</para>
+	/// </summary>
+	CHAOS_API void SetDefaultTracker(AllocationTracker* tracker);
+	CHAOS_API AllocationTracker* GetDefaultTracker();
+}
\ No newline at end of file
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "core/def.hpp"
+#include "core/log.hpp"
+#include "core/tensor.hpp"
+
+#include <array>
+#include <iterator>
+
+namespace chaos
+{
+	/// <summary>
+	/// <para>Typed view on the data of a Tensor with a fixed number of dims</para>
+	/// <para>Shape and steps are cached in fixed-size arrays, so indexing is a handful of
+	/// multiply-adds the compiler can inline and unroll. The view does not hold a reference,
+	/// the Tensor must outlive it</para>
+	/// <para>TensorView&lt;float, 3&gt; view(tensor); view(c, h, w) = 0.f;</para>
+	/// </summary>
+	template<class Type, size_t Dims>
+	class TensorView
+	{
+		static_assert(Dims > 0, "TensorView needs at least one dim");
+	public:
+		class Iterator
+		{
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = Type;
+			using difference_type = std::ptrdiff_t;
+			using pointer = Type*;
+			using reference = Type&;
+
+			Iterator() = default;
+			Iterator(const TensorView* view, Type* ptr, int outer = 0) : view(view), ptr(ptr) { index[0] = outer; }
+
+			Type& operator*() const noexcept { return *ptr; }
+			Type* operator->() const noexcept { return ptr; }
+
+			Iterator& operator++() noexcept
+			{
+				ptr += view->steps_[Dims - 1];
+				if (++index[Dims - 1] < view->shape_[Dims - 1]) return *this;
+
+				// carry to the outer dims, only once per row
+				for (size_t d = Dims - 1; d > 0; d--)
+				{
+					ptr -= static_cast<ptrdiff_t>(view->steps_[d]) * view->shape_[d];
+					index[d] = 0;
+					ptr += view->steps_[d - 1];
+					if (++index[d - 1] < view->shape_[d - 1]) return *this;
+				}
+				ptr = view->end_ptr();
+				return *this;
+			}
+			Iterator operator++(int) noexcept
+			{
+				Iterator iter = *this;
+				++*this;
+				return iter;
+			}
+
+			// the outer index tells the end apart from an element at the same address (e.g. transposed steps)
+			bool operator==(const Iterator& other) const noexcept { return ptr == other.ptr && index[0] == other.index[0]; }
+			bool operator!=(const Iterator& other) const noexcept { return not (*this == other); }
+
+		private:
+			const TensorView* view = nullptr;
+			Type* ptr = nullptr;
+			std::array<int, Dims> index = {};
+		};
+
+		constexpr TensorView() = default;
+		constexpr TensorView(Type* data, const std::array<int, Dims>& shape, const std::array<int, Dims>& steps) noexcept :
+			data_(data), shape_(shape), steps_(steps) {}
+
+		explicit TensorView(const Tensor& tensor) : data_(static_cast<Type*>(tensor.data))
+		{
+			DCHECK_EQ(tensor.shape.size(), Dims) << "expect " << Dims << " dims but got " << tensor.shape.size();
+			DCHECK_EQ(sizeof(Type), static_cast<size_t>(1 * tensor.depth * tensor.packing)) << "element size mismatch";
+			for (size_t i = 0; i < Dims; i++)
+			{
+				shape_[i] = tensor.shape.data()[i];
+				steps_[i] = tensor.steps.data()[i];
+			}
+		}
+
+		template<class...Index>
+		constexpr size_t offset(Index...idx) const noexcept
+		{
+			static_assert(sizeof...(Index) == Dims, "the number of indices should be the same as Dims");
+			size_t d = 0;
+			size_t ofst = 0;
+			((ofst += static_cast<size_t>(steps_[d++]) * static_cast<size_t>(idx)), ...);
+			return ofst;
+		}
+
+		template<class...Index>
+		Type& operator()(Index...idx) const noexcept
+		{
+#ifndef NDEBUG
+			size_t d = 0;
+			((DCHECK_LT(static_cast<size_t>(idx), static_cast<size_t>(shape_[d])) << "index " << idx << " out of dim " << d, d++), ...);
+#endif
+			return data_[offset(idx...)];
+		}
+
+		/// <summary> Pointer to the innermost row at the outer indices </summary>
+		template<class...Index>
+		Type* row(Index...idx) const noexcept
+		{
+			static_assert(sizeof...(Index) == Dims - 1, "expect an index for each outer dim");
+			return data_ + offset(idx..., 0);
+		}
+
+		Iterator begin() const noexcept { return empty() ? end() : Iterator(this, data_); }
+		Iterator end() const noexcept { return Iterator(this, end_ptr(), shape_[0]); }
+
+		constexpr Type* data() const noexcept { return data_; }
+		constexpr int shape(size_t d) const noexcept { return shape_[d]; }
+		constexpr int steps(size_t d) const noexcept { return steps_[d]; }
+
+		constexpr size_t total() const noexcept
+		{
+			size_t n = 1;
+			for (size_t i = 0; i < Dims; i++) n *= shape_[i];
+			return n;
+		}
+		constexpr bool empty() const noexcept { return data_ == nullptr || total() == 0; }
+		constexpr bool contiguous() const noexcept
+		{
+			int step = 1;
+			for (size_t i = Dims; i > 0; i--)
+			{
+				if (shape_[i - 1] > 1 && steps_[i - 1] != step) return false;
+				step *= shape_[i - 1];
+			}
+			return true;
+		}
+
+	private:
+		// where the iteration stops, one step past the last index of dim 0
+		Type* end_ptr() const noexcept { return data_ + static_cast<ptrdiff_t>(steps_[0]) * shape_[0]; }
+
+		Type* data_ = nullptr;
+		std::array<int, Dims> shape_ = {};
+		std::array<int, Dims> steps_ = {};
+	};
+}
\ No newline at end of file
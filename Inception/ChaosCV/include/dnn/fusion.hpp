@@ -0,0 +1,25 @@
+#pragma once
+
+#include "dnn/layer.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>One layer computing next(layer(x)), for a next reading only the output of layer:
+		/// BatchNorm and Scale fold into the weights of a Convolution, an activation goes into its epilogue,
+		/// and BatchNorm, Scale, ReLU, Sigmoid and Elementwise chains merge into one Elementwise. An Elementwise next
+		/// must be a single-input chain, one with another op than Sum combines several inputs and never fuses</para>
+		/// <para>The layers given are not changed, a folded Convolution gets new weights</para>
+		/// </summary>
+		/// <return>The fused layer, nullptr when the two do not fuse</return>
+		CHAOS_API std::shared_ptr<Layer> FuseLayers(const std::shared_ptr<Layer>& layer, const std::shared_ptr<Layer>& next);
+
+		/// <summary> Fuse the neighbours of a chain of layers, each reading the output of the one before, with FuseLayers </summary>
+		CHAOS_API std::vector<std::shared_ptr<Layer>> FuseSequence(const std::vector<std::shared_ptr<Layer>>& layers);
+	}
+}
\ No newline at end of file
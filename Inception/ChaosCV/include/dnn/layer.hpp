@@ -7,6 +7,13 @@ namespace chaos
 {
 	namespace dnn
 	{
+		/// <summary>
+		/// <para>A layer implements Forward in place, out of place or both, and sets support_inplace and support_outplace
+		/// to match. The default of the other one is made from it: out of place copies the input into the output and
+		/// runs in place, in place runs out of place into a new Tensor that replaces the blob</para>
+		/// <para>An out-of-place Forward writes into output_blob when the caller gives one of the right shape,
+		/// see CreateOutput, and allocates it from opt.blob_allocator otherwise</para>
+		/// </summary>
 		class CHAOS_API Layer
 		{
 		public:
@@ -17,12 +24,43 @@ namespace chaos
 			virtual void Forward(const Tensor& input_blob, Tensor& output_blob, const Option& opt = Option()) const;
 			virtual void Forward(Tensor& input_output_blob, const Option& opt = Option()) const;
 
+			/// <summary>
+			/// <para>Forward a blob the caller gives up: an in-place layer takes it over when nothing else refers to its data
+			/// and it is not read_only, otherwise the layer writes output_blob out of place, so the input is only copied
+			/// when it is shared or mapped</para>
+			/// </summary>
+			void Forward(Tensor&& input_blob, Tensor& output_blob, const Option& opt = Option()) const;
+
 			virtual void Forward(const std::vector<Tensor>& input_blobs, std::vector<Tensor>& output_blobs, const Option& opt = Option()) const;
 			virtual void Forward(std::vector<Tensor>& input_output_blobs, const Option& opt = Option()) const;
 
+			/// <summary>
+			/// <para>Forward each of a batch of independent blobs, e.g. frames, into the output of the same index</para>
+			/// <para>With opt.batch_stacking and StackBatch, blobs of the same shape are copied into one [N, ...] Tensor from
+			/// opt.blob_allocator and forwarded at once, so the kernels see one large problem. The outputs are then views into the result,
+			/// freed with the last of them, except those the caller gives, see CreateOutput. Otherwise the blobs are split into
+			/// contiguous parts run in parallel on opt.thread_pool, each part with its own workspace allocator from
+			/// opt.workspace_allocators, and opt.blob_allocator must then be thread-safe</para>
+			/// </summary>
+			void ForwardBatch(const std::vector<Tensor>& input_blobs, std::vector<Tensor>& output_blobs, const Option& opt = Option()) const;
+
+			/// <summary>
+			/// <para>Whether ForwardBatch should run n blobs like this one as a stack [n, ...], for a layer whose Forward
+			/// takes such stacks and runs them faster than the blobs one by one, e.g. with larger GEMMs</para>
+			/// </summary>
+			virtual bool StackBatch(const Tensor& blob, int n) const;
+
+			/// <summary>
+			/// <para>Make output_blob a dense Tensor of this shape for an out-of-place Forward</para>
+			/// <para>A dense output_blob of the same shape, depth and packing that is not read_only is kept and written
+			/// directly, e.g. a view into a larger Tensor, any other one is replaced by a Tensor from opt.blob_allocator</para>
+			/// </summary>
+			static void CreateOutput(Tensor& output_blob, const Shape& shape, const Depth& depth, const Packing& packing, const Option& opt);
+
 			const std::string type;
 
 			bool support_inplace = false;
+			bool support_outplace = false;
 		};
 	}
 
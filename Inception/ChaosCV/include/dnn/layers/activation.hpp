@@ -0,0 +1,64 @@
+#pragma once
+
+#include "dnn/layer.hpp"
+
+#include <cmath>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		enum class ActivationType
+		{
+			Identity,
+			// max(x, 0) + slope * min(x, 0)
+			ReLU,
+			// 1 / (1 + exp(-x))
+			Sigmoid,
+		};
+
+		/// <summary> The activation of a layer output, applied in the epilogue of the layer computing it </summary>
+		struct Activation
+		{
+			ActivationType type = ActivationType::Identity;
+			float slope = 0.f;
+
+			float operator()(float x) const noexcept
+			{
+				switch (type)
+				{
+				case ActivationType::ReLU: return x > 0.f ? x : x * slope;
+				case ActivationType::Sigmoid: return 1.f / (1.f + std::exp(-x));
+				default: return x;
+				}
+			}
+		};
+
+		/// <summary> Apply activation to size floats in place </summary>
+		CHAOS_API void Activate(float* data, int64_t size, const Activation& activation);
+
+		/// <summary> max(x, 0) + slope * min(x, 0) elementwise, in place or out of place </summary>
+		class CHAOS_API ReLU : public Layer
+		{
+		public:
+			explicit ReLU(float slope = 0.f);
+
+			void Forward(const Tensor& input_blob, Tensor& output_blob, const Option& opt = Option()) const override;
+			void Forward(Tensor& input_output_blob, const Option& opt = Option()) const override;
+			using Layer::Forward;
+
+			float slope;
+		};
+
+		/// <summary> 1 / (1 + exp(-x)) elementwise, in place or out of place </summary>
+		class CHAOS_API Sigmoid : public Layer
+		{
+		public:
+			Sigmoid();
+
+			void Forward(const Tensor& input_blob, Tensor& output_blob, const Option& opt = Option()) const override;
+			void Forward(Tensor& input_output_blob, const Option& opt = Option()) const override;
+			using Layer::Forward;
+		};
+	}
+}
\ No newline at end of file
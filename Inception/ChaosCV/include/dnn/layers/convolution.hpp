@@ -0,0 +1,80 @@
+#pragma once
+
+#include "dnn/layers/activation.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		enum class ConvolutionAlgorithm
+		{
+			// picked from the shapes and the packing of the input
+			Auto,
+			// im2col into the workspace and a GEMM per group, a 1x1 stride 1 kernel multiplies the input directly
+			Im2colGemm,
+			// direct loops on C4HW4 / C8HW8, a CHW input is packed first
+			Direct,
+			// 3x3 stride 1 only, 2x2 or 4x4 output tiles with one GEMM per point of the transform
+			Winograd23,
+			Winograd43,
+		};
+
+		class ConvolutionKernels;
+
+		/// <summary>
+		/// <para>2-D convolution of float Tensors [C, H, W] or batches [N, C, H, W], with stride, zero padding, dilation and groups.
+		/// The GEMMs of a batch of small images run over several images at once</para>
+		/// <para>A CHW input gives a CHW output, a C4HW4 / C8HW8 input gives an output packed the same way.
+		/// Auto runs Winograd for 3x3 stride 1 kernels on enough channels, direct loops for packed inputs and
+		/// depthwise kernels, and im2col with a GEMM otherwise. Scratch comes from opt.workspace_allocator</para>
+		/// <para>The transformed weights of each algorithm are made on first use and kept</para>
+		/// </summary>
+		class CHAOS_API Convolution : public Layer
+		{
+		public:
+			/// <param name="weight">[out_channels, in_channels / groups, kernel_h, kernel_w], float CHW</param>
+			/// <param name="bias">[out_channels] or empty</param>
+			Convolution(const Tensor& weight, const Tensor& bias = Tensor(), int stride = 1, int padding = 0, int dilation = 1, int groups = 1);
+			~Convolution();
+
+			Convolution(const Convolution&) = delete;
+			Convolution& operator=(const Convolution&) = delete;
+
+			void Forward(const Tensor& input_blob, Tensor& output_blob, const Option& opt = Option()) const override;
+			using Layer::Forward;
+
+			/// <summary> The output shape for an input shape, packed the same way </summary>
+			Shape OutputShape(const Shape& input_shape, const Packing& packing = Packing::CHW) const;
+
+			/// <summary> Stack the images of a batch when they are small enough that the GEMMs run over several of them </summary>
+			bool StackBatch(const Tensor& blob, int n) const override;
+
+			/// <summary> The algorithm Auto picks for an input </summary>
+			ConvolutionAlgorithm Select(const Shape& input_shape, const Packing& packing = Packing::CHW) const;
+
+			Tensor weight;
+			Tensor bias;
+
+			int in_channels;
+			int out_channels;
+			int kernel_h;
+			int kernel_w;
+
+			int stride_h;
+			int stride_w;
+			int pad_h;
+			int pad_w;
+			int dilation_h;
+			int dilation_w;
+			int groups;
+
+			/// <summary> Force an algorithm, it falls back to Auto where it does not apply </summary>
+			ConvolutionAlgorithm algorithm = ConvolutionAlgorithm::Auto;
+			/// <summary> Applied with the bias while the output is still in the cache </summary>
+			Activation activation;
+
+		private:
+			ConvolutionKernels* kernels;
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "dnn/layers/activation.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>y = activation(x * scale[c] + shift[c]) for the channel c of x, an empty scale is 1 and an empty shift is 0</para>
+		/// <para>The channels are C of [..., C, H, W], or the outermost axis of 1 and 2 dims tensors</para>
+		/// </summary>
+		struct ElementwiseStep
+		{
+			Tensor scale;
+			Tensor shift;
+			Activation activation;
+		};
+
+		/// <summary>
+		/// <para>Run count steps over a float input into output in one pass, output may be input, also a strided view
+		/// which is then written through its steps. A CHW, C4HW4 or C8HW8 input gives an output packed the same way,
+		/// the lanes past the last channel stay 0</para>
+		/// </summary>
+		CHAOS_API void ApplySteps(const ElementwiseStep* steps, size_t count, const Tensor& input, Tensor& output, const Option& opt);
+
+		enum class ElementwiseOp
+		{
+			Sum,
+			Product,
+			Max,
+		};
+
+		class ElementwiseChain;
+
+		/// <summary>
+		/// <para>Combine inputs of the same shape by op, then run a chain of steps on the result, in one pass over the data</para>
+		/// <para>With one input it is the chain alone, which is what FuseLayers merges BatchNorm, Scale, ReLU and Sigmoid into</para>
+		/// </summary>
+		class CHAOS_API Elementwise : public Layer
+		{
+		public:
+			explicit Elementwise(ElementwiseOp op = ElementwiseOp::Sum);
+			~Elementwise();
+
+			Elementwise(const Elementwise&) = delete;
+			Elementwise& operator=(const Elementwise&) = delete;
+
+			void Forward(const Tensor& input_blob, Tensor& output_blob, const Option& opt = Option()) const override;
+			void Forward(Tensor& input_output_blob, const Option& opt = Option()) const override;
+			void Forward(const std::vector<Tensor>& input_blobs, std::vector<Tensor>& output_blobs, const Option& opt = Option()) const override;
+			using Layer::Forward;
+
+			/// <summary> Add a step to the chain, it is folded into the last step when that one has no activation </summary>
+			void Append(const ElementwiseStep& step);
+
+			size_t num_steps() const noexcept;
+			const ElementwiseStep& step(size_t index) const;
+
+			ElementwiseOp op;
+
+		private:
+			ElementwiseChain* chain;
+		};
+
+		/// <summary> (x - mean) / sqrt(var + eps) * gamma + beta per channel, kept as x * scale + shift </summary>
+		class CHAOS_API BatchNorm : public Layer
+		{
+		public:
+			/// <param name="gamma">[C] or empty for 1</param>
+			/// <param name="beta">[C] or empty for 0</param>
+			BatchNorm(const Tensor& mean, const Tensor& var, const Tensor& gamma = Tensor(), const Tensor& beta = Tensor(), float eps = 1e-5f);
+
+			void Forward(const Tensor& input_blob, Tensor& output_blob, const Option& opt = Option()) const override;
+			void Forward(Tensor& input_output_blob, const Option& opt = Option()) const override;
+			using Layer::Forward;
+
+			Tensor scale;
+			Tensor shift;
+		};
+
+		/// <summary> x * scale + bias per channel </summary>
+		class CHAOS_API Scale : public Layer
+		{
+		public:
+			/// <param name="bias">[C] or empty for 0</param>
+			Scale(const Tensor& scale, const Tensor& bias = Tensor());
+
+			void Forward(const Tensor& input_blob, Tensor& output_blob, const Option& opt = Option()) const override;
+			void Forward(Tensor& input_output_blob, const Option& opt = Option()) const override;
+			using Layer::Forward;
+
+			Tensor scale;
+			Tensor bias;
+		};
+	}
+}
\ No newline at end of file
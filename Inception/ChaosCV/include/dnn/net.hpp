@@ -0,0 +1,115 @@
+#pragma once
+
+#include "dnn/layer.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		class NetGraph;
+		class ExtractorState;
+		class Extractor;
+
+		/// <summary>
+		/// <para>A DAG of layers connected by named blobs, run through an Extractor</para>
+		/// <para>Layers are added in topological order: the bottoms of a layer are blobs written by earlier layers,
+		/// or the inputs of the Net, which are the blobs no layer writes</para>
+		/// </summary>
+		class CHAOS_API Net
+		{
+		public:
+			Net();
+			~Net();
+
+			Net(const Net&) = delete;
+			Net& operator=(const Net&) = delete;
+
+			/// <summary>
+			/// <para>Add a layer reading the blobs bottoms and writing the blobs tops, each blob is written once</para>
+			/// <para>A layer with one bottom and one top runs the Tensor Forward, the others the vector Forward</para>
+			/// </summary>
+			/// <return>The index of the layer</return>
+			int AddLayer(const std::shared_ptr<Layer>& layer, const std::vector<std::string>& bottoms, const std::vector<std::string>& tops);
+
+			/// <return>The index of the blob, -1 if there is no blob of this name</return>
+			int FindBlob(const std::string& name) const;
+			const std::string& blob_name(int index) const;
+			const std::shared_ptr<Layer>& layer(int index) const;
+
+			size_t num_blobs() const noexcept;
+			size_t num_layers() const noexcept;
+
+			/// <summary>
+			/// <para>Fuse each layer with the layer after it when FuseLayers can and that layer is the only reader of
+			/// its output, e.g. Convolution, BatchNorm and ReLU become one Convolution</para>
+			/// <para>The blobs between fused layers are no longer computed, except those in keep, which are not fused away.
+			/// Fuse before creating the Extractors</para>
+			/// </summary>
+			/// <return>The number of layers removed</return>
+			int Fuse(const std::vector<std::string>& keep = {});
+
+			/// <summary> An Extractor starting with a copy of opt </summary>
+			Extractor CreateExtractor() const;
+
+			Option opt;
+
+		private:
+			friend class Extractor;
+			NetGraph* graph;
+		};
+
+		/// <summary>
+		/// <para>Runs a Net for a set of inputs, only the layers needed by the extracted blobs are run</para>
+		/// <para>A layer is queued on opt.thread_pool as soon as the layers writing its bottoms are done, so independent
+		/// branches run concurrently and opt.blob_allocator and opt.workspace_allocator must then be thread-safe.
+		/// At most opt.num_threads layers run at once, set it to 1 to run the layers one after another</para>
+		/// </summary>
+		class CHAOS_API Extractor
+		{
+		public:
+			~Extractor();
+
+			Extractor(Extractor&& extractor) noexcept;
+			Extractor& operator=(Extractor&& extractor) noexcept;
+
+			Extractor(const Extractor&) = delete;
+			Extractor& operator=(const Extractor&) = delete;
+
+			/// <summary> Set an input of the Net, or any other blob to skip the layers computing it </summary>
+			void Input(const std::string& name, const Tensor& blob);
+
+			/// <summary>
+			/// <para>Run the layers the blob depends on, blobs kept from earlier calls are not computed again</para>
+			/// </summary>
+			void Extract(const std::string& name, Tensor& blob);
+			/// <summary> Extract several blobs, their shared layers run once </summary>
+			void Extract(const std::vector<std::string>& names, std::vector<Tensor>& blobs);
+
+			/// <summary>
+			/// <para>Plan the blob memory for extracting names: extract them once from the inputs already set,
+			/// with the layers one after another, recording what each layer allocates from opt.blob_allocator, then place
+			/// those buffers in one slab by their lifetimes with PlanMemory</para>
+			/// <para>Later extractions of the same names then take the blobs from the slab, and only the extracted
+			/// blobs are allocated. Layers should allocate in the same order on each run, a request that does not
+			/// fit the plan, e.g. for inputs of another shape, falls back to opt.blob_allocator. A layer given memory
+			/// of the slab also waits for the layers that used it before</para>
+			/// <para>The extracted blobs come from opt.blob_allocator, they may be kept across runs and after the Extractor is gone</para>
+			/// </summary>
+			/// <return>The size of the slab in bytes</return>
+			size_t Plan(const std::vector<std::string>& names);
+
+			Option opt;
+
+		private:
+			friend class Net;
+			explicit Extractor(const Net& net);
+
+			const NetGraph* graph;
+			ExtractorState* state;
+		};
+	}
+}
\ No newline at end of file
@@ -2,6 +2,9 @@
 
 #include "core/core.hpp"
 #include "core/allocator.hpp"
+#include "core/parallel.hpp"
+
+#include <vector>
 
 namespace chaos
 {
@@ -9,6 +12,20 @@ namespace chaos
 	{
 	public:
 		Allocator* blob_allocator = nullptr;
+		// scratch memory used inside Forward, e.g. an ArenaAllocator reset by ArenaScope
 		Allocator* workspace_allocator = nullptr;
+		// scratch of each thread running a part of Layer::ForwardBatch, empty gives each one an ArenaAllocator for the call
+		std::vector<Allocator*> workspace_allocators;
+
+		// threads used by the kernels, 0 means all the threads of the pool
+		int num_threads = 0;
+		// nullptr means ThreadPool::Global()
+		ThreadPool* thread_pool = nullptr;
+
+		// release the blobs of a Net once their last reader ran, and let an in-place layer take over its input
+		bool light_mode = true;
+
+		// let Layer::ForwardBatch stack blobs of the same shape into one [N, ...] Tensor where the layer gains from it, see Layer::StackBatch
+		bool batch_stacking = true;
 	};
 }
\ No newline at end of file
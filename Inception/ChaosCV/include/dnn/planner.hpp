@@ -0,0 +1,30 @@
+#pragma once
+
+#include "core/def.hpp"
+#include "core/allocator.hpp"
+
+#include <vector>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary> A buffer of size bytes used from step first to step last, both included </summary>
+		struct BufferLife
+		{
+			size_t size = 0;
+			int first = 0;
+			int last = 0;
+		};
+
+		/// <summary>
+		/// <para>Place buffers in one slab so that the buffers alive at the same step never overlap</para>
+		/// <para>Greedy by size: the largest buffers go first, each into the smallest gap left between
+		/// the placed buffers it lives with, or after all of them</para>
+		/// </summary>
+		/// <param name="offsets">The byte offset of each buffer in the slab, multiples of alignment</param>
+		/// <param name="alignment">Power of two, each size is rounded up to it</param>
+		/// <return>The size of the slab in bytes</return>
+		CHAOS_API size_t PlanMemory(const std::vector<BufferLife>& buffers, std::vector<size_t>& offsets, size_t alignment = GetDefaultAlignment());
+	}
+}
\ No newline at end of file
@@ -0,0 +1,422 @@
+#include "core/allocator.hpp"
+#include "core/log.hpp"
+#include "core/types.hpp"
+#include "core/tracking.hpp"
+
+#include <bit>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define NOGDI // wingdi.h defines ERROR
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+namespace chaos
+{
+	static std::atomic<size_t> default_alignment = ALIGNMENT;
+	void SetDefaultAlignment(size_t alignment)
+	{
+		CHECK(alignment >= sizeof(void*) && 0 == (alignment & (alignment - 1))) << "alignment should be a power of 2, but got " << alignment;
+		default_alignment.store(alignment, std::memory_order_relaxed);
+	}
+	size_t GetDefaultAlignment() noexcept
+	{
+		return default_alignment.load(std::memory_order_relaxed);
+	}
+
+	void* FastMalloc(size_t capacity)
+	{
+		void* data = ALIGNED_MALLOC(capacity, GetDefaultAlignment());
+		if (AllocationTracker* tracker = GetDefaultTracker()) tracker->OnMalloc(data, capacity);
+		return data;
+	}
+	void FastFree(void* data)
+	{
+		if (AllocationTracker* tracker = GetDefaultTracker()) tracker->OnFree(data);
+		ALIGNED_FREE(data);
+	}
+
+	class SizeClassPool
+	{
+	public:
+		explicit SizeClassPool(size_t max_cached) : max_cached(max_cached) {}
+		~SizeClassPool()
+		{
+			Trim(0);
+			LOG_IF(ERROR, in_use_blocks > 0) << "pool allocator destroyed too early, " << in_use_blocks << " blocks still in use";
+		}
+
+		// round size up to one of four classes per power of two, so the waste is at most 25%,
+		// whole multiples of the same alignment HeaderOf keeps
+		static size_t ClassOf(size_t size)
+		{
+			size_t alignment = GetDefaultAlignment();
+			size = AlignSize(std::max<size_t>(size, 1), static_cast<int>(alignment));
+			size_t msb = std::bit_floor(size);
+			size_t granularity = std::max<size_t>(msb >> 2, alignment);
+			return (size + granularity - 1) & ~(granularity - 1);
+		}
+
+		// the block handed out starts this far into the allocation, after its class and this offset,
+		// a multiple of the alignment so that the block stays aligned
+		static size_t HeaderOf() noexcept
+		{
+			return std::max<size_t>(GetDefaultAlignment(), 2 * sizeof(size_t));
+		}
+
+		static size_t* Header(void* ptr) noexcept
+		{
+			return static_cast<size_t*>(ptr) - 2;
+		}
+
+		static void Release(void* ptr) noexcept
+		{
+			chaos::FastFree(static_cast<uchar*>(ptr) - Header(ptr)[1]);
+		}
+
+		void* Malloc(size_t size)
+		{
+			size_t cls = ClassOf(size);
+			size_t header = HeaderOf();
+			void* ptr = nullptr;
+
+			auto iter = free_lists.find(cls);
+			if (iter != free_lists.end() && not iter->second.empty())
+			{
+				ptr = iter->second.back();
+				iter->second.pop_back();
+				cached_bytes -= cls;
+				// cached before the default alignment changed
+				if (Header(ptr)[1] != header)
+				{
+					Release(ptr);
+					ptr = nullptr;
+				}
+			}
+			if (not ptr)
+			{
+				ptr = static_cast<uchar*>(chaos::FastMalloc(header + cls)) + header;
+				Header(ptr)[0] = cls;
+				Header(ptr)[1] = header;
+			}
+
+			in_use_bytes += cls;
+			in_use_blocks++;
+			return ptr;
+		}
+
+		void Free(void* ptr)
+		{
+			if (not ptr) return;
+			size_t cls = Header(ptr)[0];
+			in_use_bytes -= cls;
+			in_use_blocks--;
+
+			if (max_cached > 0 && cached_bytes + cls > max_cached)
+			{
+				Release(ptr);
+				return;
+			}
+
+			free_lists[cls].push_back(ptr);
+			cached_bytes += cls;
+		}
+
+		void Trim(size_t keep)
+		{
+			// drop the largest classes first, they are the most expensive to keep around
+			std::vector<size_t> classes;
+			for (const auto& [cls, list] : free_lists) if (not list.empty()) classes.push_back(cls);
+			std::sort(classes.begin(), classes.end(), std::greater<size_t>());
+
+			for (size_t cls : classes)
+			{
+				auto& list = free_lists[cls];
+				while (not list.empty() && cached_bytes > keep)
+				{
+					Release(list.back());
+					list.pop_back();
+					cached_bytes -= cls;
+				}
+				if (cached_bytes <= keep) break;
+			}
+		}
+
+		std::mutex mtx;
+
+		size_t max_cached = 0;
+		size_t cached_bytes = 0;
+		size_t in_use_bytes = 0;
+		size_t in_use_blocks = 0;
+
+		std::unordered_map<size_t, std::vector<void*>> free_lists;
+	};
+
+
+	PoolAllocator::PoolAllocator(size_t max_cached) : pool(new SizeClassPool(max_cached)) {}
+	PoolAllocator::~PoolAllocator() { delete pool; }
+
+	void* PoolAllocator::FastMalloc(size_t size)
+	{
+		std::lock_guard lock(pool->mtx);
+		return pool->Malloc(size);
+	}
+	void PoolAllocator::FastFree(void* ptr)
+	{
+		std::lock_guard lock(pool->mtx);
+		pool->Free(ptr);
+	}
+
+	void PoolAllocator::Trim(size_t keep)
+	{
+		std::lock_guard lock(pool->mtx);
+		pool->Trim(keep);
+	}
+	void PoolAllocator::SetMaxCached(size_t max_cached)
+	{
+		std::lock_guard lock(pool->mtx);
+		pool->max_cached = max_cached;
+		if (max_cached > 0) pool->Trim(max_cached);
+	}
+
+	size_t PoolAllocator::cached() const
+	{
+		std::lock_guard lock(pool->mtx);
+		return pool->cached_bytes;
+	}
+	size_t PoolAllocator::in_use() const
+	{
+		std::lock_guard lock(pool->mtx);
+		return pool->in_use_bytes;
+	}
+
+
+	UnlockedPoolAllocator::UnlockedPoolAllocator(size_t max_cached) : pool(new SizeClassPool(max_cached)) {}
+	UnlockedPoolAllocator::~UnlockedPoolAllocator() { delete pool; }
+
+	void* UnlockedPoolAllocator::FastMalloc(size_t size) { return pool->Malloc(size); }
+	void UnlockedPoolAllocator::FastFree(void* ptr) { pool->Free(ptr); }
+
+	void UnlockedPoolAllocator::Trim(size_t keep) { pool->Trim(keep); }
+	void UnlockedPoolAllocator::SetMaxCached(size_t max_cached)
+	{
+		pool->max_cached = max_cached;
+		if (max_cached > 0) pool->Trim(max_cached);
+	}
+
+	size_t UnlockedPoolAllocator::cached() const { return pool->cached_bytes; }
+	size_t UnlockedPoolAllocator::in_use() const { return pool->in_use_bytes; }
+
+
+	class PageBlocks
+	{
+	public:
+		static constexpr size_t huge_page_size = 2 << 20;
+
+		~PageBlocks()
+		{
+			LOG_IF(ERROR, not blocks.empty()) << "page allocator destroyed too early, " << blocks.size() << " blocks still mapped";
+			for (const auto& [ptr, size] : blocks) Unmap(ptr, size);
+		}
+
+		static void* Map(size_t size, bool huge_pages, bool prefault)
+		{
+#ifdef _WIN32
+			void* ptr = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+			if (ptr && prefault)
+			{
+				SYSTEM_INFO info;
+				GetSystemInfo(&info);
+				for (size_t i = 0; i < size; i += info.dwPageSize) static_cast<volatile uchar*>(ptr)[i] = 0;
+			}
+			return ptr;
+#else
+			int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_POPULATE
+			if (prefault && not huge_pages) flags |= MAP_POPULATE;
+#endif
+			if (not huge_pages)
+			{
+				void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+				return ptr == MAP_FAILED ? nullptr : ptr;
+			}
+
+			// over-map and trim, so that the block starts on a huge page boundary
+			size_t length = size + huge_page_size;
+			void* raw = mmap(nullptr, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+			if (raw == MAP_FAILED) return nullptr;
+
+			uchar* ptr = AlignPtr(static_cast<uchar*>(raw), static_cast<int>(huge_page_size));
+			size_t head = ptr - static_cast<uchar*>(raw);
+			size_t tail = length - head - size;
+			if (head > 0) munmap(raw, head);
+			if (tail > 0) munmap(ptr + size, tail);
+#ifdef MADV_HUGEPAGE
+			madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+			if (prefault)
+			{
+				long page = sysconf(_SC_PAGESIZE);
+				for (size_t i = 0; i < size; i += page) static_cast<volatile uchar*>(ptr)[i] = 0;
+			}
+			return ptr;
+#endif
+		}
+
+		static void Unmap(void* ptr, size_t size)
+		{
+#ifdef _WIN32
+			VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+			munmap(ptr, size);
+#endif
+		}
+
+		std::mutex mtx;
+		size_t mapped_bytes = 0;
+		std::unordered_map<void*, size_t> blocks;
+	};
+
+	PageAllocator::PageAllocator(size_t threshold, bool huge_pages, bool prefault) :
+		threshold(threshold), huge_pages(huge_pages), prefault(prefault), blocks(new PageBlocks()) {}
+	PageAllocator::~PageAllocator() { delete blocks; }
+
+	void* PageAllocator::FastMalloc(size_t size)
+	{
+		if (size < threshold) return chaos::FastMalloc(size);
+
+		size = AlignSize(size, static_cast<int>(huge_pages ? PageBlocks::huge_page_size : 4096));
+		void* ptr = PageBlocks::Map(size, huge_pages, prefault);
+		if (nullptr == ptr)
+		{
+			LOG(WARNING) << "failed to map " << size << " bytes, fall back to FastMalloc";
+			return chaos::FastMalloc(size);
+		}
+
+		std::lock_guard lock(blocks->mtx);
+		blocks->blocks[ptr] = size;
+		blocks->mapped_bytes += size;
+		return ptr;
+	}
+
+	void PageAllocator::FastFree(void* ptr)
+	{
+		if (nullptr == ptr) return;
+		{
+			std::lock_guard lock(blocks->mtx);
+			auto iter = blocks->blocks.find(ptr);
+			if (iter != blocks->blocks.end())
+			{
+				size_t size = iter->second;
+				blocks->blocks.erase(iter);
+				blocks->mapped_bytes -= size;
+				PageBlocks::Unmap(ptr, size);
+				return;
+			}
+		}
+		chaos::FastFree(ptr);
+	}
+
+	size_t PageAllocator::mapped() const
+	{
+		std::lock_guard lock(blocks->mtx);
+		return blocks->mapped_bytes;
+	}
+
+
+	class ArenaChunks
+	{
+	public:
+		struct Chunk
+		{
+			uchar* data = nullptr;
+			size_t size = 0;
+		};
+
+		explicit ArenaChunks(size_t chunk_size) : chunk_size(chunk_size) {}
+		~ArenaChunks()
+		{
+			for (auto& chunk : chunks) chaos::FastFree(chunk.data);
+		}
+
+		void* Malloc(size_t size)
+		{
+			size = AlignSize(std::max<size_t>(size, 1), static_cast<int>(GetDefaultAlignment()));
+			// find the first chunk from the current one that can hold the slice
+			for (; current < chunks.size(); current++, offset = 0)
+			{
+				if (offset + size <= chunks[current].size)
+				{
+					void* ptr = chunks[current].data + offset;
+					offset += size;
+					return ptr;
+				}
+			}
+
+			Chunk chunk;
+			chunk.size = std::max(chunk_size, size);
+			chunk.data = static_cast<uchar*>(chaos::FastMalloc(chunk.size));
+			chunks.push_back(chunk);
+
+			current = chunks.size() - 1;
+			offset = size;
+			return chunk.data;
+		}
+
+		size_t chunk_size;
+
+		size_t current = 0;
+		size_t offset = 0;
+		std::vector<Chunk> chunks;
+	};
+
+	ArenaAllocator::ArenaAllocator(size_t chunk_size) : chunks(new ArenaChunks(chunk_size)) {}
+	ArenaAllocator::~ArenaAllocator() { delete chunks; }
+
+	void* ArenaAllocator::FastMalloc(size_t size)
+	{
+		return chunks->Malloc(size);
+	}
+
+	ArenaAllocator::Mark ArenaAllocator::GetMark() const noexcept
+	{
+		return Mark{ chunks->current, chunks->offset };
+	}
+
+	void ArenaAllocator::Reset(const Mark& mark)
+	{
+		DCHECK(mark.chunk < chunks->current || (mark.chunk == chunks->current && mark.offset <= chunks->offset)) << "reset to a mark newer than the top";
+		chunks->current = mark.chunk;
+		chunks->offset = mark.offset;
+	}
+
+	void ArenaAllocator::Trim()
+	{
+		auto& list = chunks->chunks;
+		size_t keep = chunks->offset > 0 ? chunks->current + 1 : chunks->current;
+		for (size_t i = keep; i < list.size(); i++) chaos::FastFree(list[i].data);
+		if (keep < list.size()) list.resize(keep);
+	}
+
+	size_t ArenaAllocator::used() const noexcept
+	{
+		size_t bytes = chunks->offset;
+		for (size_t i = 0; i < chunks->current && i < chunks->chunks.size(); i++) bytes += chunks->chunks[i].size;
+		return bytes;
+	}
+	size_t ArenaAllocator::reserved() const noexcept
+	{
+		size_t bytes = 0;
+		for (const auto& chunk : chunks->chunks) bytes += chunk.size;
+		return bytes;
+	}
+}
\ No newline at end of file
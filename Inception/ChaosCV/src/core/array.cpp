@@ -7,13 +7,13 @@ namespace chaos
 	Steps::Steps(int s0) : Array<int>(1) { data_[0] = s0; }
 	Steps::Steps(int s0, int s1) : Array<int>(2) { data_[0] = s0; data_[1] = s1; }
 	Steps::Steps(int s0, int s1, int s2) : Array<int>(3) { data_[0] = s0; data_[1] = s1; data_[2] = s2; }
-	Steps::Steps(Array<int>&& arr) noexcept : Array<int>(arr) {}
+	Steps::Steps(Array<int>&& arr) noexcept : Array<int>(std::move(arr)) {}
 
 	Shape::Shape() : Array<int>(0) {}
 	Shape::Shape(int d0) : Array<int>(1) { data_[0] = d0; }
 	Shape::Shape(int d0, int d1) : Array<int>(2) { data_[0] = d0; data_[1] = d1; }
 	Shape::Shape(int d0, int d1, int d2) : Array<int>(3) { data_[0] = d0; data_[1] = d1; data_[2] = d2; }
-	Shape::Shape(Array<int>&& arr) noexcept : Array<int>(arr) {}
+	Shape::Shape(Array<int>&& arr) noexcept : Array<int>(std::move(arr)) {}
 
 	int Shape::total() const noexcept { return std::accumulate(data_, data_ + size_, 1, std::multiplies<int>()); }
 	Steps Shape::steps() const noexcept
@@ -0,0 +1,348 @@
+#include "core/tensor.hpp"
+#include "core/parallel.hpp"
+#include "core/cpu.hpp"
+#include "core/strided.hpp"
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+
+#ifdef CHAOS_X86
+#include <immintrin.h>
+#endif
+
+namespace chaos
+{
+	namespace
+	{
+		struct Half
+		{
+			uint16_t bits;
+		};
+	}
+
+	static inline float HalfToFloat(uint16_t h) noexcept
+	{
+		uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+		uint32_t em = h & 0x7fff;
+		uint32_t bits;
+		if (em >= 0x7c00) // inf and nan
+		{
+			bits = sign | 0x7f800000 | ((em & 0x3ff) << 13);
+		}
+		else if (em >= 0x0400) // normal, rebias the exponent
+		{
+			bits = sign | ((em << 13) + 0x38000000);
+		}
+		else // subnormal, em * 2^-24 is exact
+		{
+			float f = static_cast<float>(em) * 5.9604644775390625e-8f;
+			memcpy(&bits, &f, 4);
+			bits |= sign;
+		}
+		float f;
+		memcpy(&f, &bits, 4);
+		return f;
+	}
+	// round to nearest even, as vcvtps2ph does
+	static inline uint16_t FloatToHalf(float value) noexcept
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, 4);
+		uint32_t sign = (bits >> 16) & 0x8000;
+		bits &= 0x7fffffff;
+
+		uint32_t h;
+		if (bits >= 0x47800000) // overflow, inf and nan
+		{
+			h = bits > 0x7f800000 ? 0x7e00 : 0x7c00;
+		}
+		else if (bits < 0x38800000) // subnormal, let the fpu round at the 2^-24 ulp
+		{
+			float f;
+			memcpy(&f, &bits, 4);
+			f += 0.5f;
+			memcpy(&bits, &f, 4);
+			h = bits - 0x3f000000;
+		}
+		else
+		{
+			uint32_t odd = (bits >> 13) & 1;
+			bits += 0xc8000fff + odd; // rebias the exponent and round
+			h = bits >> 13;
+		}
+		return static_cast<uint16_t>(h | sign);
+	}
+
+	template<class Acc, class Type>
+	static inline Acc Load(const Type* src) noexcept
+	{
+		if constexpr (std::is_same_v<Type, Half>) return HalfToFloat(src->bits);
+		else return static_cast<Acc>(*src);
+	}
+	template<class Type, class Acc>
+	static inline void Store(Type* dst, Acc val) noexcept
+	{
+		if constexpr (std::is_same_v<Type, uint8_t> or std::is_same_v<Type, int8_t>)
+		{
+			constexpr Acc lo = static_cast<Acc>(std::is_same_v<Type, uint8_t> ? 0 : -128);
+			constexpr Acc hi = static_cast<Acc>(std::is_same_v<Type, uint8_t> ? 255 : 127);
+			val = std::nearbyint(val);
+			if (!(val > lo)) val = lo; // nan too
+			if (val > hi) val = hi;
+			*dst = static_cast<Type>(val);
+		}
+		else if constexpr (std::is_same_v<Type, Half>)
+		{
+			dst->bits = FloatToHalf(static_cast<float>(val));
+		}
+		else
+		{
+			*dst = static_cast<Type>(val);
+		}
+	}
+
+	// convert n contiguous scalars, scale and shift repeat every period scalars
+	using ConvertRow = void(*)(void* dst, const void* src, int64_t n, const float* scale, const float* shift, int period);
+
+	template<class Dst, class Src>
+	static void ConvertScalar(void* dst, const void* src, int64_t n, const float* scale, const float* shift, int period)
+	{
+		// doubles keep their precision, the rest is computed in float like the vector kernels
+		using Acc = std::conditional_t<std::is_same_v<Dst, double> or std::is_same_v<Src, double>, double, float>;
+		Dst* d = static_cast<Dst*>(dst);
+		const Src* s = static_cast<const Src*>(src);
+		for (int64_t i = 0, k = 0; i < n; i++)
+		{
+			Store(d + i, Load<Acc>(s + i) * static_cast<Acc>(scale[k]) + static_cast<Acc>(shift[k]));
+			if (++k == period) k = 0;
+		}
+	}
+
+#ifdef CHAOS_X86
+	template<class Src>
+	CHAOS_TARGET("avx2,fma,f16c") static inline __m256 Load8(const Src* src) noexcept
+	{
+		if constexpr (std::is_same_v<Src, uint8_t>)
+		{
+			return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src))));
+		}
+		else if constexpr (std::is_same_v<Src, int8_t>)
+		{
+			return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src))));
+		}
+		else if constexpr (std::is_same_v<Src, Half>)
+		{
+			return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+		}
+		else
+		{
+			return _mm256_loadu_ps(src);
+		}
+	}
+	template<class Dst>
+	CHAOS_TARGET("avx2,fma,f16c") static inline void Store8(Dst* dst, __m256 val) noexcept
+	{
+		if constexpr (std::is_same_v<Dst, uint8_t> or std::is_same_v<Dst, int8_t>)
+		{
+			// clamp first, cvtps2dq turns out of range values into INT_MIN; max puts nan to lo like the scalar path
+			constexpr float lo = std::is_same_v<Dst, uint8_t> ? 0.f : -128.f;
+			constexpr float hi = std::is_same_v<Dst, uint8_t> ? 255.f : 127.f;
+			val = _mm256_min_ps(_mm256_max_ps(val, _mm256_set1_ps(lo)), _mm256_set1_ps(hi));
+			__m256i i32 = _mm256_cvtps_epi32(val);
+			__m128i i16 = _mm_packs_epi32(_mm256_castsi256_si128(i32), _mm256_extracti128_si256(i32, 1));
+			__m128i i8 = std::is_same_v<Dst, uint8_t> ? _mm_packus_epi16(i16, i16) : _mm_packs_epi16(i16, i16);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst), i8);
+		}
+		else if constexpr (std::is_same_v<Dst, Half>)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_cvtps_ph(val, _MM_FROUND_TO_NEAREST_INT));
+		}
+		else
+		{
+			_mm256_storeu_ps(dst, val);
+		}
+	}
+
+	template<class Dst, class Src>
+	CHAOS_TARGET("avx2,fma,f16c") static void ConvertAVX2(void* dst, const void* src, int64_t n, const float* scale, const float* shift, int period)
+	{
+		Dst* d = static_cast<Dst*>(dst);
+		const Src* s = static_cast<const Src*>(src);
+
+		// the period is 8 or 24 scalars, so the pattern is 1 or 3 registers
+		__m256 vscale[3];
+		__m256 vshift[3];
+		int vecs = period / 8;
+		for (int k = 0; k < vecs; k++)
+		{
+			vscale[k] = _mm256_loadu_ps(scale + k * 8);
+			vshift[k] = _mm256_loadu_ps(shift + k * 8);
+		}
+
+		int64_t i = 0;
+		int k = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			Store8(d + i, _mm256_fmadd_ps(Load8(s + i), vscale[k], vshift[k]));
+			if (++k == vecs) k = 0;
+		}
+		// the tail is shorter than a register, it never wraps around the pattern
+		ConvertScalar<Dst, Src>(d + i, s + i, n - i, scale + k * 8, shift + k * 8, period);
+	}
+#endif
+
+	template<class Func>
+	static auto DispatchType(const DataType& type, Func&& func)
+	{
+		switch (type)
+		{
+		case DataType::U8: return func(uint8_t());
+		case DataType::S8: return func(int8_t());
+		case DataType::F16: return func(Half());
+		case DataType::F32: return func(float());
+		default: return func(double());
+		}
+	}
+
+	static ConvertRow SelectKernel(const DataType& dst_type, const DataType& src_type, bool vectorize)
+	{
+		return DispatchType(dst_type, [&](auto dst) {
+			return DispatchType(src_type, [&](auto src) -> ConvertRow {
+				using Dst = decltype(dst);
+				using Src = decltype(src);
+#ifdef CHAOS_X86
+				// doubles go through the scalar path to keep their precision
+				if constexpr (not std::is_same_v<Dst, double> and not std::is_same_v<Src, double>)
+				{
+					if (vectorize) return &ConvertAVX2<Dst, Src>;
+				}
+#endif
+				return &ConvertScalar<Dst, Src>;
+			});
+		});
+	}
+
+	Tensor Tensor::Convert(const DataType& src_type, const DataType& dst_type, const Array<float>& scale, const Array<float>& shift, Allocator* allocator) const
+	{
+		if (empty()) return Tensor();
+		CHECK_EQ(depth, DepthOf(src_type)) << "the depth does not match the source type";
+		if (depth != DepthOf(src_type)) return Tensor();
+
+		size_t dims = shape.size();
+		int lanes = static_cast<int>(packing);
+		int64_t channels = (dims >= 3 ? shape[static_cast<int>(dims) - 3] : 1) * static_cast<int64_t>(lanes);
+		bool scales = scale.size() <= 1 || static_cast<int64_t>(scale.size()) == channels;
+		bool shifts = shift.size() <= 1 || static_cast<int64_t>(shift.size()) == channels;
+		CHECK(scales) << "expect 1 or " << channels << " scales but got " << scale.size();
+		if (!scales) return Tensor();
+		CHECK(shifts) << "expect 1 or " << channels << " shifts but got " << shift.size();
+		if (!shifts) return Tensor();
+
+		Tensor dst = Tensor(shape, DepthOf(dst_type), packing, allocator);
+		if (src_type == dst_type && scale.size() == 0 && shift.size() == 0)
+		{
+			CopyTo(dst);
+			return dst;
+		}
+
+		// dims [0, split) are walked head by head, the last of them is the channel axis when the scales differ per C
+		bool per_channel = scale.size() > 1 || shift.size() > 1;
+		size_t split = per_channel && dims >= 3 ? dims - 2 : 0;
+		int64_t groups = split > 0 ? shape.data()[split - 1] : 1;
+		int64_t heads = 1;
+		for (size_t i = 0; i < split; i++) heads *= shape.data()[i];
+
+		// scale and shift of each channel group, repeated over lcm(lanes, 8) scalars for the vector kernels
+		int period = lanes == 3 ? 24 : 8;
+		std::vector<float> patterns(groups * period * 2);
+		for (int64_t g = 0; g < groups; g++)
+		{
+			float* sc = patterns.data() + g * period * 2;
+			float* sh = sc + period;
+			for (int i = 0; i < period; i++)
+			{
+				int c = static_cast<int>(g * lanes + i % lanes);
+				sc[i] = scale.size() == 0 ? 1.f : scale.data()[scale.size() == 1 ? 0 : c];
+				sh[i] = shift.size() == 0 ? 0.f : shift.data()[shift.size() == 1 ? 0 : c];
+			}
+		}
+
+		bool vectorize = false;
+#ifdef CHAOS_X86
+		vectorize = CpuSupportAVX2() && CpuSupportFMA() && CpuSupportF16C();
+#endif
+		ConvertRow kernel = SelectKernel(dst_type, src_type, vectorize);
+		ConvertRow scalar = SelectKernel(dst_type, src_type, false);
+
+		Shape tail = Shape(Array<int>(dims - split, shape.data() + split, 1));
+		StridedLoop<2> loop(tail, { dst.steps.data() + split, steps.data() + split });
+		int64_t rows = loop.rows();
+		int64_t cols = loop.cols();
+		int64_t dstep = loop.step(0);
+		int64_t sstep = loop.step(1);
+		size_t desize = 1 * dst.depth * packing;
+		size_t sesize = 1 * depth * packing;
+		uchar* ddata = static_cast<uchar*>(dst.data);
+		const uchar* sdata = static_cast<const uchar*>(data);
+
+		// convert cols [c0, c1) of rows [r0, r1) of a head
+		auto convert = [&](int64_t h, int64_t r0, int64_t r1, int64_t c0, int64_t c1) {
+			int64_t doffset = 0;
+			int64_t soffset = 0;
+			for (size_t d = split, idx = h; d > 0; d--)
+			{
+				int64_t i = idx % shape.data()[d - 1];
+				idx /= shape.data()[d - 1];
+				doffset += i * dst.steps.data()[d - 1];
+				soffset += i * steps.data()[d - 1];
+			}
+			const float* sc = patterns.data() + (h % groups) * period * 2;
+			const float* sh = sc + period;
+
+			loop.ForEachRow(r0, r1, [&](const int64_t* offset) {
+				uchar* d = ddata + (doffset + offset[0] + c0 * dstep) * desize;
+				const uchar* s = sdata + (soffset + offset[1] + c0 * sstep) * sesize;
+				if (dstep == 1 && sstep == 1)
+				{
+					kernel(d, s, (c1 - c0) * lanes, sc, sh, period);
+					return;
+				}
+				for (int64_t j = c0; j < c1; j++, d += dstep * desize, s += sstep * sesize)
+				{
+					scalar(d, s, lanes, sc, sh, period);
+				}
+			});
+		};
+
+		// long rows (a dense Tensor is a single one) are cut into blocks, short rows are grouped
+		constexpr int64_t block_scalars = 1 << 16;
+		int64_t block = std::max<int64_t>(1, block_scalars / lanes);
+		int64_t pieces = (cols + block - 1) / block;
+		if (pieces > 1)
+		{
+			ParallelFor(0, heads * rows * pieces, [&](int64_t first, int64_t last) {
+				for (int64_t t = first; t < last; t++)
+				{
+					int64_t c0 = t % pieces * block;
+					int64_t r = t / pieces % rows;
+					convert(t / pieces / rows, r, r + 1, c0, std::min(cols, c0 + block));
+				}
+			});
+		}
+		else
+		{
+			ParallelFor(0, heads * rows, [&](int64_t first, int64_t last) {
+				for (int64_t h = first / rows; h * rows < last; h++)
+				{
+					int64_t r0 = std::max<int64_t>(first - h * rows, 0);
+					int64_t r1 = std::min<int64_t>(last - h * rows, rows);
+					convert(h, r0, r1, 0, cols);
+				}
+			}, std::max<int64_t>(1, block_scalars / (cols * lanes)));
+		}
+		return dst;
+	}
+}
\ No newline at end of file
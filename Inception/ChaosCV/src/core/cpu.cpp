@@ -0,0 +1,71 @@
+#include "core/cpu.hpp"
+
+#if defined(__GNUC__) && defined(CHAOS_X86)
+#include <cpuid.h>
+#elif defined(_MSC_VER) && defined(CHAOS_X86)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace chaos
+{
+	struct CpuFeatures
+	{
+		bool sse41 = false;
+		bool avx = false;
+		bool avx2 = false;
+		bool fma = false;
+		bool f16c = false;
+		bool avx512f = false;
+
+		CpuFeatures()
+		{
+#if defined(__GNUC__) && defined(CHAOS_X86)
+			__builtin_cpu_init();
+			sse41 = __builtin_cpu_supports("sse4.1");
+			avx = __builtin_cpu_supports("avx");
+			avx2 = __builtin_cpu_supports("avx2");
+			fma = __builtin_cpu_supports("fma");
+			avx512f = __builtin_cpu_supports("avx512f");
+			// f16c is not known by every gcc, it is bit 29 of ecx in leaf 1
+			unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+			__get_cpuid(1, &eax, &ebx, &ecx, &edx);
+			f16c = avx && (ecx & (1u << 29));
+#elif defined(_MSC_VER) && defined(CHAOS_X86)
+			int info[4];
+			__cpuid(info, 0);
+			int max_leaf = info[0];
+
+			__cpuid(info, 1);
+			sse41 = info[2] & (1 << 19);
+			bool osxsave = info[2] & (1 << 27);
+			unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+			bool ymm = (xcr0 & 0x6) == 0x6;
+			bool zmm = (xcr0 & 0xe6) == 0xe6;
+			avx = ymm && (info[2] & (1 << 28));
+			fma = avx && (info[2] & (1 << 12));
+			f16c = avx && (info[2] & (1 << 29));
+
+			if (max_leaf >= 7)
+			{
+				__cpuidex(info, 7, 0);
+				avx2 = avx && (info[1] & (1 << 5));
+				avx512f = zmm && (info[1] & (1 << 16));
+			}
+#endif
+		}
+	};
+
+	static const CpuFeatures& Features()
+	{
+		static const CpuFeatures features;
+		return features;
+	}
+
+	bool CpuSupportSSE41() noexcept { return Features().sse41; }
+	bool CpuSupportAVX() noexcept { return Features().avx; }
+	bool CpuSupportAVX2() noexcept { return Features().avx2; }
+	bool CpuSupportFMA() noexcept { return Features().fma; }
+	bool CpuSupportF16C() noexcept { return Features().f16c; }
+	bool CpuSupportAVX512F() noexcept { return Features().avx512f; }
+}
\ No newline at end of file
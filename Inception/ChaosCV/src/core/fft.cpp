@@ -0,0 +1,658 @@
+#include "core/fft.hpp"
+#include "core/cpu.hpp"
+#include "core/parallel.hpp"
+
+#include <cmath>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+#ifdef CHAOS_X86
+#include <immintrin.h>
+#endif
+
+namespace chaos
+{
+	// prime factors up to this one have a butterfly, sizes with a larger one go through Bluestein
+	constexpr int max_radix = 13;
+	// Complex values per task at least
+	constexpr int64_t fft_grain = 1 << 14;
+	// columns gathered together, so each row is read a cache line at a time
+	constexpr int64_t fft_columns = 8;
+
+	constexpr double fft_pi = 3.14159265358979323846;
+
+	// Stockham stage: before it the data holds, for each of the m * radix interleaved sequences, their DFTs of
+	// length l; the stage merges groups of radix of them into DFTs of length l * radix:
+	// out[(f + l * g) * m + k] = sum_q exp(-2 pi i q g / radix) * w(f, q) * in[(f * radix + q) * m + k]
+	struct Stage
+	{
+		int radix;
+		int64_t l;
+		int64_t m;
+		// w(f, q) = exp(-2 pi i q f / (l * radix)) at [f * (radix - 1) + q - 1]
+		std::vector<Complex> twiddles;
+		// the same at [(q - 1) * l + f], for the vectors over f of the last stage
+		std::vector<Complex> transposed;
+		// exp(-2 pi i j / radix), for the generic butterfly
+		std::vector<Complex> roots;
+	};
+
+	struct FFTPlan
+	{
+		int64_t n = 0;
+		std::vector<Stage> stages;
+		// exp(-2 pi i k / n) for k in [0, n / 2], a real input of size n runs an FFT of n / 2
+		std::vector<Complex> half;
+
+		// Bluestein: the chirp, a convolution through FFTs of inner->n and the chirp again
+		const FFTPlan* inner = nullptr;
+		std::vector<Complex> chirp;
+		// the FFT of the conjugate chirp, scaled by 1 / inner->n
+		std::vector<Complex> filter;
+
+		// Complex scratch values for Execute
+		int64_t work = 0;
+	};
+
+	static Complex Root(int64_t k, int64_t n) noexcept
+	{
+		double angle = -2. * fft_pi * static_cast<double>(k % n) / static_cast<double>(n);
+		return Complex(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+	}
+
+	static inline Complex MulNegI(const Complex& a) noexcept
+	{
+		return Complex(a.im, -a.re);
+	}
+
+	// the radices of n, empty if it has a prime factor above max_radix
+	static std::vector<int> Factorize(int64_t n)
+	{
+		std::vector<int> radices;
+		int fours = 0;
+		for (; n % 4 == 0; n /= 4) fours++;
+		for (int p : { 2, 3, 5, 7, 11, 13 })
+		{
+			for (; n % p == 0; n /= p) radices.push_back(p);
+		}
+		if (n != 1) return std::vector<int>();
+		// the 4s last, the final stages with a small m are then vectorized over f
+		radices.insert(radices.end(), fours, 4);
+		return radices;
+	}
+
+
+	template<int P>
+	static inline void Butterfly(Complex* a) noexcept
+	{
+		if constexpr (P == 2)
+		{
+			Complex t = a[0] - a[1];
+			a[0] = a[0] + a[1];
+			a[1] = t;
+		}
+		else if constexpr (P == 3)
+		{
+			constexpr float c = 0.866025403784438646f; // sqrt(3) / 2
+			Complex s = a[1] + a[2];
+			Complex d = MulNegI(a[1] - a[2]);
+			Complex t = Complex(a[0].re - 0.5f * s.re, a[0].im - 0.5f * s.im);
+			a[0] = a[0] + s;
+			a[1] = Complex(t.re + c * d.re, t.im + c * d.im);
+			a[2] = Complex(t.re - c * d.re, t.im - c * d.im);
+		}
+		else
+		{
+			Complex t0 = a[0] + a[2];
+			Complex t1 = a[0] - a[2];
+			Complex t2 = a[1] + a[3];
+			Complex t3 = MulNegI(a[1] - a[3]);
+			a[0] = t0 + t2;
+			a[1] = t1 + t3;
+			a[2] = t0 - t2;
+			a[3] = t1 - t3;
+		}
+	}
+
+	// f in [f0, f1) and k in [k0, k1) of a stage
+	template<int P>
+	static void StageScalar(const Stage& stage, const Complex* in, Complex* out, int64_t f0, int64_t f1, int64_t k0, int64_t k1) noexcept
+	{
+		int64_t l = stage.l;
+		int64_t m = stage.m;
+		for (int64_t f = f0; f < f1; f++)
+		{
+			const Complex* w = stage.twiddles.data() + f * (P - 1);
+			for (int64_t k = k0; k < k1; k++)
+			{
+				Complex a[P];
+				a[0] = in[f * P * m + k];
+				for (int q = 1; q < P; q++) a[q] = in[(f * P + q) * m + k] * w[q - 1];
+				Butterfly<P>(a);
+				for (int g = 0; g < P; g++) out[(f + l * g) * m + k] = a[g];
+			}
+		}
+	}
+
+	static void StageGeneric(const Stage& stage, const Complex* in, Complex* out) noexcept
+	{
+		int p = stage.radix;
+		int64_t l = stage.l;
+		int64_t m = stage.m;
+		const Complex* roots = stage.roots.data();
+		for (int64_t f = 0; f < l; f++)
+		{
+			const Complex* w = stage.twiddles.data() + f * (p - 1);
+			for (int64_t k = 0; k < m; k++)
+			{
+				Complex a[max_radix];
+				a[0] = in[f * p * m + k];
+				for (int q = 1; q < p; q++) a[q] = in[(f * p + q) * m + k] * w[q - 1];
+				for (int g = 0; g < p; g++)
+				{
+					Complex acc = a[0];
+					for (int q = 1; q < p; q++) acc = acc + a[q] * roots[q * g % p];
+					out[(f + l * g) * m + k] = acc;
+				}
+			}
+		}
+	}
+
+#ifdef CHAOS_X86
+	// 4 complex products, the Complex are interleaved (re, im)
+	CHAOS_TARGET("avx2,fma") static inline __m256 MulAVX2(__m256 a, __m256 w) noexcept
+	{
+		__m256 swapped = _mm256_permute_ps(a, 0xB1);
+		return _mm256_fmaddsub_ps(a, _mm256_moveldup_ps(w), _mm256_mul_ps(swapped, _mm256_movehdup_ps(w)));
+	}
+
+	CHAOS_TARGET("avx2,fma") static inline __m256 MulNegIAVX2(__m256 a) noexcept
+	{
+		return _mm256_xor_ps(_mm256_permute_ps(a, 0xB1), _mm256_setr_ps(0.f, -0.f, 0.f, -0.f, 0.f, -0.f, 0.f, -0.f));
+	}
+
+	template<int P>
+	CHAOS_TARGET("avx2,fma") static inline void ButterflyAVX2(__m256* a) noexcept
+	{
+		if constexpr (P == 2)
+		{
+			__m256 t = _mm256_sub_ps(a[0], a[1]);
+			a[0] = _mm256_add_ps(a[0], a[1]);
+			a[1] = t;
+		}
+		else if constexpr (P == 3)
+		{
+			__m256 s = _mm256_add_ps(a[1], a[2]);
+			__m256 d = _mm256_mul_ps(MulNegIAVX2(_mm256_sub_ps(a[1], a[2])), _mm256_set1_ps(0.866025403784438646f));
+			__m256 t = _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), s, a[0]);
+			a[0] = _mm256_add_ps(a[0], s);
+			a[1] = _mm256_add_ps(t, d);
+			a[2] = _mm256_sub_ps(t, d);
+		}
+		else
+		{
+			__m256 t0 = _mm256_add_ps(a[0], a[2]);
+			__m256 t1 = _mm256_sub_ps(a[0], a[2]);
+			__m256 t2 = _mm256_add_ps(a[1], a[3]);
+			__m256 t3 = MulNegIAVX2(_mm256_sub_ps(a[1], a[3]));
+			a[0] = _mm256_add_ps(t0, t2);
+			a[1] = _mm256_add_ps(t1, t3);
+			a[2] = _mm256_sub_ps(t0, t2);
+			a[3] = _mm256_sub_ps(t1, t3);
+		}
+	}
+
+	static inline const float* Floats(const Complex* data) noexcept { return reinterpret_cast<const float*>(data); }
+	static inline float* Floats(Complex* data) noexcept { return reinterpret_cast<float*>(data); }
+
+	// vectors over k while m >= 4, over f for the last stage of a radix 2 or 4, scalar otherwise
+	template<int P>
+	CHAOS_TARGET("avx2,fma") static void StageAVX2(const Stage& stage, const Complex* in, Complex* out) noexcept
+	{
+		int64_t l = stage.l;
+		int64_t m = stage.m;
+		if (m >= 4)
+		{
+			int64_t mv = m / 4 * 4;
+			for (int64_t f = 0; f < l; f++)
+			{
+				const Complex* w = stage.twiddles.data() + f * (P - 1);
+				__m256 wv[P];
+				for (int q = 1; q < P; q++) wv[q] = _mm256_castpd_ps(_mm256_broadcast_sd(reinterpret_cast<const double*>(w + q - 1)));
+				for (int64_t k = 0; k < mv; k += 4)
+				{
+					__m256 a[P];
+					a[0] = _mm256_loadu_ps(Floats(in + f * P * m + k));
+					for (int q = 1; q < P; q++) a[q] = MulAVX2(_mm256_loadu_ps(Floats(in + (f * P + q) * m + k)), wv[q]);
+					ButterflyAVX2<P>(a);
+					for (int g = 0; g < P; g++) _mm256_storeu_ps(Floats(out + (f + l * g) * m + k), a[g]);
+				}
+			}
+			if (mv < m) StageScalar<P>(stage, in, out, 0, l, mv, m);
+			return;
+		}
+
+		if constexpr (P == 2 || P == 4)
+		{
+			if (m == 1)
+			{
+				int64_t lv = l / 4 * 4;
+				for (int64_t f = 0; f < lv; f += 4)
+				{
+					// in[f * P + q] for 4 values of f, transposed to one vector per q
+					__m256 a[P];
+					if constexpr (P == 4)
+					{
+						__m256 v0 = _mm256_loadu_ps(Floats(in + f * 4));
+						__m256 v1 = _mm256_loadu_ps(Floats(in + f * 4 + 4));
+						__m256 v2 = _mm256_loadu_ps(Floats(in + f * 4 + 8));
+						__m256 v3 = _mm256_loadu_ps(Floats(in + f * 4 + 12));
+						__m256d t0 = _mm256_castps_pd(_mm256_permute2f128_ps(v0, v2, 0x20));
+						__m256d t1 = _mm256_castps_pd(_mm256_permute2f128_ps(v1, v3, 0x20));
+						__m256d t2 = _mm256_castps_pd(_mm256_permute2f128_ps(v0, v2, 0x31));
+						__m256d t3 = _mm256_castps_pd(_mm256_permute2f128_ps(v1, v3, 0x31));
+						a[0] = _mm256_castpd_ps(_mm256_unpacklo_pd(t0, t1));
+						a[1] = _mm256_castpd_ps(_mm256_unpackhi_pd(t0, t1));
+						a[2] = _mm256_castpd_ps(_mm256_unpacklo_pd(t2, t3));
+						a[3] = _mm256_castpd_ps(_mm256_unpackhi_pd(t2, t3));
+					}
+					else
+					{
+						__m256d v0 = _mm256_castps_pd(_mm256_loadu_ps(Floats(in + f * 2)));
+						__m256d v1 = _mm256_castps_pd(_mm256_loadu_ps(Floats(in + f * 2 + 4)));
+						a[0] = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_unpacklo_pd(v0, v1), 0xD8));
+						a[1] = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_unpackhi_pd(v0, v1), 0xD8));
+					}
+					for (int q = 1; q < P; q++) a[q] = MulAVX2(a[q], _mm256_loadu_ps(Floats(stage.transposed.data() + (q - 1) * l + f)));
+					ButterflyAVX2<P>(a);
+					for (int g = 0; g < P; g++) _mm256_storeu_ps(Floats(out + f + l * g), a[g]);
+				}
+				StageScalar<P>(stage, in, out, lv, l, 0, 1);
+				return;
+			}
+		}
+		StageScalar<P>(stage, in, out, 0, l, 0, m);
+	}
+#endif
+
+	static void RunStage(const Stage& stage, const Complex* in, Complex* out) noexcept
+	{
+#ifdef CHAOS_X86
+		static const bool avx2 = CpuSupportAVX2() && CpuSupportFMA();
+		if (avx2)
+		{
+			switch (stage.radix)
+			{
+			case 2: StageAVX2<2>(stage, in, out); return;
+			case 3: StageAVX2<3>(stage, in, out); return;
+			case 4: StageAVX2<4>(stage, in, out); return;
+			default: break;
+			}
+		}
+#endif
+		switch (stage.radix)
+		{
+		case 2: StageScalar<2>(stage, in, out, 0, stage.l, 0, stage.m); return;
+		case 3: StageScalar<3>(stage, in, out, 0, stage.l, 0, stage.m); return;
+		case 4: StageScalar<4>(stage, in, out, 0, stage.l, 0, stage.m); return;
+		default: StageGeneric(stage, in, out); return;
+		}
+	}
+
+	// forward DFT of data in place, work holds plan.work values
+	static void Execute(const FFTPlan& plan, Complex* data, Complex* work) noexcept
+	{
+		if (plan.inner)
+		{
+			const FFTPlan& inner = *plan.inner;
+			Complex* a = work;
+			Complex* scratch = work + inner.n;
+			for (int64_t k = 0; k < plan.n; k++) a[k] = data[k] * plan.chirp[k];
+			std::fill(a + plan.n, a + inner.n, Complex());
+			Execute(inner, a, scratch);
+			// the inverse FFT as conj(FFT(conj(x))), the 1 / size is in the filter
+			for (int64_t k = 0; k < inner.n; k++) a[k] = (a[k] * plan.filter[k]).conj();
+			Execute(inner, a, scratch);
+			for (int64_t k = 0; k < plan.n; k++) data[k] = a[k].conj() * plan.chirp[k];
+			return;
+		}
+
+		Complex* src = data;
+		Complex* dst = work;
+		for (const Stage& stage : plan.stages)
+		{
+			RunStage(stage, src, dst);
+			std::swap(src, dst);
+		}
+		if (src != data) memcpy(data, src, plan.n * sizeof(Complex));
+	}
+
+	static const FFTPlan& GetPlan(int64_t n);
+
+	static std::unique_ptr<FFTPlan> MakePlan(int64_t n)
+	{
+		auto plan = std::make_unique<FFTPlan>();
+		plan->n = n;
+		if (n % 2 == 0)
+		{
+			plan->half.resize(n / 2 + 1);
+			for (int64_t k = 0; k <= n / 2; k++) plan->half[k] = Root(k, n);
+		}
+
+		std::vector<int> radices = Factorize(n);
+		if (n == 1 || not radices.empty())
+		{
+			int64_t l = 1;
+			for (int p : radices)
+			{
+				Stage stage;
+				stage.radix = p;
+				stage.l = l;
+				stage.m = n / (l * p);
+				stage.twiddles.resize(l * (p - 1));
+				stage.transposed.resize(l * (p - 1));
+				for (int64_t f = 0; f < l; f++)
+				{
+					for (int q = 1; q < p; q++)
+					{
+						Complex w = Root(q * f, l * p);
+						stage.twiddles[f * (p - 1) + q - 1] = w;
+						stage.transposed[(q - 1) * l + f] = w;
+					}
+				}
+				if (p > 4)
+				{
+					stage.roots.resize(p);
+					for (int j = 0; j < p; j++) stage.roots[j] = Root(j, p);
+				}
+				plan->stages.push_back(std::move(stage));
+				l *= p;
+			}
+			plan->work = n;
+			return plan;
+		}
+
+		// Bluestein: exp(-2 pi i j k / n) = c(j) c(k) conj(c(k - j)) with the chirp c(k) = exp(-pi i k^2 / n),
+		// so the DFT is a convolution by conj(c), done by FFTs of a power of 2 of at least 2n - 1
+		int64_t size = 1;
+		while (size < 2 * n - 1) size *= 2;
+		plan->inner = &GetPlan(size);
+		plan->chirp.resize(n);
+		for (int64_t k = 0; k < n; k++) plan->chirp[k] = Root(k * k % (2 * n), 2 * n);
+
+		plan->filter.assign(size, Complex());
+		for (int64_t k = 0; k < n; k++)
+		{
+			plan->filter[k] = plan->chirp[k].conj();
+			if (k > 0) plan->filter[size - k] = plan->chirp[k].conj();
+		}
+		std::vector<Complex> scratch(plan->inner->work);
+		Execute(*plan->inner, plan->filter.data(), scratch.data());
+		float scale = 1.f / static_cast<float>(size);
+		for (auto& value : plan->filter) value = Complex(value.re * scale, value.im * scale);
+
+		plan->work = size + plan->inner->work;
+		return plan;
+	}
+
+	// made once per size and never released, so the references stay valid
+	static const FFTPlan& GetPlan(int64_t n)
+	{
+		static std::mutex mutex;
+		static std::unordered_map<int64_t, std::unique_ptr<FFTPlan>> plans;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = plans.find(n);
+			if (it != plans.end()) return *it->second;
+		}
+		// made without the lock, a Bluestein plan asks for another one
+		std::unique_ptr<FFTPlan> plan = MakePlan(n);
+		std::lock_guard<std::mutex> lock(mutex);
+		return *plans.emplace(n, std::move(plan)).first->second;
+	}
+
+
+	static void Conj(Complex* data, int64_t n) noexcept
+	{
+		for (int64_t i = 0; i < n; i++) data[i].im = -data[i].im;
+	}
+	static void ConjScale(Complex* data, int64_t n, float scale) noexcept
+	{
+		for (int64_t i = 0; i < n; i++) data[i] = Complex(data[i].re * scale, -data[i].im * scale);
+	}
+
+	// transform the rows of length n in place, the inverse as conj(FFT(conj(x))) / n
+	static void ComplexRows(Complex* data, int64_t rows, int64_t n, bool inverse)
+	{
+		const FFTPlan& plan = GetPlan(n);
+		ParallelFor(0, rows, [&](int64_t first, int64_t last) {
+			std::vector<Complex> work(plan.work);
+			for (int64_t r = first; r < last; r++)
+			{
+				Complex* row = data + r * n;
+				if (inverse) Conj(row, n);
+				Execute(plan, row, work.data());
+				if (inverse) ConjScale(row, n, 1.f / static_cast<float>(n));
+			}
+		}, std::max<int64_t>(1, fft_grain / n));
+	}
+
+	// the spectrum X of 2h reals from the FFT Z of their h pairs: with a = Z[k] and b = Z[h - k],
+	// X[k] = (a + conj(b)) / 2 - i w^k (a - conj(b)) / 2, and X[2h - k] = conj(X[k])
+	static inline Complex Merge(const Complex& a, const Complex& b, const Complex& w) noexcept
+	{
+		Complex even = Complex(0.5f * (a.re + b.re), 0.5f * (a.im - b.im));
+		Complex odd = Complex(0.5f * (a.im + b.im), -0.5f * (a.re - b.re));
+		return even + w * odd;
+	}
+
+	static void SplitReal(Complex* x, int64_t h, const Complex* w) noexcept
+	{
+		int64_t n = 2 * h;
+		// the pairs (k, h - k) are read before either is written
+		for (int64_t k = 0; k <= h / 2; k++)
+		{
+			int64_t j = h - k;
+			Complex a = x[k];
+			Complex b = x[j % h];
+			Complex xk = Merge(a, b, w[k]);
+			Complex xj = Merge(b, a, w[j]);
+			x[k] = xk;
+			x[j] = xj;
+			if (k > 0) x[n - k] = xk.conj();
+			if (k > 0 && j < h) x[n - j] = xj.conj();
+		}
+	}
+
+	// the full spectrum of real rows of length n
+	static void RealRows(const float* src, Complex* dst, int64_t rows, int64_t n)
+	{
+		if (n % 2 != 0)
+		{
+			ParallelFor(0, rows * n, [&](int64_t first, int64_t last) {
+				for (int64_t i = first; i < last; i++) dst[i] = Complex(src[i]);
+			}, fft_grain);
+			ComplexRows(dst, rows, n, false);
+			return;
+		}
+
+		int64_t h = n / 2;
+		const FFTPlan& plan = GetPlan(h);
+		const Complex* w = GetPlan(n).half.data();
+		ParallelFor(0, rows, [&](int64_t first, int64_t last) {
+			std::vector<Complex> work(plan.work);
+			for (int64_t r = first; r < last; r++)
+			{
+				Complex* row = dst + r * n;
+				// the reals as h Complex in the first half of the row
+				memcpy(reinterpret_cast<float*>(row), src + r * n, n * sizeof(float));
+				Execute(plan, row, work.data());
+				SplitReal(row, h, w);
+			}
+		}, std::max<int64_t>(1, fft_grain / n));
+	}
+
+	// transform the first cols columns of h x w matrices in place
+	static void Columns(Complex* data, int64_t batches, int64_t h, int64_t w, int64_t cols, bool inverse)
+	{
+		const FFTPlan& plan = GetPlan(h);
+		int64_t groups = (cols + fft_columns - 1) / fft_columns;
+		ParallelFor(0, batches * groups, [&](int64_t first, int64_t last) {
+			std::vector<Complex> buffer(fft_columns * h);
+			std::vector<Complex> work(plan.work);
+			for (int64_t t = first; t < last; t++)
+			{
+				Complex* base = data + t / groups * h * w;
+				int64_t c0 = t % groups * fft_columns;
+				int64_t c1 = std::min(cols, c0 + fft_columns);
+				for (int64_t r = 0; r < h; r++)
+				{
+					for (int64_t c = c0; c < c1; c++) buffer[(c - c0) * h + r] = base[r * w + c];
+				}
+				for (int64_t c = c0; c < c1; c++)
+				{
+					Complex* column = buffer.data() + (c - c0) * h;
+					if (inverse) Conj(column, h);
+					Execute(plan, column, work.data());
+					if (inverse) ConjScale(column, h, 1.f / static_cast<float>(h));
+				}
+				for (int64_t r = 0; r < h; r++)
+				{
+					for (int64_t c = c0; c < c1; c++) base[r * w + c] = buffer[(c - c0) * h + r];
+				}
+			}
+		}, std::max<int64_t>(1, fft_grain / (h * fft_columns)));
+	}
+
+	// the spectrum of a real matrix: X[r][c] = conj(X[-r][-c]) for the columns past w / 2
+	static void MirrorColumns(Complex* data, int64_t batches, int64_t h, int64_t w)
+	{
+		ParallelFor(0, batches * h, [&](int64_t first, int64_t last) {
+			for (int64_t t = first; t < last; t++)
+			{
+				Complex* base = data + t / h * h * w;
+				int64_t r = t % h;
+				const Complex* mirror = base + (h - r) % h * w;
+				Complex* row = base + r * w;
+				for (int64_t c = w / 2 + 1; c < w; c++) row[c] = mirror[w - c].conj();
+			}
+		}, std::max<int64_t>(1, fft_grain / w));
+	}
+
+
+	// a complex (D4, C2HW2) or real (D4, CHW) Tensor of at least dims dims, checked before its shape is read
+	static bool Transformable(const Tensor& tensor, size_t dims)
+	{
+		bool filled = !tensor.empty();
+		CHECK(filled) << "can not transform an empty Tensor";
+		if (!filled) return false;
+		bool typed = tensor.depth == Depth::D4 && (tensor.packing == Packing::C2HW2 || tensor.packing == Packing::CHW);
+		CHECK(typed) << "FFT works on complex (D4, C2HW2) or real (D4, CHW) Tensors";
+		if (!typed) return false;
+		bool enough = tensor.shape.size() >= dims;
+		CHECK(enough) << "the transform takes the last " << dims << " dims";
+		return enough;
+	}
+
+	static bool IsComplex(const Tensor& tensor)
+	{
+		return tensor.packing == Packing::C2HW2;
+	}
+
+	// a dense complex copy of tensor
+	static Tensor ComplexCopy(const Tensor& tensor, Allocator* allocator)
+	{
+		Tensor src = tensor.contiguous() ? tensor : tensor.Clone();
+		Tensor dst = Tensor(src.shape, Depth::D4, Packing::C2HW2, allocator);
+		size_t total = src.shape.total();
+		if (IsComplex(src))
+		{
+			memcpy(dst.data, src.data, total * sizeof(Complex));
+		}
+		else
+		{
+			const float* real = static_cast<const float*>(src.data);
+			Complex* data = static_cast<Complex*>(dst.data);
+			for (size_t i = 0; i < total; i++) data[i] = Complex(real[i]);
+		}
+		return dst;
+	}
+
+	static Tensor RealPart(const Tensor& tensor, Allocator* allocator)
+	{
+		Tensor dst = Tensor(tensor.shape, Depth::D4, Packing::CHW, allocator);
+		const Complex* src = static_cast<const Complex*>(tensor.data);
+		float* data = static_cast<float*>(dst.data);
+		for (int i = 0; i < tensor.shape.total(); i++) data[i] = src[i].re;
+		return dst;
+	}
+
+	Tensor FFT(const Tensor& tensor, Allocator* allocator)
+	{
+		if (!Transformable(tensor, 1)) return Tensor();
+		int64_t n = tensor.shape[-1];
+		int64_t rows = tensor.shape.total() / n;
+		if (IsComplex(tensor))
+		{
+			Tensor dst = ComplexCopy(tensor, allocator);
+			ComplexRows(static_cast<Complex*>(dst.data), rows, n, false);
+			return dst;
+		}
+
+		Tensor src = tensor.contiguous() ? tensor : tensor.Clone();
+		Tensor dst = Tensor(src.shape, Depth::D4, Packing::C2HW2, allocator);
+		RealRows(static_cast<const float*>(src.data), static_cast<Complex*>(dst.data), rows, n);
+		return dst;
+	}
+
+	Tensor IFFT(const Tensor& tensor, bool real_output, Allocator* allocator)
+	{
+		if (!Transformable(tensor, 1)) return Tensor();
+		int64_t n = tensor.shape[-1];
+		int64_t rows = tensor.shape.total() / n;
+		Tensor dst = ComplexCopy(tensor, allocator);
+		ComplexRows(static_cast<Complex*>(dst.data), rows, n, true);
+		return real_output ? RealPart(dst, allocator) : dst;
+	}
+
+	Tensor FFT2(const Tensor& tensor, Allocator* allocator)
+	{
+		if (!Transformable(tensor, 2)) return Tensor();
+		int64_t h = tensor.shape[-2];
+		int64_t w = tensor.shape[-1];
+		int64_t batches = tensor.shape.total() / (h * w);
+		if (IsComplex(tensor))
+		{
+			Tensor dst = ComplexCopy(tensor, allocator);
+			Complex* data = static_cast<Complex*>(dst.data);
+			ComplexRows(data, batches * h, w, false);
+			Columns(data, batches, h, w, w, false);
+			return dst;
+		}
+
+		Tensor src = tensor.contiguous() ? tensor : tensor.Clone();
+		Tensor dst = Tensor(src.shape, Depth::D4, Packing::C2HW2, allocator);
+		Complex* data = static_cast<Complex*>(dst.data);
+		RealRows(static_cast<const float*>(src.data), data, batches * h, w);
+		Columns(data, batches, h, w, w / 2 + 1, false);
+		MirrorColumns(data, batches, h, w);
+		return dst;
+	}
+
+	Tensor IFFT2(const Tensor& tensor, bool real_output, Allocator* allocator)
+	{
+		if (!Transformable(tensor, 2)) return Tensor();
+		int64_t h = tensor.shape[-2];
+		int64_t w = tensor.shape[-1];
+		int64_t batches = tensor.shape.total() / (h * w);
+		Tensor dst = ComplexCopy(tensor, allocator);
+		Complex* data = static_cast<Complex*>(dst.data);
+		ComplexRows(data, batches * h, w, true);
+		Columns(data, batches, h, w, w, true);
+		return real_output ? RealPart(dst, allocator) : dst;
+	}
+}
\ No newline at end of file
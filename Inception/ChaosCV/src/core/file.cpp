@@ -3,6 +3,7 @@
 
 #include <regex>
 #include <iostream>
+#include <utility>
 #include <algorithm>
 
 
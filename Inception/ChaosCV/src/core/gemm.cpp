@@ -0,0 +1,426 @@
+#include "core/gemm.hpp"
+#include "core/cpu.hpp"
+#include "core/strided.hpp"
+#include "core/allocator.hpp"
+
+#include <array>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#ifdef CHAOS_X86
+#include <immintrin.h>
+#endif
+
+namespace chaos
+{
+	// tile = alpha * op(A) panel (mr x kc) * op(B) panel (kc x nr) + beta * tile, both panels packed
+	// so every step of k reads mr and nr contiguous floats; mr, nr smaller than the kernel's are the edges
+	using MicroKernel = void(*)(int64_t kc, const float* pa, const float* pb, float* c, int64_t ldc, float alpha, float beta, int64_t mr, int64_t nr);
+
+	struct GemmKernel
+	{
+		MicroKernel kernel;
+		// the register tile
+		int64_t mr;
+		int64_t nr;
+		// a B micro-panel kc x nr stays in L1, an A block mc x kc in L2 and the B block kc x nc in L3
+		int64_t kc;
+		int64_t mc;
+		int64_t nc;
+	};
+
+	// products up to this many multiply-adds run on the calling thread
+	constexpr int64_t small_gemm = 1 << 18;
+
+	// merge a computed tile into C, only the mr x nr corner is valid
+	static void StoreTile(const float* tile, int64_t ld, float* c, int64_t ldc, float alpha, float beta, int64_t mr, int64_t nr) noexcept
+	{
+		for (int64_t i = 0; i < mr; i++)
+		{
+			float* dst = c + i * ldc;
+			const float* src = tile + i * ld;
+			if (beta == 0.f)
+			{
+				for (int64_t j = 0; j < nr; j++) dst[j] = alpha * src[j];
+			}
+			else
+			{
+				for (int64_t j = 0; j < nr; j++) dst[j] = alpha * src[j] + beta * dst[j];
+			}
+		}
+	}
+
+	template<int64_t MR, int64_t NR>
+	static void KernelScalar(int64_t kc, const float* pa, const float* pb, float* c, int64_t ldc, float alpha, float beta, int64_t mr, int64_t nr) noexcept
+	{
+		float acc[MR * NR] = {};
+		for (int64_t p = 0; p < kc; p++, pa += MR, pb += NR)
+		{
+			for (int64_t i = 0; i < MR; i++)
+			{
+				for (int64_t j = 0; j < NR; j++) acc[i * NR + j] += pa[i] * pb[j];
+			}
+		}
+		StoreTile(acc, NR, c, ldc, alpha, beta, mr, nr);
+	}
+
+#ifdef CHAOS_X86
+	// 6 x 16: 12 accumulators, 2 loads of B and 6 broadcasts of A per step of k
+	CHAOS_TARGET("avx2,fma") static void KernelAVX2(int64_t kc, const float* pa, const float* pb, float* c, int64_t ldc, float alpha, float beta, int64_t mr, int64_t nr) noexcept
+	{
+		constexpr int64_t MR = 6;
+		constexpr int64_t NR = 16;
+		__m256 acc[MR][2];
+		for (int64_t i = 0; i < MR; i++) acc[i][0] = acc[i][1] = _mm256_setzero_ps();
+
+		for (int64_t p = 0; p < kc; p++, pa += MR, pb += NR)
+		{
+			__m256 b0 = _mm256_loadu_ps(pb);
+			__m256 b1 = _mm256_loadu_ps(pb + 8);
+			for (int64_t i = 0; i < MR; i++)
+			{
+				__m256 a = _mm256_broadcast_ss(pa + i);
+				acc[i][0] = _mm256_fmadd_ps(a, b0, acc[i][0]);
+				acc[i][1] = _mm256_fmadd_ps(a, b1, acc[i][1]);
+			}
+		}
+
+		__m256 va = _mm256_set1_ps(alpha);
+		__m256 vb = _mm256_set1_ps(beta);
+		if (mr == MR && nr == NR)
+		{
+			for (int64_t i = 0; i < MR; i++)
+			{
+				float* dst = c + i * ldc;
+				for (int64_t j = 0; j < 2; j++)
+				{
+					__m256 val = _mm256_mul_ps(va, acc[i][j]);
+					if (beta != 0.f) val = _mm256_fmadd_ps(vb, _mm256_loadu_ps(dst + j * 8), val);
+					_mm256_storeu_ps(dst + j * 8, val);
+				}
+			}
+			return;
+		}
+
+		alignas(32) float tile[MR * NR];
+		for (int64_t i = 0; i < MR; i++)
+		{
+			_mm256_store_ps(tile + i * NR, acc[i][0]);
+			_mm256_store_ps(tile + i * NR + 8, acc[i][1]);
+		}
+		StoreTile(tile, NR, c, ldc, alpha, beta, mr, nr);
+	}
+
+	// 12 x 32: 24 of the 32 registers accumulate, 2 hold B and 1 the broadcast of A
+	CHAOS_TARGET("avx512f") static void KernelAVX512(int64_t kc, const float* pa, const float* pb, float* c, int64_t ldc, float alpha, float beta, int64_t mr, int64_t nr) noexcept
+	{
+		constexpr int64_t MR = 12;
+		constexpr int64_t NR = 32;
+		__m512 acc[MR][2];
+		for (int64_t i = 0; i < MR; i++) acc[i][0] = acc[i][1] = _mm512_setzero_ps();
+
+		for (int64_t p = 0; p < kc; p++, pa += MR, pb += NR)
+		{
+			__m512 b0 = _mm512_loadu_ps(pb);
+			__m512 b1 = _mm512_loadu_ps(pb + 16);
+			for (int64_t i = 0; i < MR; i++)
+			{
+				__m512 a = _mm512_set1_ps(pa[i]);
+				acc[i][0] = _mm512_fmadd_ps(a, b0, acc[i][0]);
+				acc[i][1] = _mm512_fmadd_ps(a, b1, acc[i][1]);
+			}
+		}
+
+		__m512 va = _mm512_set1_ps(alpha);
+		__m512 vb = _mm512_set1_ps(beta);
+		if (mr == MR && nr == NR)
+		{
+			for (int64_t i = 0; i < MR; i++)
+			{
+				float* dst = c + i * ldc;
+				for (int64_t j = 0; j < 2; j++)
+				{
+					__m512 val = _mm512_mul_ps(va, acc[i][j]);
+					if (beta != 0.f) val = _mm512_fmadd_ps(vb, _mm512_loadu_ps(dst + j * 16), val);
+					_mm512_storeu_ps(dst + j * 16, val);
+				}
+			}
+			return;
+		}
+
+		alignas(64) float tile[MR * NR];
+		for (int64_t i = 0; i < MR; i++)
+		{
+			_mm512_store_ps(tile + i * NR, acc[i][0]);
+			_mm512_store_ps(tile + i * NR + 16, acc[i][1]);
+		}
+		StoreTile(tile, NR, c, ldc, alpha, beta, mr, nr);
+	}
+#endif
+
+	static const GemmKernel& SelectKernel()
+	{
+		static const GemmKernel kernel = []() -> GemmKernel {
+#ifdef CHAOS_X86
+			if (CpuSupportAVX512F()) return { &KernelAVX512, 12, 32, 256, 144, 2048 };
+			if (CpuSupportAVX2() && CpuSupportFMA()) return { &KernelAVX2, 6, 16, 256, 96, 2048 };
+#endif
+			return { &KernelScalar<4, 8>, 4, 8, 256, 64, 1024 };
+		}();
+		return kernel;
+	}
+
+	// rows [i0, i0 + rows) of op(A) and k in [p0, p0 + kb) as one panel, padded with zeros to mr rows
+	static void PackA(bool trans, const float* a, int64_t lda, int64_t i0, int64_t p0, int64_t rows, int64_t kb, int64_t mr, float* dst) noexcept
+	{
+		if (trans) // op(A)(i, p) = a[p, i], each step of k is contiguous
+		{
+			for (int64_t p = 0; p < kb; p++, dst += mr)
+			{
+				memcpy(dst, a + (p0 + p) * lda + i0, rows * sizeof(float));
+				std::fill(dst + rows, dst + mr, 0.f);
+			}
+			return;
+		}
+
+		for (int64_t i = 0; i < rows; i++)
+		{
+			const float* src = a + (i0 + i) * lda + p0;
+			for (int64_t p = 0; p < kb; p++) dst[p * mr + i] = src[p];
+		}
+		for (int64_t i = rows; i < mr; i++)
+		{
+			for (int64_t p = 0; p < kb; p++) dst[p * mr + i] = 0.f;
+		}
+	}
+
+	// k in [p0, p0 + kb) and columns [j0, j0 + cols) of op(B) as one panel, padded with zeros to nr columns
+	static void PackB(bool trans, const float* b, int64_t ldb, int64_t p0, int64_t j0, int64_t kb, int64_t cols, int64_t nr, float* dst) noexcept
+	{
+		if (not trans) // op(B)(p, j) = b[p, j], each step of k is contiguous
+		{
+			for (int64_t p = 0; p < kb; p++, dst += nr)
+			{
+				memcpy(dst, b + (p0 + p) * ldb + j0, cols * sizeof(float));
+				std::fill(dst + cols, dst + nr, 0.f);
+			}
+			return;
+		}
+
+		for (int64_t j = 0; j < cols; j++)
+		{
+			const float* src = b + (j0 + j) * ldb + p0;
+			for (int64_t p = 0; p < kb; p++) dst[p * nr + j] = src[p];
+		}
+		for (int64_t j = cols; j < nr; j++)
+		{
+			for (int64_t p = 0; p < kb; p++) dst[p * nr + j] = 0.f;
+		}
+	}
+
+	// C = beta * C, the whole product when k or alpha is 0
+	static void Scale(float* c, int64_t m, int64_t n, int64_t ldc, float beta) noexcept
+	{
+		for (int64_t i = 0; i < m; i++)
+		{
+			float* row = c + i * ldc;
+			if (beta == 0.f) std::fill(row, row + n, 0.f);
+			else for (int64_t j = 0; j < n; j++) row[j] *= beta;
+		}
+	}
+
+	struct PackBuffer
+	{
+		explicit PackBuffer(size_t size) : data(static_cast<float*>(FastMalloc(size * sizeof(float)))) {}
+		~PackBuffer() { FastFree(data); }
+
+		PackBuffer(const PackBuffer&) = delete;
+		PackBuffer& operator=(const PackBuffer&) = delete;
+
+		float* data;
+	};
+
+	void Gemm(bool trans_a, bool trans_b, int64_t m, int64_t n, int64_t k, float alpha,
+		const float* a, int64_t lda, const float* b, int64_t ldb, float beta, float* c, int64_t ldc,
+		int num_threads, ThreadPool* pool)
+	{
+		if (m <= 0 || n <= 0) return;
+		if (k <= 0 || alpha == 0.f)
+		{
+			Scale(c, m, n, ldc, beta);
+			return;
+		}
+
+		const GemmKernel& gk = SelectKernel();
+		if (m * n * k <= small_gemm) num_threads = 1;
+		int threads = num_threads > 0 ? num_threads : (pool ? pool : ThreadPool::Global())->num_threads();
+
+		int64_t mr = gk.mr;
+		int64_t nr = gk.nr;
+		int64_t kc = std::min(gk.kc, k);
+		int64_t nc = std::min(gk.nc, (n + nr - 1) / nr * nr);
+		int64_t panels_m = (m + mr - 1) / mr;
+
+		// all of op(A) is packed for each block of k, each thread then keeps its mc rows in L2
+		PackBuffer packed_a(panels_m * mr * kc);
+		PackBuffer packed_b(nc * kc);
+		float* pa = packed_a.data;
+		float* pb = packed_b.data;
+
+		for (int64_t jc = 0; jc < n; jc += nc)
+		{
+			int64_t nb = std::min(nc, n - jc);
+			int64_t panels_n = (nb + nr - 1) / nr;
+			for (int64_t pc = 0; pc < k; pc += kc)
+			{
+				int64_t kb = std::min(kc, k - pc);
+				// the first block of k applies beta, the others add to it
+				float beta_pc = pc == 0 ? beta : 1.f;
+
+				ParallelFor(0, panels_n, [&](int64_t first, int64_t last) {
+					for (int64_t j = first; j < last; j++)
+					{
+						PackB(trans_b, b, ldb, pc, jc + j * nr, kb, std::min(nr, nb - j * nr), nr, pb + j * nr * kb);
+					}
+				}, 4, threads, pool);
+				ParallelFor(0, panels_m, [&](int64_t first, int64_t last) {
+					for (int64_t i = first; i < last; i++)
+					{
+						PackA(trans_a, a, lda, i * mr, pc, std::min(mr, m - i * mr), kb, mr, pa + i * mr * kb);
+					}
+				}, 4, threads, pool);
+
+				// mc rows by all the columns of the block, the columns are split too when that is not enough tiles
+				int64_t tile_m = std::max<int64_t>(gk.mc / mr, 1);
+				int64_t tile_n = panels_n;
+				int64_t blocks_m = (panels_m + tile_m - 1) / tile_m;
+				while (tile_n > 1 && blocks_m * ((panels_n + tile_n - 1) / tile_n) < 2 * threads) tile_n = (tile_n + 1) / 2;
+
+				ParallelFor2D(panels_m, panels_n, tile_m, tile_n, [&](int64_t i0, int64_t i1, int64_t j0, int64_t j1) {
+					// a B micro-panel is reused over the rows from L1 while the A block streams from L2
+					for (int64_t j = j0; j < j1; j++)
+					{
+						int64_t col = jc + j * nr;
+						const float* panel_b = pb + j * nr * kb;
+						for (int64_t i = i0; i < i1; i++)
+						{
+							int64_t row = i * mr;
+							gk.kernel(kb, pa + i * mr * kb, panel_b, c + row * ldc + col, ldc, alpha, beta_pc,
+								std::min(mr, m - row), std::min(nr, n - col));
+						}
+					}
+				}, threads, pool);
+			}
+		}
+	}
+
+
+	// the shape of a x b, the leading dims broadcast
+	static Shape ProductShape(const Tensor& a, const Tensor& b, bool trans_a, bool trans_b)
+	{
+		CHECK_GE(a.shape.size(), 2) << "a should be a matrix or a batch of matrices";
+		CHECK_GE(b.shape.size(), 2) << "b should be a matrix or a batch of matrices";
+		int m = trans_a ? a.shape[-1] : a.shape[-2];
+		int ka = trans_a ? a.shape[-2] : a.shape[-1];
+		int kb = trans_b ? b.shape[-1] : b.shape[-2];
+		int n = trans_b ? b.shape[-2] : b.shape[-1];
+		CHECK_EQ(ka, kb) << "can not multiply " << a.shape << " by " << b.shape;
+
+		size_t dims = std::max(a.shape.size(), b.shape.size());
+		Shape shape = Array<int>(dims);
+		for (size_t d = 3; d <= dims; d++)
+		{
+			int da = d <= a.shape.size() ? a.shape[-static_cast<int>(d)] : 1;
+			int db = d <= b.shape.size() ? b.shape[-static_cast<int>(d)] : 1;
+			CHECK(da == db || da == 1 || db == 1) << "can not broadcast the batches of " << a.shape << " and " << b.shape;
+			shape[-static_cast<int>(d)] = std::max(da, db);
+		}
+		shape[-2] = m;
+		shape[-1] = n;
+		return shape;
+	}
+
+	// the steps of the batch dims of tensor in a product of dims dims, 0 for the broadcast ones
+	static void BatchSteps(const Tensor& tensor, size_t dims, int* steps)
+	{
+		size_t own = tensor.shape.size() - 2;
+		size_t pad = dims - own;
+		for (size_t d = 0; d < dims; d++)
+		{
+			steps[d] = d < pad || tensor.shape[d - pad] == 1 ? 0 : tensor.steps[d - pad];
+		}
+	}
+
+	static const float* MatrixData(const Tensor& tensor)
+	{
+		CHECK(tensor.depth == Depth::D4 && tensor.packing == Packing::CHW) << "Matmul works on float CHW Tensors";
+		return static_cast<const float*>(tensor.data);
+	}
+
+	void Matmul(const Tensor& a, const Tensor& b, Tensor& c, float alpha, float beta, bool trans_a, bool trans_b)
+	{
+		Shape shape = ProductShape(a, b, trans_a, trans_b);
+		CHECK_EQ(c.shape, shape) << "expect c with the shape of the product";
+		CHECK_EQ(c.steps[-1], 1) << "the rows of c should be contiguous";
+		float* cdata = const_cast<float*>(MatrixData(c));
+
+		// a strided last dim is made contiguous, strided rows are fine
+		Tensor lhs = a.steps[-1] == 1 ? a : a.Clone();
+		Tensor rhs = b.steps[-1] == 1 ? b : b.Clone();
+		const float* adata = MatrixData(lhs);
+		const float* bdata = MatrixData(rhs);
+
+		int64_t m = shape[-2];
+		int64_t n = shape[-1];
+		int64_t k = trans_a ? lhs.shape[-2] : lhs.shape[-1];
+		int64_t lda = lhs.steps[-2];
+		int64_t ldb = rhs.steps[-2];
+		int64_t ldc = c.steps[-2];
+
+		size_t dims = shape.size() - 2;
+		if (dims == 0)
+		{
+			Gemm(trans_a, trans_b, m, n, k, alpha, adata, lda, bdata, ldb, beta, cdata, ldc);
+			return;
+		}
+
+		// the offsets of every batch, in c, a and b
+		int steps[3][StridedLoop<3>::max_dims];
+		BatchSteps(c, dims, steps[0]);
+		BatchSteps(lhs, dims, steps[1]);
+		BatchSteps(rhs, dims, steps[2]);
+		Shape batch = Array<int>(dims);
+		for (size_t d = 0; d < dims; d++) batch[d] = shape[d];
+
+		StridedLoop<3> loop(batch, { steps[0], steps[1], steps[2] });
+		std::vector<std::array<int64_t, 3>> offsets;
+		offsets.reserve(loop.rows() * loop.cols());
+		loop.ForEachRow(0, loop.rows(), [&](const int64_t* offset) {
+			for (int64_t j = 0; j < loop.cols(); j++)
+			{
+				offsets.push_back({ offset[0] + j * loop.step(0), offset[1] + j * loop.step(1), offset[2] + j * loop.step(2) });
+			}
+		});
+
+		auto run = [&](int64_t first, int64_t last, int num_threads) {
+			for (int64_t t = first; t < last; t++)
+			{
+				const auto& offset = offsets[t];
+				Gemm(trans_a, trans_b, m, n, k, alpha, adata + offset[1], lda, bdata + offset[2], ldb, beta, cdata + offset[0], ldc, num_threads);
+			}
+		};
+
+		// small matrices are spread by batch, large ones keep every thread on one product
+		int64_t batches = static_cast<int64_t>(offsets.size());
+		if (m * n * k <= small_gemm) ParallelFor(0, batches, [&](int64_t first, int64_t last) { run(first, last, 1); });
+		else run(0, batches, 0);
+	}
+
+	Tensor Matmul(const Tensor& a, const Tensor& b, bool trans_a, bool trans_b, Allocator* allocator)
+	{
+		Tensor c = Tensor(ProductShape(a, b, trans_a, trans_b), Depth::D4, Packing::CHW, allocator);
+		Matmul(a, b, c, 1.f, 0.f, trans_a, trans_b);
+		return c;
+	}
+}
\ No newline at end of file
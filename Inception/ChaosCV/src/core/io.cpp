@@ -0,0 +1,308 @@
+#include "core/io.hpp"
+
+#include <vector>
+#include <cstdint>
+
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
+
+namespace chaos
+{
+	constexpr size_t container_alignment = 64;
+	constexpr uint32_t container_version = 1;
+
+	struct ContainerHeader
+	{
+		char magic[8] = { 'C', 'H', 'A', 'O', 'S', 'T', 'N', 'S' };
+		uint32_t version = container_version;
+		uint8_t reserved[52] = {};
+	};
+	static_assert(sizeof(ContainerHeader) == container_alignment);
+
+	// followed by int32 shape[dims], int32 steps[dims] and the padding to 64 bytes
+	struct RecordHeader
+	{
+		char magic[4] = { 'T', 'N', 'S', 'R' };
+		uint32_t dims = 0;
+		uint32_t depth = 0;
+		uint32_t packing = 0;
+		uint64_t header = 0; // bytes of the record header, including shape, steps and padding
+		uint64_t payload = 0; // bytes of the payload, without padding
+		uint8_t reserved[32] = {};
+	};
+	static_assert(sizeof(RecordHeader) == container_alignment);
+
+	// more dims than any loop of the library takes
+	constexpr uint32_t max_record_dims = 32;
+
+	static bool ValidDepth(uint32_t depth) noexcept
+	{
+		return depth == 1 || depth == 2 || depth == 4 || depth == 8;
+	}
+
+	static bool ValidPacking(uint32_t packing) noexcept
+	{
+		return packing == 1 || packing == 2 || packing == 3 || packing == 4 || packing == 8;
+	}
+
+	// positive sizes, each step past the rows below it, and a payload of exactly shape[0] * steps[0] elements
+	static bool ValidLayout(const Shape& shape, const Steps& steps, uint64_t esize, uint64_t payload) noexcept
+	{
+		int dims = static_cast<int>(shape.size());
+		for (int i = 0; i < dims; i++)
+		{
+			if (shape[i] <= 0 || steps[i] <= 0) return false;
+			if (i + 1 < dims && static_cast<int64_t>(steps[i]) < static_cast<int64_t>(steps[i + 1]) * shape[i + 1]) return false;
+		}
+		uint64_t elements = static_cast<uint64_t>(shape[0]) * static_cast<uint64_t>(steps[0]);
+		return payload % esize == 0 && payload / esize == elements;
+	}
+
+	static bool WritePadding(FILE* fp, size_t bytes)
+	{
+		static const uchar zeros[container_alignment] = {};
+		size_t pad = AlignSize(bytes, container_alignment) - bytes;
+		return pad == 0 || fwrite(zeros, 1, pad, fp) == pad;
+	}
+
+	TensorWriter::TensorWriter(const File& file, bool append)
+	{
+		Open(file, append);
+	}
+	TensorWriter::~TensorWriter()
+	{
+		Close();
+	}
+
+	bool TensorWriter::Open(const File& file, bool append)
+	{
+		Close();
+
+		fp = fopen(file.data(), append ? "ab" : "wb");
+		if (nullptr == fp)
+		{
+			LOG(ERROR) << "can not open " << file;
+			return false;
+		}
+
+		fseek64(fp, 0, SEEK_END);
+		if (ftell64(fp) == 0)
+		{
+			ContainerHeader header;
+			fwrite(&header, sizeof(header), 1, fp);
+		}
+		return true;
+	}
+
+	void TensorWriter::Close()
+	{
+		if (fp) fclose(fp);
+		fp = nullptr;
+	}
+
+	bool TensorWriter::Write(const Tensor& tensor)
+	{
+		DCHECK(opened()) << "the writer is not opened";
+		DCHECK(not tensor.empty()) << "can not write an empty tensor";
+
+		const Shape& shape = tensor.shape;
+		const Steps& steps = tensor.steps;
+		size_t dims = shape.size();
+		size_t esize = 1 * tensor.depth * tensor.packing;
+
+		RecordHeader record;
+		record.dims = static_cast<uint32_t>(dims);
+		record.depth = static_cast<uint32_t>(tensor.depth);
+		record.packing = static_cast<uint32_t>(tensor.packing);
+		record.header = AlignSize(sizeof(RecordHeader) + 2 * dims * sizeof(int32_t), container_alignment);
+		record.payload = shape.total() * esize;
+
+		Steps dense = shape.steps();
+		bool ok = fwrite(&record, sizeof(record), 1, fp) == 1;
+		ok = ok && fwrite(shape.data(), sizeof(int32_t), dims, fp) == dims;
+		ok = ok && fwrite(dense.data(), sizeof(int32_t), dims, fp) == dims;
+		ok = ok && WritePadding(fp, sizeof(RecordHeader) + 2 * dims * sizeof(int32_t));
+
+		if (steps == dense)
+		{
+			ok = ok && fwrite(tensor.data, 1, record.payload, fp) == record.payload;
+		}
+		else
+		{
+			// compact row by row through a staging buffer, no full copy of the tensor
+			int w = shape[-1];
+			size_t estep = steps[-1];
+			size_t rows = shape.total() / w;
+			size_t row_bytes = w * esize;
+			std::vector<uchar> buffer(std::max<size_t>(row_bytes, 1 << 20));
+			size_t used = 0;
+			for (size_t r = 0; ok && r < rows; r++)
+			{
+				size_t offset = 0;
+				size_t idx = r;
+				for (int d = 2; d <= static_cast<int>(dims); d++)
+				{
+					offset += idx % shape[-d] * steps[-d];
+					idx /= shape[-d];
+				}
+				const uchar* src = static_cast<const uchar*>(tensor.data) + offset * esize;
+
+				if (used + row_bytes > buffer.size())
+				{
+					ok = fwrite(buffer.data(), 1, used, fp) == used;
+					used = 0;
+				}
+				if (estep == 1)
+				{
+					memcpy(buffer.data() + used, src, row_bytes);
+				}
+				else
+				{
+					for (int i = 0; i < w; i++) memcpy(buffer.data() + used + i * esize, src + i * estep * esize, esize);
+				}
+				used += row_bytes;
+			}
+			ok = ok && fwrite(buffer.data(), 1, used, fp) == used;
+		}
+		ok = ok && WritePadding(fp, record.payload);
+
+		LOG_IF(ERROR, not ok) << "failed to write the tensor " << shape;
+		return ok;
+	}
+
+
+	TensorReader::TensorReader(const File& file)
+	{
+		Open(file);
+	}
+	TensorReader::~TensorReader()
+	{
+		Close();
+	}
+
+	bool TensorReader::Open(const File& file)
+	{
+		Close();
+
+		fp = fopen(file.data(), "rb");
+		if (nullptr == fp)
+		{
+			LOG(ERROR) << "can not open " << file;
+			return false;
+		}
+
+		ContainerHeader header;
+		ContainerHeader expected;
+		if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0)
+		{
+			LOG(ERROR) << file << " is not a tensor container";
+			Close();
+			return false;
+		}
+		if (header.version > container_version)
+		{
+			LOG(ERROR) << file << " has version " << header.version << ", expect " << container_version << " or lower";
+			Close();
+			return false;
+		}
+
+		TensorReader::file = file;
+		return true;
+	}
+
+	void TensorReader::Close()
+	{
+		if (fp) fclose(fp);
+		fp = nullptr;
+	}
+
+	bool TensorReader::Next(Shape& shape, Steps& steps, Depth& depth, Packing& packing, size_t& payload)
+	{
+		DCHECK(opened()) << "the reader is not opened";
+
+		RecordHeader record;
+		RecordHeader expected;
+		if (fread(&record, sizeof(record), 1, fp) != 1) return false; // end of file
+		if (memcmp(record.magic, expected.magic, sizeof(record.magic)) != 0 || 0 == record.dims)
+		{
+			LOG(ERROR) << file << " has a corrupted record";
+			return false;
+		}
+
+		// the fields are checked before they size anything, a corrupted file must not overflow a buffer
+		size_t fields = sizeof(RecordHeader) + 2 * static_cast<size_t>(record.dims) * sizeof(int32_t);
+		bool valid = record.dims <= max_record_dims and record.header >= fields and ValidDepth(record.depth) and ValidPacking(record.packing);
+		if (not valid)
+		{
+			LOG(ERROR) << file << " has a corrupted record header";
+			return false;
+		}
+
+		shape = Array<int>(record.dims);
+		steps = Array<int>(record.dims);
+		bool ok = fread(shape.data(), sizeof(int32_t), record.dims, fp) == record.dims;
+		ok = ok && fread(steps.data(), sizeof(int32_t), record.dims, fp) == record.dims;
+		ok = ok && fseek64(fp, record.header - fields, SEEK_CUR) == 0;
+		if (not ok)
+		{
+			LOG(ERROR) << file << " has a truncated record";
+			return false;
+		}
+
+		depth = static_cast<Depth>(record.depth);
+		packing = static_cast<Packing>(record.packing);
+		payload = record.payload;
+		if (not ValidLayout(shape, steps, 1ull * depth * packing, payload))
+		{
+			LOG(ERROR) << file << " has a record whose payload of " << payload << " bytes does not match its shape " << shape;
+			return false;
+		}
+		return true;
+	}
+
+	bool TensorReader::Read(Tensor& tensor, Allocator* allocator)
+	{
+		Shape shape;
+		Steps steps;
+		Depth depth;
+		Packing packing;
+		size_t payload;
+		if (not Next(shape, steps, depth, packing, payload)) return false;
+
+		tensor.Create(shape, steps, depth, packing, allocator);
+		bool ok = fread(tensor.data, 1, payload, fp) == payload;
+		ok = ok && fseek64(fp, AlignSize(payload, container_alignment) - payload, SEEK_CUR) == 0;
+		LOG_IF(ERROR, not ok) << file << " has a truncated payload";
+		return ok;
+	}
+
+	bool TensorReader::Map(Tensor& tensor)
+	{
+		Shape shape;
+		Steps steps;
+		Depth depth;
+		Packing packing;
+		size_t payload;
+		if (not Next(shape, steps, depth, packing, payload)) return false;
+
+		size_t offset = static_cast<size_t>(ftell64(fp));
+		tensor = Tensor::Map(file, shape, depth, packing, offset, steps);
+		return not tensor.empty() && fseek64(fp, AlignSize(payload, container_alignment), SEEK_CUR) == 0;
+	}
+
+	bool TensorReader::Skip()
+	{
+		Shape shape;
+		Steps steps;
+		Depth depth;
+		Packing packing;
+		size_t payload;
+		if (not Next(shape, steps, depth, packing, payload)) return false;
+		return fseek64(fp, AlignSize(payload, container_alignment), SEEK_CUR) == 0;
+	}
+}
\ No newline at end of file
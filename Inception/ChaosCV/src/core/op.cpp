@@ -0,0 +1,307 @@
+#include "core/op.hpp"
+#include "core/cpu.hpp"
+
+#include <array>
+#include <algorithm>
+
+#ifdef CHAOS_X86
+#include <immintrin.h>
+#endif
+
+namespace chaos
+{
+	template<BinaryKind Kind, class Type>
+	static inline Type Compute(const Type& lhs, const Type& rhs)
+	{
+		if constexpr (Kind == BinaryKind::Add) return lhs + rhs;
+		else if constexpr (Kind == BinaryKind::Sub) return lhs - rhs;
+		else if constexpr (Kind == BinaryKind::Mul) return lhs * rhs;
+		else return lhs / rhs;
+	}
+
+	template<class Type, BinaryKind Kind, Broadcast Scalar>
+	static void ScalarLoop(const Type* lhs, const Type* rhs, Type* dst, size_t n)
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			dst[i] = Compute<Kind>(Scalar == Broadcast::Lhs ? lhs[0] : lhs[i], Scalar == Broadcast::Rhs ? rhs[0] : rhs[i]);
+		}
+	}
+
+#ifdef CHAOS_X86
+	// one struct per ISA and element type, width is in elements, Complex takes two floats
+
+	template<class Type> struct Sse;
+	template<> struct Sse<float>
+	{
+		using reg = __m128;
+		static constexpr size_t width = 4;
+		CHAOS_TARGET("sse4.1") static reg Load(const float* p) { return _mm_loadu_ps(p); }
+		CHAOS_TARGET("sse4.1") static void Store(float* p, reg v) { _mm_storeu_ps(p, v); }
+		CHAOS_TARGET("sse4.1") static reg Add(reg a, reg b) { return _mm_add_ps(a, b); }
+		CHAOS_TARGET("sse4.1") static reg Sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+		CHAOS_TARGET("sse4.1") static reg Mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+		CHAOS_TARGET("sse4.1") static reg Div(reg a, reg b) { return _mm_div_ps(a, b); }
+	};
+	template<> struct Sse<int>
+	{
+		using reg = __m128i;
+		static constexpr size_t width = 4;
+		CHAOS_TARGET("sse4.1") static reg Load(const int* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+		CHAOS_TARGET("sse4.1") static void Store(int* p, reg v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+		CHAOS_TARGET("sse4.1") static reg Add(reg a, reg b) { return _mm_add_epi32(a, b); }
+		CHAOS_TARGET("sse4.1") static reg Sub(reg a, reg b) { return _mm_sub_epi32(a, b); }
+		CHAOS_TARGET("sse4.1") static reg Mul(reg a, reg b) { return _mm_mullo_epi32(a, b); }
+		// there is no integer division, the quotient of two int32 in double truncates to the exact result
+		CHAOS_TARGET("sse4.1") static reg Div(reg a, reg b)
+		{
+			__m128i lo = _mm_cvttpd_epi32(_mm_div_pd(_mm_cvtepi32_pd(a), _mm_cvtepi32_pd(b)));
+			__m128i hi = _mm_cvttpd_epi32(_mm_div_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(a, a)), _mm_cvtepi32_pd(_mm_unpackhi_epi64(b, b))));
+			return _mm_unpacklo_epi64(lo, hi);
+		}
+	};
+	template<> struct Sse<Complex>
+	{
+		using reg = __m128;
+		static constexpr size_t width = 2;
+		CHAOS_TARGET("sse4.1") static reg Load(const Complex* p) { return _mm_loadu_ps(reinterpret_cast<const float*>(p)); }
+		CHAOS_TARGET("sse4.1") static void Store(Complex* p, reg v) { _mm_storeu_ps(reinterpret_cast<float*>(p), v); }
+		CHAOS_TARGET("sse4.1") static reg Add(reg a, reg b) { return _mm_add_ps(a, b); }
+		CHAOS_TARGET("sse4.1") static reg Sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+		// [ac - bd, bc + ad]
+		CHAOS_TARGET("sse4.1") static reg Mul(reg a, reg b)
+		{
+			reg swap = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+			return _mm_addsub_ps(_mm_mul_ps(a, _mm_moveldup_ps(b)), _mm_mul_ps(swap, _mm_movehdup_ps(b)));
+		}
+		// [ac + bd, bc - ad] / (c^2 + d^2)
+		CHAOS_TARGET("sse4.1") static reg Div(reg a, reg b)
+		{
+			reg swap = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+			reg cross = _mm_xor_ps(_mm_mul_ps(swap, _mm_movehdup_ps(b)), _mm_set1_ps(-0.f));
+			reg num = _mm_addsub_ps(_mm_mul_ps(a, _mm_moveldup_ps(b)), cross);
+			reg norm = _mm_mul_ps(b, b);
+			return _mm_div_ps(num, _mm_add_ps(norm, _mm_shuffle_ps(norm, norm, _MM_SHUFFLE(2, 3, 0, 1))));
+		}
+	};
+
+	template<class Type> struct Avx2;
+	template<> struct Avx2<float>
+	{
+		using reg = __m256;
+		static constexpr size_t width = 8;
+		CHAOS_TARGET("avx2,fma") static reg Load(const float* p) { return _mm256_loadu_ps(p); }
+		CHAOS_TARGET("avx2,fma") static void Store(float* p, reg v) { _mm256_storeu_ps(p, v); }
+		CHAOS_TARGET("avx2,fma") static reg Add(reg a, reg b) { return _mm256_add_ps(a, b); }
+		CHAOS_TARGET("avx2,fma") static reg Sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+		CHAOS_TARGET("avx2,fma") static reg Mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+		CHAOS_TARGET("avx2,fma") static reg Div(reg a, reg b) { return _mm256_div_ps(a, b); }
+	};
+	template<> struct Avx2<int>
+	{
+		using reg = __m256i;
+		static constexpr size_t width = 8;
+		CHAOS_TARGET("avx2,fma") static reg Load(const int* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+		CHAOS_TARGET("avx2,fma") static void Store(int* p, reg v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+		CHAOS_TARGET("avx2,fma") static reg Add(reg a, reg b) { return _mm256_add_epi32(a, b); }
+		CHAOS_TARGET("avx2,fma") static reg Sub(reg a, reg b) { return _mm256_sub_epi32(a, b); }
+		CHAOS_TARGET("avx2,fma") static reg Mul(reg a, reg b) { return _mm256_mullo_epi32(a, b); }
+		CHAOS_TARGET("avx2,fma") static reg Div(reg a, reg b)
+		{
+			__m128i lo = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(a)), _mm256_cvtepi32_pd(_mm256_castsi256_si128(b))));
+			__m128i hi = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(a, 1)), _mm256_cvtepi32_pd(_mm256_extracti128_si256(b, 1))));
+			return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		}
+	};
+	template<> struct Avx2<Complex>
+	{
+		using reg = __m256;
+		static constexpr size_t width = 4;
+		CHAOS_TARGET("avx2,fma") static reg Load(const Complex* p) { return _mm256_loadu_ps(reinterpret_cast<const float*>(p)); }
+		CHAOS_TARGET("avx2,fma") static void Store(Complex* p, reg v) { _mm256_storeu_ps(reinterpret_cast<float*>(p), v); }
+		CHAOS_TARGET("avx2,fma") static reg Add(reg a, reg b) { return _mm256_add_ps(a, b); }
+		CHAOS_TARGET("avx2,fma") static reg Sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+		CHAOS_TARGET("avx2,fma") static reg Mul(reg a, reg b)
+		{
+			reg swap = _mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1));
+			return _mm256_fmaddsub_ps(a, _mm256_moveldup_ps(b), _mm256_mul_ps(swap, _mm256_movehdup_ps(b)));
+		}
+		CHAOS_TARGET("avx2,fma") static reg Div(reg a, reg b)
+		{
+			reg swap = _mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1));
+			reg num = _mm256_fmsubadd_ps(a, _mm256_moveldup_ps(b), _mm256_mul_ps(swap, _mm256_movehdup_ps(b)));
+			reg norm = _mm256_mul_ps(b, b);
+			return _mm256_div_ps(num, _mm256_add_ps(norm, _mm256_permute_ps(norm, _MM_SHUFFLE(2, 3, 0, 1))));
+		}
+	};
+
+	template<class Type> struct Avx512;
+	template<> struct Avx512<float>
+	{
+		using reg = __m512;
+		static constexpr size_t width = 16;
+		CHAOS_TARGET("avx512f") static reg Load(const float* p) { return _mm512_loadu_ps(p); }
+		CHAOS_TARGET("avx512f") static void Store(float* p, reg v) { _mm512_storeu_ps(p, v); }
+		CHAOS_TARGET("avx512f") static reg Add(reg a, reg b) { return _mm512_add_ps(a, b); }
+		CHAOS_TARGET("avx512f") static reg Sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+		CHAOS_TARGET("avx512f") static reg Mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+		CHAOS_TARGET("avx512f") static reg Div(reg a, reg b) { return _mm512_div_ps(a, b); }
+	};
+	// GCC 12 passes an undefined register to the unmasked forms of many AVX-512 intrinsics and then warns it may be
+	// used uninitialized, the maskz forms with every lane set compile to the same instructions on zeros instead
+	constexpr __mmask8 all8 = 0xFF;
+	constexpr __mmask16 all16 = 0xFFFF;
+
+	template<> struct Avx512<int>
+	{
+		using reg = __m512i;
+		static constexpr size_t width = 16;
+		CHAOS_TARGET("avx512f") static reg Load(const int* p) { return _mm512_loadu_si512(p); }
+		CHAOS_TARGET("avx512f") static void Store(int* p, reg v) { _mm512_storeu_si512(p, v); }
+		CHAOS_TARGET("avx512f") static reg Add(reg a, reg b) { return _mm512_add_epi32(a, b); }
+		CHAOS_TARGET("avx512f") static reg Sub(reg a, reg b) { return _mm512_sub_epi32(a, b); }
+		CHAOS_TARGET("avx512f") static reg Mul(reg a, reg b) { return _mm512_mullo_epi32(a, b); }
+		CHAOS_TARGET("avx512f") static reg Div(reg a, reg b)
+		{
+			__m512d alo = _mm512_maskz_cvtepi32_pd(all8, _mm512_maskz_extracti64x4_epi64(all8, a, 0));
+			__m512d blo = _mm512_maskz_cvtepi32_pd(all8, _mm512_maskz_extracti64x4_epi64(all8, b, 0));
+			__m512d ahi = _mm512_maskz_cvtepi32_pd(all8, _mm512_maskz_extracti64x4_epi64(all8, a, 1));
+			__m512d bhi = _mm512_maskz_cvtepi32_pd(all8, _mm512_maskz_extracti64x4_epi64(all8, b, 1));
+			__m256i lo = _mm512_maskz_cvttpd_epi32(all8, _mm512_div_pd(alo, blo));
+			__m256i hi = _mm512_maskz_cvttpd_epi32(all8, _mm512_div_pd(ahi, bhi));
+			return _mm512_maskz_inserti64x4(all8, _mm512_maskz_inserti64x4(all8, _mm512_setzero_si512(), lo, 0), hi, 1);
+		}
+	};
+	template<> struct Avx512<Complex>
+	{
+		using reg = __m512;
+		static constexpr size_t width = 8;
+		CHAOS_TARGET("avx512f") static reg Load(const Complex* p) { return _mm512_loadu_ps(p); }
+		CHAOS_TARGET("avx512f") static void Store(Complex* p, reg v) { _mm512_storeu_ps(p, v); }
+		CHAOS_TARGET("avx512f") static reg Add(reg a, reg b) { return _mm512_add_ps(a, b); }
+		CHAOS_TARGET("avx512f") static reg Sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+		CHAOS_TARGET("avx512f") static reg Mul(reg a, reg b)
+		{
+			reg swap = _mm512_maskz_permute_ps(all16, a, _MM_SHUFFLE(2, 3, 0, 1));
+			return _mm512_fmaddsub_ps(a, _mm512_maskz_moveldup_ps(all16, b), _mm512_mul_ps(swap, _mm512_maskz_movehdup_ps(all16, b)));
+		}
+		CHAOS_TARGET("avx512f") static reg Div(reg a, reg b)
+		{
+			reg swap = _mm512_maskz_permute_ps(all16, a, _MM_SHUFFLE(2, 3, 0, 1));
+			reg num = _mm512_fmsubadd_ps(a, _mm512_maskz_moveldup_ps(all16, b), _mm512_mul_ps(swap, _mm512_maskz_movehdup_ps(all16, b)));
+			reg norm = _mm512_mul_ps(b, b);
+			return _mm512_div_ps(num, _mm512_add_ps(norm, _mm512_maskz_permute_ps(all16, norm, _MM_SHUFFLE(2, 3, 0, 1))));
+		}
+	};
+
+	// the loops are the same for every ISA, but each needs the target of its vectors to inline them;
+	// a scalar side is loaded once from a copy filling a whole register
+#define CHAOS_BINARY_BODY                                                                           \
+	if (n == 0) return;                                                                             \
+	Type lfill[V::width];                                                                           \
+	Type rfill[V::width];                                                                           \
+	std::fill_n(lfill, V::width, lhs[0]);                                                           \
+	std::fill_n(rfill, V::width, rhs[0]);                                                           \
+	const typename V::reg lscalar = V::Load(lfill);                                                 \
+	const typename V::reg rscalar = V::Load(rfill);                                                 \
+	size_t i = 0;                                                                                   \
+	for (; i + V::width <= n; i += V::width)                                                        \
+	{                                                                                               \
+		typename V::reg a = Scalar == Broadcast::Lhs ? lscalar : V::Load(lhs + i);                  \
+		typename V::reg b = Scalar == Broadcast::Rhs ? rscalar : V::Load(rhs + i);                  \
+		if constexpr (Kind == BinaryKind::Add) V::Store(dst + i, V::Add(a, b));                     \
+		else if constexpr (Kind == BinaryKind::Sub) V::Store(dst + i, V::Sub(a, b));                \
+		else if constexpr (Kind == BinaryKind::Mul) V::Store(dst + i, V::Mul(a, b));                \
+		else V::Store(dst + i, V::Div(a, b));                                                       \
+	}                                                                                               \
+	ScalarLoop<Type, Kind, Scalar>(Scalar == Broadcast::Lhs ? lhs : lhs + i,                        \
+		Scalar == Broadcast::Rhs ? rhs : rhs + i, dst + i, n - i);
+
+	template<class Type, BinaryKind Kind, Broadcast Scalar>
+	CHAOS_TARGET("sse4.1") static void LoopSSE(const Type* lhs, const Type* rhs, Type* dst, size_t n)
+	{
+		using V = Sse<Type>;
+		CHAOS_BINARY_BODY
+	}
+	template<class Type, BinaryKind Kind, Broadcast Scalar>
+	CHAOS_TARGET("avx2,fma") static void LoopAVX2(const Type* lhs, const Type* rhs, Type* dst, size_t n)
+	{
+		using V = Avx2<Type>;
+		CHAOS_BINARY_BODY
+	}
+	template<class Type, BinaryKind Kind, Broadcast Scalar>
+	CHAOS_TARGET("avx512f") static void LoopAVX512(const Type* lhs, const Type* rhs, Type* dst, size_t n)
+	{
+		using V = Avx512<Type>;
+		CHAOS_BINARY_BODY
+	}
+#undef CHAOS_BINARY_BODY
+#endif
+
+	template<class Type>
+	using BinaryFunc = void(*)(const Type*, const Type*, Type*, size_t);
+
+	enum class Isa
+	{
+		None,
+		SSE41,
+		AVX2,
+		AVX512,
+	};
+
+	static Isa DetectIsa()
+	{
+#ifdef CHAOS_X86
+		if (CpuSupportAVX512F()) return Isa::AVX512;
+		if (CpuSupportAVX2() && CpuSupportFMA()) return Isa::AVX2;
+		if (CpuSupportSSE41()) return Isa::SSE41;
+#endif
+		return Isa::None;
+	}
+
+	template<class Type, BinaryKind Kind, Broadcast Scalar>
+	static BinaryFunc<Type> Select(Isa isa)
+	{
+#ifdef CHAOS_X86
+		switch (isa)
+		{
+		case Isa::AVX512: return &LoopAVX512<Type, Kind, Scalar>;
+		case Isa::AVX2: return &LoopAVX2<Type, Kind, Scalar>;
+		case Isa::SSE41: return &LoopSSE<Type, Kind, Scalar>;
+		default: break;
+		}
+#endif
+		return &ScalarLoop<Type, Kind, Scalar>;
+	}
+
+	template<class Type, BinaryKind Kind>
+	static std::array<BinaryFunc<Type>, 3> SelectAll(Isa isa)
+	{
+		return { Select<Type, Kind, Broadcast::None>(isa), Select<Type, Kind, Broadcast::Lhs>(isa), Select<Type, Kind, Broadcast::Rhs>(isa) };
+	}
+
+	// picked once, indexed by [kind][scalar]
+	template<class Type>
+	static void Run(const BinaryKind& kind, const Type* lhs, const Type* rhs, Type* dst, size_t n, const Broadcast& scalar)
+	{
+		static const std::array<std::array<BinaryFunc<Type>, 3>, 4> table = [] {
+			Isa isa = DetectIsa();
+			return std::array<std::array<BinaryFunc<Type>, 3>, 4>{ SelectAll<Type, BinaryKind::Add>(isa), SelectAll<Type, BinaryKind::Sub>(isa),
+				SelectAll<Type, BinaryKind::Mul>(isa), SelectAll<Type, BinaryKind::Div>(isa) };
+		}();
+		table[static_cast<int>(kind)][static_cast<int>(scalar)](lhs, rhs, dst, n);
+	}
+
+	void BinaryKernel(const BinaryKind& kind, const float* lhs, const float* rhs, float* dst, size_t n, const Broadcast& scalar)
+	{
+		Run(kind, lhs, rhs, dst, n, scalar);
+	}
+	void BinaryKernel(const BinaryKind& kind, const int* lhs, const int* rhs, int* dst, size_t n, const Broadcast& scalar)
+	{
+		Run(kind, lhs, rhs, dst, n, scalar);
+	}
+	void BinaryKernel(const BinaryKind& kind, const Complex* lhs, const Complex* rhs, Complex* dst, size_t n, const Broadcast& scalar)
+	{
+		Run(kind, lhs, rhs, dst, n, scalar);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,286 @@
+#include "core/tensor.hpp"
+#include "core/parallel.hpp"
+#include "core/cpu.hpp"
+
+#include <cstdint>
+#include <algorithm>
+
+#ifdef CHAOS_X86
+#include <immintrin.h>
+#endif
+
+namespace chaos
+{
+	// the packed axis is C of [..., C, H, W], or the outermost axis of 1 and 2 dims tensors
+	static inline size_t PackedAxis(size_t dims)
+	{
+		return dims >= 3 ? dims - 3 : 0;
+	}
+
+	// dst[i * dstep] = src[i * sstep], steps in elements of esize bytes
+	static void CopyLane(uchar* dst, int64_t dstep, const uchar* src, int64_t sstep, int64_t n, size_t esize)
+	{
+		auto copy = [=](auto* d, const auto* s) {
+			for (int64_t i = 0; i < n; i++) d[i * dstep] = s[i * sstep];
+		};
+		switch (esize)
+		{
+		case 1: copy(reinterpret_cast<uint8_t*>(dst), reinterpret_cast<const uint8_t*>(src)); break;
+		case 2: copy(reinterpret_cast<uint16_t*>(dst), reinterpret_cast<const uint16_t*>(src)); break;
+		case 4: copy(reinterpret_cast<uint32_t*>(dst), reinterpret_cast<const uint32_t*>(src)); break;
+		case 8: copy(reinterpret_cast<uint64_t*>(dst), reinterpret_cast<const uint64_t*>(src)); break;
+		default:
+			for (int64_t i = 0; i < n; i++) memcpy(dst + i * dstep * esize, src + i * sstep * esize, esize);
+			break;
+		}
+	}
+	static void ZeroLane(uchar* dst, int64_t dstep, int64_t n, size_t esize)
+	{
+		for (int64_t i = 0; i < n; i++) memset(dst + i * dstep * esize, 0, esize);
+	}
+
+#ifdef CHAOS_X86
+	// 4 planes to C4 interleaved, 4x4 transposes
+	static void Pack4(float* dst, const float* const* src, int64_t n)
+	{
+		int64_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 r0 = _mm_loadu_ps(src[0] + i);
+			__m128 r1 = _mm_loadu_ps(src[1] + i);
+			__m128 r2 = _mm_loadu_ps(src[2] + i);
+			__m128 r3 = _mm_loadu_ps(src[3] + i);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(dst + i * 4, r0);
+			_mm_storeu_ps(dst + i * 4 + 4, r1);
+			_mm_storeu_ps(dst + i * 4 + 8, r2);
+			_mm_storeu_ps(dst + i * 4 + 12, r3);
+		}
+		for (; i < n; i++)
+		{
+			for (int k = 0; k < 4; k++) dst[i * 4 + k] = src[k][i];
+		}
+	}
+	static void Unpack4(float* const* dst, const float* src, int64_t n)
+	{
+		int64_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 r0 = _mm_loadu_ps(src + i * 4);
+			__m128 r1 = _mm_loadu_ps(src + i * 4 + 4);
+			__m128 r2 = _mm_loadu_ps(src + i * 4 + 8);
+			__m128 r3 = _mm_loadu_ps(src + i * 4 + 12);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(dst[0] + i, r0);
+			_mm_storeu_ps(dst[1] + i, r1);
+			_mm_storeu_ps(dst[2] + i, r2);
+			_mm_storeu_ps(dst[3] + i, r3);
+		}
+		for (; i < n; i++)
+		{
+			for (int k = 0; k < 4; k++) dst[k][i] = src[i * 4 + k];
+		}
+	}
+
+	CHAOS_TARGET("avx") static inline void Transpose8(__m256& r0, __m256& r1, __m256& r2, __m256& r3, __m256& r4, __m256& r5, __m256& r6, __m256& r7)
+	{
+		__m256 t0 = _mm256_unpacklo_ps(r0, r1);
+		__m256 t1 = _mm256_unpackhi_ps(r0, r1);
+		__m256 t2 = _mm256_unpacklo_ps(r2, r3);
+		__m256 t3 = _mm256_unpackhi_ps(r2, r3);
+		__m256 t4 = _mm256_unpacklo_ps(r4, r5);
+		__m256 t5 = _mm256_unpackhi_ps(r4, r5);
+		__m256 t6 = _mm256_unpacklo_ps(r6, r7);
+		__m256 t7 = _mm256_unpackhi_ps(r6, r7);
+		__m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+		r0 = _mm256_permute2f128_ps(s0, s4, 0x20);
+		r1 = _mm256_permute2f128_ps(s1, s5, 0x20);
+		r2 = _mm256_permute2f128_ps(s2, s6, 0x20);
+		r3 = _mm256_permute2f128_ps(s3, s7, 0x20);
+		r4 = _mm256_permute2f128_ps(s0, s4, 0x31);
+		r5 = _mm256_permute2f128_ps(s1, s5, 0x31);
+		r6 = _mm256_permute2f128_ps(s2, s6, 0x31);
+		r7 = _mm256_permute2f128_ps(s3, s7, 0x31);
+	}
+
+	// 8 planes to C8 interleaved, 8x8 transposes
+	CHAOS_TARGET("avx") static void Pack8(float* dst, const float* const* src, int64_t n)
+	{
+		int64_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 r0 = _mm256_loadu_ps(src[0] + i);
+			__m256 r1 = _mm256_loadu_ps(src[1] + i);
+			__m256 r2 = _mm256_loadu_ps(src[2] + i);
+			__m256 r3 = _mm256_loadu_ps(src[3] + i);
+			__m256 r4 = _mm256_loadu_ps(src[4] + i);
+			__m256 r5 = _mm256_loadu_ps(src[5] + i);
+			__m256 r6 = _mm256_loadu_ps(src[6] + i);
+			__m256 r7 = _mm256_loadu_ps(src[7] + i);
+			Transpose8(r0, r1, r2, r3, r4, r5, r6, r7);
+			float* d = dst + i * 8;
+			_mm256_storeu_ps(d, r0);
+			_mm256_storeu_ps(d + 8, r1);
+			_mm256_storeu_ps(d + 16, r2);
+			_mm256_storeu_ps(d + 24, r3);
+			_mm256_storeu_ps(d + 32, r4);
+			_mm256_storeu_ps(d + 40, r5);
+			_mm256_storeu_ps(d + 48, r6);
+			_mm256_storeu_ps(d + 56, r7);
+		}
+		for (; i < n; i++)
+		{
+			for (int k = 0; k < 8; k++) dst[i * 8 + k] = src[k][i];
+		}
+	}
+	CHAOS_TARGET("avx") static void Unpack8(float* const* dst, const float* src, int64_t n)
+	{
+		int64_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			const float* s = src + i * 8;
+			__m256 r0 = _mm256_loadu_ps(s);
+			__m256 r1 = _mm256_loadu_ps(s + 8);
+			__m256 r2 = _mm256_loadu_ps(s + 16);
+			__m256 r3 = _mm256_loadu_ps(s + 24);
+			__m256 r4 = _mm256_loadu_ps(s + 32);
+			__m256 r5 = _mm256_loadu_ps(s + 40);
+			__m256 r6 = _mm256_loadu_ps(s + 48);
+			__m256 r7 = _mm256_loadu_ps(s + 56);
+			Transpose8(r0, r1, r2, r3, r4, r5, r6, r7);
+			_mm256_storeu_ps(dst[0] + i, r0);
+			_mm256_storeu_ps(dst[1] + i, r1);
+			_mm256_storeu_ps(dst[2] + i, r2);
+			_mm256_storeu_ps(dst[3] + i, r3);
+			_mm256_storeu_ps(dst[4] + i, r4);
+			_mm256_storeu_ps(dst[5] + i, r5);
+			_mm256_storeu_ps(dst[6] + i, r6);
+			_mm256_storeu_ps(dst[7] + i, r7);
+		}
+		for (; i < n; i++)
+		{
+			for (int k = 0; k < 8; k++) dst[k][i] = src[i * 8 + k];
+		}
+	}
+#endif
+
+	// gather one output group of p_out lanes, src[k] is nullptr for the padding lanes
+	static void PackGroup(uchar* dst, const uchar* const* src, int p_in, int p_out, int64_t plane, size_t esize)
+	{
+#ifdef CHAOS_X86
+		bool full = std::all_of(src, src + p_out, [](const uchar* s) { return s != nullptr; });
+		if (full && p_in == 1 && esize == 4)
+		{
+			const float* const* planes = reinterpret_cast<const float* const*>(src);
+			if (p_out == 4) return Pack4(reinterpret_cast<float*>(dst), planes, plane);
+			if (p_out == 8 && CpuSupportAVX()) return Pack8(reinterpret_cast<float*>(dst), planes, plane);
+		}
+#endif
+		for (int k = 0; k < p_out; k++)
+		{
+			if (src[k])
+			{
+				CopyLane(dst + k * esize, p_out, src[k], p_in, plane, esize);
+			}
+			else
+			{
+				ZeroLane(dst + k * esize, p_out, plane, esize);
+			}
+		}
+	}
+
+	// scatter one input group of p_in lanes to planes, dst[k] is nullptr for the dropped lanes
+	static void UnpackGroup(uchar* const* dst, const uchar* src, int p_in, int64_t plane, size_t esize)
+	{
+#ifdef CHAOS_X86
+		bool full = std::all_of(dst, dst + p_in, [](const uchar* d) { return d != nullptr; });
+		if (full && esize == 4)
+		{
+			float* const* planes = reinterpret_cast<float* const*>(dst);
+			if (p_in == 4) return Unpack4(planes, reinterpret_cast<const float*>(src), plane);
+			if (p_in == 8 && CpuSupportAVX()) return Unpack8(planes, reinterpret_cast<const float*>(src), plane);
+		}
+#endif
+		for (int k = 0; k < p_in; k++)
+		{
+			if (dst[k]) CopyLane(dst[k], 1, src + k * esize, p_in, plane, esize);
+		}
+	}
+
+	Tensor Tensor::Repack(const Packing& new_packing, int channels, Allocator* allocator) const
+	{
+		if (empty()) return Tensor();
+
+		size_t dims = shape.size();
+		size_t axis = PackedAxis(dims);
+		int p_in = static_cast<int>(packing);
+		int p_out = static_cast<int>(new_packing);
+		size_t esize = static_cast<size_t>(depth);
+
+		int64_t in_groups = shape[axis];
+		int64_t all_channels = in_groups * p_in;
+		int64_t num_channels = channels > 0 ? std::min<int64_t>(channels, all_channels) : all_channels;
+		if (p_in == p_out && num_channels == all_channels) return *this;
+
+		// the kernels walk whole planes
+		Tensor src = steps == shape.steps() ? *this : Clone();
+
+		int64_t outer = 1;
+		int64_t plane = 1;
+		for (size_t i = 0; i < axis; i++) outer *= shape[i];
+		for (size_t i = axis + 1; i < dims; i++) plane *= shape[i];
+
+		Shape new_shape = shape;
+		int64_t out_groups = (num_channels + p_out - 1) / p_out;
+		new_shape[static_cast<int>(axis)] = static_cast<int>(out_groups);
+		Tensor dst = Tensor(new_shape, depth, new_packing, allocator);
+
+		const uchar* sdata = static_cast<const uchar*>(src.data);
+		uchar* ddata = static_cast<uchar*>(dst.data);
+		int64_t grain = std::max<int64_t>(1, (1 << 16) / (plane * std::max(p_in, p_out) * esize));
+
+		if (p_out == 1)
+		{
+			// one task per input group, so that the full groups can be transposed at once
+			ParallelFor(0, outer * in_groups, [&](int64_t first, int64_t last) {
+				uchar* lanes[8] = {};
+				for (int64_t t = first; t < last; t++)
+				{
+					int64_t o = t / in_groups;
+					int64_t g = t % in_groups;
+					for (int k = 0; k < p_in; k++)
+					{
+						int64_t c = g * p_in + k;
+						lanes[k] = c < num_channels ? ddata + (o * num_channels + c) * plane * esize : nullptr;
+					}
+					UnpackGroup(lanes, sdata + (o * in_groups + g) * plane * p_in * esize, p_in, plane, esize);
+				}
+			}, grain);
+		}
+		else
+		{
+			ParallelFor(0, outer * out_groups, [&](int64_t first, int64_t last) {
+				const uchar* lanes[8] = {};
+				for (int64_t t = first; t < last; t++)
+				{
+					int64_t o = t / out_groups;
+					int64_t g = t % out_groups;
+					for (int k = 0; k < p_out; k++)
+					{
+						int64_t c = g * p_out + k;
+						lanes[k] = c < num_channels ? sdata + ((o * in_groups + c / p_in) * plane * p_in + c % p_in) * esize : nullptr;
+					}
+					PackGroup(ddata + (o * out_groups + g) * plane * p_out * esize, lanes, p_in, p_out, plane, esize);
+				}
+			}, grain);
+		}
+		return dst;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,312 @@
+#include "core/parallel.hpp"
+#include "core/log.hpp"
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <condition_variable>
+
+namespace chaos
+{
+	struct Task
+	{
+		void (*run)(void*) = nullptr;
+		void* arg = nullptr;
+	};
+
+	class WorkerQueues
+	{
+	public:
+		struct Queue
+		{
+			std::mutex mtx;
+			std::deque<Task> tasks;
+		};
+
+		explicit WorkerQueues(int num_workers)
+		{
+			// the last queue takes the tasks pushed by threads outside the pool
+			for (int i = 0; i <= num_workers; i++) queues.push_back(std::make_unique<Queue>());
+			for (int i = 0; i < num_workers; i++) workers.emplace_back(&WorkerQueues::WorkerLoop, this, i);
+		}
+		~WorkerQueues()
+		{
+			{
+				std::lock_guard lock(mtx);
+				stop = true;
+			}
+			cv.notify_all();
+			for (auto& worker : workers) worker.join();
+		}
+
+		int num_workers() const noexcept { return static_cast<int>(workers.size()); }
+
+		// the queue of the calling thread, the injector if it is not a worker of this pool
+		int Self() const noexcept;
+
+		void Push(const Task& task, int count)
+		{
+			Queue& queue = *queues[Self()];
+			{
+				std::lock_guard lock(queue.mtx);
+				for (int i = 0; i < count; i++) queue.tasks.push_back(task);
+			}
+			pending.fetch_add(count);
+
+			// taking the lock orders the push before the predicate check of a sleeping worker
+			{
+				std::lock_guard lock(mtx);
+			}
+			if (count > 1) cv.notify_all(); else cv.notify_one();
+		}
+
+		bool Pop(Task& task, int self)
+		{
+			if (pending.load(std::memory_order_acquire) <= 0) return false;
+
+			// own queue from the back, it is the warmest
+			if (TakeBack(*queues[self], task)) return true;
+
+			// then the injector and the other workers from the front
+			size_t n = queues.size();
+			for (size_t i = 1; i < n; i++)
+			{
+				if (TakeFront(*queues[(self + n - i) % n], task)) return true;
+			}
+			return false;
+		}
+
+	private:
+		bool TakeBack(Queue& queue, Task& task)
+		{
+			std::lock_guard lock(queue.mtx);
+			if (queue.tasks.empty()) return false;
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+			pending.fetch_sub(1);
+			return true;
+		}
+		bool TakeFront(Queue& queue, Task& task)
+		{
+			std::lock_guard lock(queue.mtx);
+			if (queue.tasks.empty()) return false;
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+			pending.fetch_sub(1);
+			return true;
+		}
+
+		void WorkerLoop(int id);
+
+		std::vector<std::unique_ptr<Queue>> queues;
+		std::vector<std::thread> workers;
+
+		std::atomic<int> pending = 0;
+
+		std::mutex mtx;
+		std::condition_variable cv;
+		bool stop = false;
+	};
+
+	static thread_local const WorkerQueues* current_queues = nullptr;
+	static thread_local int current_worker = -1;
+
+	int WorkerQueues::Self() const noexcept
+	{
+		return current_queues == this ? current_worker : num_workers();
+	}
+
+	void WorkerQueues::WorkerLoop(int id)
+	{
+		current_queues = this;
+		current_worker = id;
+
+		Task task;
+		while (true)
+		{
+			if (Pop(task, id))
+			{
+				task.run(task.arg);
+				continue;
+			}
+
+			std::unique_lock lock(mtx);
+			cv.wait(lock, [this]() { return stop || pending.load() > 0; });
+			if (stop && pending.load() <= 0) return;
+		}
+	}
+
+	// shared by the caller and the helper tasks of one ParallelFor, chunks are claimed with an atomic counter
+	struct RangeGroup
+	{
+		const std::function<void(int64_t, int64_t)>* func = nullptr;
+		int64_t begin = 0;
+		int64_t end = 0;
+		int64_t chunk = 1;
+		int64_t num_chunks = 0;
+
+		std::atomic<int64_t> next = 0;
+		std::atomic<int> helpers = 0;
+
+		void Work()
+		{
+			for (int64_t c = next.fetch_add(1); c < num_chunks; c = next.fetch_add(1))
+			{
+				int64_t first = begin + c * chunk;
+				(*func)(first, std::min(end, first + chunk));
+			}
+		}
+
+		static void Help(void* arg)
+		{
+			RangeGroup* group = static_cast<RangeGroup*>(arg);
+			group->Work();
+			group->helpers.fetch_sub(1, std::memory_order_release);
+		}
+	};
+
+	class TaskGroupState
+	{
+	public:
+		std::atomic<int64_t> pending = 0;
+	};
+
+	// one task of a TaskGroup, it deletes itself once run
+	struct GroupTask
+	{
+		TaskGroupState* state = nullptr;
+		std::function<void()> func;
+
+		static void Run(void* arg)
+		{
+			std::unique_ptr<GroupTask> task(static_cast<GroupTask*>(arg));
+			task->func();
+			task->state->pending.fetch_sub(1, std::memory_order_release);
+		}
+	};
+
+
+	ThreadPool::ThreadPool(int num_threads)
+	{
+		if (num_threads <= 0) num_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+		queues = new WorkerQueues(num_threads - 1);
+	}
+	ThreadPool::~ThreadPool()
+	{
+		delete queues;
+	}
+
+	int ThreadPool::num_threads() const noexcept
+	{
+		return queues->num_workers() + 1;
+	}
+
+	void ThreadPool::ParallelFor(int64_t begin, int64_t end, const std::function<void(int64_t, int64_t)>& func, int64_t grain, int num_threads)
+	{
+		int64_t n = end - begin;
+		if (n <= 0) return;
+
+		int threads = num_threads > 0 ? std::min(num_threads, ThreadPool::num_threads()) : ThreadPool::num_threads();
+		grain = std::max<int64_t>(grain, 1);
+		if (threads <= 1 || n <= grain)
+		{
+			func(begin, end);
+			return;
+		}
+
+		// a few chunks per thread, so that the threads finishing early take over the rest
+		RangeGroup group;
+		group.func = &func;
+		group.begin = begin;
+		group.end = end;
+		group.chunk = std::max(grain, (n + threads * 4 - 1) / (threads * 4));
+		group.num_chunks = (n + group.chunk - 1) / group.chunk;
+
+		int helpers = static_cast<int>(std::min<int64_t>(threads, group.num_chunks)) - 1;
+		group.helpers = helpers;
+		if (helpers > 0) queues->Push(Task{ &RangeGroup::Help, &group }, helpers);
+
+		group.Work();
+
+		// help with whatever is queued until every helper of this group is done with it
+		int self = queues->Self();
+		Task task;
+		while (group.helpers.load(std::memory_order_acquire) > 0)
+		{
+			if (queues->Pop(task, self))
+			{
+				task.run(task.arg);
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	ThreadPool* ThreadPool::Global()
+	{
+		static ThreadPool pool;
+		return &pool;
+	}
+
+
+	TaskGroup::TaskGroup(ThreadPool* pool) : pool(pool ? pool : ThreadPool::Global()), state(new TaskGroupState) {}
+
+	TaskGroup::~TaskGroup()
+	{
+		Wait();
+		delete state;
+	}
+
+	void TaskGroup::Run(const std::function<void()>& func)
+	{
+		state->pending.fetch_add(1);
+		pool->queues->Push(Task{ &GroupTask::Run, new GroupTask{ state, func } }, 1);
+	}
+
+	void TaskGroup::Wait()
+	{
+		// help with whatever is queued, the tasks of this group may be on any worker
+		int self = pool->queues->Self();
+		Task task;
+		while (state->pending.load(std::memory_order_acquire) > 0)
+		{
+			if (pool->queues->Pop(task, self))
+			{
+				task.run(task.arg);
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+
+	void ParallelFor(int64_t begin, int64_t end, const std::function<void(int64_t, int64_t)>& func, int64_t grain, int num_threads, ThreadPool* pool)
+	{
+		(pool ? pool : ThreadPool::Global())->ParallelFor(begin, end, func, grain, num_threads);
+	}
+
+	void ParallelFor2D(int64_t rows, int64_t cols, int64_t tile_rows, int64_t tile_cols,
+		const std::function<void(int64_t, int64_t, int64_t, int64_t)>& func, int num_threads, ThreadPool* pool)
+	{
+		tile_rows = std::max<int64_t>(tile_rows, 1);
+		tile_cols = std::max<int64_t>(tile_cols, 1);
+		int64_t tiles_y = (rows + tile_rows - 1) / tile_rows;
+		int64_t tiles_x = (cols + tile_cols - 1) / tile_cols;
+		ParallelFor(0, tiles_y * tiles_x, [&](int64_t first, int64_t last) {
+			for (int64_t t = first; t < last; t++)
+			{
+				int64_t r = t / tiles_x * tile_rows;
+				int64_t c = t % tiles_x * tile_cols;
+				func(r, std::min(rows, r + tile_rows), c, std::min(cols, c + tile_cols));
+			}
+		}, 1, num_threads, pool);
+	}
+}
\ No newline at end of file
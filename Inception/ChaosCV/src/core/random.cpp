@@ -0,0 +1,382 @@
+#include "core/random.hpp"
+#include "core/cpu.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#ifdef CHAOS_X86
+#include <immintrin.h>
+#endif
+
+namespace chaos
+{
+	constexpr uint32_t philox_m0 = 0xD2511F53;
+	constexpr uint32_t philox_m1 = 0xCD9E8D57;
+	constexpr uint32_t philox_w0 = 0x9E3779B9;
+	constexpr uint32_t philox_w1 = 0xBB67AE85;
+	constexpr int philox_rounds = 10;
+
+	// blocks of 4 values per task at least
+	constexpr int64_t random_grain = 2048;
+
+	// the key and the upper half of the counter
+	struct Stream
+	{
+		uint32_t k0;
+		uint32_t k1;
+		uint32_t s0;
+		uint32_t s1;
+	};
+
+	static inline void PhiloxScalar(const Stream& st, uint64_t counter, uint32_t out[4]) noexcept
+	{
+		uint32_t c0 = static_cast<uint32_t>(counter);
+		uint32_t c1 = static_cast<uint32_t>(counter >> 32);
+		uint32_t c2 = st.s0;
+		uint32_t c3 = st.s1;
+		uint32_t k0 = st.k0;
+		uint32_t k1 = st.k1;
+		for (int r = 0; r < philox_rounds; r++)
+		{
+			uint64_t p0 = static_cast<uint64_t>(philox_m0) * c0;
+			uint64_t p1 = static_cast<uint64_t>(philox_m1) * c2;
+			c0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+			c1 = static_cast<uint32_t>(p1);
+			c2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+			c3 = static_cast<uint32_t>(p0);
+			k0 += philox_w0;
+			k1 += philox_w1;
+		}
+		out[0] = c0;
+		out[1] = c1;
+		out[2] = c2;
+		out[3] = c3;
+	}
+
+	// The transforms below are written once with explicit fma and once with the AVX2 intrinsics in the same
+	// order, every operation is correctly rounded so both paths give the same bits
+
+	// the upper 24 bits as a float in [0, 1), exact
+	static inline float Unit(uint32_t x) noexcept
+	{
+		return static_cast<float>(x >> 8) * 0x1p-24f;
+	}
+
+	constexpr float log_poly[9] = { 7.0376836292E-2f, -1.1514610310E-1f, 1.1676998740E-1f, -1.2420140846E-1f, 1.4249322787E-1f,
+		-1.6668057665E-1f, 2.0000714765E-1f, -2.4999993993E-1f, 3.3333331174E-1f };
+	constexpr float sin_poly[3] = { -1.9515295891E-4f, 8.3321608736E-3f, -1.6666654611E-1f };
+	constexpr float cos_poly[3] = { 2.443315711809948E-5f, -1.388731625493765E-3f, 4.166664568298827E-2f };
+	constexpr float sqrt_half = 0.707106781186547524f;
+	constexpr float half_pi = 1.57079632679489661923f;
+
+	// natural log of x in (0, 1], the Cephes polynomial
+	static float Log(float x) noexcept
+	{
+		uint32_t bits;
+		memcpy(&bits, &x, sizeof(float));
+		float e = static_cast<float>(static_cast<int>(bits >> 23) - 126);
+		bits = (bits & 0x807fffffu) | 0x3f000000u;
+		float m;
+		memcpy(&m, &bits, sizeof(float));
+		if (m < sqrt_half)
+		{
+			e = e - 1.f;
+			m = m + m;
+		}
+		m = m - 1.f;
+
+		float z = m * m;
+		float y = log_poly[0];
+		for (int i = 1; i < 9; i++) y = std::fma(y, m, log_poly[i]);
+		y = y * m * z;
+		y = std::fma(e, -2.12194440e-4f, y);
+		y = std::fma(z, -0.5f, y);
+		return std::fma(e, 0.693359375f, m + y);
+	}
+
+	// sin and cos of 2 pi u for u in [0, 1): quadrant by rounding 4u, then polynomials on [-pi/4, pi/4]
+	static void SinCos(float u, float& sin, float& cos) noexcept
+	{
+		float t = u * 4.f;
+		float q = std::floor(t + 0.5f);
+		float x = (t - q) * half_pi;
+		float z = x * x;
+		float s = std::fma(std::fma(std::fma(sin_poly[0], z, sin_poly[1]), z, sin_poly[2]), z * x, x);
+		float c = std::fma(std::fma(std::fma(cos_poly[0], z, cos_poly[1]), z, cos_poly[2]), z * z, std::fma(-0.5f, z, 1.f));
+
+		int quadrant = static_cast<int>(q);
+		sin = quadrant & 1 ? c : s;
+		cos = quadrant & 1 ? s : c;
+		if (quadrant & 2) sin = -sin;
+		if ((quadrant + 1) & 2) cos = -cos;
+	}
+
+	enum class Distribution
+	{
+		Uniform,
+		Normal,
+	};
+
+	// 4 words to 4 values, uniform: a + u * b, normal: a + r * (cos, sin) * b for each pair of words
+	template<Distribution D>
+	static inline void Transform(const uint32_t w[4], float a, float b, float out[4]) noexcept
+	{
+		if constexpr (D == Distribution::Uniform)
+		{
+			for (int i = 0; i < 4; i++) out[i] = std::fma(Unit(w[i]), b, a);
+		}
+		else
+		{
+			for (int i = 0; i < 4; i += 2)
+			{
+				float u1 = static_cast<float>((w[i] >> 8) + 1) * 0x1p-24f; // (0, 1], log stays finite
+				float r = std::sqrt(-2.f * Log(u1));
+				float sin, cos;
+				SinCos(Unit(w[i + 1]), sin, cos);
+				out[i] = std::fma(r * cos, b, a);
+				out[i + 1] = std::fma(r * sin, b, a);
+			}
+		}
+	}
+
+	// blocks [block, block + blocks) into the first n values of dst
+	template<Distribution D>
+	static void GenerateScalar(const Stream& st, uint64_t block, int64_t blocks, float a, float b, float* dst, int64_t n) noexcept
+	{
+		for (int64_t i = 0; i < blocks && i * 4 < n; i++)
+		{
+			uint32_t w[4];
+			float v[4];
+			PhiloxScalar(st, block + i, w);
+			Transform<D>(w, a, b, v);
+			memcpy(dst + i * 4, v, std::min<int64_t>(4, n - i * 4) * sizeof(float));
+		}
+	}
+
+#ifdef CHAOS_X86
+	// the high and low halves of the 32 x 32 bit products of each lane
+	CHAOS_TARGET("avx2,fma") static inline __m256i MulHiLo(__m256i x, __m256i m, __m256i& lo) noexcept
+	{
+		__m256i even = _mm256_mul_epu32(x, m);
+		__m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), m);
+		lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+		return _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+	}
+
+	// 8 blocks from counter on, x[w] holds word w of each block
+	CHAOS_TARGET("avx2,fma") static inline void PhiloxAVX2(const Stream& st, uint64_t counter, __m256i x[4]) noexcept
+	{
+		__m256i lo = _mm256_set1_epi32(static_cast<int>(counter));
+		__m256i sign = _mm256_set1_epi32(static_cast<int>(0x80000000u));
+		__m256i c0 = _mm256_add_epi32(lo, _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		// the low word wrapped, carry into the high one
+		__m256i carry = _mm256_cmpgt_epi32(_mm256_xor_si256(lo, sign), _mm256_xor_si256(c0, sign));
+		__m256i c1 = _mm256_sub_epi32(_mm256_set1_epi32(static_cast<int>(counter >> 32)), carry);
+		__m256i c2 = _mm256_set1_epi32(static_cast<int>(st.s0));
+		__m256i c3 = _mm256_set1_epi32(static_cast<int>(st.s1));
+		__m256i k0 = _mm256_set1_epi32(static_cast<int>(st.k0));
+		__m256i k1 = _mm256_set1_epi32(static_cast<int>(st.k1));
+		const __m256i m0 = _mm256_set1_epi32(static_cast<int>(philox_m0));
+		const __m256i m1 = _mm256_set1_epi32(static_cast<int>(philox_m1));
+		const __m256i w0 = _mm256_set1_epi32(static_cast<int>(philox_w0));
+		const __m256i w1 = _mm256_set1_epi32(static_cast<int>(philox_w1));
+		for (int r = 0; r < philox_rounds; r++)
+		{
+			__m256i lo0, lo1;
+			__m256i hi0 = MulHiLo(c0, m0, lo0);
+			__m256i hi1 = MulHiLo(c2, m1, lo1);
+			c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), k0);
+			c1 = lo1;
+			c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), k1);
+			c3 = lo0;
+			k0 = _mm256_add_epi32(k0, w0);
+			k1 = _mm256_add_epi32(k1, w1);
+		}
+		x[0] = c0;
+		x[1] = c1;
+		x[2] = c2;
+		x[3] = c3;
+	}
+
+	CHAOS_TARGET("avx2,fma") static inline __m256 UnitAVX2(__m256i x) noexcept
+	{
+		return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(x, 8)), _mm256_set1_ps(0x1p-24f));
+	}
+
+	CHAOS_TARGET("avx2,fma") static inline __m256 LogAVX2(__m256 x) noexcept
+	{
+		__m256i bits = _mm256_castps_si256(x);
+		__m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+		__m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(static_cast<int>(0x807fffffu))),
+			_mm256_set1_epi32(0x3f000000)));
+		__m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(sqrt_half), _CMP_LT_OQ);
+		e = _mm256_sub_ps(e, _mm256_and_ps(small, _mm256_set1_ps(1.f)));
+		m = _mm256_sub_ps(_mm256_add_ps(m, _mm256_and_ps(small, m)), _mm256_set1_ps(1.f));
+
+		__m256 z = _mm256_mul_ps(m, m);
+		__m256 y = _mm256_set1_ps(log_poly[0]);
+		for (int i = 1; i < 9; i++) y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(log_poly[i]));
+		y = _mm256_mul_ps(_mm256_mul_ps(y, m), z);
+		y = _mm256_fmadd_ps(e, _mm256_set1_ps(-2.12194440e-4f), y);
+		y = _mm256_fmadd_ps(z, _mm256_set1_ps(-0.5f), y);
+		return _mm256_fmadd_ps(e, _mm256_set1_ps(0.693359375f), _mm256_add_ps(m, y));
+	}
+
+	CHAOS_TARGET("avx2,fma") static inline void SinCosAVX2(__m256 u, __m256& sin, __m256& cos) noexcept
+	{
+		__m256 t = _mm256_mul_ps(u, _mm256_set1_ps(4.f));
+		__m256 q = _mm256_floor_ps(_mm256_add_ps(t, _mm256_set1_ps(0.5f)));
+		__m256 x = _mm256_mul_ps(_mm256_sub_ps(t, q), _mm256_set1_ps(half_pi));
+		__m256 z = _mm256_mul_ps(x, x);
+		__m256 s = _mm256_fmadd_ps(_mm256_set1_ps(sin_poly[0]), z, _mm256_set1_ps(sin_poly[1]));
+		s = _mm256_fmadd_ps(s, z, _mm256_set1_ps(sin_poly[2]));
+		s = _mm256_fmadd_ps(s, _mm256_mul_ps(z, x), x);
+		__m256 c = _mm256_fmadd_ps(_mm256_set1_ps(cos_poly[0]), z, _mm256_set1_ps(cos_poly[1]));
+		c = _mm256_fmadd_ps(c, z, _mm256_set1_ps(cos_poly[2]));
+		c = _mm256_fmadd_ps(c, _mm256_mul_ps(z, z), _mm256_fmadd_ps(_mm256_set1_ps(-0.5f), z, _mm256_set1_ps(1.f)));
+
+		__m256i quadrant = _mm256_cvttps_epi32(q);
+		__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+		__m256i sin_sign = _mm256_slli_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(2)), 30);
+		__m256i cos_sign = _mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30);
+		sin = _mm256_xor_ps(_mm256_blendv_ps(s, c, swap), _mm256_castsi256_ps(sin_sign));
+		cos = _mm256_xor_ps(_mm256_blendv_ps(c, s, swap), _mm256_castsi256_ps(cos_sign));
+	}
+
+	// 8 blocks as 32 values in the order of the blocks
+	template<Distribution D>
+	CHAOS_TARGET("avx2,fma") static inline void GroupAVX2(const Stream& st, uint64_t block, __m256 va, __m256 vb, float* dst) noexcept
+	{
+		__m256i x[4];
+		PhiloxAVX2(st, block, x);
+
+		__m256 v[4];
+		if constexpr (D == Distribution::Uniform)
+		{
+			for (int i = 0; i < 4; i++) v[i] = _mm256_fmadd_ps(UnitAVX2(x[i]), vb, va);
+		}
+		else
+		{
+			for (int i = 0; i < 4; i += 2)
+			{
+				__m256 u1 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_srli_epi32(x[i], 8), _mm256_set1_epi32(1))), _mm256_set1_ps(0x1p-24f));
+				__m256 r = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_set1_ps(-2.f), LogAVX2(u1)));
+				__m256 sin, cos;
+				SinCosAVX2(UnitAVX2(x[i + 1]), sin, cos);
+				v[i] = _mm256_fmadd_ps(_mm256_mul_ps(r, cos), vb, va);
+				v[i + 1] = _mm256_fmadd_ps(_mm256_mul_ps(r, sin), vb, va);
+			}
+		}
+
+		// words to blocks: a 4 x 8 transpose
+		__m256 t0 = _mm256_unpacklo_ps(v[0], v[1]);
+		__m256 t1 = _mm256_unpacklo_ps(v[2], v[3]);
+		__m256 t2 = _mm256_unpackhi_ps(v[0], v[1]);
+		__m256 t3 = _mm256_unpackhi_ps(v[2], v[3]);
+		__m256 r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0)); // blocks 0 and 4
+		__m256 r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2)); // 1 and 5
+		__m256 r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0)); // 2 and 6
+		__m256 r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2)); // 3 and 7
+		_mm256_storeu_ps(dst, _mm256_permute2f128_ps(r0, r1, 0x20));
+		_mm256_storeu_ps(dst + 8, _mm256_permute2f128_ps(r2, r3, 0x20));
+		_mm256_storeu_ps(dst + 16, _mm256_permute2f128_ps(r0, r1, 0x31));
+		_mm256_storeu_ps(dst + 24, _mm256_permute2f128_ps(r2, r3, 0x31));
+	}
+
+	template<Distribution D>
+	CHAOS_TARGET("avx2,fma") static void GenerateAVX2(const Stream& st, uint64_t block, int64_t blocks, float a, float b, float* dst, int64_t n) noexcept
+	{
+		__m256 va = _mm256_set1_ps(a);
+		__m256 vb = _mm256_set1_ps(b);
+		int64_t i = 0;
+		for (; i + 8 <= blocks && (i + 8) * 4 <= n; i += 8) GroupAVX2<D>(st, block + i, va, vb, dst + i * 4);
+		// the tail through a buffer, the extra blocks are thrown away
+		for (; i < blocks && i * 4 < n; i += 8)
+		{
+			alignas(32) float buffer[32];
+			GroupAVX2<D>(st, block + i, va, vb, buffer);
+			memcpy(dst + i * 4, buffer, std::min<int64_t>(32, n - i * 4) * sizeof(float));
+		}
+	}
+#endif
+
+	template<Distribution D>
+	static void Generate(const Stream& st, uint64_t first, float a, float b, float* data, size_t n, int num_threads, ThreadPool* pool)
+	{
+		using Kernel = void(*)(const Stream&, uint64_t, int64_t, float, float, float*, int64_t);
+		static const Kernel kernel = []() -> Kernel {
+#ifdef CHAOS_X86
+			if (CpuSupportAVX2() && CpuSupportFMA()) return &GenerateAVX2<D>;
+#endif
+			return &GenerateScalar<D>;
+		}();
+
+		int64_t count = static_cast<int64_t>(n);
+		int64_t blocks = (count + 3) / 4;
+		ParallelFor(0, blocks, [&](int64_t begin, int64_t end) {
+			kernel(st, first + begin, end - begin, a, b, data + begin * 4, std::min(count, end * 4) - begin * 4);
+		}, random_grain, num_threads, pool);
+	}
+
+	static Stream StreamOf(uint64_t seed, uint64_t stream) noexcept
+	{
+		return Stream{ static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32), static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32) };
+	}
+
+	Philox::Philox(uint64_t seed, uint64_t stream) noexcept : key(seed), id(stream) {}
+	Philox::Philox(const Philox& other) noexcept : key(other.key), id(other.id), counter(other.position()) {}
+	Philox& Philox::operator=(const Philox& other) noexcept
+	{
+		key = other.key;
+		id = other.id;
+		counter = other.position();
+		return *this;
+	}
+
+	void Philox::Seed(uint64_t seed, uint64_t stream) noexcept
+	{
+		key = seed;
+		id = stream;
+		std::atomic_ref<uint64_t>(counter).store(0);
+	}
+
+	void Philox::Skip(uint64_t n) noexcept
+	{
+		Reserve(n);
+	}
+
+	uint64_t Philox::position() const noexcept
+	{
+		return std::atomic_ref<uint64_t>(counter).load();
+	}
+
+	uint64_t Philox::Reserve(size_t n) noexcept
+	{
+		return std::atomic_ref<uint64_t>(counter).fetch_add((n + 3) / 4);
+	}
+
+	std::array<uint32_t, 4> Philox::Block(uint64_t seed, uint64_t stream, uint64_t counter) noexcept
+	{
+		std::array<uint32_t, 4> words;
+		PhiloxScalar(StreamOf(seed, stream), counter, words.data());
+		return words;
+	}
+
+	void Philox::Uniform(float* data, size_t n, float min, float max, int num_threads, ThreadPool* pool)
+	{
+		Generate<Distribution::Uniform>(StreamOf(key, id), Reserve(n), min, max - min, data, n, num_threads, pool);
+	}
+
+	void Philox::Normal(float* data, size_t n, float mu, float sigma, int num_threads, ThreadPool* pool)
+	{
+		Generate<Distribution::Normal>(StreamOf(key, id), Reserve(n), mu, sigma, data, n, num_threads, pool);
+	}
+
+	Philox& Philox::Global()
+	{
+		static Philox global;
+		return global;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,673 @@
+#include "core/reduce.hpp"
+#include "core/parallel.hpp"
+#include "core/strided.hpp"
+#include "core/cpu.hpp"
+
+#include <bit>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#ifdef CHAOS_X86
+#include <immintrin.h>
+#endif
+
+namespace chaos
+{
+	// scalars summed by the accumulators before the pairwise tree takes over
+	constexpr int64_t reduce_block = 4096;
+	// large inputs are cut into at most this many ranges, a fixed split keeps the results reproducible
+	constexpr int64_t reduce_ranges = 64;
+	// scalars per range at least
+	constexpr int64_t reduce_grain = 1 << 16;
+
+	// pairwise summation with a binary counter, level l holds the sum of 2^l values
+	struct Cascade
+	{
+		float levels[64];
+		uint64_t count = 0;
+
+		void Add(float val) noexcept
+		{
+			int l = 0;
+			for (; count >> l & 1; l++) val = levels[l] + val;
+			levels[l] = val;
+			count++;
+		}
+		float Total() const noexcept
+		{
+			float total = 0.f;
+			for (int l = 0; l < 64; l++)
+			{
+				if (count >> l & 1) total = levels[l] + total;
+			}
+			return total;
+		}
+	};
+
+	enum class Map
+	{
+		Identity,
+		Abs,
+		Square,
+	};
+
+	template<Map M>
+	static inline float Apply(float x) noexcept
+	{
+		if constexpr (M == Map::Abs) return std::abs(x);
+		else if constexpr (M == Map::Square) return x * x;
+		else return x;
+	}
+
+	template<Map M>
+	static float SumScalar(const float* data, int64_t n, int64_t step) noexcept
+	{
+		float acc[4] = {};
+		int64_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			for (int k = 0; k < 4; k++) acc[k] += Apply<M>(data[(i + k) * step]);
+		}
+		for (; i < n; i++) acc[0] += Apply<M>(data[i * step]);
+		return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+	}
+	static float DotScalar(const float* lhs, int64_t lstep, const float* rhs, int64_t rstep, int64_t n) noexcept
+	{
+		float acc[4] = {};
+		int64_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			for (int k = 0; k < 4; k++) acc[k] += lhs[(i + k) * lstep] * rhs[(i + k) * rstep];
+		}
+		for (; i < n; i++) acc[0] += lhs[i * lstep] * rhs[i * rstep];
+		return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+	}
+
+	struct Extreme
+	{
+		float value = std::numeric_limits<float>::quiet_NaN();
+		int64_t index = -1;
+	};
+
+	// the first best scalar, NaN never wins
+	template<bool IsMax>
+	static void Update(Extreme& best, const Extreme& other) noexcept
+	{
+		if (other.index < 0) return;
+		if (best.index < 0 || (IsMax ? other.value > best.value : other.value < best.value)) best = other;
+	}
+
+	template<bool IsMax>
+	static Extreme ExtremeScalar(const float* data, int64_t n, int64_t step) noexcept
+	{
+		Extreme best;
+		for (int64_t i = 0; i < n; i++)
+		{
+			float x = data[i * step];
+			if (x == x && (best.index < 0 || (IsMax ? x > best.value : x < best.value)))
+			{
+				best.value = x;
+				best.index = i;
+			}
+		}
+		return best;
+	}
+
+#ifdef CHAOS_X86
+	CHAOS_TARGET("avx2,fma") static inline float HorizontalSum(__m256 v) noexcept
+	{
+		__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		return _mm_cvtss_f32(s);
+	}
+
+	template<Map M>
+	CHAOS_TARGET("avx2,fma") static inline __m256 Accumulate(__m256 acc, __m256 x) noexcept
+	{
+		if constexpr (M == Map::Abs) return _mm256_add_ps(acc, _mm256_andnot_ps(_mm256_set1_ps(-0.f), x));
+		else if constexpr (M == Map::Square) return _mm256_fmadd_ps(x, x, acc);
+		else return _mm256_add_ps(acc, x);
+	}
+
+	// 4 independent accumulators hide the latency of the adds
+	template<Map M>
+	CHAOS_TARGET("avx2,fma") static float SumAVX2(const float* data, int64_t n) noexcept
+	{
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		__m256 acc2 = _mm256_setzero_ps();
+		__m256 acc3 = _mm256_setzero_ps();
+		int64_t i = 0;
+		for (; i + 32 <= n; i += 32)
+		{
+			acc0 = Accumulate<M>(acc0, _mm256_loadu_ps(data + i));
+			acc1 = Accumulate<M>(acc1, _mm256_loadu_ps(data + i + 8));
+			acc2 = Accumulate<M>(acc2, _mm256_loadu_ps(data + i + 16));
+			acc3 = Accumulate<M>(acc3, _mm256_loadu_ps(data + i + 24));
+		}
+		for (; i + 8 <= n; i += 8) acc0 = Accumulate<M>(acc0, _mm256_loadu_ps(data + i));
+		float total = HorizontalSum(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+		return total + SumScalar<M>(data + i, n - i, 1);
+	}
+	CHAOS_TARGET("avx2,fma") static float DotAVX2(const float* lhs, const float* rhs, int64_t n) noexcept
+	{
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		__m256 acc2 = _mm256_setzero_ps();
+		__m256 acc3 = _mm256_setzero_ps();
+		int64_t i = 0;
+		for (; i + 32 <= n; i += 32)
+		{
+			acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(lhs + i), _mm256_loadu_ps(rhs + i), acc0);
+			acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(lhs + i + 8), _mm256_loadu_ps(rhs + i + 8), acc1);
+			acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(lhs + i + 16), _mm256_loadu_ps(rhs + i + 16), acc2);
+			acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(lhs + i + 24), _mm256_loadu_ps(rhs + i + 24), acc3);
+		}
+		for (; i + 8 <= n; i += 8) acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(lhs + i), _mm256_loadu_ps(rhs + i), acc0);
+		float total = HorizontalSum(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+		return total + DotScalar(lhs + i, 1, rhs + i, 1, n - i);
+	}
+
+	// find the value with the vectors, then its first index in the block that is still in L1
+	template<bool IsMax>
+	CHAOS_TARGET("avx2,fma") static Extreme ExtremeAVX2(const float* data, int64_t n) noexcept
+	{
+		if (n < 16) return ExtremeScalar<IsMax>(data, n, 1);
+
+		constexpr float init = IsMax ? -std::numeric_limits<float>::infinity() : std::numeric_limits<float>::infinity();
+		__m256 acc0 = _mm256_set1_ps(init);
+		__m256 acc1 = _mm256_set1_ps(init);
+		int64_t i = 0;
+		// min/max return the second operand when one is NaN, so NaN are skipped
+		for (; i + 16 <= n; i += 16)
+		{
+			__m256 x0 = _mm256_loadu_ps(data + i);
+			__m256 x1 = _mm256_loadu_ps(data + i + 8);
+			acc0 = IsMax ? _mm256_max_ps(x0, acc0) : _mm256_min_ps(x0, acc0);
+			acc1 = IsMax ? _mm256_max_ps(x1, acc1) : _mm256_min_ps(x1, acc1);
+		}
+		__m256 acc = IsMax ? _mm256_max_ps(acc0, acc1) : _mm256_min_ps(acc0, acc1);
+		alignas(32) float lanes[8];
+		_mm256_store_ps(lanes, acc);
+		float best = lanes[0];
+		for (int k = 1; k < 8; k++) best = IsMax ? std::max(best, lanes[k]) : std::min(best, lanes[k]);
+		for (; i < n; i++)
+		{
+			if (data[i] == data[i]) best = IsMax ? std::max(best, data[i]) : std::min(best, data[i]);
+		}
+
+		__m256 target = _mm256_set1_ps(best);
+		for (i = 0; i + 8 <= n; i += 8)
+		{
+			int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(data + i), target, _CMP_EQ_OQ));
+			if (mask) return Extreme{ best, i + std::countr_zero(static_cast<unsigned>(mask)) };
+		}
+		for (; i < n; i++)
+		{
+			if (data[i] == best) return Extreme{ best, i };
+		}
+		return Extreme(); // every scalar is NaN
+	}
+#endif
+
+	static bool UseAVX2() noexcept
+	{
+#ifdef CHAOS_X86
+		static const bool avx2 = CpuSupportAVX2() && CpuSupportFMA();
+		return avx2;
+#else
+		return false;
+#endif
+	}
+
+	template<Map M>
+	static float SumBlock(const float* data, int64_t n, int64_t step) noexcept
+	{
+#ifdef CHAOS_X86
+		if (step == 1 && UseAVX2()) return SumAVX2<M>(data, n);
+#endif
+		return SumScalar<M>(data, n, step);
+	}
+	static float DotBlock(const float* lhs, int64_t lstep, const float* rhs, int64_t rstep, int64_t n) noexcept
+	{
+#ifdef CHAOS_X86
+		if (lstep == 1 && rstep == 1 && UseAVX2()) return DotAVX2(lhs, rhs, n);
+#endif
+		return DotScalar(lhs, lstep, rhs, rstep, n);
+	}
+	template<bool IsMax>
+	static Extreme ExtremeBlock(const float* data, int64_t n, int64_t step) noexcept
+	{
+#ifdef CHAOS_X86
+		if (step == 1 && UseAVX2()) return ExtremeAVX2<IsMax>(data, n);
+#endif
+		return ExtremeScalar<IsMax>(data, n, step);
+	}
+
+	// a row of any length, block by block
+	template<Map M>
+	static void SumRow(Cascade& cascade, const float* data, int64_t n, int64_t step) noexcept
+	{
+		for (int64_t i = 0; i < n; i += reduce_block)
+		{
+			cascade.Add(SumBlock<M>(data + i * step, std::min(reduce_block, n - i), step));
+		}
+	}
+	static void DotRow(Cascade& cascade, const float* lhs, int64_t lstep, const float* rhs, int64_t rstep, int64_t n) noexcept
+	{
+		for (int64_t i = 0; i < n; i += reduce_block)
+		{
+			cascade.Add(DotBlock(lhs + i * lstep, lstep, rhs + i * rstep, rstep, std::min(reduce_block, n - i)));
+		}
+	}
+	template<bool IsMax>
+	static void ExtremeRow(Extreme& best, const float* data, int64_t n, int64_t step, int64_t index) noexcept
+	{
+		for (int64_t i = 0; i < n; i += reduce_block)
+		{
+			Extreme local = ExtremeBlock<IsMax>(data + i * step, std::min(reduce_block, n - i), step);
+			if (local.index >= 0) local.index += index + i;
+			Update<IsMax>(best, local);
+		}
+	}
+
+	// split [0, total) into at most reduce_ranges ranges and run func(k, begin, end) on each, return the number of ranges
+	template<class Func>
+	static int64_t SplitRanges(int64_t total, int64_t grain, Func&& func)
+	{
+		int64_t ranges = std::clamp<int64_t>(total / std::max<int64_t>(grain, 1), 1, reduce_ranges);
+		if (ranges == 1)
+		{
+			func(0, 0, total);
+			return 1;
+		}
+		ParallelFor(0, ranges, [&](int64_t first, int64_t last) {
+			for (int64_t k = first; k < last; k++) func(k, total * k / ranges, total * (k + 1) / ranges);
+		});
+		return ranges;
+	}
+
+	// func(ptrs, steps, n, index) on the runs of scalars of the elements [e0, e1) in row-major order,
+	// steps are in scalars and index is the flat scalar index of the first one
+	template<size_t N, class Func>
+	static void ForEachRun(const StridedLoop<N>& loop, const std::array<const float*, N>& base, int lanes, int64_t e0, int64_t e1, Func&& func)
+	{
+		if (e0 >= e1) return;
+		int64_t cols = loop.cols();
+		int64_t r0 = e0 / cols;
+		int64_t r1 = (e1 + cols - 1) / cols;
+
+		bool dense = true;
+		std::array<int64_t, N> steps;
+		std::array<int64_t, N> ones;
+		ones.fill(1);
+		for (size_t k = 0; k < N; k++)
+		{
+			dense = dense && loop.step(k) == 1;
+			steps[k] = loop.step(k) * lanes;
+		}
+
+		int64_t row = r0;
+		loop.ForEachRow(r0, r1, [&](const int64_t* offset) {
+			int64_t c0 = row == r0 ? e0 - r0 * cols : 0;
+			int64_t c1 = row == r1 - 1 ? e1 - row * cols : cols;
+			int64_t index = (row * cols + c0) * lanes;
+			std::array<const float*, N> ptrs;
+			for (size_t k = 0; k < N; k++) ptrs[k] = base[k] + (offset[k] + c0 * loop.step(k)) * lanes;
+			row++;
+
+			if (dense)
+			{
+				func(ptrs, ones, (c1 - c0) * lanes, index);
+			}
+			else if (lanes == 1)
+			{
+				func(ptrs, steps, c1 - c0, index);
+			}
+			else
+			{
+				// strided packed elements, the lanes of each are contiguous
+				for (int64_t c = c0; c < c1; c++, index += lanes)
+				{
+					func(ptrs, ones, lanes, index);
+					for (size_t k = 0; k < N; k++) ptrs[k] += steps[k];
+				}
+			}
+		});
+	}
+
+	static const float* FloatData(const Tensor& tensor)
+	{
+		CHECK(tensor.depth == Depth::D4) << "reductions work on float Tensors";
+		return static_cast<const float*>(tensor.data);
+	}
+
+	template<Map M>
+	static float SumAll(const Tensor& tensor)
+	{
+		if (tensor.empty()) return 0.f;
+		const float* data = FloatData(tensor);
+		int lanes = static_cast<int>(tensor.packing);
+		StridedLoop<1> loop(tensor.shape, { tensor.steps.data() });
+
+		float partials[reduce_ranges];
+		int64_t ranges = SplitRanges(loop.rows() * loop.cols(), reduce_grain / lanes, [&](int64_t k, int64_t e0, int64_t e1) {
+			Cascade cascade;
+			ForEachRun<1>(loop, { data }, lanes, e0, e1, [&](const auto& ptrs, const auto& steps, int64_t n, int64_t) {
+				SumRow<M>(cascade, ptrs[0], n, steps[0]);
+			});
+			partials[k] = cascade.Total();
+		});
+
+		Cascade total;
+		for (int64_t k = 0; k < ranges; k++) total.Add(partials[k]);
+		return total.Total();
+	}
+
+	template<bool IsMax>
+	static Extreme ExtremeAll(const Tensor& tensor)
+	{
+		if (tensor.empty()) return Extreme();
+		const float* data = FloatData(tensor);
+		int lanes = static_cast<int>(tensor.packing);
+		StridedLoop<1> loop(tensor.shape, { tensor.steps.data() });
+
+		Extreme partials[reduce_ranges];
+		int64_t ranges = SplitRanges(loop.rows() * loop.cols(), reduce_grain / lanes, [&](int64_t k, int64_t e0, int64_t e1) {
+			Extreme best;
+			ForEachRun<1>(loop, { data }, lanes, e0, e1, [&](const auto& ptrs, const auto& steps, int64_t n, int64_t index) {
+				ExtremeRow<IsMax>(best, ptrs[0], n, steps[0], index);
+			});
+			partials[k] = best;
+		});
+
+		Extreme best;
+		for (int64_t k = 0; k < ranges; k++) Update<IsMax>(best, partials[k]);
+		return best;
+	}
+
+	static int64_t Count(const Tensor& tensor)
+	{
+		return tensor.empty() ? 0 : static_cast<int64_t>(tensor.shape.total()) * static_cast<int>(tensor.packing);
+	}
+
+	float SumKernel(const float* data, size_t n)
+	{
+		float partials[reduce_ranges];
+		int64_t ranges = SplitRanges(static_cast<int64_t>(n), reduce_grain, [&](int64_t k, int64_t begin, int64_t end) {
+			Cascade cascade;
+			SumRow<Map::Identity>(cascade, data + begin, end - begin, 1);
+			partials[k] = cascade.Total();
+		});
+		Cascade total;
+		for (int64_t k = 0; k < ranges; k++) total.Add(partials[k]);
+		return total.Total();
+	}
+
+	float DotKernel(const float* lhs, const float* rhs, size_t n)
+	{
+		float partials[reduce_ranges];
+		int64_t ranges = SplitRanges(static_cast<int64_t>(n), reduce_grain, [&](int64_t k, int64_t begin, int64_t end) {
+			Cascade cascade;
+			DotRow(cascade, lhs + begin, 1, rhs + begin, 1, end - begin);
+			partials[k] = cascade.Total();
+		});
+		Cascade total;
+		for (int64_t k = 0; k < ranges; k++) total.Add(partials[k]);
+		return total.Total();
+	}
+
+	float sum(const Tensor& tensor)
+	{
+		return SumAll<Map::Identity>(tensor);
+	}
+
+	float mean(const Tensor& tensor)
+	{
+		int64_t count = Count(tensor);
+		return count == 0 ? 0.f : SumAll<Map::Identity>(tensor) / static_cast<float>(count);
+	}
+
+	float norm(const Tensor& tensor, const NormType& type)
+	{
+		return type == NormType::L1 ? SumAll<Map::Abs>(tensor) : std::sqrt(SumAll<Map::Square>(tensor));
+	}
+
+	float dot(const Tensor& lhs, const Tensor& rhs)
+	{
+		DCHECK_EQ(lhs.shape, rhs.shape) << "expect shape=" << lhs.shape << " but got " << rhs.shape;
+		CHECK(lhs.packing == rhs.packing) << "the packings should be the same";
+		if (lhs.empty()) return 0.f;
+		const float* ldata = FloatData(lhs);
+		const float* rdata = FloatData(rhs);
+		int lanes = static_cast<int>(lhs.packing);
+		StridedLoop<2> loop(lhs.shape, { lhs.steps.data(), rhs.steps.data() });
+
+		float partials[reduce_ranges];
+		int64_t ranges = SplitRanges(loop.rows() * loop.cols(), reduce_grain / lanes, [&](int64_t k, int64_t e0, int64_t e1) {
+			Cascade cascade;
+			ForEachRun<2>(loop, { ldata, rdata }, lanes, e0, e1, [&](const auto& ptrs, const auto& steps, int64_t n, int64_t) {
+				DotRow(cascade, ptrs[0], steps[0], ptrs[1], steps[1], n);
+			});
+			partials[k] = cascade.Total();
+		});
+
+		Cascade total;
+		for (int64_t k = 0; k < ranges; k++) total.Add(partials[k]);
+		return total.Total();
+	}
+
+	float min(const Tensor& tensor)
+	{
+		return ExtremeAll<false>(tensor).value;
+	}
+	float max(const Tensor& tensor)
+	{
+		return ExtremeAll<true>(tensor).value;
+	}
+	int64_t argmin(const Tensor& tensor)
+	{
+		return ExtremeAll<false>(tensor).index;
+	}
+	int64_t argmax(const Tensor& tensor)
+	{
+		return ExtremeAll<true>(tensor).index;
+	}
+
+
+	enum class ReduceOp
+	{
+		Sum,
+		Mean,
+		L1,
+		L2,
+		Min,
+		Max,
+		ArgMin,
+		ArgMax,
+	};
+
+	// one output, the reduced sub-space is walked by inner from data
+	template<ReduceOp Op>
+	static float ReduceOne(const StridedLoop<1>& inner, const float* data)
+	{
+		constexpr Map M = Op == ReduceOp::L1 ? Map::Abs : Op == ReduceOp::L2 ? Map::Square : Map::Identity;
+		constexpr bool is_max = Op == ReduceOp::Max || Op == ReduceOp::ArgMax;
+		int64_t cols = inner.cols();
+		int64_t step = inner.step(0);
+		if constexpr (Op == ReduceOp::Min || Op == ReduceOp::Max || Op == ReduceOp::ArgMin || Op == ReduceOp::ArgMax)
+		{
+			Extreme best;
+			int64_t row = 0;
+			inner.ForEachRow(0, inner.rows(), [&](const int64_t* offset) {
+				ExtremeRow<is_max>(best, data + offset[0], cols, step, row++ * cols);
+			});
+			if constexpr (Op == ReduceOp::ArgMin || Op == ReduceOp::ArgMax)
+			{
+				float result;
+				int index = static_cast<int>(best.index);
+				memcpy(&result, &index, sizeof(int));
+				return result;
+			}
+			else
+			{
+				return best.value;
+			}
+		}
+		else
+		{
+			Cascade cascade;
+			inner.ForEachRow(0, inner.rows(), [&](const int64_t* offset) {
+				SumRow<M>(cascade, data + offset[0], cols, step);
+			});
+			return cascade.Total();
+		}
+	}
+
+	// adjacent outputs whose inputs are adjacent too (e.g. a sum over the batch), added column by column
+	// so every input row is read once and in order; flushed to per-column cascades every column_block rows
+	constexpr int64_t column_tile = 64;
+	constexpr int64_t column_block = 256;
+
+	template<Map M>
+	static void SumColumns(const StridedLoop<1>& inner, const float* data, float* dst, int64_t n)
+	{
+		Cascade cascades[column_tile];
+		float acc[column_tile] = {};
+		int64_t count = 0;
+		auto flush = [&]() {
+			for (int64_t t = 0; t < n; t++)
+			{
+				cascades[t].Add(acc[t]);
+				acc[t] = 0.f;
+			}
+			count = 0;
+		};
+
+		int64_t cols = inner.cols();
+		int64_t step = inner.step(0);
+		inner.ForEachRow(0, inner.rows(), [&](const int64_t* offset) {
+			for (int64_t j = 0; j < cols; j++)
+			{
+				const float* src = data + offset[0] + j * step;
+				for (int64_t t = 0; t < n; t++) acc[t] += Apply<M>(src[t]);
+				if (++count == column_block) flush();
+			}
+		});
+		if (count > 0) flush();
+		for (int64_t t = 0; t < n; t++) dst[t] = cascades[t].Total();
+	}
+
+	template<ReduceOp Op>
+	static Tensor ReduceAxes(const Tensor& tensor, const Array<int>& axis, bool keep_dims, Allocator* allocator)
+	{
+		CHECK(not tensor.empty()) << "can not reduce an empty Tensor";
+		CHECK(tensor.packing == Packing::CHW) << "the Tensor should be CHW, Repack it first";
+		const float* data = FloatData(tensor);
+
+		int dims = static_cast<int>(tensor.shape.size());
+		bool reduced[StridedLoop<1>::max_dims] = {};
+		for (size_t i = 0; i < axis.size(); i++)
+		{
+			int a = axis.data()[i] < 0 ? axis.data()[i] + dims : axis.data()[i];
+			CHECK(a >= 0 && a < dims) << "axis " << axis.data()[i] << " out of " << dims << " dims";
+			reduced[a] = true;
+		}
+
+		// the outputs walk the kept dims, each output walks the reduced ones
+		Shape kept = tensor.shape;
+		Shape inner_shape = tensor.shape;
+		for (int d = 0; d < dims; d++)
+		{
+			if (reduced[d]) kept.data()[d] = 1; else inner_shape.data()[d] = 1;
+		}
+		int64_t count = inner_shape.total();
+
+		Tensor dst = Tensor(kept, Depth::D4, Packing::CHW, allocator);
+		StridedLoop<2> outer(kept, { dst.steps.data(), tensor.steps.data() });
+		StridedLoop<1> inner(inner_shape, { tensor.steps.data() });
+		float* out = static_cast<float*>(dst.data);
+
+		constexpr Map M = Op == ReduceOp::L1 ? Map::Abs : Op == ReduceOp::L2 ? Map::Square : Map::Identity;
+		constexpr bool columns = Op == ReduceOp::Sum || Op == ReduceOp::Mean || Op == ReduceOp::L1 || Op == ReduceOp::L2;
+		bool by_column = columns && outer.step(0) == 1 && outer.step(1) == 1 && outer.cols() > 1;
+
+		int64_t cols = outer.cols();
+		int64_t tile = by_column ? column_tile : 1;
+		int64_t tiles = (cols + tile - 1) / tile;
+		ParallelFor(0, outer.rows() * tiles, [&](int64_t first, int64_t last) {
+			for (int64_t t = first; t < last; t++)
+			{
+				int64_t r = t / tiles;
+				int64_t c0 = t % tiles * tile;
+				int64_t c1 = std::min(cols, c0 + tile);
+				outer.ForEachRow(r, r + 1, [&](const int64_t* offset) {
+					if (by_column)
+					{
+						SumColumns<M>(inner, data + offset[1] + c0, out + offset[0] + c0, c1 - c0);
+						return;
+					}
+					for (int64_t c = c0; c < c1; c++)
+					{
+						out[offset[0] + c * outer.step(0)] = ReduceOne<Op>(inner, data + offset[1] + c * outer.step(1));
+					}
+				});
+			}
+		}, std::max<int64_t>(1, reduce_grain / (tile * count)));
+
+		if constexpr (Op == ReduceOp::Mean)
+		{
+			for (int64_t i = 0; i < kept.total(); i++) out[i] /= static_cast<float>(count);
+		}
+		else if constexpr (Op == ReduceOp::L2)
+		{
+			for (int64_t i = 0; i < kept.total(); i++) out[i] = std::sqrt(out[i]);
+		}
+
+		if (not keep_dims)
+		{
+			Array<int> axes(static_cast<size_t>(std::count(reduced, reduced + dims, true)));
+			for (int d = 0, j = 0; d < dims; d++)
+			{
+				if (reduced[d]) axes[j++] = d;
+			}
+			dst.shape = Squeeze(kept, axes);
+			dst.steps = dst.shape.steps();
+		}
+		return dst;
+	}
+
+	Tensor sum(const Tensor& tensor, const Array<int>& axis, bool keep_dims, Allocator* allocator)
+	{
+		return ReduceAxes<ReduceOp::Sum>(tensor, axis, keep_dims, allocator);
+	}
+	Tensor mean(const Tensor& tensor, const Array<int>& axis, bool keep_dims, Allocator* allocator)
+	{
+		return ReduceAxes<ReduceOp::Mean>(tensor, axis, keep_dims, allocator);
+	}
+	Tensor norm(const Tensor& tensor, const NormType& type, const Array<int>& axis, bool keep_dims, Allocator* allocator)
+	{
+		if (type == NormType::L1) return ReduceAxes<ReduceOp::L1>(tensor, axis, keep_dims, allocator);
+		return ReduceAxes<ReduceOp::L2>(tensor, axis, keep_dims, allocator);
+	}
+	Tensor min(const Tensor& tensor, const Array<int>& axis, bool keep_dims, Allocator* allocator)
+	{
+		return ReduceAxes<ReduceOp::Min>(tensor, axis, keep_dims, allocator);
+	}
+	Tensor max(const Tensor& tensor, const Array<int>& axis, bool keep_dims, Allocator* allocator)
+	{
+		return ReduceAxes<ReduceOp::Max>(tensor, axis, keep_dims, allocator);
+	}
+	Tensor argmin(const Tensor& tensor, int axis, bool keep_dims, Allocator* allocator)
+	{
+		return ReduceAxes<ReduceOp::ArgMin>(tensor, { axis }, keep_dims, allocator);
+	}
+	Tensor argmax(const Tensor& tensor, int axis, bool keep_dims, Allocator* allocator)
+	{
+		return ReduceAxes<ReduceOp::ArgMax>(tensor, { axis }, keep_dims, allocator);
+	}
+}
\ No newline at end of file
@@ -1,6 +1,25 @@
 #include "core/tensor.hpp"
+#include "core/parallel.hpp"
+#include "core/random.hpp"
+#include "core/strided.hpp"
 
-#include <random>
+#include <utility>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#define NOGDI // wingdi.h defines ERROR
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 namespace chaos
 {
@@ -22,7 +41,7 @@ namespace chaos
 
 	Tensor::Tensor(const Tensor& tensor) :
 		data(tensor.data), ref_cnt(tensor.ref_cnt), allocator(tensor.allocator),
-		shape(tensor.shape), steps(tensor.steps), depth(tensor.depth), packing(tensor.packing)
+		shape(tensor.shape), steps(tensor.steps), depth(tensor.depth), packing(tensor.packing), read_only(tensor.read_only)
 	{
 		if (ref_cnt) CHAOS_XADD(ref_cnt, 1);
 	}
@@ -42,13 +61,61 @@ namespace chaos
 		steps = tensor.steps;
 		depth = tensor.depth;
 		packing = tensor.packing;
+		read_only = tensor.read_only;
+
+		return *this;
+	}
+
+	Tensor::Tensor(Tensor&& tensor) noexcept :
+		data(std::exchange(tensor.data, nullptr)), allocator(std::exchange(tensor.allocator, nullptr)), ref_cnt(std::exchange(tensor.ref_cnt, nullptr)),
+		shape(std::move(tensor.shape)), steps(std::move(tensor.steps)), depth(tensor.depth), packing(tensor.packing), read_only(std::exchange(tensor.read_only, false)) {}
+	Tensor& Tensor::operator=(Tensor&& tensor) noexcept
+	{
+		if (this == &tensor) return *this;
+
+		Release();
+
+		data = std::exchange(tensor.data, nullptr);
+		ref_cnt = std::exchange(tensor.ref_cnt, nullptr);
+		allocator = std::exchange(tensor.allocator, nullptr);
+
+		shape = std::move(tensor.shape);
+		steps = std::move(tensor.steps);
+		depth = tensor.depth;
+		packing = tensor.packing;
+		read_only = std::exchange(tensor.read_only, false);
 
 		return *this;
 	}
 
+	void Tensor::swap(Tensor& tensor) noexcept
+	{
+		std::swap(data, tensor.data);
+		std::swap(ref_cnt, tensor.ref_cnt);
+		std::swap(allocator, tensor.allocator);
+
+		std::swap(shape, tensor.shape);
+		std::swap(steps, tensor.steps);
+		std::swap(depth, tensor.depth);
+		std::swap(packing, tensor.packing);
+		std::swap(read_only, tensor.read_only);
+	}
+
+	Tensor Tensor::Borrow() const noexcept
+	{
+		Tensor tensor;
+		tensor.data = data;
+		tensor.shape = shape;
+		tensor.steps = steps;
+		tensor.depth = depth;
+		tensor.packing = packing;
+		tensor.read_only = read_only;
+		return tensor;
+	}
+
 	void Tensor::Create(const Shape& new_shape, const Steps& new_steps, const Depth& new_depth, const Packing& new_packing, Allocator* new_allocator)
 	{
-		if (shape == new_shape && steps == new_steps && depth == new_depth && packing == new_packing && allocator == new_allocator)
+		if (shape == new_shape && steps == new_steps && depth == new_depth && packing == new_packing && allocator == new_allocator && !read_only)
 			return;
 
 		Release();
@@ -63,7 +130,8 @@ namespace chaos
 		size_t total = static_cast<size_t>(shape[0]) * steps[0];
 		if (total > 0)
 		{
-			size_t capacity = AlignSize(total * depth * packing, 4);
+			// pad to the alignment, so that vector loads and stores on the tail stay inside the block
+			size_t capacity = AlignSize(total * depth * packing, static_cast<int>(GetDefaultAlignment()));
 			if (allocator)
 			{
 				data = allocator->FastMalloc(capacity + sizeof(ref_cnt));
@@ -99,6 +167,59 @@ namespace chaos
 		data = nullptr;
 		ref_cnt = nullptr;
 		allocator = nullptr;
+		read_only = false;
+	}
+
+	template<class Type>
+	static void CopyStrided(uchar* dst, const uchar* src, int64_t n, int64_t dstep, int64_t sstep)
+	{
+		Type* d = reinterpret_cast<Type*>(dst);
+		const Type* s = reinterpret_cast<const Type*>(src);
+		if (dstep == 1)
+		{
+			int64_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+			if constexpr (sizeof(Type) == 4)
+			{
+				// deinterleave, e.g. the real part of complex data or a channel of C2HW2
+				for (; sstep == 2 && i + 4 <= n; i += 4)
+				{
+					__m128 v0 = _mm_loadu_ps(reinterpret_cast<const float*>(s + i * 2));
+					__m128 v1 = _mm_loadu_ps(reinterpret_cast<const float*>(s + i * 2 + 4));
+					_mm_storeu_ps(reinterpret_cast<float*>(d + i), _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0)));
+				}
+			}
+#endif
+			for (; i < n; i++) d[i] = s[i * sstep];
+		}
+		else if (sstep == 1)
+		{
+			for (int64_t i = 0; i < n; i++) d[i * dstep] = s[i];
+		}
+		else
+		{
+			for (int64_t i = 0; i < n; i++) d[i * dstep] = s[i * sstep];
+		}
+	}
+
+	static void CopyRow(uchar* dst, const uchar* src, int64_t n, int64_t dstep, int64_t sstep, size_t esize)
+	{
+		if (dstep == 1 && sstep == 1)
+		{
+			memcpy(dst, src, n * esize);
+			return;
+		}
+
+		switch (esize)
+		{
+		case 1: CopyStrided<uint8_t>(dst, src, n, dstep, sstep); break;
+		case 2: CopyStrided<uint16_t>(dst, src, n, dstep, sstep); break;
+		case 4: CopyStrided<uint32_t>(dst, src, n, dstep, sstep); break;
+		case 8: CopyStrided<uint64_t>(dst, src, n, dstep, sstep); break;
+		default:
+			for (int64_t i = 0; i < n; i++) memcpy(dst + i * dstep * esize, src + i * sstep * esize, esize);
+			break;
+		}
 	}
 
 	void Tensor::CopyTo(Tensor& tensor) const
@@ -107,26 +228,28 @@ namespace chaos
 		DCHECK_EQ(shape, tensor.shape) << "expect shape=" << shape << " but got " << tensor.shape;
 		if (steps == tensor.steps)
 		{
-			memcpy(tensor.data, data, total() * depth * packing);
+			// large copies are split, a single core can not saturate the memory bandwidth
+			uchar* dst = static_cast<uchar*>(tensor.data);
+			const uchar* src = static_cast<const uchar*>(data);
+			ParallelFor(0, total() * depth * packing, [=](int64_t first, int64_t last) {
+				memcpy(dst + first, src + first, last - first);
+			}, 4 << 20);
 		}
 		else
 		{
-			size_t dims = shape.size();
+			// merge the dims contiguous in both, then copy whole rows
 			size_t esize = 1 * depth * packing;
-			for (size_t i = 0; i < shape.total(); i++)
-			{
-				size_t dofst = 0; // dst offset
-				size_t sofst = 0; // src offset
-				size_t idx = i;
-				for (int d = 1; d <= dims; d++)
-				{
-					size_t k = idx % shape[-d];
-					dofst += k * tensor.steps[-d];
-					sofst += k * steps[-d];
-					idx /= shape[-d];
-				}
-				memcpy((uchar*)tensor.data + dofst * esize, (const uchar*)data + sofst * esize, esize);
-			}
+			StridedLoop<2> loop(shape, { tensor.steps.data(), steps.data() });
+			uchar* dst = static_cast<uchar*>(tensor.data);
+			const uchar* src = static_cast<const uchar*>(data);
+			int64_t cols = loop.cols();
+			int64_t dstep = loop.step(0);
+			int64_t sstep = loop.step(1);
+			ParallelFor(0, loop.rows(), [&](int64_t first, int64_t last) {
+				loop.ForEachRow(first, last, [=](const int64_t* offset) {
+					CopyRow(dst + offset[0] * esize, src + offset[1] * esize, cols, dstep, sstep, esize);
+				});
+			}, std::max<int64_t>(1, (1 << 18) / (cols * esize)));
 		}
 	}
 
@@ -168,7 +291,9 @@ namespace chaos
 		{
 			if (new_shape[i] != 1) sub_steps[j++] = steps[i];
 		}
-		return Tensor(sub_shape, depth, packing, (uchar*)data + offset * depth * packing, sub_steps);
+		Tensor sub = Tensor(sub_shape, depth, packing, (uchar*)data + offset * depth * packing, sub_steps);
+		sub.read_only = read_only;
+		return sub;
 	}
 
 	
@@ -192,25 +317,24 @@ namespace chaos
 		return Cut(sub, at);
 	}
 
-	static std::default_random_engine engine;
 	Tensor Tensor::randn(const Shape& shape, float mu, float sigma, Allocator* allocator)
 	{
-		std::normal_distribution<float> normal(mu, sigma);
+		return randn(shape, Philox::Global(), mu, sigma, allocator);
+	}
+	Tensor Tensor::randu(const Shape& shape, float min, float max, Allocator* allocator)
+	{
+		return randu(shape, Philox::Global(), min, max, allocator);
+	}
+	Tensor Tensor::randn(const Shape& shape, Philox& generator, float mu, float sigma, Allocator* allocator)
+	{
 		Tensor r = Tensor(shape, Depth::D4, Packing::CHW, allocator);
-		for (size_t i = 0; i < shape.total(); i++)
-		{
-			r[i] = normal(engine);
-		}
+		generator.Normal(static_cast<float*>(r.data), r.total(), mu, sigma);
 		return r;
 	}
-	Tensor Tensor::randu(const Shape& shape, float min, float max, Allocator* allocator)
+	Tensor Tensor::randu(const Shape& shape, Philox& generator, float min, float max, Allocator* allocator)
 	{
-		std::uniform_real_distribution<float> uniform(min, max);
 		Tensor r = Tensor(shape, Depth::D4, Packing::CHW, allocator);
-		for (size_t i = 0; i < shape.total(); i++)
-		{
-			r[i] = uniform(engine);
-		}
+		generator.Uniform(static_cast<float*>(r.data), r.total(), min, max);
 		return r;
 	}
 	Tensor Tensor::zeros(const Shape& shape, Allocator* allocator)
@@ -229,4 +353,100 @@ namespace chaos
 		}
 		return e;
 	}
+
+	// owns a read-only view of a file and the reference counter of the Tensors on it
+	// FastFree is called by the last Tensor::Release, it unmaps the file and deletes the owner
+	class FileMapping : public Allocator
+	{
+	public:
+		static FileMapping* Open(const char* path, size_t offset, size_t length)
+		{
+#ifdef _WIN32
+			HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) return nullptr;
+
+			LARGE_INTEGER file_size;
+			GetFileSizeEx(file, &file_size);
+			if (static_cast<size_t>(file_size.QuadPart) < offset + length)
+			{
+				CloseHandle(file);
+				return nullptr;
+			}
+
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			CloseHandle(file);
+			if (nullptr == mapping) return nullptr;
+
+			SYSTEM_INFO info;
+			GetSystemInfo(&info);
+			size_t start = offset / info.dwAllocationGranularity * info.dwAllocationGranularity;
+			void* base = MapViewOfFile(mapping, FILE_MAP_READ, static_cast<DWORD>(start >> 32), static_cast<DWORD>(start), offset - start + length);
+			CloseHandle(mapping);
+			if (nullptr == base) return nullptr;
+#else
+			int fd = open(path, O_RDONLY);
+			if (fd < 0) return nullptr;
+
+			struct stat st;
+			if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < offset + length)
+			{
+				close(fd);
+				return nullptr;
+			}
+
+			size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+			size_t start = offset / page * page;
+			void* base = mmap(nullptr, offset - start + length, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(start));
+			close(fd); // the mapping keeps the file open
+			if (base == MAP_FAILED) return nullptr;
+#endif
+			FileMapping* mapping = new FileMapping();
+			mapping->base = base;
+			mapping->length = offset - start + length;
+			mapping->data = static_cast<uchar*>(base) + (offset - start);
+			return mapping;
+		}
+
+		void* FastMalloc(size_t) override
+		{
+			LOG(FATAL) << "a file mapping can not allocate memory";
+			return nullptr;
+		}
+		void FastFree(void*) override
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(base);
+#else
+			munmap(base, length);
+#endif
+			delete this;
+		}
+
+		void* base = nullptr;
+		size_t length = 0;
+
+		void* data = nullptr;
+		int ref_cnt = 1;
+	};
+
+	Tensor Tensor::Map(const File& file, const Shape& shape, const Depth& depth, const Packing& packing, size_t offset, const Steps& steps)
+	{
+		DCHECK_GT(shape.size(), 0) << "expect a non-empty shape";
+
+		Tensor tensor = Tensor(shape, depth, packing, nullptr, steps);
+		size_t length = static_cast<size_t>(shape[0]) * tensor.steps[0] * depth * packing;
+
+		FileMapping* mapping = length > 0 ? FileMapping::Open(file.data(), offset, length) : nullptr;
+		if (nullptr == mapping)
+		{
+			LOG(ERROR) << "can not map " << length << " bytes at " << offset << " from " << file;
+			return Tensor();
+		}
+
+		tensor.data = mapping->data;
+		tensor.allocator = mapping;
+		tensor.ref_cnt = &mapping->ref_cnt;
+		tensor.read_only = true;
+		return tensor;
+	}
 }
\ No newline at end of file
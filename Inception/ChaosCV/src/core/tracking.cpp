@@ -0,0 +1,190 @@
+#include "core/tracking.hpp"
+#include "core/log.hpp"
+
+#include <bit>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <iomanip>
+#include <sstream>
+#include <unordered_map>
+
+namespace chaos
+{
+	class AllocationRecords
+	{
+	public:
+		struct Record
+		{
+			size_t size = 0;
+			const char* tag = nullptr;
+		};
+
+		std::string name;
+		bool report_leaks = true;
+
+		mutable std::mutex mtx;
+		AllocationStats stats;
+		std::unordered_map<void*, Record> blocks;
+	};
+
+	static thread_local const char* current_tag = nullptr;
+
+	AllocationTracker::AllocationTracker(const std::string& name, bool report_leaks) : records(new AllocationRecords())
+	{
+		records->name = name;
+		records->report_leaks = report_leaks;
+	}
+	AllocationTracker::~AllocationTracker()
+	{
+		// ReportLeaks reads the blocks under the lock, a pool may still free into the tracker from another thread
+		if (records->report_leaks)
+		{
+			std::stringstream report;
+			if (ReportLeaks(report)) LOG(WARNING) << report.str();
+		}
+		delete records;
+	}
+
+	void AllocationTracker::OnMalloc(void* ptr, size_t size)
+	{
+		if (nullptr == ptr) return;
+
+		const char* tag = current_tag;
+
+		std::lock_guard lock(records->mtx);
+		auto& stats = records->stats;
+		stats.live_bytes += size;
+		stats.peak_bytes = std::max(stats.peak_bytes, stats.live_bytes);
+		stats.live_blocks++;
+		stats.allocations++;
+		stats.histogram[std::min<size_t>(std::bit_width(size), stats.histogram.size() - 1)]++;
+
+		if (tag)
+		{
+			auto& tag_stats = stats.tags[tag];
+			tag_stats.live_bytes += size;
+			tag_stats.peak_bytes = std::max(tag_stats.peak_bytes, tag_stats.live_bytes);
+			tag_stats.allocations++;
+		}
+
+		records->blocks[ptr] = { size, tag };
+	}
+
+	void AllocationTracker::OnFree(void* ptr)
+	{
+		if (nullptr == ptr) return;
+
+		std::lock_guard lock(records->mtx);
+		auto iter = records->blocks.find(ptr);
+		if (iter == records->blocks.end()) return; // allocated before tracking
+
+		auto& stats = records->stats;
+		auto [size, tag] = iter->second;
+		stats.live_bytes -= size;
+		stats.live_blocks--;
+		stats.frees++;
+		if (tag) stats.tags[tag].live_bytes -= size;
+
+		records->blocks.erase(iter);
+	}
+
+	AllocationStats AllocationTracker::Snapshot() const
+	{
+		std::lock_guard lock(records->mtx);
+		return records->stats;
+	}
+
+	void AllocationTracker::Dump(std::ostream& stream) const
+	{
+		AllocationStats stats = Snapshot();
+		stream << "[" << records->name << "] live " << stats.live_bytes << " bytes in " << stats.live_blocks
+			<< " blocks, peak " << stats.peak_bytes << " bytes, " << stats.allocations << " allocations, " << stats.frees << " frees" << std::endl;
+		for (size_t i = 0; i < stats.histogram.size(); i++)
+		{
+			if (0 == stats.histogram[i]) continue;
+			size_t low = i == 0 ? 0 : static_cast<size_t>(1) << (i - 1);
+			stream << "  [" << std::setw(12) << low << ", " << std::setw(12) << (low == 0 ? 1 : low * 2) << ") " << stats.histogram[i] << std::endl;
+		}
+		for (const auto& [tag, tag_stats] : stats.tags)
+		{
+			stream << "  " << tag << ": live " << tag_stats.live_bytes << " bytes, peak " << tag_stats.peak_bytes
+				<< " bytes, " << tag_stats.allocations << " allocations" << std::endl;
+		}
+	}
+
+	size_t AllocationTracker::ReportLeaks(std::ostream& stream) const
+	{
+		std::lock_guard lock(records->mtx);
+		if (records->blocks.empty()) return 0;
+
+		stream << "[" << records->name << "] " << records->blocks.size() << " blocks (" << records->stats.live_bytes << " bytes) still alive";
+		std::map<std::string, std::pair<size_t, size_t>> by_tag; // tag -> (blocks, bytes)
+		for (const auto& [ptr, record] : records->blocks)
+		{
+			auto& [blocks, bytes] = by_tag[record.tag ? record.tag : "<untagged>"];
+			blocks++;
+			bytes += record.size;
+		}
+		for (const auto& [tag, leak] : by_tag)
+		{
+			stream << std::endl << "  " << tag << ": " << leak.first << " blocks, " << leak.second << " bytes";
+		}
+		return records->blocks.size();
+	}
+
+	void AllocationTracker::Reset()
+	{
+		std::lock_guard lock(records->mtx);
+		records->stats = AllocationStats();
+		records->blocks.clear();
+	}
+
+
+	TrackingAllocator::TrackingAllocator(Allocator* allocator, const std::string& name, bool report_leaks) :
+		allocator(allocator), tracker(name, report_leaks) {}
+
+	void* TrackingAllocator::FastMalloc(size_t size)
+	{
+		void* ptr = allocator ? allocator->FastMalloc(size) : chaos::FastMalloc(size);
+		tracker.OnMalloc(ptr, size);
+		return ptr;
+	}
+	void TrackingAllocator::FastFree(void* ptr)
+	{
+		tracker.OnFree(ptr);
+		if (allocator)
+		{
+			allocator->FastFree(ptr);
+		}
+		else
+		{
+			chaos::FastFree(ptr);
+		}
+	}
+
+
+	AllocationTag::AllocationTag(const char* tag) : previous(current_tag)
+	{
+		current_tag = tag;
+	}
+	AllocationTag::~AllocationTag()
+	{
+		current_tag = previous;
+	}
+	const char* AllocationTag::Current() noexcept
+	{
+		return current_tag;
+	}
+
+
+	static std::atomic<AllocationTracker*> default_tracker = nullptr;
+	void SetDefaultTracker(AllocationTracker* tracker)
+	{
+		default_tracker.store(tracker, std::memory_order_release);
+	}
+	AllocationTracker* GetDefaultTracker()
+	{
+		return default_tracker.load(std::memory_order_acquire);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include "dnn/fusion.hpp"
+#include "dnn/layers/convolution.hpp"
+#include "dnn/layers/elementwise.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		// the steps of a layer computing each element from the same element of its input
+		static bool StepsOf(const Layer& layer, std::vector<ElementwiseStep>& steps)
+		{
+			steps.clear();
+			if (auto bn = dynamic_cast<const BatchNorm*>(&layer)) steps.push_back({ bn->scale, bn->shift, Activation() });
+			else if (auto scale = dynamic_cast<const Scale*>(&layer)) steps.push_back({ scale->scale, scale->bias, Activation() });
+			else if (auto relu = dynamic_cast<const ReLU*>(&layer)) steps.push_back({ Tensor(), Tensor(), { ActivationType::ReLU, relu->slope } });
+			else if (dynamic_cast<const Sigmoid*>(&layer)) steps.push_back({ Tensor(), Tensor(), { ActivationType::Sigmoid, 0.f } });
+			else if (auto elementwise = dynamic_cast<const Elementwise*>(&layer))
+			{
+				for (size_t i = 0; i < elementwise->num_steps(); i++) steps.push_back(elementwise->step(i));
+			}
+			else return false;
+			return true;
+		}
+
+		// the channels of the scales and shifts, 0 if there are none, -1 if they differ
+		static int Channels(const std::vector<ElementwiseStep>& steps)
+		{
+			int channels = 0;
+			for (const auto& step : steps)
+			{
+				for (const Tensor* values : { &step.scale, &step.shift })
+				{
+					if (values->empty()) continue;
+					if (channels != 0 and channels != values->shape.total()) return -1;
+					channels = values->shape.total();
+				}
+			}
+			return channels;
+		}
+
+		// weight * scale[o] and bias * scale[o] + shift[o] for each output channel o, then the activation in the epilogue
+		static std::shared_ptr<Layer> Fold(const Convolution& conv, const ElementwiseStep& step)
+		{
+			int out = conv.out_channels;
+			Tensor weight = conv.weight;
+			Tensor bias = conv.bias;
+			if (not step.scale.empty())
+			{
+				weight = conv.weight.Clone();
+				int size = weight.shape.total() / out;
+				for (int o = 0; o < out; o++)
+				{
+					for (int j = 0; j < size; j++) weight[o * size + j] *= step.scale[o];
+				}
+			}
+			if (not step.shift.empty() or (not step.scale.empty() and not bias.empty()))
+			{
+				bias = Tensor::zeros(Shape(out));
+				for (int o = 0; o < out; o++)
+				{
+					float b = conv.bias.empty() ? 0.f : conv.bias[o];
+					bias[o] = (step.scale.empty() ? b : b * step.scale[o]) + (step.shift.empty() ? 0.f : step.shift[o]);
+				}
+			}
+
+			auto fused = std::make_shared<Convolution>(weight, bias, conv.stride_h, conv.pad_h, conv.dilation_h, conv.groups);
+			fused->stride_w = conv.stride_w;
+			fused->pad_w = conv.pad_w;
+			fused->dilation_w = conv.dilation_w;
+			fused->algorithm = conv.algorithm;
+			fused->activation = step.activation;
+			return fused;
+		}
+
+		std::shared_ptr<Layer> FuseLayers(const std::shared_ptr<Layer>& layer, const std::shared_ptr<Layer>& next)
+		{
+			std::vector<ElementwiseStep> steps;
+			if (not layer or not next or not StepsOf(*next, steps)) return nullptr;
+			// a Product or a Max combines several inputs, only a chain on the one output of layer fuses
+			auto chain = dynamic_cast<const Elementwise*>(next.get());
+			if (chain and chain->op != ElementwiseOp::Sum) return nullptr;
+
+			if (auto conv = dynamic_cast<const Convolution*>(layer.get()))
+			{
+				// past an activation, or with several steps, the rest is no longer one affine map per channel
+				if (conv->activation.type != ActivationType::Identity or steps.size() != 1) return nullptr;
+				int channels = Channels(steps);
+				if (channels != 0 and channels != conv->out_channels) return nullptr;
+				return Fold(*conv, steps[0]);
+			}
+
+			std::vector<ElementwiseStep> first;
+			if (not StepsOf(*layer, first)) return nullptr;
+			int before = Channels(first);
+			int after = Channels(steps);
+			if (before < 0 or after < 0 or (before != 0 and after != 0 and before != after)) return nullptr;
+
+			auto elementwise = dynamic_cast<const Elementwise*>(layer.get());
+			auto fused = std::make_shared<Elementwise>(elementwise ? elementwise->op : ElementwiseOp::Sum);
+			for (const auto& step : first) fused->Append(step);
+			for (const auto& step : steps) fused->Append(step);
+			return fused;
+		}
+
+		std::vector<std::shared_ptr<Layer>> FuseSequence(const std::vector<std::shared_ptr<Layer>>& layers)
+		{
+			std::vector<std::shared_ptr<Layer>> fused;
+			for (const auto& layer : layers)
+			{
+				std::shared_ptr<Layer> both = fused.empty() ? nullptr : FuseLayers(fused.back(), layer);
+				if (both) fused.back() = both;
+				else fused.push_back(layer);
+			}
+			return fused;
+		}
+	}
+}
\ No newline at end of file
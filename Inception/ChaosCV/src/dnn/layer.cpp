@@ -1,43 +1,223 @@
 #include "dnn/layer.hpp"
 
+#include <algorithm>
+#include <memory>
+#include <optional>
+
 namespace chaos
 {
 	namespace dnn
 	{
 		Layer::Layer(const std::string& type) : type(type) {}
 
+		// an output given by the caller that a Forward writes directly
+		static bool Fits(const Tensor& output_blob, const Shape& shape, const Depth& depth, const Packing& packing)
+		{
+			return not output_blob.empty() and output_blob.shape == shape and output_blob.depth == depth and
+				output_blob.packing == packing and output_blob.contiguous() and not output_blob.read_only;
+		}
+
+		void Layer::CreateOutput(Tensor& output_blob, const Shape& shape, const Depth& depth, const Packing& packing, const Option& opt)
+		{
+			if (not Fits(output_blob, shape, depth, packing)) output_blob = Tensor(shape, depth, packing, opt.blob_allocator);
+		}
+
 		void Layer::Forward(const Tensor& input_blob, Tensor& output_blob, const Option& opt) const
 		{
-			CHECK(support_inplace);
+			CHECK(support_inplace) << "layer " << type << " implements no Forward";
+			if (not support_inplace) return;
 
-			output_blob = input_blob.Clone(opt.blob_allocator);
+			CreateOutput(output_blob, input_blob.shape, input_blob.depth, input_blob.packing, opt);
 			CHECK(not output_blob.empty());
+			input_blob.CopyTo(output_blob);
 
 			Forward(output_blob, opt);
 		}
 
 		void Layer::Forward(Tensor& input_output_blob, const Option& opt) const
 		{
-			LOG(FATAL);
+			CHECK(support_outplace) << "layer " << type << " implements no Forward";
+			if (not support_outplace) return;
+
+			Tensor output_blob;
+			Forward(static_cast<const Tensor&>(input_output_blob), output_blob, opt);
+			input_output_blob = std::move(output_blob);
 		}
 
-		void Layer::Forward(const std::vector<Tensor>& input_blobs, std::vector<Tensor>& output_blobs, const Option& opt) const
+		void Layer::Forward(Tensor&& input_blob, Tensor& output_blob, const Option& opt) const
 		{
-			CHECK(support_inplace);
+			if (&input_blob == &output_blob)
+			{
+				Forward(output_blob, opt);
+				return;
+			}
 
+			// the data is ours alone, so writing it in place is invisible to anyone else
+			bool unique = input_blob.ref_cnt and *input_blob.ref_cnt == 1 and not input_blob.read_only;
+			if (support_inplace and unique)
+			{
+				output_blob = std::move(input_blob);
+				Forward(output_blob, opt);
+				return;
+			}
+
+			Forward(static_cast<const Tensor&>(input_blob), output_blob, opt);
+			input_blob.Release();
+		}
+
+		void Layer::Forward(const std::vector<Tensor>& input_blobs, std::vector<Tensor>& output_blobs, const Option& opt) const
+		{
 			output_blobs.resize(input_blobs.size());
-			for (int i = 0; i < input_blobs.size(); i++)
+			for (size_t i = 0; i < input_blobs.size(); i++)
 			{
-				output_blobs[i] = input_blobs[i].Clone(opt.blob_allocator);
+				Forward(input_blobs[i], output_blobs[i], opt);
 				CHECK(not output_blobs[i].empty());
 			}
+		}
 
-			Forward(output_blobs, opt);
+		void Layer::Forward(std::vector<Tensor>& input_output_blobs, const Option& opt) const
+		{
+			for (auto& blob : input_output_blobs) Forward(blob, opt);
+		}
+
+		bool Layer::StackBatch(const Tensor&, int) const
+		{
+			return false;
 		}
 
-		void Layer::Forward(std::vector<Tensor>& blobs, const Option& opt) const
+		// the blobs go into one stack when they share shape, depth and packing
+		static bool Stackable(const std::vector<Tensor>& blobs)
 		{
-			LOG(FATAL);
+			if (blobs.size() < 2) return false;
+			const Tensor& first = blobs[0];
+			for (const auto& blob : blobs)
+			{
+				if (blob.empty() or blob.shape != first.shape or blob.depth != first.depth or blob.packing != first.packing) return false;
+			}
+			return true;
+		}
+
+		// owns the stacked output of ForwardBatch and the reference counter of the frames viewing it
+		// FastFree is called by the last Tensor::Release of a frame, it releases the stack and deletes the owner
+		class StackFrames : public Allocator
+		{
+		public:
+			explicit StackFrames(Tensor&& stack) : stack(std::move(stack)) {}
+
+			void* FastMalloc(size_t) override
+			{
+				LOG(FATAL) << "the frames of a stack can not allocate memory";
+				return nullptr;
+			}
+			void FastFree(void*) override
+			{
+				delete this;
+			}
+
+			Tensor stack;
+			int ref_cnt = 0;
+		};
+
+		// [n, shape...]
+		static Shape StackShape(const Shape& shape, int n)
+		{
+			int dims = static_cast<int>(shape.size());
+			Shape stack = Array<int>(dims + 1, n);
+			for (int i = 0; i < dims; i++) stack[i + 1] = shape[i];
+			return stack;
+		}
+
+		void Layer::ForwardBatch(const std::vector<Tensor>& input_blobs, std::vector<Tensor>& output_blobs, const Option& opt) const
+		{
+			int n = static_cast<int>(input_blobs.size());
+			output_blobs.resize(n);
+			if (n == 0) return;
+
+			if (opt.batch_stacking and Stackable(input_blobs) and StackBatch(input_blobs[0], n))
+			{
+				const Tensor& first = input_blobs[0];
+				// an in-place layer gives the stack back as its result, which the outputs then view, so it is no scratch
+				Tensor stack = Tensor(StackShape(first.shape, n), first.depth, first.packing, opt.blob_allocator);
+				size_t in_bytes = stack.steps[0] * first.depth * first.packing;
+				ParallelFor(0, n, [&](int64_t begin, int64_t end) {
+					for (int64_t i = begin; i < end; i++)
+					{
+						Tensor frame = Tensor(first.shape, first.depth, first.packing, static_cast<uchar*>(stack.data) + i * in_bytes);
+						input_blobs[i].CopyTo(frame);
+					}
+				}, 1, opt.num_threads, opt.thread_pool);
+
+				Tensor result;
+				Forward(std::move(stack), result, opt);
+				CHECK(not result.empty() and result.contiguous() and result.shape[0] == n) << "layer " << type << " gives no stack of " << n;
+				if (result.empty() or not result.contiguous() or result.shape[0] != n) return;
+
+				int dims = static_cast<int>(result.shape.size()) - 1;
+				Shape shape = Array<int>(dims);
+				for (int i = 0; i < dims; i++) shape[i] = result.shape[i + 1];
+				size_t out_bytes = result.steps[0] * result.depth * result.packing;
+				Depth depth = result.depth;
+				Packing packing = result.packing;
+				uchar* data = static_cast<uchar*>(result.data);
+
+				// the outputs are views into the stack, which the last of them frees, only the outputs given are copied into
+				StackFrames* owner = new StackFrames(std::move(result));
+				std::vector<int> given;
+				for (int i = 0; i < n; i++)
+				{
+					if (Fits(output_blobs[i], shape, depth, packing))
+					{
+						given.push_back(i);
+						continue;
+					}
+					Tensor frame = Tensor(shape, depth, packing, data + i * out_bytes);
+					frame.allocator = owner;
+					frame.ref_cnt = &owner->ref_cnt;
+					owner->ref_cnt++;
+					output_blobs[i] = std::move(frame);
+				}
+				ParallelFor(0, static_cast<int64_t>(given.size()), [&](int64_t begin, int64_t end) {
+					for (int64_t i = begin; i < end; i++)
+					{
+						Tensor(shape, depth, packing, data + given[i] * out_bytes).CopyTo(output_blobs[given[i]]);
+					}
+				}, 1, opt.num_threads, opt.thread_pool);
+				if (owner->ref_cnt == 0) delete owner;
+				return;
+			}
+
+			ThreadPool* pool = opt.thread_pool ? opt.thread_pool : ThreadPool::Global();
+			int threads = opt.num_threads > 0 ? std::min(opt.num_threads, pool->num_threads()) : pool->num_threads();
+			int parts = std::min(n, threads);
+			if (parts <= 1)
+			{
+				for (int i = 0; i < n; i++)
+				{
+					Forward(input_blobs[i], output_blobs[i], opt);
+					CHECK(not output_blobs[i].empty());
+				}
+				return;
+			}
+
+			// each part runs its frames one after another on one thread, with the threads left over for its kernels
+			bool given = opt.workspace_allocators.size() >= static_cast<size_t>(parts);
+			std::vector<std::unique_ptr<ArenaAllocator>> arenas(given ? 0 : parts);
+			ParallelFor(0, parts, [&](int64_t begin, int64_t end) {
+				for (int64_t p = begin; p < end; p++)
+				{
+					Option part = opt;
+					part.num_threads = std::max(1, threads / parts);
+					if (not given) arenas[p] = std::make_unique<ArenaAllocator>();
+					part.workspace_allocator = given ? opt.workspace_allocators[p] : arenas[p].get();
+					for (int64_t i = p * n / parts; i < (p + 1) * n / parts; i++)
+					{
+						std::optional<ArenaScope> scope;
+						if (not given) scope.emplace(*arenas[p]);
+						Forward(input_blobs[i], output_blobs[i], part);
+						CHECK(not output_blobs[i].empty());
+					}
+				}
+			}, 1, threads, pool);
 		}
 	}
 }
\ No newline at end of file
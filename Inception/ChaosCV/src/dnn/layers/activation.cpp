@@ -0,0 +1,112 @@
+#include "dnn/layers/activation.hpp"
+#include "dnn/layers/elementwise.hpp"
+#include "core/cpu.hpp"
+
+#ifdef CHAOS_X86
+#include <immintrin.h>
+#endif
+
+namespace chaos
+{
+	namespace dnn
+	{
+#ifdef CHAOS_X86
+		// exp(x) = 2^n * exp(r) with r = x - n * ln2 in [-ln2 / 2, ln2 / 2] and a degree 5 polynomial, about 1 ulp
+		CHAOS_TARGET("avx2,fma") static inline __m256 Exp(__m256 x) noexcept
+		{
+			x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.3f)), _mm256_set1_ps(88.3f));
+			__m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+			__m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+			r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+			__m256 p = _mm256_set1_ps(1.9875691500e-4f);
+			p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+			p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+			p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+			p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+			p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+			p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.f)));
+			__m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+			return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+		}
+
+		CHAOS_TARGET("avx2,fma") static void SigmoidAVX2(float* data, int64_t size) noexcept
+		{
+			const __m256 one = _mm256_set1_ps(1.f);
+			int64_t i = 0;
+			for (; i + 8 <= size; i += 8)
+			{
+				__m256 x = _mm256_loadu_ps(data + i);
+				__m256 e = Exp(_mm256_sub_ps(_mm256_setzero_ps(), x));
+				_mm256_storeu_ps(data + i, _mm256_div_ps(one, _mm256_add_ps(one, e)));
+			}
+			for (; i < size; i++) data[i] = 1.f / (1.f + std::exp(-data[i]));
+		}
+#endif
+
+		void Activate(float* data, int64_t size, const Activation& activation)
+		{
+			switch (activation.type)
+			{
+			case ActivationType::ReLU:
+			{
+				float slope = activation.slope;
+				for (int64_t i = 0; i < size; i++) data[i] = data[i] > 0.f ? data[i] : data[i] * slope;
+				break;
+			}
+			case ActivationType::Sigmoid:
+			{
+#ifdef CHAOS_X86
+				static const bool avx2 = CpuSupportAVX2() and CpuSupportFMA();
+				if (avx2)
+				{
+					SigmoidAVX2(data, size);
+					break;
+				}
+#endif
+				for (int64_t i = 0; i < size; i++) data[i] = 1.f / (1.f + std::exp(-data[i]));
+				break;
+			}
+			default:
+				break;
+			}
+		}
+
+
+		ReLU::ReLU(float slope) : Layer("ReLU"), slope(slope)
+		{
+			support_inplace = true;
+			support_outplace = true;
+		}
+
+		void ReLU::Forward(const Tensor& input_blob, Tensor& output_blob, const Option& opt) const
+		{
+			ElementwiseStep step = { Tensor(), Tensor(), { ActivationType::ReLU, slope } };
+			ApplySteps(&step, 1, input_blob, output_blob, opt);
+		}
+
+		void ReLU::Forward(Tensor& input_output_blob, const Option& opt) const
+		{
+			ElementwiseStep step = { Tensor(), Tensor(), { ActivationType::ReLU, slope } };
+			ApplySteps(&step, 1, input_output_blob, input_output_blob, opt);
+		}
+
+
+		Sigmoid::Sigmoid() : Layer("Sigmoid")
+		{
+			support_inplace = true;
+			support_outplace = true;
+		}
+
+		void Sigmoid::Forward(const Tensor& input_blob, Tensor& output_blob, const Option& opt) const
+		{
+			ElementwiseStep step = { Tensor(), Tensor(), { ActivationType::Sigmoid, 0.f } };
+			ApplySteps(&step, 1, input_blob, output_blob, opt);
+		}
+
+		void Sigmoid::Forward(Tensor& input_output_blob, const Option& opt) const
+		{
+			ElementwiseStep step = { Tensor(), Tensor(), { ActivationType::Sigmoid, 0.f } };
+			ApplySteps(&step, 1, input_output_blob, input_output_blob, opt);
+		}
+	}
+}
\ No newline at end of file
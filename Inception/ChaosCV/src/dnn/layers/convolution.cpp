@@ -0,0 +1,957 @@
+#include "dnn/layers/convolution.hpp"
+#include "core/cpu.hpp"
+#include "core/gemm.hpp"
+#include "core/parallel.hpp"
+
+#include <mutex>
+#include <algorithm>
+
+#ifdef CHAOS_X86
+#include <immintrin.h>
+#endif
+
+namespace chaos
+{
+	namespace dnn
+	{
+		// Winograd needs this many input and output channels to beat im2col, and F(4,3) eight times as many
+		// to pay for its larger transforms, the GEMM of each point of the transform is k = in_channels
+		constexpr int winograd_channels = 64;
+		// floats of the im2col block in the workspace, about the size of L2
+		constexpr int64_t im2col_block = 1 << 19;
+		// the GEMM slows down below this many columns, so the im2col matrices of images of a batch with at most half
+		// as many outputs go side by side, larger ones lose more to moving the products than the GEMM gains
+		constexpr int64_t im2col_columns = 256;
+		// floats of the Winograd tile buffers, large enough that the GEMM of each point sees wide matrices
+		constexpr int64_t winograd_block = 1 << 20;
+		constexpr int64_t winograd_tiles = 64;
+
+		class ConvolutionKernels
+		{
+		public:
+			// the bias padded with zeros to a multiple of 8 lanes
+			Tensor bias;
+
+			std::once_flag direct4_flag;
+			std::once_flag direct8_flag;
+			std::once_flag winograd23_flag;
+			std::once_flag winograd43_flag;
+			// groups == 1: [ob][ib][ky][kx][il][ol], depthwise: [cb][ky][kx][l], zero past the channels
+			Tensor direct4;
+			Tensor direct8;
+			// [alpha * alpha][out][in]
+			Tensor winograd23;
+			Tensor winograd43;
+		};
+
+		// the sizes of one call
+		struct ConvShape
+		{
+			int64_t batch;
+			int64_t h;
+			int64_t w;
+			int64_t out_h;
+			int64_t out_w;
+		};
+
+		static inline int64_t CeilDiv(int64_t a, int64_t b) noexcept
+		{
+			return (a + b - 1) / b;
+		}
+
+		// [begin, end) of the outputs x whose input x * stride + offset falls in [0, size)
+		static inline void ValidRange(int64_t offset, int64_t stride, int64_t size, int64_t out_size, int64_t& begin, int64_t& end) noexcept
+		{
+			begin = offset >= 0 ? 0 : std::min(out_size, CeilDiv(-offset, stride));
+			end = size - 1 - offset < 0 ? 0 : std::min(out_size, (size - 1 - offset) / stride + 1);
+			end = std::max(begin, end);
+		}
+
+		static bool Depthwise(const Convolution& conv) noexcept
+		{
+			return conv.groups > 1 and conv.groups == conv.in_channels and conv.groups == conv.out_channels;
+		}
+
+		static bool WinogradShape(const Convolution& conv) noexcept
+		{
+			return conv.kernel_h == 3 and conv.kernel_w == 3 and conv.stride_h == 1 and conv.stride_w == 1 and
+				conv.dilation_h == 1 and conv.dilation_w == 1 and conv.groups == 1;
+		}
+
+
+		Convolution::Convolution(const Tensor& weight, const Tensor& bias, int stride, int padding, int dilation, int groups) :
+			Layer("Convolution"), weight(weight.contiguous() ? weight : weight.Clone()), bias(bias.contiguous() ? bias : bias.Clone()),
+			in_channels(0), out_channels(0), kernel_h(0), kernel_w(0),
+			stride_h(stride), stride_w(stride), pad_h(padding), pad_w(padding), dilation_h(dilation), dilation_w(dilation), groups(groups),
+			kernels(new ConvolutionKernels)
+		{
+			support_outplace = true;
+
+			// a rejected weight leaves no channels, so Forward refuses every input
+			bool shaped = weight.depth == Depth::D4 and weight.packing == Packing::CHW and weight.shape.size() == 4;
+			CHECK(shaped) << "the weight should be a float [out_channels, in_channels / groups, kernel_h, kernel_w] Tensor";
+			if (not shaped) return;
+			bool grouped = groups > 0 and weight.shape[0] % groups == 0;
+			CHECK(grouped) << "out_channels " << weight.shape[0] << " is not a multiple of groups " << groups;
+			if (not grouped) return;
+			bool strided = stride > 0 and dilation > 0 and padding >= 0;
+			CHECK(strided);
+			if (not strided) return;
+			bool biased = bias.empty() or bias.shape.total() == weight.shape[0];
+			CHECK(biased) << "expect " << weight.shape[0] << " biases";
+			if (not biased) return;
+			out_channels = weight.shape[0];
+			in_channels = weight.shape[1] * groups;
+			kernel_h = weight.shape[2];
+			kernel_w = weight.shape[3];
+
+			kernels->bias = Tensor::zeros(Shape(static_cast<int>(CeilDiv(out_channels, 8) * 8)));
+			if (not bias.empty()) memcpy(kernels->bias.data, this->bias.data, out_channels * sizeof(float));
+		}
+
+		Convolution::~Convolution()
+		{
+			delete kernels;
+		}
+
+		Shape Convolution::OutputShape(const Shape& input_shape, const Packing& packing) const
+		{
+			size_t dims = input_shape.size();
+			CHECK_GE(dims, 3) << "expect [C, H, W] or [..., C, H, W]";
+			Shape shape = input_shape;
+			int lanes = static_cast<int>(packing);
+			int axis = static_cast<int>(dims) - 3;
+			shape[axis] = (out_channels + lanes - 1) / lanes;
+			shape[axis + 1] = (input_shape[axis + 1] + 2 * pad_h - dilation_h * (kernel_h - 1) - 1) / stride_h + 1;
+			shape[axis + 2] = (input_shape[axis + 2] + 2 * pad_w - dilation_w * (kernel_w - 1) - 1) / stride_w + 1;
+			return shape;
+		}
+
+		ConvolutionAlgorithm Convolution::Select(const Shape& input_shape, const Packing& packing) const
+		{
+			bool depthwise = Depthwise(*this);
+			if (packing != Packing::CHW) return groups == 1 or depthwise ? ConvolutionAlgorithm::Direct : ConvolutionAlgorithm::Im2colGemm;
+			if (depthwise) return ConvolutionAlgorithm::Direct;
+			int channels = std::min(in_channels, out_channels);
+			if (WinogradShape(*this) and channels >= winograd_channels)
+			{
+				Shape shape = OutputShape(input_shape, packing);
+				bool large = channels >= 8 * winograd_channels and shape[-2] >= 8 and shape[-1] >= 8;
+				return large ? ConvolutionAlgorithm::Winograd43 : ConvolutionAlgorithm::Winograd23;
+			}
+			return ConvolutionAlgorithm::Im2colGemm;
+		}
+
+
+		// ---------------------------------------------------------------- im2col + GEMM, CHW
+
+		// rows [k0, k1) of the im2col matrix for the output rows [y0, y1), a row k = (c, ky, kx) holds one input per output
+		// and starts ld floats after the row before
+		static void Im2col(const Convolution& conv, const float* image, float* col, int64_t ld, const ConvShape& s, int64_t y0, int64_t y1, int64_t k0, int64_t k1)
+		{
+			int64_t kk = static_cast<int64_t>(conv.kernel_h) * conv.kernel_w;
+			for (int64_t k = k0; k < k1; k++)
+			{
+				int64_t c = k / kk;
+				int64_t ky = k % kk / conv.kernel_w;
+				int64_t kx = k % conv.kernel_w;
+				const float* plane = image + c * s.h * s.w;
+				int64_t offset = kx * conv.dilation_w - conv.pad_w;
+				int64_t begin, end;
+				ValidRange(offset, conv.stride_w, s.w, s.out_w, begin, end);
+				for (int64_t y = y0; y < y1; y++)
+				{
+					float* out = col + k * ld + (y - y0) * s.out_w;
+					int64_t iy = y * conv.stride_h - conv.pad_h + ky * conv.dilation_h;
+					if (iy < 0 or iy >= s.h)
+					{
+						std::fill(out, out + s.out_w, 0.f);
+						continue;
+					}
+					const float* line = plane + iy * s.w + offset;
+					std::fill(out, out + begin, 0.f);
+					if (conv.stride_w == 1) memcpy(out + begin, line + begin, (end - begin) * sizeof(float));
+					else for (int64_t x = begin; x < end; x++) out[x] = line[x * conv.stride_w];
+					std::fill(out + end, out + s.out_w, 0.f);
+				}
+			}
+		}
+
+		// bias and activation on size outputs of each of channels channels, step apart, right after the GEMM wrote them
+		static void Epilogue(const Convolution& conv, const float* bias, float* dst, int64_t channels, int64_t step, int64_t size, const Option& opt)
+		{
+			if (not bias and conv.activation.type == ActivationType::Identity) return;
+			ParallelFor(0, channels, [&](int64_t first, int64_t last) {
+				for (int64_t c = first; c < last; c++)
+				{
+					float* out = dst + c * step;
+					if (bias)
+					{
+						float b = bias[c];
+						for (int64_t j = 0; j < size; j++) out[j] += b;
+					}
+					Activate(out, size, conv.activation);
+				}
+			}, std::max<int64_t>(1, (1 << 14) / size), opt.num_threads, opt.thread_pool);
+		}
+
+		// the images whose im2col matrices go side by side in one GEMM, 1 when each image is wide enough on its own
+		static int64_t Im2colFrames(const Convolution& conv, const ConvShape& s)
+		{
+			int64_t k = conv.in_channels / conv.groups * conv.kernel_h * conv.kernel_w;
+			int64_t plane = s.out_h * s.out_w;
+			if (s.batch < 2 or 2 * plane > im2col_columns or k * plane > im2col_block) return 1;
+			return std::clamp<int64_t>(std::min(CeilDiv(im2col_columns, plane), im2col_block / (k * plane)), 1, s.batch);
+		}
+
+		// the im2col matrices of frames images side by side, one GEMM writes the products of all of them, which are then moved to their images
+		static void Im2colGemmFrames(const Convolution& conv, const float* src, float* dst, const ConvShape& s, int64_t frames, const Option& opt)
+		{
+			int64_t in_group = conv.in_channels / conv.groups;
+			int64_t out_group = conv.out_channels / conv.groups;
+			int64_t k = in_group * conv.kernel_h * conv.kernel_w;
+			int64_t plane = s.out_h * s.out_w;
+			const float* weight = static_cast<const float*>(conv.weight.data);
+			const float* bias = conv.bias.empty() ? nullptr : static_cast<const float*>(conv.bias.data);
+
+			Tensor buffer = Tensor(Shape(static_cast<int>((k + out_group) * frames * plane)), Depth::D4, Packing::CHW, opt.workspace_allocator);
+			float* col = static_cast<float*>(buffer.data);
+			float* product = col + k * frames * plane;
+
+			for (int64_t n0 = 0; n0 < s.batch; n0 += frames)
+			{
+				int64_t count = std::min(frames, s.batch - n0);
+				int64_t cols = count * plane;
+				for (int64_t g = 0; g < conv.groups; g++)
+				{
+					ParallelFor(0, count * k, [&](int64_t first, int64_t last) {
+						for (int64_t i = first; i < last; i++)
+						{
+							int64_t f = i / k;
+							const float* image = src + ((n0 + f) * conv.in_channels + g * in_group) * s.h * s.w;
+							Im2col(conv, image, col + f * plane, cols, s, 0, s.out_h, i % k, i % k + 1);
+						}
+					}, std::max<int64_t>(1, (1 << 14) / plane), opt.num_threads, opt.thread_pool);
+					Gemm(false, false, out_group, cols, k, 1.f, weight + g * out_group * k, k, col, cols, 0.f, product, cols, opt.num_threads, opt.thread_pool);
+					Epilogue(conv, bias ? bias + g * out_group : nullptr, product, out_group, cols, cols, opt);
+					ParallelFor(0, count * out_group, [&](int64_t first, int64_t last) {
+						for (int64_t i = first; i < last; i++)
+						{
+							int64_t f = i / out_group;
+							int64_t o = i % out_group;
+							memcpy(dst + ((n0 + f) * conv.out_channels + g * out_group + o) * plane, product + o * cols + f * plane, plane * sizeof(float));
+						}
+					}, std::max<int64_t>(1, (1 << 14) / plane), opt.num_threads, opt.thread_pool);
+				}
+			}
+		}
+
+		static void Im2colGemm(const Convolution& conv, const float* src, float* dst, const ConvShape& s, const Option& opt)
+		{
+			int64_t in_group = conv.in_channels / conv.groups;
+			int64_t out_group = conv.out_channels / conv.groups;
+			int64_t k = in_group * conv.kernel_h * conv.kernel_w;
+			int64_t plane = s.out_h * s.out_w;
+			const float* weight = static_cast<const float*>(conv.weight.data);
+			const float* bias = conv.bias.empty() ? nullptr : static_cast<const float*>(conv.bias.data);
+			bool pointwise = conv.kernel_h == 1 and conv.kernel_w == 1 and conv.stride_h == 1 and conv.stride_w == 1 and conv.pad_h == 0 and conv.pad_w == 0;
+
+			// output rows per block, so that the block of the im2col matrix stays in the cache
+			int64_t band = std::clamp<int64_t>(im2col_block / (k * s.out_w), 1, s.out_h);
+			int64_t frames = Im2colFrames(conv, s);
+			if (frames > 1)
+			{
+				Im2colGemmFrames(conv, src, dst, s, frames, opt);
+				return;
+			}
+			Tensor col = pointwise ? Tensor() : Tensor(Shape(static_cast<int>(k * band * s.out_w)), Depth::D4, Packing::CHW, opt.workspace_allocator);
+			float* cdata = static_cast<float*>(col.data);
+
+			for (int64_t n = 0; n < s.batch; n++)
+			{
+				for (int64_t g = 0; g < conv.groups; g++)
+				{
+					const float* image = src + (n * conv.in_channels + g * in_group) * s.h * s.w;
+					float* out = dst + (n * conv.out_channels + g * out_group) * plane;
+					const float* wg = weight + g * out_group * k;
+					if (pointwise)
+					{
+						Gemm(false, false, out_group, plane, k, 1.f, wg, k, image, plane, 0.f, out, plane, opt.num_threads, opt.thread_pool);
+						Epilogue(conv, bias ? bias + g * out_group : nullptr, out, out_group, plane, plane, opt);
+						continue;
+					}
+					for (int64_t y0 = 0; y0 < s.out_h; y0 += band)
+					{
+						int64_t y1 = std::min(s.out_h, y0 + band);
+						int64_t cols = (y1 - y0) * s.out_w;
+						ParallelFor(0, k, [&](int64_t first, int64_t last) {
+							Im2col(conv, image, cdata, cols, s, y0, y1, first, last);
+						}, std::max<int64_t>(1, (1 << 14) / cols), opt.num_threads, opt.thread_pool);
+						Gemm(false, false, out_group, cols, k, 1.f, wg, k, cdata, cols, 0.f, out + y0 * s.out_w, plane, opt.num_threads, opt.thread_pool);
+						Epilogue(conv, bias ? bias + g * out_group : nullptr, out + y0 * s.out_w, out_group, plane, cols, opt);
+					}
+				}
+			}
+		}
+
+
+		// ---------------------------------------------------------------- Winograd F(2,3) and F(4,3), CHW
+
+		// the 1-D transforms written out, the 2-D ones apply them to the columns and then to the rows
+		template<int M> struct WinogradTransform;
+		template<> struct WinogradTransform<2>
+		{
+			static constexpr int alpha = 4;
+			static constexpr float G[4][3] = { { 1, 0, 0 }, { .5f, .5f, .5f }, { .5f, -.5f, .5f }, { 0, 0, 1 } };
+
+			// B^T = [1 0 -1 0; 0 1 1 0; 0 -1 1 0; 0 1 0 -1]
+			static inline void Input(const float* d, int ds, float* r, int rs) noexcept
+			{
+				float d0 = d[0], d1 = d[ds], d2 = d[2 * ds], d3 = d[3 * ds];
+				r[0] = d0 - d2;
+				r[rs] = d1 + d2;
+				r[2 * rs] = d2 - d1;
+				r[3 * rs] = d1 - d3;
+			}
+
+			// A^T = [1 1 1 0; 0 1 -1 -1]
+			static inline void Output(const float* m, int ms, float* y, int ys) noexcept
+			{
+				float m1 = m[ms], m2 = m[2 * ms];
+				y[0] = m[0] + m1 + m2;
+				y[ys] = m1 - m2 - m[3 * ms];
+			}
+		};
+		template<> struct WinogradTransform<4>
+		{
+			static constexpr int alpha = 6;
+			static constexpr float G[6][3] = {
+				{ 1 / 4.f, 0, 0 }, { -1 / 6.f, -1 / 6.f, -1 / 6.f }, { -1 / 6.f, 1 / 6.f, -1 / 6.f },
+				{ 1 / 24.f, 1 / 12.f, 1 / 6.f }, { 1 / 24.f, -1 / 12.f, 1 / 6.f }, { 0, 0, 1 } };
+
+			// B^T = [4 0 -5 0 1 0; 0 -4 -4 1 1 0; 0 4 -4 -1 1 0; 0 -2 -1 2 1 0; 0 2 -1 -2 1 0; 0 4 0 -5 0 1]
+			static inline void Input(const float* d, int ds, float* r, int rs) noexcept
+			{
+				float d0 = d[0], d1 = d[ds], d2 = d[2 * ds], d3 = d[3 * ds], d4 = d[4 * ds], d5 = d[5 * ds];
+				float a = d4 - 4 * d2;
+				float b = d3 - 4 * d1;
+				float c = d4 - d2;
+				float e = 2 * (d3 - d1);
+				r[0] = 4 * d0 - 5 * d2 + d4;
+				r[rs] = a + b;
+				r[2 * rs] = a - b;
+				r[3 * rs] = c + e;
+				r[4 * rs] = c - e;
+				r[5 * rs] = 4 * d1 - 5 * d3 + d5;
+			}
+
+			// A^T = [1 1 1 1 1 0; 0 1 -1 2 -2 0; 0 1 1 4 4 0; 0 1 -1 8 -8 1]
+			static inline void Output(const float* m, int ms, float* y, int ys) noexcept
+			{
+				float m1 = m[ms], m2 = m[2 * ms], m3 = m[3 * ms], m4 = m[4 * ms];
+				float a = m1 + m2;
+				float b = m1 - m2;
+				float c = m3 + m4;
+				float e = m3 - m4;
+				y[0] = m[0] + a + c;
+				y[ys] = b + 2 * e;
+				y[2 * ys] = a + 4 * c;
+				y[3 * ys] = b + 8 * e + m[5 * ms];
+			}
+		};
+
+		// U = G g G^T for each pair of channels, stored [alpha * alpha][out][in]
+		template<int M>
+		static Tensor WinogradWeights(const Convolution& conv)
+		{
+			using W = WinogradTransform<M>;
+			constexpr int A = W::alpha;
+			int64_t out = conv.out_channels;
+			int64_t in = conv.in_channels;
+			Tensor u = Tensor(Shape(static_cast<int>(A * A * out * in)), Depth::D4);
+			const float* weight = static_cast<const float*>(conv.weight.data);
+			float* data = static_cast<float*>(u.data);
+			for (int64_t o = 0; o < out; o++)
+			{
+				for (int64_t i = 0; i < in; i++)
+				{
+					const float* g = weight + (o * in + i) * 9;
+					float t[A][3];
+					for (int a = 0; a < A; a++)
+					{
+						for (int j = 0; j < 3; j++) t[a][j] = W::G[a][0] * g[j] + W::G[a][1] * g[3 + j] + W::G[a][2] * g[6 + j];
+					}
+					for (int a = 0; a < A; a++)
+					{
+						for (int b = 0; b < A; b++) data[((a * A + b) * out + o) * in + i] = t[a][0] * W::G[b][0] + t[a][1] * W::G[b][1] + t[a][2] * W::G[b][2];
+					}
+				}
+			}
+			return u;
+		}
+
+		// the tiles transformed at once
+		template<int M>
+		static int64_t WinogradBlock(const Convolution& conv) noexcept
+		{
+			constexpr int E = WinogradTransform<M>::alpha * WinogradTransform<M>::alpha;
+			return std::max(winograd_tiles, winograd_block / (E * (conv.in_channels + conv.out_channels)));
+		}
+
+		template<int M>
+		static void Winograd(const Convolution& conv, const float* src, float* dst, const float* u, const float* bias, const ConvShape& s, const Option& opt)
+		{
+			using W = WinogradTransform<M>;
+			constexpr int A = W::alpha;
+			constexpr int E = A * A;
+			int64_t in = conv.in_channels;
+			int64_t out = conv.out_channels;
+			int64_t tiles_w = CeilDiv(s.out_w, M);
+			int64_t image_tiles = CeilDiv(s.out_h, M) * tiles_w;
+			// the blocks run over the tiles of all the images, so a batch of small images still gives wide GEMMs
+			int64_t tiles = s.batch * image_tiles;
+
+			// the transformed input V [E][in][block] and the products [E][out][block] of a block of tiles, the points of the
+			// transform are a cache line more than whole rows apart, or the E values of a tile could all map to one cache set
+			int64_t block = std::min(tiles, WinogradBlock<M>(conv));
+			int64_t ld = CeilDiv(block, 16) * 16;
+			int64_t v_step = in * ld + 16;
+			int64_t m_step = out * ld + 16;
+			Tensor buffer = Tensor(Shape(static_cast<int>(E * (v_step + m_step))), Depth::D4, Packing::CHW, opt.workspace_allocator);
+			float* v = static_cast<float*>(buffer.data);
+			float* m = v + E * v_step;
+
+			for (int64_t t0 = 0; t0 < tiles; t0 += block)
+			{
+				int64_t count = std::min(block, tiles - t0);
+
+				// V = B^T d B
+				ParallelFor(0, in, [&](int64_t first, int64_t last) {
+					for (int64_t c = first; c < last; c++)
+					{
+						for (int64_t t = 0; t < count; t++)
+						{
+							int64_t n = (t0 + t) / image_tiles;
+							int64_t tile = (t0 + t) % image_tiles;
+							const float* plane = src + (n * in + c) * s.h * s.w;
+							int64_t y0 = tile / tiles_w * M - conv.pad_h;
+							int64_t x0 = tile % tiles_w * M - conv.pad_w;
+							float d[A][A];
+							bool inside = y0 >= 0 and x0 >= 0 and y0 + A <= s.h and x0 + A <= s.w;
+							for (int i = 0; i < A; i++)
+							{
+								int64_t iy = y0 + i;
+								bool row = iy >= 0 and iy < s.h;
+								for (int j = 0; j < A; j++)
+								{
+									int64_t ix = x0 + j;
+									d[i][j] = inside or (row and ix >= 0 and ix < s.w) ? plane[iy * s.w + ix] : 0.f;
+								}
+							}
+							float r[A][A];
+							float x[A][A];
+							for (int j = 0; j < A; j++) W::Input(&d[0][j], A, &r[0][j], A);
+							for (int i = 0; i < A; i++) W::Input(r[i], 1, x[i], 1);
+							float* vt = v + c * ld + t;
+							for (int e = 0; e < E; e++) vt[e * v_step] = x[e / A][e % A];
+						}
+					}
+				}, std::max<int64_t>(1, 256 / count), opt.num_threads, opt.thread_pool);
+
+				// one product [out x in] x [in x count] per point of the transform
+				ParallelFor(0, E, [&](int64_t first, int64_t last) {
+					for (int64_t e = first; e < last; e++)
+					{
+						Gemm(false, false, out, count, in, 1.f, u + e * out * in, in, v + e * v_step, ld, 0.f, m + e * m_step, ld, 1);
+					}
+				}, 1, opt.num_threads, opt.thread_pool);
+
+				// Y = A^T M A
+				ParallelFor(0, out, [&](int64_t first, int64_t last) {
+					for (int64_t o = first; o < last; o++)
+					{
+						for (int64_t t = 0; t < count; t++)
+						{
+							int64_t n = (t0 + t) / image_tiles;
+							int64_t tile = (t0 + t) % image_tiles;
+							float* plane = dst + (n * out + o) * s.out_h * s.out_w;
+							float p[A][A];
+							const float* mt = m + o * ld + t;
+							for (int e = 0; e < E; e++) p[e / A][e % A] = mt[e * m_step];
+							float r[M][A];
+							float y[M][M];
+							for (int j = 0; j < A; j++) W::Output(&p[0][j], A, &r[0][j], A);
+							for (int i = 0; i < M; i++) W::Output(r[i], 1, y[i], 1);
+							int64_t y0 = tile / tiles_w * M;
+							int64_t x0 = tile % tiles_w * M;
+							int64_t rows = std::min<int64_t>(M, s.out_h - y0);
+							int64_t cols = std::min<int64_t>(M, s.out_w - x0);
+							for (int64_t i = 0; i < rows; i++)
+							{
+								for (int64_t j = 0; j < cols; j++) plane[(y0 + i) * s.out_w + x0 + j] = conv.activation(y[i][j] + bias[o]);
+							}
+						}
+					}
+				}, std::max<int64_t>(1, 256 / count), opt.num_threads, opt.thread_pool);
+			}
+		}
+
+
+		// ---------------------------------------------------------------- direct loops, C4HW4 / C8HW8 and depthwise CHW
+
+		struct DirectArgs
+		{
+			const float* src;
+			float* dst;
+			const float* weight;
+			const float* bias;
+			int64_t in_blocks;
+			int64_t out_blocks;
+			ConvShape s;
+		};
+
+		template<int P>
+		static Tensor PackDirect(const Convolution& conv)
+		{
+			int64_t kk = static_cast<int64_t>(conv.kernel_h) * conv.kernel_w;
+			const float* weight = static_cast<const float*>(conv.weight.data);
+			if (Depthwise(conv))
+			{
+				Tensor packed = Tensor::zeros(Shape(static_cast<int>(CeilDiv(conv.out_channels, P) * kk * P)));
+				float* data = static_cast<float*>(packed.data);
+				for (int64_t c = 0; c < conv.out_channels; c++)
+				{
+					for (int64_t k = 0; k < kk; k++) data[(c / P * kk + k) * P + c % P] = weight[c * kk + k];
+				}
+				return packed;
+			}
+
+			int64_t in = conv.in_channels;
+			int64_t in_blocks = CeilDiv(in, P);
+			Tensor packed = Tensor::zeros(Shape(static_cast<int>(CeilDiv(conv.out_channels, P) * in_blocks * kk * P * P)));
+			float* data = static_cast<float*>(packed.data);
+			for (int64_t o = 0; o < conv.out_channels; o++)
+			{
+				for (int64_t i = 0; i < in; i++)
+				{
+					for (int64_t k = 0; k < kk; k++) data[(((o / P * in_blocks + i / P) * kk + k) * P + i % P) * P + o % P] = weight[(o * in + i) * kk + k];
+				}
+			}
+			return packed;
+		}
+
+		// the outputs [begin, end) of a row whose window lies inside the input for every kx
+		static void InteriorRange(const Convolution& conv, const ConvShape& s, int64_t& begin, int64_t& end)
+		{
+			int64_t first_begin, first_end, last_begin, last_end;
+			ValidRange(-conv.pad_w, conv.stride_w, s.w, s.out_w, first_begin, first_end);
+			ValidRange(static_cast<int64_t>(conv.kernel_w - 1) * conv.dilation_w - conv.pad_w, conv.stride_w, s.w, s.out_w, last_begin, last_end);
+			begin = std::max(first_begin, last_begin);
+			end = std::max(begin, std::min(first_end, last_end));
+		}
+
+		template<int P>
+		static void DirectRow(const Convolution& conv, const DirectArgs& a, int64_t n, int64_t ob, int64_t y)
+		{
+			int64_t kk = static_cast<int64_t>(conv.kernel_h) * conv.kernel_w;
+			const float* image = a.src + n * a.in_blocks * a.s.h * a.s.w * P;
+			const float* weight = a.weight + ob * a.in_blocks * kk * P * P;
+			const float* bias = a.bias + ob * P;
+			float* out = a.dst + ((n * a.out_blocks + ob) * a.s.out_h + y) * a.s.out_w * P;
+			for (int64_t x = 0; x < a.s.out_w; x++)
+			{
+				float acc[P];
+				for (int l = 0; l < P; l++) acc[l] = bias[l];
+				for (int64_t ib = 0; ib < a.in_blocks; ib++)
+				{
+					const float* plane = image + ib * a.s.h * a.s.w * P;
+					for (int64_t ky = 0; ky < conv.kernel_h; ky++)
+					{
+						int64_t iy = y * conv.stride_h - conv.pad_h + ky * conv.dilation_h;
+						if (iy < 0 or iy >= a.s.h) continue;
+						for (int64_t kx = 0; kx < conv.kernel_w; kx++)
+						{
+							int64_t ix = x * conv.stride_w - conv.pad_w + kx * conv.dilation_w;
+							if (ix < 0 or ix >= a.s.w) continue;
+							const float* px = plane + (iy * a.s.w + ix) * P;
+							const float* wk = weight + ((ib * conv.kernel_h + ky) * conv.kernel_w + kx) * P * P;
+							for (int il = 0; il < P; il++)
+							{
+								for (int ol = 0; ol < P; ol++) acc[ol] += px[il] * wk[il * P + ol];
+							}
+						}
+					}
+				}
+				for (int l = 0; l < P; l++) out[x * P + l] = acc[l];
+			}
+		}
+
+#ifdef CHAOS_X86
+		template<int P> struct Lanes;
+		template<> struct Lanes<4>
+		{
+			using Type = __m128;
+			CHAOS_TARGET("avx2,fma") static inline Type Load(const float* p) noexcept { return _mm_loadu_ps(p); }
+			CHAOS_TARGET("avx2,fma") static inline Type Broadcast(const float* p) noexcept { return _mm_broadcast_ss(p); }
+			CHAOS_TARGET("avx2,fma") static inline Type FMA(Type a, Type b, Type c) noexcept { return _mm_fmadd_ps(a, b, c); }
+			CHAOS_TARGET("avx2,fma") static inline void Store(float* p, Type v) noexcept { _mm_storeu_ps(p, v); }
+		};
+		template<> struct Lanes<8>
+		{
+			using Type = __m256;
+			CHAOS_TARGET("avx2,fma") static inline Type Load(const float* p) noexcept { return _mm256_loadu_ps(p); }
+			CHAOS_TARGET("avx2,fma") static inline Type Broadcast(const float* p) noexcept { return _mm256_broadcast_ss(p); }
+			CHAOS_TARGET("avx2,fma") static inline Type FMA(Type a, Type b, Type c) noexcept { return _mm256_fmadd_ps(a, b, c); }
+			CHAOS_TARGET("avx2,fma") static inline void Store(float* p, Type v) noexcept { _mm256_storeu_ps(p, v); }
+		};
+
+		template<int P>
+		CHAOS_TARGET("avx2,fma") static void DirectPixelAVX2(const Convolution& conv, const DirectArgs& a, const float* image, const float* weight,
+			const float* bias, float* out, int64_t y, int64_t x) noexcept
+		{
+			using L = Lanes<P>;
+			typename L::Type acc = L::Load(bias);
+			for (int64_t ib = 0; ib < a.in_blocks; ib++)
+			{
+				const float* plane = image + ib * a.s.h * a.s.w * P;
+				for (int64_t ky = 0; ky < conv.kernel_h; ky++)
+				{
+					int64_t iy = y * conv.stride_h - conv.pad_h + ky * conv.dilation_h;
+					if (iy < 0 or iy >= a.s.h) continue;
+					for (int64_t kx = 0; kx < conv.kernel_w; kx++)
+					{
+						int64_t ix = x * conv.stride_w - conv.pad_w + kx * conv.dilation_w;
+						if (ix < 0 or ix >= a.s.w) continue;
+						const float* px = plane + (iy * a.s.w + ix) * P;
+						const float* wk = weight + ((ib * conv.kernel_h + ky) * conv.kernel_w + kx) * P * P;
+						for (int il = 0; il < P; il++) acc = L::FMA(L::Broadcast(px + il), L::Load(wk + il * P), acc);
+					}
+				}
+			}
+			L::Store(out + x * P, acc);
+		}
+
+		// 4 outputs at a time inside the row, each input lane broadcast against a row of P output lanes
+		template<int P>
+		CHAOS_TARGET("avx2,fma") static void DirectRowAVX2(const Convolution& conv, const DirectArgs& a, int64_t n, int64_t ob, int64_t y) noexcept
+		{
+			using L = Lanes<P>;
+			int64_t kk = static_cast<int64_t>(conv.kernel_h) * conv.kernel_w;
+			const float* image = a.src + n * a.in_blocks * a.s.h * a.s.w * P;
+			const float* weight = a.weight + ob * a.in_blocks * kk * P * P;
+			const float* bias = a.bias + ob * P;
+			float* out = a.dst + ((n * a.out_blocks + ob) * a.s.out_h + y) * a.s.out_w * P;
+			int64_t step = static_cast<int64_t>(conv.stride_w) * P;
+
+			int64_t begin, end;
+			InteriorRange(conv, a.s, begin, end);
+			int64_t x = 0;
+			for (; x < begin; x++) DirectPixelAVX2<P>(conv, a, image, weight, bias, out, y, x);
+			for (; x + 4 <= end; x += 4)
+			{
+				typename L::Type acc0 = L::Load(bias);
+				typename L::Type acc1 = acc0;
+				typename L::Type acc2 = acc0;
+				typename L::Type acc3 = acc0;
+				for (int64_t ib = 0; ib < a.in_blocks; ib++)
+				{
+					const float* plane = image + ib * a.s.h * a.s.w * P;
+					for (int64_t ky = 0; ky < conv.kernel_h; ky++)
+					{
+						int64_t iy = y * conv.stride_h - conv.pad_h + ky * conv.dilation_h;
+						if (iy < 0 or iy >= a.s.h) continue;
+						const float* line = plane + iy * a.s.w * P;
+						for (int64_t kx = 0; kx < conv.kernel_w; kx++)
+						{
+							const float* px = line + (x * conv.stride_w - conv.pad_w + kx * conv.dilation_w) * P;
+							const float* wk = weight + ((ib * conv.kernel_h + ky) * conv.kernel_w + kx) * P * P;
+							for (int il = 0; il < P; il++)
+							{
+								typename L::Type w = L::Load(wk + il * P);
+								acc0 = L::FMA(L::Broadcast(px + il), w, acc0);
+								acc1 = L::FMA(L::Broadcast(px + step + il), w, acc1);
+								acc2 = L::FMA(L::Broadcast(px + 2 * step + il), w, acc2);
+								acc3 = L::FMA(L::Broadcast(px + 3 * step + il), w, acc3);
+							}
+						}
+					}
+				}
+				L::Store(out + x * P, acc0);
+				L::Store(out + (x + 1) * P, acc1);
+				L::Store(out + (x + 2) * P, acc2);
+				L::Store(out + (x + 3) * P, acc3);
+			}
+			for (; x < a.s.out_w; x++) DirectPixelAVX2<P>(conv, a, image, weight, bias, out, y, x);
+		}
+#endif
+
+		// the activation of an output row, the lanes past the last channel stay 0
+		template<int P>
+		static void ActivateRow(const Convolution& conv, const DirectArgs& a, int64_t n, int64_t ob, int64_t y)
+		{
+			if (conv.activation.type == ActivationType::Identity) return;
+			float* out = a.dst + ((n * a.out_blocks + ob) * a.s.out_h + y) * a.s.out_w * P;
+			Activate(out, a.s.out_w * P, conv.activation);
+			int64_t valid = conv.out_channels - ob * P;
+			for (int64_t x = 0; valid < P and x < a.s.out_w; x++)
+			{
+				for (int64_t l = valid; l < P; l++) out[x * P + l] = 0.f;
+			}
+		}
+
+		static bool DirectAVX2() noexcept
+		{
+#ifdef CHAOS_X86
+			static const bool avx2 = CpuSupportAVX2() and CpuSupportFMA();
+			return avx2;
+#else
+			return false;
+#endif
+		}
+
+		template<int P>
+		static void DirectPacked(const Convolution& conv, const DirectArgs& a, const Option& opt)
+		{
+			bool avx2 = DirectAVX2();
+			int64_t rows = a.s.batch * a.out_blocks * a.s.out_h;
+			int64_t work = a.s.out_w * a.in_blocks * conv.kernel_h * conv.kernel_w * P * P;
+			ParallelFor(0, rows, [&](int64_t first, int64_t last) {
+				for (int64_t i = first; i < last; i++)
+				{
+					int64_t y = i % a.s.out_h;
+					int64_t ob = i / a.s.out_h % a.out_blocks;
+					int64_t n = i / a.s.out_h / a.out_blocks;
+#ifdef CHAOS_X86
+					if (avx2) DirectRowAVX2<P>(conv, a, n, ob, y);
+					else DirectRow<P>(conv, a, n, ob, y);
+#else
+					DirectRow<P>(conv, a, n, ob, y);
+#endif
+					ActivateRow<P>(conv, a, n, ob, y);
+				}
+			}, std::max<int64_t>(1, (1 << 16) / std::max<int64_t>(1, work)), opt.num_threads, opt.thread_pool);
+		}
+
+		// each lane has its own kernel, the window is clipped once per kx instead of per pixel
+		template<int P>
+		static void DepthwisePacked(const Convolution& conv, const DirectArgs& a, const Option& opt)
+		{
+			int64_t kk = static_cast<int64_t>(conv.kernel_h) * conv.kernel_w;
+			ParallelFor(0, a.s.batch * a.out_blocks * a.s.out_h, [&](int64_t first, int64_t last) {
+				for (int64_t i = first; i < last; i++)
+				{
+					int64_t y = i % a.s.out_h;
+					int64_t cb = i / a.s.out_h % a.out_blocks;
+					int64_t n = i / a.s.out_h / a.out_blocks;
+					const float* plane = a.src + (n * a.in_blocks + cb) * a.s.h * a.s.w * P;
+					const float* weight = a.weight + cb * kk * P;
+					const float* bias = a.bias + cb * P;
+					float* out = a.dst + ((n * a.out_blocks + cb) * a.s.out_h + y) * a.s.out_w * P;
+					for (int64_t x = 0; x < a.s.out_w; x++)
+					{
+						for (int l = 0; l < P; l++) out[x * P + l] = bias[l];
+					}
+					for (int64_t ky = 0; ky < conv.kernel_h; ky++)
+					{
+						int64_t iy = y * conv.stride_h - conv.pad_h + ky * conv.dilation_h;
+						if (iy < 0 or iy >= a.s.h) continue;
+						const float* line = plane + iy * a.s.w * P;
+						for (int64_t kx = 0; kx < conv.kernel_w; kx++)
+						{
+							int64_t offset = kx * conv.dilation_w - conv.pad_w;
+							int64_t begin, end;
+							ValidRange(offset, conv.stride_w, a.s.w, a.s.out_w, begin, end);
+							const float* wk = weight + (ky * conv.kernel_w + kx) * P;
+							for (int64_t x = begin; x < end; x++)
+							{
+								const float* px = line + (x * conv.stride_w + offset) * P;
+								float* o = out + x * P;
+								for (int l = 0; l < P; l++) o[l] += px[l] * wk[l];
+							}
+						}
+					}
+					ActivateRow<P>(conv, a, n, cb, y);
+				}
+			}, std::max<int64_t>(1, (1 << 14) / (a.s.out_w * kk * P)), opt.num_threads, opt.thread_pool);
+		}
+
+		static void DepthwiseCHW(const Convolution& conv, const float* src, float* dst, const float* bias, const ConvShape& s, const Option& opt)
+		{
+			int64_t kk = static_cast<int64_t>(conv.kernel_h) * conv.kernel_w;
+			const float* weight = static_cast<const float*>(conv.weight.data);
+			int64_t channels = conv.out_channels;
+			ParallelFor(0, s.batch * channels, [&](int64_t first, int64_t last) {
+				for (int64_t i = first; i < last; i++)
+				{
+					int64_t c = i % channels;
+					const float* plane = src + i * s.h * s.w;
+					const float* wc = weight + c * kk;
+					float* out = dst + i * s.out_h * s.out_w;
+					std::fill(out, out + s.out_h * s.out_w, bias[c]);
+					for (int64_t y = 0; y < s.out_h; y++)
+					{
+						float* row = out + y * s.out_w;
+						for (int64_t ky = 0; ky < conv.kernel_h; ky++)
+						{
+							int64_t iy = y * conv.stride_h - conv.pad_h + ky * conv.dilation_h;
+							if (iy < 0 or iy >= s.h) continue;
+							const float* line = plane + iy * s.w;
+							for (int64_t kx = 0; kx < conv.kernel_w; kx++)
+							{
+								int64_t offset = kx * conv.dilation_w - conv.pad_w;
+								int64_t begin, end;
+								ValidRange(offset, conv.stride_w, s.w, s.out_w, begin, end);
+								float k = wc[ky * conv.kernel_w + kx];
+								if (conv.stride_w == 1)
+								{
+									for (int64_t x = begin; x < end; x++) row[x] += k * line[x + offset];
+								}
+								else
+								{
+									for (int64_t x = begin; x < end; x++) row[x] += k * line[x * conv.stride_w + offset];
+								}
+							}
+						}
+					}
+					Activate(out, s.out_h * s.out_w, conv.activation);
+				}
+			}, std::max<int64_t>(1, (1 << 14) / (s.out_h * s.out_w * kk)), opt.num_threads, opt.thread_pool);
+		}
+
+		// input and output packed the same way, C4HW4 or C8HW8
+		static void DirectForward(const Convolution& conv, ConvolutionKernels& kernels, const Tensor& input, Tensor& output, const ConvShape& s, const Option& opt)
+		{
+			DirectArgs a = { static_cast<const float*>(input.data), static_cast<float*>(output.data), nullptr,
+				static_cast<const float*>(kernels.bias.data), input.shape[-3], output.shape[-3], s };
+			bool depthwise = Depthwise(conv);
+			if (input.packing == Packing::C8HW8)
+			{
+				std::call_once(kernels.direct8_flag, [&] { kernels.direct8 = PackDirect<8>(conv); });
+				a.weight = static_cast<const float*>(kernels.direct8.data);
+				if (depthwise) DepthwisePacked<8>(conv, a, opt);
+				else DirectPacked<8>(conv, a, opt);
+			}
+			else
+			{
+				std::call_once(kernels.direct4_flag, [&] { kernels.direct4 = PackDirect<4>(conv); });
+				a.weight = static_cast<const float*>(kernels.direct4.data);
+				if (depthwise) DepthwisePacked<4>(conv, a, opt);
+				else DirectPacked<4>(conv, a, opt);
+			}
+		}
+
+		static void ForwardCHW(const Convolution& conv, ConvolutionKernels& kernels, ConvolutionAlgorithm algorithm,
+			const Tensor& input, Tensor& output, const ConvShape& s, const Option& opt)
+		{
+			const float* src = static_cast<const float*>(input.data);
+			float* dst = static_cast<float*>(output.data);
+			const float* bias = static_cast<const float*>(kernels.bias.data);
+			switch (algorithm)
+			{
+			case ConvolutionAlgorithm::Winograd23:
+				std::call_once(kernels.winograd23_flag, [&] { kernels.winograd23 = WinogradWeights<2>(conv); });
+				Winograd<2>(conv, src, dst, static_cast<const float*>(kernels.winograd23.data), bias, s, opt);
+				break;
+			case ConvolutionAlgorithm::Winograd43:
+				std::call_once(kernels.winograd43_flag, [&] { kernels.winograd43 = WinogradWeights<4>(conv); });
+				Winograd<4>(conv, src, dst, static_cast<const float*>(kernels.winograd43.data), bias, s, opt);
+				break;
+			case ConvolutionAlgorithm::Direct:
+				if (Depthwise(conv))
+				{
+					DepthwiseCHW(conv, src, dst, bias, s, opt);
+				}
+				else
+				{
+					Packing packing = DirectAVX2() ? Packing::C8HW8 : Packing::C4HW4;
+					Tensor packed = input.Repack(packing, 0, opt.workspace_allocator);
+					Tensor result = Tensor(conv.OutputShape(packed.shape, packing), Depth::D4, packing, opt.workspace_allocator);
+					DirectForward(conv, kernels, packed, result, s, opt);
+					result.Repack(Packing::CHW, conv.out_channels, opt.workspace_allocator).CopyTo(output);
+				}
+				break;
+			default:
+				Im2colGemm(conv, src, dst, s, opt);
+				break;
+			}
+		}
+
+		// the algorithm asked for when it applies to the convolution, the one of Select otherwise
+		static ConvolutionAlgorithm Resolve(const Convolution& conv, const Shape& shape, const Packing& packing)
+		{
+			ConvolutionAlgorithm selected = conv.algorithm;
+			bool applies = selected == ConvolutionAlgorithm::Im2colGemm or
+				(selected == ConvolutionAlgorithm::Direct and (conv.groups == 1 or Depthwise(conv))) or
+				((selected == ConvolutionAlgorithm::Winograd23 or selected == ConvolutionAlgorithm::Winograd43) and WinogradShape(conv));
+			return applies ? selected : conv.Select(shape, packing);
+		}
+
+		void Convolution::Forward(const Tensor& input_blob, Tensor& output_blob, const Option& opt) const
+		{
+			int dims = static_cast<int>(input_blob.shape.size());
+			bool valid = input_blob.depth == Depth::D4 and dims >= 3 and (input_blob.packing == Packing::CHW or
+				input_blob.packing == Packing::C4HW4 or input_blob.packing == Packing::C8HW8);
+			CHECK(valid) << "Convolution expects a float [C, H, W] or [..., C, H, W] Tensor packed as CHW, C4HW4 or C8HW8";
+			if (not valid) return;
+			int lanes = static_cast<int>(input_blob.packing);
+			bool matches = input_blob.shape[-3] == (in_channels + lanes - 1) / lanes;
+			CHECK(matches) << "expect " << in_channels << " input channels but got " << input_blob.shape[-3] << " blocks of " << lanes;
+			if (not matches) return;
+			Shape shape = OutputShape(input_blob.shape, input_blob.packing);
+			bool fits = shape[-2] > 0 and shape[-1] > 0;
+			CHECK(fits) << "the kernel is larger than the padded input " << input_blob.shape;
+			if (not fits) return;
+
+			const Tensor input = input_blob.contiguous() ? input_blob : input_blob.Clone(opt.workspace_allocator);
+			// the kernels read the input while they write the output, so Forward(x, x) gets a fresh output, input keeps x alive
+			if (output_blob.data == input.data) output_blob = Tensor();
+			CreateOutput(output_blob, shape, Depth::D4, input.packing, opt);
+			// the leading dims are all frames of one batch
+			int64_t batch = 1;
+			for (int i = 0; i < dims - 3; i++) batch *= input.shape[i];
+			ConvShape s = { batch, input.shape[-2], input.shape[-1], shape[-2], shape[-1] };
+
+			ConvolutionAlgorithm selected = Resolve(*this, input.shape, input.packing);
+
+			if (input.packing == Packing::CHW)
+			{
+				ForwardCHW(*this, *kernels, selected, input, output_blob, s, opt);
+			}
+			else if (selected == ConvolutionAlgorithm::Direct)
+			{
+				DirectForward(*this, *kernels, input, output_blob, s, opt);
+			}
+			else
+			{
+				// the other algorithms run on CHW
+				Tensor planar = input.Repack(Packing::CHW, in_channels, opt.workspace_allocator);
+				Tensor result = Tensor(OutputShape(planar.shape), Depth::D4, Packing::CHW, opt.workspace_allocator);
+				ForwardCHW(*this, *kernels, selected, planar, result, s, opt);
+				result.Repack(input.packing, 0, opt.workspace_allocator).CopyTo(output_blob);
+			}
+		}
+
+		bool Convolution::StackBatch(const Tensor& blob, int n) const
+		{
+			int dims = static_cast<int>(blob.shape.size());
+			if (n < 2 or dims < 3) return false;
+			int64_t batch = n;
+			for (int i = 0; i < dims - 3; i++) batch *= blob.shape[i];
+			Shape shape = OutputShape(blob.shape, blob.packing);
+			ConvShape s = { batch, blob.shape[-2], blob.shape[-1], shape[-2], shape[-1] };
+
+			// the direct loops run frame by frame anyway, the others span frames while one image leaves them narrow
+			switch (Resolve(*this, blob.shape, blob.packing))
+			{
+			case ConvolutionAlgorithm::Winograd23:
+				return CeilDiv(s.out_h, 2) * CeilDiv(s.out_w, 2) < WinogradBlock<2>(*this);
+			case ConvolutionAlgorithm::Winograd43:
+				return CeilDiv(s.out_h, 4) * CeilDiv(s.out_w, 4) < WinogradBlock<4>(*this);
+			case ConvolutionAlgorithm::Im2colGemm:
+				return Im2colFrames(*this, s) > 1;
+			default:
+				return false;
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,327 @@
+#include "dnn/layers/elementwise.hpp"
+#include "core/parallel.hpp"
+
+#include <algorithm>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		// floats of a plane run through all the steps at a time, so that they stay in L1
+		constexpr int64_t chunk_floats = 4096;
+
+		class ElementwiseChain
+		{
+		public:
+			std::vector<ElementwiseStep> steps;
+		};
+
+		// a float blob as outer x blocks planes of plane pixels, each of lanes interleaved channels
+		struct ChannelPlanes
+		{
+			int64_t outer = 1;
+			int64_t blocks = 1;
+			int64_t plane = 1;
+			int lanes = 1;
+		};
+
+		static ChannelPlanes Planes(const Tensor& blob)
+		{
+			ChannelPlanes p;
+			size_t dims = blob.shape.size();
+			size_t axis = dims >= 3 ? dims - 3 : 0;
+			for (size_t i = 0; i < axis; i++) p.outer *= blob.shape[static_cast<int>(i)];
+			p.blocks = blob.shape[static_cast<int>(axis)];
+			for (size_t i = axis + 1; i < dims; i++) p.plane *= blob.shape[static_cast<int>(i)];
+			p.lanes = static_cast<int>(blob.packing);
+			return p;
+		}
+
+		static bool Supported(const Tensor& blob) noexcept
+		{
+			return not blob.empty() and blob.depth == Depth::D4 and
+				(blob.packing == Packing::CHW or blob.packing == Packing::C4HW4 or blob.packing == Packing::C8HW8);
+		}
+
+		// the channels of the scales and shifts, 0 if there are none
+		static int64_t Channels(const ElementwiseStep* steps, size_t count)
+		{
+			int64_t channels = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				if (not steps[i].scale.empty()) channels = std::max<int64_t>(channels, steps[i].scale.shape.total());
+				if (not steps[i].shift.empty()) channels = std::max<int64_t>(channels, steps[i].shift.shape.total());
+			}
+			return channels;
+		}
+
+		template<int P>
+		static inline void Affine(float* data, int64_t size, const float* scale, const float* shift) noexcept
+		{
+			for (int64_t i = 0; i < size; i += P)
+			{
+				for (int l = 0; l < P; l++) data[i + l] = data[i + l] * scale[l] + shift[l];
+			}
+		}
+
+		// the steps over size floats of a plane whose lane 0 is the channel channel
+		static void RunSteps(const ElementwiseStep* steps, size_t count, float* data, int64_t size, int lanes, int64_t channel, int64_t channels)
+		{
+			for (size_t k = 0; k < count; k++)
+			{
+				const ElementwiseStep& step = steps[k];
+				if (not step.scale.empty() or not step.shift.empty())
+				{
+					float scale[8];
+					float shift[8];
+					for (int l = 0; l < lanes; l++)
+					{
+						int64_t c = std::min(channel + l, channels - 1);
+						scale[l] = step.scale.empty() ? 1.f : step.scale[c];
+						shift[l] = step.shift.empty() ? 0.f : step.shift[c];
+					}
+					switch (lanes)
+					{
+					case 4: Affine<4>(data, size, scale, shift); break;
+					case 8: Affine<8>(data, size, scale, shift); break;
+					default: Affine<1>(data, size, scale, shift); break;
+					}
+				}
+				Activate(data, size, step.activation);
+			}
+			int64_t valid = channels - channel;
+			if (valid >= lanes) return;
+			for (int64_t i = 0; i < size; i += lanes)
+			{
+				for (int64_t l = valid; l < lanes; l++) data[i + l] = 0.f;
+			}
+		}
+
+		// dst = inputs[0] op inputs[1] op ..., then the steps, chunk by chunk of each plane
+		static void Run(const std::vector<const float*>& inputs, ElementwiseOp op, float* dst, const ChannelPlanes& p,
+			const ElementwiseStep* steps, size_t count, int64_t channels, const Option& opt)
+		{
+			int64_t size = p.plane * p.lanes;
+			int64_t chunk = std::min(size, chunk_floats / p.lanes * p.lanes);
+			int64_t chunks = (size + chunk - 1) / chunk;
+			ParallelFor(0, p.outer * p.blocks * chunks, [&](int64_t first, int64_t last) {
+				for (int64_t i = first; i < last; i++)
+				{
+					int64_t plane = i / chunks;
+					int64_t offset = plane * size + i % chunks * chunk;
+					int64_t n = std::min(chunk, size - i % chunks * chunk);
+					float* out = dst + offset;
+					if (inputs[0] + offset != out) memcpy(out, inputs[0] + offset, n * sizeof(float));
+					for (size_t k = 1; k < inputs.size(); k++)
+					{
+						const float* in = inputs[k] + offset;
+						switch (op)
+						{
+						case ElementwiseOp::Product: for (int64_t j = 0; j < n; j++) out[j] *= in[j]; break;
+						case ElementwiseOp::Max: for (int64_t j = 0; j < n; j++) out[j] = std::max(out[j], in[j]); break;
+						default: for (int64_t j = 0; j < n; j++) out[j] += in[j]; break;
+						}
+					}
+					RunSteps(steps, count, out, n, p.lanes, plane % p.blocks * p.lanes, channels);
+				}
+			}, std::max<int64_t>(1, (1 << 16) / chunk), opt.num_threads, opt.thread_pool);
+		}
+
+		// the channels the steps run on, all the lanes when no step has a scale or a shift
+		static bool CheckChannels(const ElementwiseStep* steps, size_t count, const ChannelPlanes& p, int64_t& channels)
+		{
+			channels = Channels(steps, count);
+			if (channels == 0) channels = p.blocks * p.lanes;
+			bool matches = (channels + p.lanes - 1) / p.lanes == p.blocks;
+			CHECK(matches) << "the steps are for " << channels << " channels but the blob has " << p.blocks << " blocks of " << p.lanes;
+			return matches;
+		}
+
+		void ApplySteps(const ElementwiseStep* steps, size_t count, const Tensor& input, Tensor& output, const Option& opt)
+		{
+			bool supported = Supported(input);
+			CHECK(supported) << "expect a float Tensor packed as CHW, C4HW4 or C8HW8";
+			if (not supported) return;
+			ChannelPlanes p = Planes(input);
+			int64_t channels;
+			if (not CheckChannels(steps, count, p, channels)) return;
+
+			if (&output == &input and not input.contiguous())
+			{
+				// in place on a strided view, e.g. a Cut: run on a dense copy and write it back through the steps
+				Tensor dense = input.Clone(opt.workspace_allocator);
+				Run({ static_cast<const float*>(dense.data) }, ElementwiseOp::Sum, static_cast<float*>(dense.data), p, steps, count, channels, opt);
+				dense.CopyTo(output);
+				return;
+			}
+			const Tensor src = input.contiguous() ? input : input.Clone(opt.workspace_allocator);
+			Layer::CreateOutput(output, src.shape, Depth::D4, src.packing, opt);
+			Run({ static_cast<const float*>(src.data) }, ElementwiseOp::Sum, static_cast<float*>(output.data), p, steps, count, channels, opt);
+		}
+
+
+		Elementwise::Elementwise(ElementwiseOp op) : Layer("Elementwise"), op(op), chain(new ElementwiseChain)
+		{
+			support_inplace = true;
+			support_outplace = true;
+		}
+
+		Elementwise::~Elementwise()
+		{
+			delete chain;
+		}
+
+		void Elementwise::Forward(const Tensor& input_blob, Tensor& output_blob, const Option& opt) const
+		{
+			ApplySteps(chain->steps.data(), chain->steps.size(), input_blob, output_blob, opt);
+		}
+
+		void Elementwise::Forward(Tensor& input_output_blob, const Option& opt) const
+		{
+			ApplySteps(chain->steps.data(), chain->steps.size(), input_output_blob, input_output_blob, opt);
+		}
+
+		void Elementwise::Forward(const std::vector<Tensor>& input_blobs, std::vector<Tensor>& output_blobs, const Option& opt) const
+		{
+			output_blobs.resize(1);
+			CHECK(not input_blobs.empty()) << "Elementwise needs an input";
+			if (input_blobs.empty()) return;
+			if (input_blobs.size() == 1)
+			{
+				Forward(input_blobs[0], output_blobs[0], opt);
+				return;
+			}
+
+			const Tensor& first = input_blobs[0];
+			bool same = Supported(first);
+			for (const auto& blob : input_blobs) same = same and blob.shape == first.shape and blob.depth == first.depth and blob.packing == first.packing;
+			CHECK(same) << "Elementwise expects float inputs of the same shape and packing";
+			if (not same) return;
+			ChannelPlanes p = Planes(first);
+			int64_t channels;
+			if (not CheckChannels(chain->steps.data(), chain->steps.size(), p, channels)) return;
+
+			std::vector<Tensor> sources;
+			std::vector<const float*> inputs;
+			for (const auto& blob : input_blobs)
+			{
+				sources.push_back(blob.contiguous() ? blob : blob.Clone(opt.workspace_allocator));
+				inputs.push_back(static_cast<const float*>(sources.back().data));
+			}
+			CreateOutput(output_blobs[0], first.shape, Depth::D4, first.packing, opt);
+			Run(inputs, op, static_cast<float*>(output_blobs[0].data), p, chain->steps.data(), chain->steps.size(), channels, opt);
+		}
+
+		// the channel values of a scale or a shift, or value when it is empty
+		static inline float At(const Tensor& values, int64_t c, float value) noexcept
+		{
+			return values.empty() ? value : values[c];
+		}
+
+		void Elementwise::Append(const ElementwiseStep& step)
+		{
+			ElementwiseStep next = step;
+			if (not next.scale.contiguous()) next.scale = next.scale.Clone();
+			if (not next.shift.contiguous()) next.shift = next.shift.Clone();
+			int64_t channels = Channels(&next, 1);
+			int64_t known = Channels(chain->steps.data(), chain->steps.size());
+			bool matches = (next.scale.empty() or next.scale.shape.total() == channels) and (next.shift.empty() or next.shift.shape.total() == channels) and
+				(known == 0 or channels == 0 or known == channels);
+			CHECK(matches) << "the steps of an Elementwise should all have the same channels";
+			if (not matches) return;
+
+			auto& steps = chain->steps;
+			if (steps.empty() or steps.back().activation.type != ActivationType::Identity)
+			{
+				steps.push_back(next);
+				return;
+			}
+
+			// (x * a + b) * c + d = x * (a * c) + (b * c + d)
+			ElementwiseStep& last = steps.back();
+			if (channels > 0)
+			{
+				int64_t n = channels;
+				Tensor scale = last.scale.empty() and next.scale.empty() ? Tensor() : Tensor::zeros(Shape(static_cast<int>(n)));
+				Tensor shift = last.shift.empty() and next.shift.empty() ? Tensor() : Tensor::zeros(Shape(static_cast<int>(n)));
+				for (int64_t c = 0; c < n; c++)
+				{
+					float s = At(next.scale, c, 1.f);
+					if (not scale.empty()) scale[c] = At(last.scale, c, 1.f) * s;
+					if (not shift.empty()) shift[c] = At(last.shift, c, 0.f) * s + At(next.shift, c, 0.f);
+				}
+				last.scale = scale;
+				last.shift = shift;
+			}
+			last.activation = next.activation;
+		}
+
+		size_t Elementwise::num_steps() const noexcept
+		{
+			return chain->steps.size();
+		}
+
+		const ElementwiseStep& Elementwise::step(size_t index) const
+		{
+			return chain->steps[index];
+		}
+
+
+		BatchNorm::BatchNorm(const Tensor& mean, const Tensor& var, const Tensor& gamma, const Tensor& beta, float eps) : Layer("BatchNorm")
+		{
+			support_inplace = true;
+			support_outplace = true;
+
+			int channels = mean.shape.total();
+			bool matches = mean.depth == Depth::D4 and var.depth == Depth::D4 and var.shape.total() == channels and
+				(gamma.empty() or gamma.shape.total() == channels) and (beta.empty() or beta.shape.total() == channels);
+			CHECK(matches) << "expect float mean, var, gamma and beta of " << channels << " channels";
+			if (not matches) return;
+
+			const Tensor m = mean.contiguous() ? mean : mean.Clone();
+			const Tensor v = var.contiguous() ? var : var.Clone();
+			const Tensor g = gamma.contiguous() ? gamma : gamma.Clone();
+			const Tensor b = beta.contiguous() ? beta : beta.Clone();
+			scale = Tensor::zeros(Shape(channels));
+			shift = Tensor::zeros(Shape(channels));
+			for (int c = 0; c < channels; c++)
+			{
+				scale[c] = At(g, c, 1.f) / std::sqrt(v[c] + eps);
+				shift[c] = At(b, c, 0.f) - m[c] * scale[c];
+			}
+		}
+
+		void BatchNorm::Forward(const Tensor& input_blob, Tensor& output_blob, const Option& opt) const
+		{
+			ElementwiseStep step = { scale, shift, Activation() };
+			ApplySteps(&step, 1, input_blob, output_blob, opt);
+		}
+
+		void BatchNorm::Forward(Tensor& input_output_blob, const Option& opt) const
+		{
+			ElementwiseStep step = { scale, shift, Activation() };
+			ApplySteps(&step, 1, input_output_blob, input_output_blob, opt);
+		}
+
+
+		Scale::Scale(const Tensor& scale, const Tensor& bias) : Layer("Scale"),
+			scale(scale.contiguous() ? scale : scale.Clone()), bias(bias.contiguous() ? bias : bias.Clone())
+		{
+			support_inplace = true;
+			support_outplace = true;
+			CHECK(scale.depth == Depth::D4 and (bias.empty() or bias.shape.total() == scale.shape.total())) << "expect float scale and bias of the same channels";
+		}
+
+		void Scale::Forward(const Tensor& input_blob, Tensor& output_blob, const Option& opt) const
+		{
+			ElementwiseStep step = { scale, bias, Activation() };
+			ApplySteps(&step, 1, input_blob, output_blob, opt);
+		}
+
+		void Scale::Forward(Tensor& input_output_blob, const Option& opt) const
+		{
+			ElementwiseStep step = { scale, bias, Activation() };
+			ApplySteps(&step, 1, input_output_blob, input_output_blob, opt);
+		}
+	}
+}
\ No newline at end of file
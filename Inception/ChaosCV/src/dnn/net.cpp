@@ -0,0 +1,656 @@
+#include "dnn/net.hpp"
+#include "dnn/planner.hpp"
+#include "dnn/fusion.hpp"
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		struct LayerNode
+		{
+			std::shared_ptr<Layer> layer;
+			std::vector<int> bottoms;
+			std::vector<int> tops;
+		};
+
+		class NetGraph
+		{
+		public:
+			int Blob(const std::string& name)
+			{
+				auto it = index.find(name);
+				if (it != index.end()) return it->second;
+				int blob = static_cast<int>(names.size());
+				names.push_back(name);
+				producers.push_back(-1);
+				index.emplace(name, blob);
+				return blob;
+			}
+
+			std::vector<LayerNode> layers;
+			std::vector<std::string> names;
+			// the layer writing each blob, -1 for the inputs of the Net
+			std::vector<int> producers;
+			std::unordered_map<std::string, int> index;
+		};
+
+		// the blob_allocator of a layer, it records the requests of the layer while planning,
+		// then serves them in the same order from the slab
+		class LayerAllocator : public Allocator
+		{
+		public:
+			struct Slot
+			{
+				size_t offset;
+				size_t size;
+			};
+			// a slot served by the fallback, e.g. for the extracted blobs
+			static constexpr size_t external = std::numeric_limits<size_t>::max();
+
+			void* FastMalloc(size_t size) override
+			{
+				if (slab)
+				{
+					size_t i = next++;
+					if (i < slots.size() and slots[i].offset != external and size <= slots[i].size) return slab + slots[i].offset;
+				}
+				void* ptr = fallback ? fallback->FastMalloc(size) : chaos::FastMalloc(size);
+				if (recording)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					records.emplace_back(ptr, size);
+				}
+				return ptr;
+			}
+
+			void FastFree(void* ptr) override
+			{
+				if (slab and ptr >= slab and ptr < slab + capacity) return;
+				if (fallback) fallback->FastFree(ptr);
+				else chaos::FastFree(ptr);
+			}
+
+			Allocator* fallback = nullptr;
+
+			bool recording = false;
+			std::mutex mutex;
+			std::vector<std::pair<void*, size_t>> records;
+
+			uchar* slab = nullptr;
+			size_t capacity = 0;
+			std::vector<Slot> slots;
+			std::atomic<size_t> next = 0;
+		};
+
+		class ExtractorState
+		{
+		public:
+			~ExtractorState()
+			{
+				// the blobs may live in the slab
+				blobs.clear();
+				FastFree(slab);
+			}
+
+			// the blob_allocator of each layer in a planned run
+			std::vector<std::unique_ptr<LayerAllocator>> allocators;
+			void* slab = nullptr;
+			// the targets the allocators are planned for
+			std::vector<int> planned;
+			// the layers each layer waits for in a planned run besides the writers of its bottoms,
+			// they are the last to use the slab memory it is given
+			std::vector<std::vector<int>> waits;
+
+			std::vector<Tensor> blobs;
+			// set by Extractor::Input, never written in place nor released
+			std::vector<char> inputs;
+		};
+
+		// the buffers the layers allocated while planning
+		struct Recording
+		{
+			std::vector<BufferLife> buffers;
+			// read after the run, these are not placed in the slab
+			std::vector<char> external;
+			// the layer allocating each buffer, and all the layers writing or reading it
+			std::vector<int> owner;
+			std::vector<std::vector<int>> users;
+			// the buffers of each layer in the order of allocation
+			std::vector<std::vector<int>> layers;
+		};
+
+		Net::Net() : graph(new NetGraph) {}
+		Net::~Net()
+		{
+			delete graph;
+		}
+
+		int Net::AddLayer(const std::shared_ptr<Layer>& layer, const std::vector<std::string>& bottoms, const std::vector<std::string>& tops)
+		{
+			CHECK(layer) << "can not add an empty layer";
+			if (not layer) return -1;
+			for (const auto& name : tops)
+			{
+				auto it = graph->index.find(name);
+				bool known = it != graph->index.end() or std::count(bottoms.begin(), bottoms.end(), name) > 0 or std::count(tops.begin(), tops.end(), name) > 1;
+				CHECK(not known) << "layer " << layer->type << " writes blob " << name << " which is already read or written, layers should be added in topological order";
+				if (known) return -1;
+			}
+
+			int id = static_cast<int>(graph->layers.size());
+			LayerNode node;
+			node.layer = layer;
+			for (const auto& name : bottoms) node.bottoms.push_back(graph->Blob(name));
+			for (const auto& name : tops)
+			{
+				int blob = graph->Blob(name);
+				graph->producers[blob] = id;
+				node.tops.push_back(blob);
+			}
+			graph->layers.push_back(std::move(node));
+			return id;
+		}
+
+		int Net::FindBlob(const std::string& name) const
+		{
+			auto it = graph->index.find(name);
+			return it == graph->index.end() ? -1 : it->second;
+		}
+
+		const std::string& Net::blob_name(int index) const
+		{
+			return graph->names[index];
+		}
+
+		const std::shared_ptr<Layer>& Net::layer(int index) const
+		{
+			return graph->layers[index].layer;
+		}
+
+		size_t Net::num_blobs() const noexcept
+		{
+			return graph->names.size();
+		}
+
+		size_t Net::num_layers() const noexcept
+		{
+			return graph->layers.size();
+		}
+
+		int Net::Fuse(const std::vector<std::string>& keep)
+		{
+			auto& layers = graph->layers;
+			std::vector<int> readers(graph->names.size(), 0);
+			std::vector<int> reader(graph->names.size(), -1);
+			for (size_t i = 0; i < layers.size(); i++)
+			{
+				for (int blob : layers[i].bottoms)
+				{
+					readers[blob]++;
+					reader[blob] = static_cast<int>(i);
+				}
+			}
+			std::vector<bool> kept(graph->names.size(), false);
+			for (const auto& name : keep)
+			{
+				int blob = FindBlob(name);
+				if (blob >= 0) kept[blob] = true;
+			}
+
+			// a layer takes in the layer after it while that one is the only reader of its single top
+			std::vector<bool> removed(layers.size(), false);
+			for (size_t i = 0; i < layers.size(); i++)
+			{
+				if (removed[i]) continue;
+				LayerNode& node = layers[i];
+				while (node.tops.size() == 1)
+				{
+					int blob = node.tops[0];
+					if (kept[blob] or readers[blob] != 1) break;
+					LayerNode& next = layers[reader[blob]];
+					if (next.bottoms.size() != 1 or next.tops.size() != 1) break;
+					std::shared_ptr<Layer> fused = FuseLayers(node.layer, next.layer);
+					if (not fused) break;
+
+					node.layer = fused;
+					node.tops = next.tops;
+					graph->producers[blob] = -1;
+					removed[reader[blob]] = true;
+				}
+			}
+
+			std::vector<LayerNode> remaining;
+			for (size_t i = 0; i < layers.size(); i++)
+			{
+				if (removed[i]) continue;
+				for (int blob : layers[i].tops) graph->producers[blob] = static_cast<int>(remaining.size());
+				remaining.push_back(std::move(layers[i]));
+			}
+			int count = static_cast<int>(layers.size() - remaining.size());
+			layers = std::move(remaining);
+			return count;
+		}
+
+		Extractor Net::CreateExtractor() const
+		{
+			return Extractor(*this);
+		}
+
+
+		Extractor::Extractor(const Net& net) : opt(net.opt), graph(net.graph), state(new ExtractorState) {}
+
+		Extractor::~Extractor()
+		{
+			delete state;
+		}
+
+		Extractor::Extractor(Extractor&& extractor) noexcept : opt(extractor.opt), graph(extractor.graph), state(extractor.state)
+		{
+			extractor.state = nullptr;
+		}
+
+		Extractor& Extractor::operator=(Extractor&& extractor) noexcept
+		{
+			if (this != &extractor)
+			{
+				delete state;
+				opt = extractor.opt;
+				graph = extractor.graph;
+				state = extractor.state;
+				extractor.state = nullptr;
+			}
+			return *this;
+		}
+
+		// the Net may have grown since the Extractor was made
+		static void Sync(const NetGraph& graph, ExtractorState& state)
+		{
+			state.blobs.resize(graph.names.size());
+			state.inputs.resize(graph.names.size(), 0);
+		}
+
+		void Extractor::Input(const std::string& name, const Tensor& blob)
+		{
+			auto it = graph->index.find(name);
+			CHECK(it != graph->index.end()) << "no blob named " << name;
+			if (it == graph->index.end()) return;
+
+			Sync(*graph, *state);
+			// the blobs computed so far may depend on the old value
+			for (size_t i = 0; i < state->blobs.size(); i++)
+			{
+				if (not state->inputs[i]) state->blobs[i].Release();
+			}
+			state->blobs[it->second] = blob;
+			state->inputs[it->second] = 1;
+		}
+
+		/// <param name="last_reader">No one else reads the bottom, the layer may take it over</param>
+		static void Forward(const LayerNode& node, std::vector<Tensor>& blobs, bool last_reader, const Option& opt)
+		{
+			const Layer& layer = *node.layer;
+			if (node.bottoms.size() == 1 and node.tops.size() == 1)
+			{
+				Tensor& top = blobs[node.tops[0]];
+				// an old value may be shared with the caller, it is never written into
+				top.Release();
+				if (last_reader) layer.Forward(std::move(blobs[node.bottoms[0]]), top, opt);
+				else layer.Forward(blobs[node.bottoms[0]], top, opt);
+				return;
+			}
+
+			std::vector<Tensor> bottoms;
+			std::vector<Tensor> tops;
+			bottoms.reserve(node.bottoms.size());
+			for (int blob : node.bottoms) bottoms.push_back(blobs[blob]);
+			layer.Forward(bottoms, tops, opt);
+			CHECK_EQ(tops.size(), node.tops.size()) << "layer " << layer.type << " gives " << tops.size() << " blobs for " << node.tops.size() << " tops";
+			for (size_t i = 0; i < std::min(tops.size(), node.tops.size()); i++) blobs[node.tops[i]] = std::move(tops[i]);
+		}
+
+		// the buffer of record holding ptr, -1 if none
+		static int FindBuffer(const std::map<uintptr_t, int>& starts, const Recording& record, const void* ptr)
+		{
+			auto it = starts.upper_bound(reinterpret_cast<uintptr_t>(ptr));
+			if (it == starts.begin()) return -1;
+			--it;
+			bool inside = reinterpret_cast<uintptr_t>(ptr) < it->first + record.buffers[it->second].size;
+			return inside ? it->second : -1;
+		}
+
+		/// <param name="planned">Give each layer its LayerAllocator as blob_allocator</param>
+		/// <param name="record">Collect the buffers and their lifetimes, the layers then run one after another</param>
+		static void Run(const NetGraph& graph, ExtractorState& state, const std::vector<int>& targets, const Option& opt, bool planned, Recording* record = nullptr)
+		{
+			size_t num_blobs = graph.names.size();
+			std::vector<Tensor>& blobs = state.blobs;
+
+			// walk back from the targets to the blobs already there, the layers are in topological order
+			std::vector<char> wanted(num_blobs, 0);
+			std::vector<char> kept(num_blobs, 0);
+			for (int blob : targets)
+			{
+				kept[blob] = 1;
+				if (blobs[blob].empty()) wanted[blob] = 1;
+			}
+			std::vector<int> needed;
+			for (int i = static_cast<int>(graph.layers.size()) - 1; i >= 0; i--)
+			{
+				const LayerNode& node = graph.layers[i];
+				if (std::none_of(node.tops.begin(), node.tops.end(), [&](int blob) { return wanted[blob]; })) continue;
+				needed.push_back(i);
+				for (int blob : node.bottoms)
+				{
+					if (blobs[blob].empty()) wanted[blob] = 1;
+				}
+			}
+			for (size_t blob = 0; blob < num_blobs; blob++)
+			{
+				bool missing = wanted[blob] and graph.producers[blob] < 0;
+				CHECK(not missing) << "input blob " << graph.names[blob] << " is not set";
+				if (missing) return;
+			}
+			std::reverse(needed.begin(), needed.end());
+
+			// the step of each needed layer in topological order, -1 for the others
+			std::vector<int> step(graph.layers.size(), -1);
+			for (size_t s = 0; s < needed.size(); s++) step[needed[s]] = static_cast<int>(s);
+
+			// each layer waits for the needed layers writing its bottoms, and in a planned run for the layers
+			// last using the slab memory it is given
+			std::vector<int> waiting(graph.layers.size(), 0);
+			std::vector<std::vector<int>> consumers(graph.layers.size());
+			std::vector<int> readers(num_blobs, 0);
+			std::vector<int> last_read(num_blobs, 0);
+			for (int i : needed)
+			{
+				const LayerNode& node = graph.layers[i];
+				for (int blob : node.bottoms)
+				{
+					readers[blob]++;
+					last_read[blob] = std::max(last_read[blob], step[i]);
+					int producer = graph.producers[blob];
+					if (producer >= 0 and step[producer] >= 0)
+					{
+						consumers[producer].push_back(i);
+						waiting[i]++;
+					}
+				}
+				for (int blob : node.tops) last_read[blob] = step[i];
+				if (not planned or state.waits.size() <= static_cast<size_t>(i)) continue;
+				for (int layer : state.waits[i])
+				{
+					if (step[layer] < 0) continue;
+					consumers[layer].push_back(i);
+					waiting[i]++;
+				}
+			}
+
+			if (planned)
+			{
+				for (int i : needed) state.allocators[i]->next = 0;
+			}
+			std::map<uintptr_t, int> starts;
+			std::vector<int> owners(num_blobs, -1);
+
+			// guards readers, waiting and the release of the blobs, the layers write their own tops
+			std::mutex mutex;
+			auto releasable = [&](int blob) { return opt.light_mode and readers[blob] == 0 and not kept[blob] and not state.inputs[blob]; };
+
+			// run a layer, then give back what it read and return the layers it was the last wait of
+			auto run = [&](int id) {
+				const LayerNode& node = graph.layers[id];
+				bool last_reader = false;
+				if (node.bottoms.size() == 1 and node.tops.size() == 1)
+				{
+					int blob = node.bottoms[0];
+					std::lock_guard<std::mutex> lock(mutex);
+					// the other readers are done
+					last_reader = opt.light_mode and readers[blob] == 1 and not kept[blob] and not state.inputs[blob];
+				}
+
+				Option layer_opt = opt;
+				if (planned) layer_opt.blob_allocator = state.allocators[id].get();
+				Forward(node, blobs, last_reader, layer_opt);
+
+				if (record)
+				{
+					int now = step[id];
+					for (const auto& [ptr, size] : state.allocators[id]->records)
+					{
+						int buffer = static_cast<int>(record->buffers.size());
+						record->buffers.push_back(BufferLife{ size, now, now });
+						record->external.push_back(0);
+						record->owner.push_back(id);
+						record->users.push_back({ id });
+						record->layers[id].push_back(buffer);
+						// a freed block may come back, the latest buffer is the live one
+						starts[reinterpret_cast<uintptr_t>(ptr)] = buffer;
+					}
+					state.allocators[id]->records.clear();
+					// the buffers held by the new blobs, in place or as views they may be older ones
+					for (int blob : node.tops) owners[blob] = blobs[blob].empty() ? -1 : FindBuffer(starts, *record, blobs[blob].data);
+				}
+
+				std::vector<int> ready;
+				std::lock_guard<std::mutex> lock(mutex);
+				for (int blob : node.bottoms)
+				{
+					readers[blob]--;
+					if (releasable(blob)) blobs[blob].Release();
+				}
+				// tops no needed layer reads
+				for (int blob : node.tops)
+				{
+					if (releasable(blob)) blobs[blob].Release();
+				}
+				for (int next : consumers[id])
+				{
+					if (--waiting[next] == 0) ready.push_back(next);
+				}
+				return ready;
+			};
+
+			ThreadPool* pool = opt.thread_pool ? opt.thread_pool : ThreadPool::Global();
+			int threads = opt.num_threads > 0 ? std::min(opt.num_threads, pool->num_threads()) : pool->num_threads();
+			if (record or threads <= 1)
+			{
+				for (int id : needed) run(id);
+			}
+			else
+			{
+				// a layer is queued as soon as its last wait is over, at most threads layers run at once
+				TaskGroup group(pool);
+				std::mutex queue_mutex;
+				std::vector<int> queue;
+				int running = 0;
+				std::function<void(int)> submit = [&](int id) {
+					group.Run([&, id]() {
+						std::vector<int> ready = run(id);
+						std::lock_guard<std::mutex> lock(queue_mutex);
+						running--;
+						queue.insert(queue.end(), ready.begin(), ready.end());
+						for (; running < threads and not queue.empty(); running++)
+						{
+							submit(queue.back());
+							queue.pop_back();
+						}
+					});
+				};
+				{
+					std::lock_guard<std::mutex> lock(queue_mutex);
+					for (int id : needed)
+					{
+						if (waiting[id] == 0) queue.push_back(id);
+					}
+					std::reverse(queue.begin(), queue.end());
+					for (; running < threads and not queue.empty(); running++)
+					{
+						submit(queue.back());
+						queue.pop_back();
+					}
+				}
+				group.Wait();
+			}
+
+			if (record)
+			{
+				for (size_t blob = 0; blob < num_blobs; blob++)
+				{
+					int id = owners[blob];
+					if (id < 0) continue;
+					if (kept[blob]) record->external[id] = 1;
+					record->buffers[id].last = std::max(record->buffers[id].last, last_read[blob]);
+				}
+				for (int i : needed)
+				{
+					for (int blob : graph.layers[i].bottoms)
+					{
+						if (owners[blob] >= 0) record->users[owners[blob]].push_back(i);
+					}
+				}
+			}
+			if (planned)
+			{
+				// the slab is reused by the next run, only the extracted blobs stay
+				for (size_t blob = 0; blob < num_blobs; blob++)
+				{
+					if (not kept[blob] and not state.inputs[blob]) blobs[blob].Release();
+				}
+				// the extracted blobs may outlive the Extractor, they go back to the fallback and not to its allocators
+				for (int blob : targets)
+				{
+					Tensor& top = blobs[blob];
+					if (top.empty() or state.inputs[blob]) continue;
+					for (const auto& allocator : state.allocators)
+					{
+						if (top.data >= allocator->slab and top.data < allocator->slab + allocator->capacity)
+						{
+							top = top.Clone(allocator->fallback);
+							break;
+						}
+						if (top.allocator == allocator.get()) top.allocator = allocator->fallback;
+					}
+				}
+			}
+		}
+
+		static bool FindTargets(const NetGraph& graph, const std::vector<std::string>& names, std::vector<int>& targets)
+		{
+			targets.clear();
+			for (const auto& name : names)
+			{
+				auto it = graph.index.find(name);
+				CHECK(it != graph.index.end()) << "no blob named " << name;
+				if (it == graph.index.end()) return false;
+				targets.push_back(it->second);
+			}
+			return true;
+		}
+
+		void Extractor::Extract(const std::string& name, Tensor& blob)
+		{
+			std::vector<Tensor> blobs;
+			Extract(std::vector<std::string>{ name }, blobs);
+			blob = blobs.empty() ? Tensor() : std::move(blobs[0]);
+		}
+
+		void Extractor::Extract(const std::vector<std::string>& names, std::vector<Tensor>& blobs)
+		{
+			std::vector<int> targets;
+			if (not FindTargets(*graph, names, targets)) return;
+
+			Sync(*graph, *state);
+			bool planned = not state->planned.empty() and state->planned == targets and state->allocators.size() == graph->layers.size();
+			Run(*graph, *state, targets, opt, planned);
+
+			blobs.resize(targets.size());
+			for (size_t i = 0; i < targets.size(); i++) blobs[i] = state->blobs[targets[i]];
+		}
+
+		size_t Extractor::Plan(const std::vector<std::string>& names)
+		{
+			std::vector<int> targets;
+			if (not FindTargets(*graph, names, targets)) return 0;
+
+			// run every layer from the inputs, nothing may point into the old slab
+			Sync(*graph, *state);
+			for (size_t i = 0; i < state->blobs.size(); i++)
+			{
+				if (not state->inputs[i]) state->blobs[i].Release();
+			}
+			FastFree(state->slab);
+			state->slab = nullptr;
+			state->planned.clear();
+			state->waits.clear();
+
+			size_t num_layers = graph->layers.size();
+			while (state->allocators.size() < num_layers) state->allocators.push_back(std::make_unique<LayerAllocator>());
+			for (auto& allocator : state->allocators)
+			{
+				allocator->fallback = opt.blob_allocator;
+				allocator->recording = true;
+				allocator->records.clear();
+				allocator->slab = nullptr;
+				allocator->capacity = 0;
+				allocator->slots.clear();
+			}
+
+			Recording record;
+			record.layers.resize(num_layers);
+			Run(*graph, *state, targets, opt, true, &record);
+
+			std::vector<BufferLife> buffers;
+			std::vector<int> placed;
+			for (size_t id = 0; id < record.buffers.size(); id++)
+			{
+				if (record.external[id]) continue;
+				buffers.push_back(record.buffers[id]);
+				placed.push_back(static_cast<int>(id));
+			}
+			std::vector<size_t> offsets;
+			size_t size = PlanMemory(buffers, offsets);
+			std::vector<size_t> slots(record.buffers.size(), LayerAllocator::external);
+			for (size_t i = 0; i < placed.size(); i++) slots[placed[i]] = offsets[i];
+
+			// a buffer placed over an older one is allocated once every user of the older one is done
+			state->waits.assign(num_layers, {});
+			for (size_t a = 0; a < placed.size(); a++)
+			{
+				for (size_t b = 0; b < placed.size(); b++)
+				{
+					const BufferLife& older = record.buffers[placed[a]];
+					const BufferLife& newer = record.buffers[placed[b]];
+					bool overlap = offsets[a] < offsets[b] + newer.size and offsets[b] < offsets[a] + older.size;
+					if (not overlap or older.last >= newer.first) continue;
+					auto& waits = state->waits[record.owner[placed[b]]];
+					waits.insert(waits.end(), record.users[placed[a]].begin(), record.users[placed[a]].end());
+				}
+			}
+			for (auto& waits : state->waits)
+			{
+				std::sort(waits.begin(), waits.end());
+				waits.erase(std::unique(waits.begin(), waits.end()), waits.end());
+			}
+
+			state->slab = size ? chaos::FastMalloc(size) : nullptr;
+			for (size_t i = 0; i < num_layers; i++)
+			{
+				LayerAllocator& allocator = *state->allocators[i];
+				allocator.recording = false;
+				allocator.slab = static_cast<uchar*>(state->slab);
+				allocator.capacity = size;
+				for (int id : record.layers[i]) allocator.slots.push_back(LayerAllocator::Slot{ slots[id], record.buffers[id].size });
+			}
+			state->planned = targets;
+			return size;
+		}
+	}
+}
\ No newline at end of file
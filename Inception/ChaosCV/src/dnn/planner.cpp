@@ -0,0 +1,55 @@
+#include "dnn/planner.hpp"
+
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		size_t PlanMemory(const std::vector<BufferLife>& buffers, std::vector<size_t>& offsets, size_t alignment)
+		{
+			size_t n = buffers.size();
+			std::vector<size_t> sizes(n);
+			for (size_t i = 0; i < n; i++) sizes[i] = AlignSize(buffers[i].size, static_cast<int>(alignment));
+
+			std::vector<size_t> order(n);
+			std::iota(order.begin(), order.end(), 0);
+			std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) { return sizes[lhs] > sizes[rhs]; });
+
+			offsets.assign(n, 0);
+			std::vector<size_t> placed;
+			std::vector<std::pair<size_t, size_t>> busy;
+			size_t total = 0;
+			for (size_t i : order)
+			{
+				// the ranges of the placed buffers living at the same time, by offset
+				busy.clear();
+				for (size_t p : placed)
+				{
+					if (buffers[p].last < buffers[i].first or buffers[i].last < buffers[p].first) continue;
+					busy.emplace_back(offsets[p], offsets[p] + sizes[p]);
+				}
+				std::sort(busy.begin(), busy.end());
+
+				size_t best = std::numeric_limits<size_t>::max();
+				size_t best_gap = std::numeric_limits<size_t>::max();
+				size_t end = 0;
+				for (const auto& range : busy)
+				{
+					if (range.first >= end + sizes[i] and range.first - end < best_gap)
+					{
+						best = end;
+						best_gap = range.first - end;
+					}
+					end = std::max(end, range.second);
+				}
+				offsets[i] = best_gap == std::numeric_limits<size_t>::max() ? end : best;
+				total = std::max(total, offsets[i] + sizes[i]);
+				placed.push_back(i);
+			}
+			return total;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include "benchmark.hpp"
+#include <core/tensor.hpp>
+
+// the element-wise div/mod copy CopyTo used before dims were coalesced, for reference
+static void NaiveCopy(const Tensor& src, Tensor& dst)
+{
+    const Shape& shape = src.shape;
+    int dims = static_cast<int>(shape.size());
+    size_t esize = 1 * src.depth * src.packing;
+    for (int i = 0; i < shape.total(); i++)
+    {
+        size_t dofst = 0;
+        size_t sofst = 0;
+        int idx = i;
+        for (int d = 1; d <= dims; d++)
+        {
+            int k = idx % shape[-d];
+            dofst += k * dst.steps[-d];
+            sofst += k * src.steps[-d];
+            idx /= shape[-d];
+        }
+        memcpy((uchar*)dst.data + dofst * esize, (const uchar*)src.data + sofst * esize, esize);
+    }
+}
+
+static void Run(const std::string& name, const Tensor& src)
+{
+    Tensor dst = Tensor(src.shape, src.depth, src.packing);
+    double bytes = static_cast<double>(src.shape.total()) * src.depth * src.packing * 2;
+
+    double ms = Measure([&]() { src.CopyTo(dst); });
+    Report(name + " CopyTo", ms, bytes);
+    double naive = Measure([&]() { NaiveCopy(src, dst); });
+    Report(name + " naive", naive, bytes);
+    std::cout << std::setw(40) << "speedup" << std::setw(10) << std::setprecision(1) << naive / ms << "x" << std::endl;
+}
+
+int main()
+{
+    constexpr int c = 3;
+    constexpr int h = 1080;
+    constexpr int w = 1920;
+
+    // contiguous: a whole CHW frame
+    Tensor frame = Tensor::randu(Shape(c, h, w));
+    Run("contiguous [3,1080,1920]", frame);
+
+    // row-strided: a crop of the frame, each row jumps over the rest of the source row
+    Tensor crop = Tensor(Shape(c, h / 2, w / 2), Depth::D4, Packing::CHW, frame.data, frame.steps);
+    Run("row-strided crop [3,540,960]", crop);
+
+    // channel-strided: one channel of an HWC frame, element step 3
+    Tensor hwc = Tensor::randu(Shape(h, w, c));
+    Tensor channel = hwc.Cut(Shape(h, w, 1), 1);
+    Run("channel-strided HWC [1080,1920]", channel);
+
+    // element step 2, e.g. the real part of complex data
+    Tensor complex = Tensor::randu(Shape(h, w, 2));
+    Tensor real = complex.Cut(Shape(h, w, 1), 0);
+    Run("complex real part [1080,1920]", real);
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "benchmark.hpp"
+#include <core/gemm.hpp>
+
+#include <random>
+
+// the textbook i-k-j loop, for reference
+static void NaiveMatmul(const Tensor& a, const Tensor& b, Tensor& c)
+{
+    int m = a.shape[0];
+    int k = a.shape[1];
+    int n = b.shape[1];
+    const float* pa = (const float*)a.data;
+    const float* pb = (const float*)b.data;
+    float* pc = (float*)c.data;
+    std::fill(pc, pc + (size_t)m * n, 0.f);
+    for (int i = 0; i < m; i++)
+    {
+        for (int p = 0; p < k; p++)
+        {
+            float x = pa[(size_t)i * k + p];
+            for (int j = 0; j < n; j++) pc[(size_t)i * n + j] += x * pb[(size_t)p * n + j];
+        }
+    }
+}
+
+// the largest relative error over random entries, checked against a double dot product
+static double Check(const Tensor& a, const Tensor& b, const Tensor& c, bool trans_b, int samples = 256)
+{
+    int m = a.shape[0];
+    int k = a.shape[1];
+    int n = c.shape[1];
+    std::mt19937 rng(7);
+    double worst = 0;
+    for (int s = 0; s < samples; s++)
+    {
+        int i = rng() % m;
+        int j = rng() % n;
+        double acc = 0;
+        double mag = 0;
+        for (int p = 0; p < k; p++)
+        {
+            double x = (double)a.At(i, p) * (trans_b ? b.At(j, p) : b.At(p, j));
+            acc += x;
+            mag += std::abs(x);
+        }
+        worst = std::max(worst, std::abs(c.At(i, j) - acc) / mag);
+    }
+    return worst;
+}
+
+static void ReportFlops(const std::string& name, double ms, double flops)
+{
+    std::cout << std::left << std::setw(40) << name << std::right << std::setw(10) << std::fixed << std::setprecision(3)
+        << ms << " ms" << std::setw(10) << std::setprecision(1) << flops / ms / 1e6 << " GFLOPS" << std::endl;
+}
+
+static void Run(int size, bool trans_b)
+{
+    Tensor a = Tensor::randu(Shape(size, size), -1.f, 1.f);
+    Tensor b = Tensor::randu(Shape(size, size), -1.f, 1.f);
+    Tensor c = Tensor(Shape(size, size), Depth::D4, Packing::CHW);
+    double flops = 2. * size * size * size;
+    std::string name = "[" + std::to_string(size) + "]^2" + (trans_b ? " x B^T" : "");
+
+    double ms = Measure([&]() { Matmul(a, b, c, 1.f, 0.f, false, trans_b); }, size >= 2048 ? 1000. : 200.);
+    ReportFlops(name + " Matmul", ms, flops);
+    double error = Check(a, b, c, trans_b);
+    std::cout << std::setw(40) << "max relative error" << std::setw(13) << std::scientific << std::setprecision(2) << error
+        << (error < 1e-5 ? "  ok" : "  FAILED") << std::endl;
+
+    if (size <= 1024 && not trans_b)
+    {
+        Tensor ref = Tensor(Shape(size, size), Depth::D4, Packing::CHW);
+        double naive = Measure([&]() { NaiveMatmul(a, b, ref); });
+        ReportFlops(name + " naive", naive, flops);
+        std::cout << std::setw(40) << "speedup" << std::setw(10) << std::fixed << std::setprecision(1) << naive / ms << "x" << std::endl;
+    }
+}
+
+int main()
+{
+    std::cout << "threads: " << ThreadPool::Global()->num_threads() << std::endl;
+    for (int size : { 512, 1024, 2048, 4096 }) Run(size, false);
+    Run(1024, true);
+
+    // many small products are spread by batch
+    Tensor a = Tensor::randu(Shape(256, 32, 32));
+    Tensor b = Tensor::randu(Shape(256, 32, 32));
+    Tensor c = Tensor(Shape(256, 32, 32), Depth::D4, Packing::CHW);
+    double ms = Measure([&]() { Matmul(a, b, c); });
+    ReportFlops("batch 256 x [32]^2 Matmul", ms, 2. * 256 * 32 * 32 * 32);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <core/core.hpp>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+using namespace chaos;
+
+// run func repeatedly for about min_ms and return the best time of one call in milliseconds
+template<class Func>
+double Measure(Func&& func, double min_ms = 200.)
+{
+    using Clock = std::chrono::steady_clock;
+    func(); // warm up
+
+    double best = 1e30;
+    double spent = 0;
+    int runs = 0;
+    while (spent < min_ms || runs < 3)
+    {
+        auto start = Clock::now();
+        func();
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        best = std::min(best, ms);
+        spent += ms;
+        runs++;
+    }
+    return best;
+}
+
+static inline void Report(const std::string& name, double ms, double bytes)
+{
+    std::cout << std::left << std::setw(40) << name << std::right << std::setw(10) << std::fixed << std::setprecision(3)
+        << ms << " ms" << std::setw(10) << std::setprecision(2) << bytes / ms / 1e6 << " GB/s" << std::endl;
+}
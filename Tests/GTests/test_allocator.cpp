@@ -0,0 +1,157 @@
+#include "testutil.hpp"
+#include <core/tensor.hpp>
+#include <core/tracking.hpp>
+
+TEST(Allocator, PoolReuse)
+{
+    PoolAllocator allocator;
+
+    void* ptr1 = allocator.FastMalloc(1000);
+    EXPECT_TRUE(ptr1 != nullptr);
+    EXPECT_EQ((size_t)ptr1 % GetDefaultAlignment(), 0);
+    EXPECT_EQ(allocator.in_use(), 1024);
+    allocator.FastFree(ptr1);
+    EXPECT_GT(allocator.cached(), 0);
+
+    // same size class should be a free-list pop
+    void* ptr2 = allocator.FastMalloc(1010);
+    EXPECT_EQ(ptr1, ptr2);
+    EXPECT_EQ(allocator.cached(), 0);
+    allocator.FastFree(ptr2);
+
+    allocator.Trim();
+    EXPECT_EQ(allocator.cached(), 0);
+    EXPECT_EQ(allocator.in_use(), 0);
+}
+
+TEST(Allocator, PoolMaxCached)
+{
+    UnlockedPoolAllocator allocator(4096);
+
+    void* ptr1 = allocator.FastMalloc(3000);
+    void* ptr2 = allocator.FastMalloc(3000);
+    allocator.FastFree(ptr1);
+    allocator.FastFree(ptr2); // over the cap, released directly
+    EXPECT_LE(allocator.cached(), 4096);
+    EXPECT_EQ(allocator.in_use(), 0);
+}
+
+TEST(Allocator, PoolTensor)
+{
+    PoolAllocator allocator;
+    void* data = nullptr;
+    {
+        Tensor t1 = Tensor(Shape(3, 64, 64), Depth::D4, Packing::CHW, &allocator);
+        data = t1.data;
+    }
+    Tensor t2 = Tensor(Shape(3, 64, 64), Depth::D4, Packing::CHW, &allocator);
+    EXPECT_EQ(data, t2.data);
+}
+
+TEST(Allocator, ArenaScope)
+{
+    ArenaAllocator arena(1 << 16);
+
+    void* ptr1 = arena.FastMalloc(100);
+    {
+        ArenaScope scope(arena);
+        Tensor t1 = Tensor(Shape(16, 16), Depth::D4, Packing::CHW, &arena);
+        Tensor t2 = Tensor(Shape(16, 16), Depth::D4, Packing::CHW, &arena);
+        EXPECT_EQ((size_t)t1.data % GetDefaultAlignment(), 0);
+        EXPECT_NE(t1.data, t2.data);
+    }
+    size_t used = arena.used();
+
+    // larger than a chunk
+    void* ptr2 = arena.FastMalloc(1 << 17);
+    EXPECT_TRUE(ptr2 != nullptr);
+    EXPECT_GT(arena.used(), used);
+
+    arena.Reset();
+    EXPECT_EQ(arena.used(), 0);
+    EXPECT_EQ(arena.FastMalloc(100), ptr1);
+
+    arena.Reset();
+    arena.Trim();
+    EXPECT_EQ(arena.reserved(), 0);
+}
+
+TEST(Allocator, Tracking)
+{
+    TrackingAllocator allocator(nullptr, "test", false);
+    {
+        AllocationTag tag("blob");
+        Tensor t1 = Tensor(Shape(1024), Depth::D4, Packing::CHW, &allocator);
+        Tensor t2 = Tensor(Shape(1024), Depth::D4, Packing::CHW, &allocator);
+        AllocationStats stats = allocator.Snapshot();
+        EXPECT_EQ(stats.live_blocks, 2);
+        EXPECT_GE(stats.live_bytes, 2 * 1024 * sizeof(float));
+        EXPECT_EQ(stats.tags["blob"].allocations, 2);
+    }
+    AllocationStats stats = allocator.Snapshot();
+    EXPECT_EQ(stats.live_bytes, 0);
+    EXPECT_GE(stats.peak_bytes, 2 * 1024 * sizeof(float));
+    EXPECT_EQ(stats.allocations, 2);
+    EXPECT_EQ(stats.frees, 2);
+
+    void* leak = allocator.FastMalloc(10);
+    std::stringstream report;
+    EXPECT_EQ(allocator.ReportLeaks(report), 1);
+    allocator.FastFree(leak);
+}
+
+TEST(Allocator, DefaultTracker)
+{
+    AllocationTracker tracker("default", false);
+    SetDefaultTracker(&tracker);
+    {
+        Tensor t = Tensor(Shape(16, 16), Depth::D4);
+        EXPECT_EQ(tracker.Snapshot().live_blocks, 1);
+    }
+    SetDefaultTracker(nullptr);
+    EXPECT_EQ(tracker.Snapshot().live_bytes, 0);
+}
+
+TEST(Allocator, Alignment)
+{
+    EXPECT_GE(GetDefaultAlignment(), 64);
+    Tensor t1 = Tensor(Shape(3, 7), Depth::D4);
+    EXPECT_EQ((size_t)t1.data % GetDefaultAlignment(), 0);
+
+    size_t alignment = GetDefaultAlignment();
+    SetDefaultAlignment(256);
+    Tensor t2 = Tensor(Shape(3, 7), Depth::D4);
+    EXPECT_EQ((size_t)t2.data % 256, 0);
+    {
+        // the size classes of a pool follow the alignment too
+        PoolAllocator pool;
+        void* block = pool.FastMalloc(100);
+        EXPECT_EQ((size_t)block % 256, 0);
+        EXPECT_EQ(pool.in_use(), 256);
+        pool.FastFree(block);
+    }
+    SetDefaultAlignment(alignment);
+}
+
+TEST(Allocator, PageAllocator)
+{
+    PageAllocator allocator(1 << 20, true, true);
+    {
+        Tensor small = Tensor(Shape(16, 16), Depth::D4, Packing::CHW, &allocator);
+        EXPECT_EQ(allocator.mapped(), 0);
+
+        Tensor large = Tensor(Shape(4, 512, 512), Depth::D4, Packing::CHW, &allocator);
+        EXPECT_GE(allocator.mapped(), 4 * 512 * 512 * sizeof(float));
+#ifndef _WIN32
+        EXPECT_EQ((size_t)large.data % (2 << 20), 0);
+#endif
+        memset(large.data, 1, large.total() * sizeof(float));
+    }
+    EXPECT_EQ(allocator.mapped(), 0);
+}
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -46,6 +46,70 @@ TEST(Array, Dot)
     EXPECT_FLOAT_EQ(d1, 4.f);
 }
 
+TEST(Array, BinaryKernel)
+{
+    // every size up to a few AVX-512 registers, to cover the tails
+    for (size_t n = 0; n < 40; n++)
+    {
+        Array<float> a(n), b(n), c(n);
+        Array<int> x(n), y(n), z(n);
+        Array<Complex> p(n), q(n), r(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            a[i] = 0.5f * i - 7.f;
+            b[i] = 1.f + 0.25f * i;
+            x[i] = static_cast<int>(i * 37) - 500;
+            y[i] = static_cast<int>(i % 7) - 3 == 0 ? 5 : static_cast<int>(i % 7) - 3;
+            p[i] = Complex(0.5f * i, 1.f - i);
+            q[i] = Complex(1.f + i, 0.25f * i - 2.f);
+        }
+
+        BinaryOp<float, Mul<float>>(a, b, c);
+        for (size_t i = 0; i < n; i++) EXPECT_FLOAT_EQ(c[i], a[i] * b[i]);
+        BinaryOp<float, Sub<float>>(2.f, a, c);
+        for (size_t i = 0; i < n; i++) EXPECT_FLOAT_EQ(c[i], 2.f - a[i]);
+        BinaryOp<float, Div<float>>(a, 4.f, c);
+        for (size_t i = 0; i < n; i++) EXPECT_FLOAT_EQ(c[i], a[i] / 4.f);
+
+        BinaryOp<int, Div<int>>(x, y, z);
+        for (size_t i = 0; i < n; i++) EXPECT_EQ(z[i], x[i] / y[i]);
+        BinaryOp<int, Mul<int>>(x, -3, z);
+        for (size_t i = 0; i < n; i++) EXPECT_EQ(z[i], x[i] * -3);
+        BinaryOp<int, Div<int>>(1000, y, z);
+        for (size_t i = 0; i < n; i++) EXPECT_EQ(z[i], 1000 / y[i]);
+
+        BinaryOp<Complex, Mul<Complex>>(p, q, r);
+        for (size_t i = 0; i < n; i++)
+        {
+            Complex expect = p[i] * q[i];
+            EXPECT_NEAR(r[i].re, expect.re, 1e-4f);
+            EXPECT_NEAR(r[i].im, expect.im, 1e-4f);
+        }
+        BinaryOp<Complex, Div<Complex>>(p, q, r);
+        for (size_t i = 0; i < n; i++)
+        {
+            Complex expect = p[i] / q[i];
+            EXPECT_NEAR(r[i].re, expect.re, 1e-5f);
+            EXPECT_NEAR(r[i].im, expect.im, 1e-5f);
+        }
+        BinaryOp<Complex, Sub<Complex>>(Complex(1, 1), p, r);
+        for (size_t i = 0; i < n; i++)
+        {
+            EXPECT_FLOAT_EQ(r[i].re, 1.f - p[i].re);
+            EXPECT_FLOAT_EQ(r[i].im, 1.f - p[i].im);
+        }
+    }
+
+    // in place, the scalar may be an element of the array itself
+    Array<float> v = { 1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17 };
+    v += v;
+    v -= v[0];
+    for (int i = 0; i < 17; i++) EXPECT_FLOAT_EQ(v[i], 2.f * i);
+    Array<double> w = { 1,2,3 };
+    w *= 2.0;
+    EXPECT_DOUBLE_EQ(w[2], 6.0);
+}
+
 TEST(Array, Cross)
 {
     Array<float> a = {1,2,3};
@@ -122,6 +186,44 @@ TEST(Array, ChangeDims)
 }
 
 
+TEST(Array, InlineStorage)
+{
+    auto inside = [](const auto& arr) {
+        const void* ptr = arr.data();
+        return ptr >= (const void*)&arr && ptr < (const void*)(&arr + 1);
+    };
+
+    Shape shape = { 1,2,3,4,5,6,7,8 };
+    EXPECT_TRUE(inside(shape));
+    Steps steps = shape.steps();
+    EXPECT_TRUE(inside(steps));
+    EXPECT_EQ(steps[0], 2 * 3 * 4 * 5 * 6 * 7 * 8);
+
+    Shape large = { 1,2,3,4,5,6,7,8,9 };
+    EXPECT_FALSE(inside(large));
+
+    // moving an inline array copies the elements
+    Shape moved = std::move(shape);
+    EXPECT_TRUE(inside(moved));
+    EXPECT_EQ(moved, Shape({ 1,2,3,4,5,6,7,8 }));
+    EXPECT_EQ(shape.size(), 0);
+
+    // moving a heap array steals the block
+    int* data = large.data();
+    Shape stolen = std::move(large);
+    EXPECT_EQ(stolen.data(), data);
+
+    stolen = moved;
+    EXPECT_TRUE(inside(stolen));
+    EXPECT_EQ(stolen, moved);
+
+    Array<float> arr = { 1,2,3 };
+    arr.Resize(20);
+    EXPECT_FALSE(inside(arr));
+    EXPECT_FLOAT_EQ(arr[2], 3.f);
+    EXPECT_FLOAT_EQ(arr[19], 0.f);
+}
+
 
 int main(int argc, char* argv[])
 {
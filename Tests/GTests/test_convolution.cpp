@@ -0,0 +1,226 @@
+#include "testutil.hpp"
+#include <dnn/layers/convolution.hpp>
+
+using namespace chaos::dnn;
+
+struct Case
+{
+    int batch, in, out, h, w, kh, kw, stride, pad, dilation, groups;
+};
+
+// out[n][o][y][x] = b[o] + sum of w[o][i][ky][kx] * x[n][g * in_group + i][y * s - p + ky * d][x * s - p + kx * d]
+static std::vector<float> Reference(const Case& c, const Tensor& x, const Tensor& w, const Tensor& b, int oh, int ow)
+{
+    int in_group = c.in / c.groups;
+    int out_group = c.out / c.groups;
+    std::vector<float> y(static_cast<size_t>(c.batch) * c.out * oh * ow);
+    for (int n = 0; n < c.batch; n++)
+    {
+        for (int o = 0; o < c.out; o++)
+        {
+            int g = o / out_group;
+            for (int oy = 0; oy < oh; oy++)
+            {
+                for (int ox = 0; ox < ow; ox++)
+                {
+                    double acc = b[o];
+                    for (int i = 0; i < in_group; i++)
+                    {
+                        for (int ky = 0; ky < c.kh; ky++)
+                        {
+                            for (int kx = 0; kx < c.kw; kx++)
+                            {
+                                int iy = oy * c.stride - c.pad + ky * c.dilation;
+                                int ix = ox * c.stride - c.pad + kx * c.dilation;
+                                if (iy < 0 || iy >= c.h || ix < 0 || ix >= c.w) continue;
+                                acc += double(w[((o * in_group + i) * c.kh + ky) * c.kw + kx]) *
+                                    x[((n * c.in + g * in_group + i) * c.h + iy) * c.w + ix];
+                            }
+                        }
+                    }
+                    y[((n * c.out + o) * oh + oy) * ow + ox] = static_cast<float>(acc);
+                }
+            }
+        }
+    }
+    return y;
+}
+
+static void ExpectNear(const Tensor& y, const std::vector<float>& ref, const std::string& what)
+{
+    ASSERT_EQ(y.shape.total(), static_cast<int>(ref.size())) << what;
+    for (size_t i = 0; i < ref.size(); i++)
+    {
+        ASSERT_NEAR(y[i], ref[i], 1e-3f * (1.f + std::abs(ref[i]))) << what << " at " << i;
+    }
+}
+
+static const std::vector<Case> cases = {
+    { 1, 3, 5, 11, 13, 3, 3, 1, 1, 1, 1 },
+    { 2, 16, 12, 17, 15, 3, 3, 1, 1, 1, 1 },
+    { 1, 10, 9, 9, 10, 3, 3, 1, 0, 1, 1 },
+    { 1, 8, 16, 12, 12, 1, 1, 1, 0, 1, 1 },
+    { 1, 6, 8, 15, 14, 5, 5, 2, 2, 1, 2 },
+    { 1, 4, 7, 13, 13, 3, 3, 1, 2, 2, 1 },
+    { 1, 5, 6, 9, 10, 1, 3, 1, 1, 1, 1 },
+    { 2, 12, 12, 10, 11, 3, 3, 2, 1, 1, 12 },
+    { 1, 9, 9, 8, 8, 5, 5, 1, 2, 1, 9 },
+    // more Winograd tiles than one block holds
+    { 1, 16, 16, 96, 96, 3, 3, 1, 1, 1, 1 },
+    // the im2col matrices of several small images in one GEMM, the last GEMM with fewer of them
+    { 5, 4, 6, 10, 20, 3, 3, 1, 1, 1, 1 },
+    { 3, 8, 8, 9, 9, 1, 1, 1, 0, 1, 1 },
+};
+
+TEST(Convolution, Algorithms)
+{
+    const ConvolutionAlgorithm algorithms[] = { ConvolutionAlgorithm::Auto, ConvolutionAlgorithm::Im2colGemm,
+        ConvolutionAlgorithm::Direct, ConvolutionAlgorithm::Winograd23, ConvolutionAlgorithm::Winograd43 };
+    for (size_t k = 0; k < cases.size(); k++)
+    {
+        const Case& c = cases[k];
+        Tensor weight = Tensor::randn(Shape{ c.out, c.in / c.groups, c.kh, c.kw });
+        Tensor bias = Tensor::randn(Shape(c.out));
+        Tensor x = c.batch == 1 ? Tensor::randn(Shape(c.in, c.h, c.w)) : Tensor::randn(Shape{ c.batch, c.in, c.h, c.w });
+        Convolution conv(weight, bias, c.stride, c.pad, c.dilation, c.groups);
+        EXPECT_EQ(conv.in_channels, c.in);
+        EXPECT_EQ(conv.kernel_h, c.kh);
+        EXPECT_EQ(conv.kernel_w, c.kw);
+
+        Shape shape = conv.OutputShape(x.shape);
+        ASSERT_EQ(shape.size(), x.shape.size());
+        ASSERT_EQ(shape[-3], c.out);
+        std::vector<float> ref = Reference(c, x, weight, bias, shape[-2], shape[-1]);
+
+        for (auto algorithm : algorithms)
+        {
+            conv.algorithm = algorithm;
+            Tensor y;
+            conv.Forward(x, y);
+            ASSERT_EQ(y.shape, shape);
+            ASSERT_EQ(y.packing, Packing::CHW);
+            ExpectNear(y, ref, "case " + std::to_string(k) + " algorithm " + std::to_string(static_cast<int>(algorithm)));
+        }
+
+        // packed inputs give packed outputs, with zeros past the last channel
+        for (auto packing : { Packing::C4HW4, Packing::C8HW8 })
+        {
+            int lanes = static_cast<int>(packing);
+            Tensor packed = x.Repack(packing);
+            for (auto algorithm : { ConvolutionAlgorithm::Auto, ConvolutionAlgorithm::Im2colGemm })
+            {
+                conv.algorithm = algorithm;
+                Tensor y;
+                conv.Forward(packed, y);
+                ASSERT_EQ(y.packing, packing);
+                ASSERT_EQ(y.shape, conv.OutputShape(packed.shape, packing));
+                int blocks = y.shape[-3];
+                int plane = y.shape[-1] * y.shape[-2];
+                for (int i = 0; i < c.batch * plane * blocks; i++)
+                {
+                    int block = i / plane % blocks;
+                    for (int l = c.out - block * lanes; l < lanes; l++) ASSERT_EQ(y[i * lanes + l], 0.f);
+                }
+                ExpectNear(y.Repack(Packing::CHW, c.out), ref, "case " + std::to_string(k) + " packed " + std::to_string(lanes));
+            }
+        }
+    }
+}
+
+TEST(Convolution, Select)
+{
+    Convolution conv3x3(Tensor::randn(Shape{ 512, 512, 3, 3 }), Tensor(), 1, 1);
+    EXPECT_EQ(conv3x3.Select(Shape(512, 32, 32)), ConvolutionAlgorithm::Winograd43);
+    EXPECT_EQ(conv3x3.Select(Shape(512, 4, 4)), ConvolutionAlgorithm::Winograd23);
+    EXPECT_EQ(conv3x3.Select(Shape(64, 32, 32), Packing::C8HW8), ConvolutionAlgorithm::Direct);
+    Convolution narrow(Tensor::randn(Shape{ 64, 64, 3, 3 }), Tensor(), 1, 1);
+    EXPECT_EQ(narrow.Select(Shape(64, 32, 32)), ConvolutionAlgorithm::Winograd23);
+    Convolution thin(Tensor::randn(Shape{ 16, 16, 3, 3 }), Tensor(), 1, 1);
+    EXPECT_EQ(thin.Select(Shape(16, 32, 32)), ConvolutionAlgorithm::Im2colGemm);
+
+    Convolution strided(Tensor::randn(Shape{ 16, 16, 3, 3 }), Tensor(), 2, 1);
+    EXPECT_EQ(strided.Select(Shape(16, 32, 32)), ConvolutionAlgorithm::Im2colGemm);
+    Convolution depthwise(Tensor::randn(Shape{ 16, 1, 3, 3 }), Tensor(), 1, 1, 1, 16);
+    EXPECT_EQ(depthwise.Select(Shape(16, 32, 32)), ConvolutionAlgorithm::Direct);
+    Convolution grouped(Tensor::randn(Shape{ 16, 4, 3, 3 }), Tensor(), 1, 1, 1, 4);
+    EXPECT_EQ(grouped.Select(Shape(4, 32, 32), Packing::C4HW4), ConvolutionAlgorithm::Im2colGemm);
+
+    // the output of a workspace-heavy call lands in the caller's Tensor
+    Tensor x = Tensor::randn(Shape(16, 20, 20));
+    Tensor given = Tensor::zeros(thin.OutputShape(x.shape));
+    void* data = given.data;
+    thin.Forward(x, given);
+    EXPECT_EQ(given.data, data);
+
+    // an output that is the input itself gets fresh memory instead of being overwritten while it is read
+    Convolution pointwise(Tensor::randn(Shape{ 16, 16, 1, 1 }));
+    Tensor ref;
+    pointwise.Forward(x, ref);
+    Tensor y = x.Clone();
+    data = y.data;
+    pointwise.Forward(y, y);
+    EXPECT_NE(y.data, data);
+    for (int i = 0; i < ref.shape.total(); i++) ASSERT_FLOAT_EQ(y[i], ref[i]) << i;
+}
+
+TEST(Convolution, Activation)
+{
+    const Case relu_case = { 1, 6, 5, 9, 10, 3, 3, 1, 1, 1, 1 };
+    const Case sigmoid_case = { 1, 6, 6, 9, 10, 3, 3, 2, 1, 1, 6 };
+    for (const Case& c : { relu_case, sigmoid_case })
+    {
+        Tensor weight = Tensor::randn(Shape{ c.out, c.in / c.groups, c.kh, c.kw });
+        Tensor bias = Tensor::randn(Shape(c.out));
+        Tensor x = Tensor::randn(Shape(c.in, c.h, c.w));
+        Convolution conv(weight, bias, c.stride, c.pad, c.dilation, c.groups);
+        conv.activation = c.groups == 1 ? Activation{ ActivationType::ReLU, 0.1f } : Activation{ ActivationType::Sigmoid };
+        Shape shape = conv.OutputShape(x.shape);
+        std::vector<float> ref = Reference(c, x, weight, bias, shape[-2], shape[-1]);
+        for (auto& r : ref) r = conv.activation(r);
+
+        for (auto algorithm : { ConvolutionAlgorithm::Im2colGemm, ConvolutionAlgorithm::Direct, ConvolutionAlgorithm::Winograd23, ConvolutionAlgorithm::Winograd43 })
+        {
+            conv.algorithm = algorithm;
+            Tensor y;
+            conv.Forward(x, y);
+            ExpectNear(y, ref, "algorithm " + std::to_string(static_cast<int>(algorithm)));
+
+            Tensor packed;
+            conv.Forward(x.Repack(Packing::C8HW8), packed);
+            for (int i = 0; i < shape[-2] * shape[-1]; i++)
+            {
+                for (int l = c.out; l < 8; l++) ASSERT_EQ(packed[i * 8 + l], 0.f);
+            }
+            ExpectNear(packed.Repack(Packing::CHW, c.out), ref, "packed " + std::to_string(static_cast<int>(algorithm)));
+        }
+    }
+}
+
+TEST(Convolution, Batch)
+{
+    Convolution conv(Tensor::randn(Shape{ 12, 8, 3, 3 }), Tensor::randn(Shape(12)), 1, 1);
+    std::vector<Tensor> frames;
+    for (int i = 0; i < 6; i++) frames.push_back(Tensor::randn(Shape(8, 7, 9)));
+
+    ThreadPool pool(3);
+    for (auto algorithm : { ConvolutionAlgorithm::Im2colGemm, ConvolutionAlgorithm::Winograd23, ConvolutionAlgorithm::Direct })
+    {
+        conv.algorithm = algorithm;
+        for (bool stacking : { true, false })
+        {
+            Option opt;
+            opt.thread_pool = &pool;
+            opt.batch_stacking = stacking;
+            std::vector<Tensor> outputs;
+            conv.ForwardBatch(frames, outputs, opt);
+            ASSERT_EQ(outputs.size(), frames.size());
+            for (size_t i = 0; i < frames.size(); i++)
+            {
+                Tensor ref;
+                conv.Forward(frames[i], ref);
+                ASSERT_EQ(outputs[i].shape, ref.shape);
+                for (int j = 0; j < ref.shape.total(); j++) ASSERT_NEAR(outputs[i][j], ref[j], 1e-4f * (1.f + std::abs(ref[j])));
+            }
+        }
+    }
+}
\ No newline at end of file
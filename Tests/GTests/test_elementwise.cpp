@@ -0,0 +1,120 @@
+#include "testutil.hpp"
+#include <dnn/layers/elementwise.hpp>
+
+#include <cmath>
+
+using namespace chaos::dnn;
+
+static float Sigm(float x)
+{
+    return 1.f / (1.f + std::exp(-x));
+}
+
+TEST(Elementwise, Layers)
+{
+    Tensor mean = Tensor::randn(Shape(5));
+    Tensor var = Tensor::randn(Shape(5));
+    for (int c = 0; c < 5; c++) var[c] = var[c] * var[c] + 0.1f;
+    Tensor gamma = Tensor::randn(Shape(5));
+    Tensor beta = Tensor::randn(Shape(5));
+    BatchNorm bn(mean, var, gamma, beta, 1e-3f);
+    ReLU leaky(0.1f);
+    Sigmoid sigmoid;
+
+    Tensor x = Tensor::randn(Shape{ 2, 5, 3, 4 });
+    Tensor y;
+    bn.Forward(x, y);
+    ASSERT_EQ(y.shape, x.shape);
+    for (int i = 0; i < 120; i++)
+    {
+        int c = i / 12 % 5;
+        float ref = (x[i] - mean[c]) / std::sqrt(var[c] + 1e-3f) * gamma[c] + beta[c];
+        ASSERT_NEAR(y[i], ref, 1e-4f * (1 + std::abs(ref)));
+    }
+
+    // in place keeps the data, out of place leaves the input alone
+    Tensor z = y.Clone();
+    void* data = z.data;
+    leaky.Forward(z);
+    EXPECT_EQ(z.data, data);
+    Tensor s;
+    sigmoid.Forward(y, s);
+    for (int i = 0; i < 120; i++)
+    {
+        ASSERT_FLOAT_EQ(z[i], y[i] > 0 ? y[i] : 0.1f * y[i]);
+        ASSERT_NEAR(s[i], Sigm(y[i]), 1e-6f);
+    }
+
+    // in place on a strided view writes through its steps and leaves the rest alone
+    Tensor wide = Tensor::randn(Shape{ 5, 3, 8 });
+    Tensor before = wide.Clone();
+    Tensor view(Shape{ 5, 3, 4 }, Depth::D4, Packing::CHW, wide.data, wide.steps);
+    ASSERT_FALSE(view.contiguous());
+    bn.Forward(view);
+    EXPECT_EQ(view.data, wide.data);
+    for (int i = 0; i < 120; i++)
+    {
+        int c = i / 24;
+        float ref = (before[i] - mean[c]) / std::sqrt(var[c] + 1e-3f) * gamma[c] + beta[c];
+        if (i % 8 < 4) ASSERT_NEAR(wide[i], ref, 1e-4f * (1 + std::abs(ref)));
+        else ASSERT_EQ(wide[i], before[i]);
+    }
+
+    // packed, the channels of the scale keep the padding lanes 0
+    Tensor packed = x.Repack(Packing::C8HW8);
+    Elementwise chain;
+    chain.Append({ bn.scale, bn.shift, { ActivationType::Sigmoid, 0.f } });
+    Tensor p;
+    chain.Forward(packed, p);
+    ASSERT_EQ(p.packing, Packing::C8HW8);
+    for (int i = 0; i < 2 * 12; i++)
+    {
+        for (int l = 5; l < 8; l++) ASSERT_EQ(p[i * 8 + l], 0.f);
+    }
+    Tensor planar = p.Repack(Packing::CHW, 5);
+    for (int i = 0; i < 120; i++) ASSERT_NEAR(planar[i], Sigm(y[i]), 1e-5f);
+}
+
+TEST(Elementwise, Chain)
+{
+    Tensor a = Tensor::randn(Shape(6));
+    Tensor b = Tensor::randn(Shape(6));
+    Tensor c = Tensor::randn(Shape(6));
+
+    // affine steps fold into the step before them until an activation
+    Elementwise chain;
+    chain.Append({ a, b, Activation() });
+    chain.Append({ c, Tensor(), Activation() });
+    chain.Append({ Tensor(), b, { ActivationType::ReLU, 0.f } });
+    EXPECT_EQ(chain.num_steps(), 1u);
+    chain.Append({ a, Tensor(), { ActivationType::Sigmoid, 0.f } });
+    EXPECT_EQ(chain.num_steps(), 2u);
+
+    Tensor x = Tensor::randn(Shape(6, 7, 9));
+    Tensor y;
+    chain.Forward(x, y);
+    for (int i = 0; i < 6 * 63; i++)
+    {
+        int k = i / 63;
+        float v = std::max(0.f, (x[i] * a[k] + b[k]) * c[k] + b[k]);
+        ASSERT_NEAR(y[i], Sigm(v * a[k]), 1e-5f);
+    }
+
+    // several inputs are combined first
+    Tensor u = Tensor::randn(Shape(6, 7, 9));
+    Tensor v = Tensor::randn(Shape(6, 7, 9));
+    for (auto op : { ElementwiseOp::Sum, ElementwiseOp::Product, ElementwiseOp::Max })
+    {
+        Elementwise combine(op);
+        combine.Append({ Tensor(), Tensor(), { ActivationType::ReLU, 0.f } });
+        std::vector<Tensor> tops;
+        combine.Forward(std::vector<Tensor>{ x, u, v }, tops);
+        ASSERT_EQ(tops.size(), 1u);
+        ASSERT_EQ(tops[0].shape, x.shape);
+        for (int i = 0; i < 6 * 63; i++)
+        {
+            float r = op == ElementwiseOp::Sum ? x[i] + u[i] + v[i] : op == ElementwiseOp::Product ? x[i] * u[i] * v[i] : std::max({ x[i], u[i], v[i] });
+            ASSERT_NEAR(tops[0][i], std::max(r, 0.f), 1e-5f);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "testutil.hpp"
+#include <core/expr.hpp>
+
+TEST(Expr, Broadcast)
+{
+    Tensor a = Tensor::randn(Shape(2, 3, 4));
+    Tensor b = Tensor::randn(Shape(3, 1));
+    Tensor c = Tensor::randn(Shape(4));
+
+    Tensor out = Eval(a + b * c - 1.f);
+    EXPECT_EQ(out.shape, Shape(2, 3, 4));
+    EXPECT_EQ(out.depth, Depth::D4);
+    for (int n = 0; n < 2; n++)
+    {
+        for (int h = 0; h < 3; h++)
+        {
+            for (int w = 0; w < 4; w++)
+            {
+                EXPECT_FLOAT_EQ(out.At(n, h, w), a.At(n, h, w) + b.At(h, 0) * c.At(w) - 1.f);
+            }
+        }
+    }
+
+    // scalars on either side, unary minus and Apply
+    Tensor neg = Eval(-(2.f / (a * a + 1.f)));
+    Tensor abs = Eval(Apply(a, [](float x) { return x < 0 ? -x : x; }));
+    for (int i = 0; i < 24; i++)
+    {
+        float x = ((float*)a.data)[i];
+        EXPECT_FLOAT_EQ(((float*)neg.data)[i], -(2.f / (x * x + 1.f)));
+        EXPECT_FLOAT_EQ(((float*)abs.data)[i], std::abs(x));
+    }
+}
+
+TEST(Expr, Steps)
+{
+    // a transposed operand and a strided destination
+    Tensor a = Tensor::randn(Shape(5, 7));
+    Tensor at = Tensor(Shape(7, 5), Depth::D4, Packing::CHW, a.data, Steps({ 1,7 }));
+    Tensor b = Tensor::randn(Shape(7, 5));
+
+    Tensor wide = Tensor::zeros(Shape(7, 10));
+    Tensor dst = Tensor(Shape(7, 5), Depth::D4, Packing::CHW, wide.data, Steps({ 10,2 }));
+    Assign(dst, at * b);
+    for (int h = 0; h < 7; h++)
+    {
+        for (int w = 0; w < 5; w++)
+        {
+            EXPECT_FLOAT_EQ(wide.At(h, w * 2), a.At(w, h) * b.At(h, w));
+            EXPECT_FLOAT_EQ(wide.At(h, w * 2 + 1), 0.f);
+        }
+    }
+
+    // long rows are split over the threads, dst may be an operand
+    Tensor big = Tensor::randn(Shape(3, 100000));
+    Tensor ref = big.Clone();
+    Tensor bias = Tensor::randn(Shape(3, 1));
+    Assign(big, big * 2.f + bias);
+    for (int h = 0; h < 3; h++)
+    {
+        for (int w = 0; w < 100000; w += 997)
+        {
+            EXPECT_FLOAT_EQ(big.At(h, w), ref.At(h, w) * 2.f + bias.At(h, 0));
+        }
+    }
+}
+
+TEST(Expr, Types)
+{
+    Array<int> x = { 1,2,3,4,5,6,7,8,9 };
+    Array<int> y = { 9,8,7,6,5,4,3,2,1 };
+    Array<int> z(9);
+    Assign(z, Lazy(x) * Lazy(y) - 3);
+    for (int i = 0; i < 9; i++) EXPECT_EQ(z[i], x[i] * y[i] - 3);
+
+    Array<Complex> p = { Complex(1, 2), Complex(3, -1) };
+    Array<Complex> q = { Complex(0, 1), Complex(2, 2) };
+    Tensor r = Eval(Lazy(p) * Lazy(q) + Complex(1, 0));
+    EXPECT_EQ(r.packing, Packing::C2HW2);
+    for (int i = 0; i < 2; i++)
+    {
+        Complex expect = p[i] * q[i] + Complex(1, 0);
+        EXPECT_FLOAT_EQ(r.At<Complex>(i).re, expect.re);
+        EXPECT_FLOAT_EQ(r.At<Complex>(i).im, expect.im);
+    }
+
+    Tensor bytes = Tensor(Shape(4), Depth::D8, Packing::CHW);
+    Assign(bytes, Lazy<double>(bytes) * 0.0 + 0.5);
+    for (int i = 0; i < 4; i++) EXPECT_DOUBLE_EQ(bytes.At<double>(i), 0.5);
+}
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
\ No newline at end of file
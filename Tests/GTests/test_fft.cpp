@@ -0,0 +1,144 @@
+#include "testutil.hpp"
+#include <core/fft.hpp>
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+using Spectrum = std::vector<std::complex<double>>;
+
+// naive DFT of the n values at data with the given stride
+static Spectrum DFT(const Complex* data, int64_t n, int64_t stride = 1, bool inverse = false)
+{
+    Spectrum out(n);
+    for (int64_t k = 0; k < n; k++)
+    {
+        std::complex<double> acc = 0;
+        for (int64_t j = 0; j < n; j++)
+        {
+            double angle = (inverse ? 2 : -2) * M_PI * (double)(j * k % n) / n;
+            const Complex& x = data[j * stride];
+            acc += std::complex<double>(x.re, x.im) * std::polar(1., angle);
+        }
+        out[k] = inverse ? acc / (double)n : acc;
+    }
+    return out;
+}
+
+// max error relative to the largest value
+static double Error(const Spectrum& expect, const Complex* data, int64_t stride = 1)
+{
+    double err = 0, scale = 1e-12;
+    for (size_t k = 0; k < expect.size(); k++)
+    {
+        const Complex& x = data[k * stride];
+        err = std::max(err, std::abs(expect[k] - std::complex<double>(x.re, x.im)));
+        scale = std::max(scale, std::abs(expect[k]));
+    }
+    return err / scale;
+}
+
+static Tensor RandComplex(const Shape& shape)
+{
+    Tensor parts = Tensor::randn(Shape(shape.total() * 2));
+    return Tensor(shape, Depth::D4, Packing::C2HW2, parts.data).Clone();
+}
+
+TEST(FFT, Sizes)
+{
+    // radix 2, 3 and 4 butterflies, generic radices, their mixes and Bluestein for 97 and 2 * 17
+    for (int n : { 1, 2, 3, 4, 5, 7, 8, 12, 13, 16, 60, 64, 97, 34, 243, 1024, 1001 })
+    {
+        Tensor x = RandComplex(Shape(3, n));
+        Tensor y = FFT(x);
+        Tensor z = IFFT(y);
+        ASSERT_EQ(y.shape, x.shape);
+        ASSERT_EQ(y.packing, Packing::C2HW2);
+        for (int r = 0; r < 3; r++)
+        {
+            const Complex* row = (const Complex*)x.data + r * n;
+            EXPECT_LT(Error(DFT(row, n), (const Complex*)y.data + r * n), 2e-5) << "n = " << n;
+            EXPECT_LT(Error(DFT((const Complex*)y.data + r * n, n, 1, true), (const Complex*)z.data + r * n), 2e-5) << "n = " << n;
+            Spectrum same;
+            for (int j = 0; j < n; j++) same.emplace_back(row[j].re, row[j].im);
+            EXPECT_LT(Error(same, (const Complex*)z.data + r * n), 2e-5) << "n = " << n;
+        }
+    }
+}
+
+TEST(FFT, Real)
+{
+    for (int n : { 1, 2, 6, 9, 16, 30, 97, 256, 1000 })
+    {
+        Tensor x = Tensor::randn(Shape(4, n));
+        Tensor y = FFT(x);
+        ASSERT_EQ(y.packing, Packing::C2HW2);
+        for (int r = 0; r < 4; r++)
+        {
+            std::vector<Complex> row(n);
+            for (int j = 0; j < n; j++) row[j] = Complex(((const float*)x.data)[r * n + j]);
+            EXPECT_LT(Error(DFT(row.data(), n), (const Complex*)y.data + r * n), 2e-5) << "n = " << n;
+        }
+
+        Tensor back = IFFT(y, true);
+        ASSERT_EQ(back.packing, Packing::CHW);
+        for (int i = 0; i < 4 * n; i++) ASSERT_NEAR(back[i], x[i], 1e-4) << "n = " << n;
+    }
+
+    // a strided real Tensor is transformed as its values
+    Tensor wide = Tensor::randn(Shape(5, 40));
+    Tensor cut = Tensor(Shape(5, 32), Depth::D4, Packing::CHW, wide.data, Steps(40, 1));
+    Tensor a = FFT(cut);
+    Tensor b = FFT(cut.Clone());
+    for (int i = 0; i < 5 * 32; i++)
+    {
+        EXPECT_EQ(((const Complex*)a.data)[i].re, ((const Complex*)b.data)[i].re);
+        EXPECT_EQ(((const Complex*)a.data)[i].im, ((const Complex*)b.data)[i].im);
+    }
+}
+
+TEST(FFT, FFT2)
+{
+    for (auto [h, w] : { std::pair{ 8, 8 }, { 6, 10 }, { 16, 17 }, { 5, 3 }, { 1, 12 }, { 33, 64 } })
+    {
+        Tensor x = RandComplex(Shape(2, h, w));
+        Tensor real = Tensor::randn(Shape(2, h, w));
+        for (const Tensor& input : { x, real })
+        {
+            Tensor y = FFT2(input);
+            bool is_complex = input.packing == Packing::C2HW2;
+            for (int b = 0; b < 2; b++)
+            {
+                // the rows and then the columns by the naive DFT
+                std::vector<Complex> rows(h * w);
+                for (int r = 0; r < h; r++)
+                {
+                    std::vector<Complex> row(w);
+                    for (int c = 0; c < w; c++)
+                    {
+                        int64_t i = (int64_t)b * h * w + r * w + c;
+                        row[c] = is_complex ? ((const Complex*)input.data)[i] : Complex(((const float*)input.data)[i]);
+                    }
+                    Spectrum s = DFT(row.data(), w);
+                    for (int c = 0; c < w; c++) rows[r * w + c] = Complex((float)s[c].real(), (float)s[c].imag());
+                }
+                for (int c = 0; c < w; c++)
+                {
+                    const Complex* column = (const Complex*)y.data + (int64_t)b * h * w + c;
+                    EXPECT_LT(Error(DFT(rows.data() + c, h, w), column, w), 3e-5) << h << "x" << w;
+                }
+            }
+
+            Tensor z = IFFT2(y, not is_complex);
+            for (int i = 0; i < 2 * h * w; i++)
+            {
+                if (is_complex)
+                {
+                    ASSERT_NEAR(((const Complex*)z.data)[i].re, ((const Complex*)input.data)[i].re, 1e-4);
+                    ASSERT_NEAR(((const Complex*)z.data)[i].im, ((const Complex*)input.data)[i].im, 1e-4);
+                }
+                else ASSERT_NEAR(z[i], input[i], 1e-4);
+            }
+        }
+    }
+}
\ No newline at end of file
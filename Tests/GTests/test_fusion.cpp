@@ -0,0 +1,146 @@
+#include "testutil.hpp"
+#include <dnn/net.hpp>
+#include <dnn/fusion.hpp>
+#include <dnn/layers/convolution.hpp>
+#include <dnn/layers/elementwise.hpp>
+
+using namespace chaos::dnn;
+
+static std::shared_ptr<BatchNorm> RandomBatchNorm(int channels)
+{
+    Tensor var = Tensor::randn(Shape(channels));
+    for (int c = 0; c < channels; c++) var[c] = var[c] * var[c] + 0.5f;
+    return std::make_shared<BatchNorm>(Tensor::randn(Shape(channels)), var, Tensor::randn(Shape(channels)), Tensor::randn(Shape(channels)));
+}
+
+static Tensor Forward(const std::vector<std::shared_ptr<Layer>>& layers, const Tensor& x)
+{
+    Tensor blob = x;
+    for (const auto& layer : layers)
+    {
+        Tensor top;
+        layer->Forward(blob, top);
+        blob = top;
+    }
+    return blob;
+}
+
+static void ExpectNear(const Tensor& y, const Tensor& ref)
+{
+    ASSERT_EQ(y.shape, ref.shape);
+    for (int i = 0; i < ref.shape.total(); i++) ASSERT_NEAR(y[i], ref[i], 1e-4f * (1.f + std::abs(ref[i]))) << i;
+}
+
+TEST(Fusion, Sequence)
+{
+    auto conv = std::make_shared<Convolution>(Tensor::randn(Shape{ 8, 6, 3, 3 }), Tensor::randn(Shape(8)), 1, 1);
+    std::vector<std::shared_ptr<Layer>> layers = { conv, RandomBatchNorm(8), std::make_shared<ReLU>(0.2f),
+        std::make_shared<Scale>(Tensor::randn(Shape(8)), Tensor::randn(Shape(8))), RandomBatchNorm(8), std::make_shared<Sigmoid>() };
+    std::vector<std::shared_ptr<Layer>> fused = FuseSequence(layers);
+
+    // the BatchNorm and the ReLU go into the Convolution, the rest becomes one Elementwise step
+    ASSERT_EQ(fused.size(), 2u);
+    auto folded = std::dynamic_pointer_cast<Convolution>(fused[0]);
+    ASSERT_TRUE(folded);
+    EXPECT_EQ(folded->activation.type, ActivationType::ReLU);
+    EXPECT_NE(folded->weight.data, conv->weight.data);
+    auto chain = std::dynamic_pointer_cast<Elementwise>(fused[1]);
+    ASSERT_TRUE(chain);
+    EXPECT_EQ(chain->num_steps(), 1u);
+
+    Tensor x = Tensor::randn(Shape(6, 13, 11));
+    Tensor ref = Forward(layers, x);
+    for (auto algorithm : { ConvolutionAlgorithm::Im2colGemm, ConvolutionAlgorithm::Direct, ConvolutionAlgorithm::Winograd23 })
+    {
+        folded->algorithm = algorithm;
+        ExpectNear(Forward(fused, x), ref);
+    }
+    Tensor packed = Forward(fused, x.Repack(Packing::C8HW8));
+    ExpectNear(packed.Repack(Packing::CHW, 8), ref);
+
+    // nothing folds past the activation of a Convolution
+    EXPECT_FALSE(FuseLayers(fused[0], fused[1]));
+    EXPECT_FALSE(FuseLayers(fused[1], fused[0]));
+}
+
+TEST(Fusion, Net)
+{
+    // in -> conv -> bn -> relu -> a, a -> conv -> bn -> b, a -> sigmoid -> c, b + c -> relu -> out
+    std::vector<std::shared_ptr<Layer>> layers = { std::make_shared<Convolution>(Tensor::randn(Shape{ 8, 4, 3, 3 }), Tensor::randn(Shape(8)), 1, 1),
+        RandomBatchNorm(8), std::make_shared<ReLU>(), std::make_shared<Convolution>(Tensor::randn(Shape{ 8, 8, 1, 1 })), RandomBatchNorm(8),
+        std::make_shared<Sigmoid>(), std::make_shared<Elementwise>(ElementwiseOp::Sum), std::make_shared<ReLU>() };
+    auto build = [&](Net& net) {
+        net.AddLayer(layers[0], { "in" }, { "conv" });
+        net.AddLayer(layers[1], { "conv" }, { "bn" });
+        net.AddLayer(layers[2], { "bn" }, { "a" });
+        net.AddLayer(layers[3], { "a" }, { "conv2" });
+        net.AddLayer(layers[4], { "conv2" }, { "b" });
+        net.AddLayer(layers[5], { "a" }, { "c" });
+        net.AddLayer(layers[6], { "b", "c" }, { "sum" });
+        net.AddLayer(layers[7], { "sum" }, { "out" });
+    };
+
+    Tensor x = Tensor::randn(Shape(4, 12, 10));
+    Net plain;
+    build(plain);
+    Tensor ref, ref_bn;
+    {
+        Extractor ex = plain.CreateExtractor();
+        ex.Input("in", x);
+        ex.Extract("out", ref);
+        ex.Extract("bn", ref_bn);
+    }
+
+    Net fused;
+    build(fused);
+    EXPECT_EQ(fused.Fuse(), 4);
+    EXPECT_EQ(fused.num_layers(), 4u);
+    Tensor out;
+    Extractor ex = fused.CreateExtractor();
+    ex.Input("in", x);
+    ex.Extract("out", out);
+    ExpectNear(out, ref);
+
+    // a kept blob stays computed
+    Net kept;
+    build(kept);
+    EXPECT_EQ(kept.Fuse({ "bn" }), 3);
+    Extractor kex = kept.CreateExtractor();
+    kex.Input("in", x);
+    std::vector<Tensor> tops;
+    kex.Extract({ "out", "bn" }, tops);
+    ExpectNear(tops[0], ref);
+    ExpectNear(tops[1], ref_bn);
+}
+
+TEST(Fusion, Combine)
+{
+    // an Elementwise combining several inputs is not a chain on the output of the layer before it
+    auto conv = std::make_shared<Convolution>(Tensor::randn(Shape{ 8, 4, 3, 3 }), Tensor::randn(Shape(8)), 1, 1);
+    auto relu = std::make_shared<ReLU>();
+    for (auto op : { ElementwiseOp::Product, ElementwiseOp::Max })
+    {
+        auto combine = std::make_shared<Elementwise>(op);
+        EXPECT_FALSE(FuseLayers(conv, combine));
+        EXPECT_FALSE(FuseLayers(relu, combine));
+    }
+
+    // in -> conv -> a, a + y -> sum, the Sum reads two blobs and stays
+    Net net;
+    net.AddLayer(conv, { "in" }, { "a" });
+    net.AddLayer(std::make_shared<Elementwise>(ElementwiseOp::Sum), { "a", "y" }, { "sum" });
+    EXPECT_EQ(net.Fuse(), 0);
+    EXPECT_EQ(net.num_layers(), 2u);
+
+    Tensor x = Tensor::randn(Shape(4, 12, 10));
+    Tensor y = Tensor::randn(Shape(8, 12, 10));
+    Extractor ex = net.CreateExtractor();
+    ex.Input("in", x);
+    ex.Input("y", y);
+    Tensor sum;
+    ex.Extract("sum", sum);
+    Tensor ref;
+    conv->Forward(x, ref);
+    for (int i = 0; i < ref.shape.total(); i++) ref[i] += y[i];
+    ExpectNear(sum, ref);
+}
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "testutil.hpp"
+#include <core/gemm.hpp>
+
+#include <cmath>
+#include <limits>
+
+// C = alpha * op(A) * op(B) + beta * C with double accumulation
+static void NaiveGemm(bool ta, bool tb, int m, int n, int k, float alpha, const float* a, int lda, const float* b, int ldb, float beta, float* c, int ldc)
+{
+    for (int i = 0; i < m; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            double acc = 0;
+            for (int p = 0; p < k; p++)
+            {
+                acc += (double)(ta ? a[p * lda + i] : a[i * lda + p]) * (tb ? b[j * ldb + p] : b[p * ldb + j]);
+            }
+            c[i * ldc + j] = (float)(alpha * acc + (beta == 0.f ? 0. : (double)beta * c[i * ldc + j]));
+        }
+    }
+}
+
+static void ExpectGemm(bool ta, bool tb, int m, int n, int k, float alpha, float beta)
+{
+    // padded leading dims
+    int lda = (ta ? m : k) + 3;
+    int ldb = (tb ? k : n) + 5;
+    int ldc = n + 7;
+    Tensor a = Tensor::randn(Shape((ta ? k : m), lda));
+    Tensor b = Tensor::randn(Shape((tb ? n : k), ldb));
+    Tensor c = Tensor::randn(Shape(m, ldc));
+    Tensor expect = c.Clone();
+
+    Gemm(ta, tb, m, n, k, alpha, (float*)a.data, lda, (float*)b.data, ldb, beta, (float*)c.data, ldc);
+    NaiveGemm(ta, tb, m, n, k, alpha, (float*)a.data, lda, (float*)b.data, ldb, beta, (float*)expect.data, ldc);
+    for (int i = 0; i < m; i++)
+    {
+        for (int j = 0; j < ldc; j++)
+        {
+            // the padding of C is left alone
+            ASSERT_NEAR(c.At(i, j), expect.At(i, j), 1e-3f * std::sqrt((float)k)) << "ta=" << ta << " tb=" << tb << " at " << i << "," << j;
+        }
+    }
+}
+
+TEST(Gemm, Sizes)
+{
+    for (bool ta : { false, true })
+    {
+        for (bool tb : { false, true })
+        {
+            ExpectGemm(ta, tb, 1, 1, 1, 1.f, 0.f);
+            ExpectGemm(ta, tb, 13, 35, 7, 1.f, 0.f);
+            ExpectGemm(ta, tb, 50, 33, 64, 0.5f, 2.f);
+            ExpectGemm(ta, tb, 97, 70, 130, -1.f, 1.f);
+        }
+    }
+    // several blocks of k and of n
+    ExpectGemm(false, false, 37, 2100, 300, 1.f, 0.f);
+    ExpectGemm(true, true, 29, 70, 600, 2.f, -1.f);
+
+    // k = 0 only scales C, beta = 0 overwrites NaN
+    Tensor c = Tensor(Shape(4, 4), Depth::D4, Packing::CHW);
+    for (int i = 0; i < 16; i++) ((float*)c.data)[i] = std::numeric_limits<float>::quiet_NaN();
+    Tensor a = Tensor::randn(Shape(4, 4));
+    Gemm(false, false, 4, 4, 4, 1.f, (float*)a.data, 4, (float*)a.data, 4, 0.f, (float*)c.data, 4);
+    for (int i = 0; i < 16; i++) EXPECT_FALSE(std::isnan(((float*)c.data)[i]));
+    Gemm(false, false, 4, 4, 0, 1.f, nullptr, 4, nullptr, 4, 0.f, (float*)c.data, 4);
+    for (int i = 0; i < 16; i++) EXPECT_EQ(((float*)c.data)[i], 0.f);
+
+    // the packed panels follow the default alignment, which may be less than a vector
+    size_t alignment = GetDefaultAlignment();
+    SetDefaultAlignment(16);
+    ExpectGemm(false, false, 96, 96, 96, 1.f, 0.f);
+    ExpectGemm(true, false, 61, 45, 83, 1.f, 1.f);
+    SetDefaultAlignment(alignment);
+}
+
+TEST(Gemm, Matmul)
+{
+    Tensor eye = Tensor::eye(5, 5);
+    Tensor x = Tensor::randn(Shape(5, 5));
+    Tensor same = Matmul(x, eye);
+    for (int i = 0; i < 25; i++) EXPECT_FLOAT_EQ(((float*)same.data)[i], ((float*)x.data)[i]);
+
+    // batches broadcast: [2,1,6,4] x [3,4,5] -> [2,3,6,5]
+    Tensor a = Tensor::randn(Shape({ 2,1,6,4 }));
+    Tensor b = Tensor::randn(Shape(3, 4, 5));
+    Tensor c = Matmul(a, b);
+    EXPECT_EQ(c.shape, Shape({ 2,3,6,5 }));
+    for (int n = 0; n < 2; n++)
+    {
+        for (int s = 0; s < 3; s++)
+        {
+            for (int i = 0; i < 6; i++)
+            {
+                for (int j = 0; j < 5; j++)
+                {
+                    float acc = 0;
+                    for (int p = 0; p < 4; p++) acc += a.At(n, 0, i, p) * b.At(s, p, j);
+                    EXPECT_NEAR(c.At(n, s, i, j), acc, 1e-5);
+                }
+            }
+        }
+    }
+
+    // transposes, alpha and beta into an existing Tensor
+    Tensor at = Tensor::randn(Shape(4, 6));
+    Tensor bt = Tensor::randn(Shape(5, 4));
+    Tensor out = Tensor::randn(Shape(6, 5));
+    Tensor before = out.Clone();
+    Matmul(at, bt, out, 2.f, 0.5f, true, true);
+    for (int i = 0; i < 6; i++)
+    {
+        for (int j = 0; j < 5; j++)
+        {
+            float acc = 0;
+            for (int p = 0; p < 4; p++) acc += at.At(p, i) * bt.At(j, p);
+            EXPECT_NEAR(out.At(i, j), 2.f * acc + 0.5f * before.At(i, j), 1e-5);
+        }
+    }
+
+    // strided rows are used as they are, a strided last dim is cloned
+    Tensor wide = Tensor::randn(Shape(6, 9));
+    Tensor rows = Tensor(Shape(6, 4), Depth::D4, Packing::CHW, wide.data, wide.steps);
+    Tensor r = Matmul(rows, b.channel(1));
+    Tensor rc = Matmul(rows.Clone(), b.channel(1).Clone());
+    for (int i = 0; i < 30; i++) EXPECT_FLOAT_EQ(((float*)r.data)[i], ((float*)rc.data)[i]);
+
+    // columns 0, 3 and 6 of wide
+    Tensor every3 = Tensor(Shape(6, 3), Depth::D4, Packing::CHW, wide.data, Steps(9, 3));
+    Tensor g = Matmul(every3, every3, true, false);
+    EXPECT_EQ(g.shape, Shape(3, 3));
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            float acc = 0;
+            for (int p = 0; p < 6; p++) acc += wide.At(p, i * 3) * wide.At(p, j * 3);
+            EXPECT_NEAR(g.At(i, j), acc, 1e-4);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "testutil.hpp"
+#include <core/io.hpp>
+
+TEST(IO, WriteRead)
+{
+    const char* path = "test_io.tensors";
+
+    Tensor t1 = Tensor::randn(Shape(3, 4, 5));
+    Tensor t2 = t1.channel(1); // strided in the outer dim
+    Tensor t3 = t1.col(2); // strided in the inner dim
+    Array<uint16_t> arr = { 1,2,3 };
+    Tensor t4 = arr;
+    {
+        TensorWriter writer(path);
+        ASSERT_TRUE(writer.opened());
+        EXPECT_TRUE(writer.Write(t1));
+        EXPECT_TRUE(writer.Write(t2));
+    }
+    {
+        TensorWriter writer(path, true);
+        EXPECT_TRUE(writer.Write(t3));
+        EXPECT_TRUE(writer.Write(t4));
+    }
+
+    TensorReader reader(path);
+    ASSERT_TRUE(reader.opened());
+
+    Tensor r1;
+    ASSERT_TRUE(reader.Read(r1));
+    EXPECT_EQ(r1.shape, t1.shape);
+    EXPECT_EQ(r1.depth, Depth::D4);
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 4; j++)
+            for (int k = 0; k < 5; k++)
+                EXPECT_FLOAT_EQ(r1.At(i, j, k), t1.At(i, j, k));
+
+    Tensor r2;
+    ASSERT_TRUE(reader.Map(r2));
+    EXPECT_EQ(r2.shape, Shape(4, 5));
+    EXPECT_EQ((size_t)r2.data % 64, (size_t)0);
+    for (int j = 0; j < 4; j++)
+        for (int k = 0; k < 5; k++)
+            EXPECT_FLOAT_EQ(r2.At(j, k), t1.At(1, j, k));
+
+    Tensor r3;
+    ASSERT_TRUE(reader.Read(r3));
+    EXPECT_EQ(r3.shape, Shape(4));
+    for (int j = 0; j < 4; j++)
+        EXPECT_FLOAT_EQ(r3.At(j), t1.At(0, j, 2));
+
+    EXPECT_TRUE(reader.Skip());
+    Tensor r5;
+    EXPECT_FALSE(reader.Read(r5));
+
+    reader.Close();
+    r2.Release();
+    remove(path);
+}
+
+TEST(IO, Corrupted)
+{
+    const char* path = "test_io_corrupted.tensors";
+    {
+        TensorWriter writer(path);
+        ASSERT_TRUE(writer.Write(Tensor::randn(Shape(3, 4))));
+    }
+    FILE* fp = fopen(path, "rb");
+    ASSERT_TRUE(fp != nullptr);
+    std::vector<uchar> bytes(64 + 64 + 64);
+    ASSERT_EQ(fread(bytes.data(), 1, bytes.size(), fp), bytes.size());
+    fclose(fp);
+
+    // each field of the record header past the container header, set to a value no writer gives
+    struct Patch
+    {
+        size_t offset;
+        uint64_t value;
+        size_t size;
+    };
+    const Patch patches[] = {
+        { 64 + 8, 3, 4 }, // depth
+        { 64 + 12, 5, 4 }, // packing
+        { 64 + 16, 16, 8 }, // header, shorter than its shape and steps
+        { 64 + 24, 1 << 20, 8 }, // payload, larger than the shape
+        { 64 + 24, 4, 8 }, // payload, smaller than the shape
+    };
+    for (const auto& patch : patches)
+    {
+        std::vector<uchar> corrupted = bytes;
+        memcpy(corrupted.data() + patch.offset, &patch.value, patch.size);
+        fp = fopen(path, "wb");
+        ASSERT_TRUE(fp != nullptr);
+        fwrite(corrupted.data(), 1, corrupted.size(), fp);
+        fclose(fp);
+
+        TensorReader reader(path);
+        ASSERT_TRUE(reader.opened());
+        Tensor t;
+        EXPECT_FALSE(reader.Read(t)) << "at " << patch.offset;
+    }
+    remove(path);
+}
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
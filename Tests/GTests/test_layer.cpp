@@ -0,0 +1,261 @@
+#include "testutil.hpp"
+#include <dnn/layer.hpp>
+
+#include <mutex>
+#include <set>
+
+using namespace chaos::dnn;
+
+// x + 1, in place only
+class AddOne : public Layer
+{
+public:
+    AddOne() : Layer("AddOne") { support_inplace = true; }
+
+    void Forward(Tensor& blob, const Option&) const override
+    {
+        for (int i = 0; i < blob.shape.total(); i++) blob[i] += 1.f;
+    }
+    using Layer::Forward;
+};
+
+// -x, out of place only
+class Negate : public Layer
+{
+public:
+    Negate() : Layer("Negate") { support_outplace = true; }
+
+    void Forward(const Tensor& bottom, Tensor& top, const Option& opt) const override
+    {
+        CreateOutput(top, bottom.shape, bottom.depth, bottom.packing, opt);
+        for (int i = 0; i < bottom.shape.total(); i++) top[i] = -bottom[i];
+    }
+    using Layer::Forward;
+};
+
+// AddOne on any shape, so a stack of blobs runs as one
+class AddOneBatch : public AddOne
+{
+public:
+    bool StackBatch(const Tensor&, int) const override { return true; }
+};
+
+// remembers the workspace allocators it ran with
+class Workspaces : public Negate
+{
+public:
+    void Forward(const Tensor& bottom, Tensor& top, const Option& opt) const override
+    {
+        Negate::Forward(bottom, top, opt);
+        std::lock_guard<std::mutex> lock(mutex);
+        seen.insert(opt.workspace_allocator);
+    }
+    using Layer::Forward;
+
+    mutable std::mutex mutex;
+    mutable std::set<Allocator*> seen;
+};
+
+TEST(Layer, InPlace)
+{
+    AddOne layer;
+    CountingAllocator counter;
+    Option opt;
+    opt.blob_allocator = &counter;
+    Tensor x = Tensor::randn(Shape(5, 9));
+    Tensor ref = x.Clone();
+
+    // out of place: a copy, into the caller's output when it fits
+    Tensor y;
+    layer.Forward(x, y, opt);
+    EXPECT_EQ(counter.count, 1);
+    Tensor given = Tensor::zeros(Shape(5, 9));
+    void* data = given.data;
+    layer.Forward(x, given, opt);
+    EXPECT_EQ(counter.count, 1);
+    EXPECT_EQ(given.data, data);
+    for (int i = 0; i < 45; i++)
+    {
+        EXPECT_EQ(x[i], ref[i]);
+        EXPECT_EQ(y[i], ref[i] + 1);
+        EXPECT_EQ(given[i], ref[i] + 1);
+    }
+
+    // a blob given up is taken over when it is not shared
+    Tensor z;
+    data = y.data;
+    layer.Forward(std::move(y), z, opt);
+    EXPECT_EQ(counter.count, 1);
+    EXPECT_EQ(z.data, data);
+    EXPECT_TRUE(y.empty());
+
+    // and copied when it is
+    Tensor shared = z;
+    Tensor w;
+    layer.Forward(std::move(z), w, opt);
+    EXPECT_EQ(counter.count, 2);
+    EXPECT_TRUE(z.empty());
+    for (int i = 0; i < 45; i++)
+    {
+        EXPECT_FLOAT_EQ(shared[i], ref[i] + 2);
+        EXPECT_FLOAT_EQ(w[i], ref[i] + 3);
+    }
+}
+
+TEST(Layer, ReadOnly)
+{
+    const char* path = "test_layer_map.bin";
+    Tensor x = Tensor::randn(Shape(4, 8));
+    FILE* fp = fopen(path, "wb");
+    ASSERT_TRUE(fp != nullptr);
+    fwrite(x.data, sizeof(float), 32, fp);
+    fclose(fp);
+
+    // a mapped blob is the only reference to its data, but it is never taken over nor written as an output
+    AddOne layer;
+    Tensor mapped = Tensor::Map(path, Shape(4, 8));
+    ASSERT_FALSE(mapped.empty());
+    EXPECT_TRUE(mapped.read_only);
+    EXPECT_TRUE(mapped.row(1).read_only);
+    void* data = mapped.data;
+    Tensor y;
+    layer.Forward(std::move(mapped), y);
+    EXPECT_NE(y.data, data);
+    EXPECT_FALSE(y.read_only);
+
+    Tensor again = Tensor::Map(path, Shape(4, 8));
+    Tensor output = again;
+    layer.Forward(y, output);
+    EXPECT_NE(output.data, again.data);
+    for (int i = 0; i < 32; i++)
+    {
+        EXPECT_FLOAT_EQ(y[i], x[i] + 1);
+        EXPECT_FLOAT_EQ(output[i], x[i] + 2);
+        EXPECT_EQ(again[i], x[i]);
+    }
+    again.Release();
+    output.Release();
+    remove(path);
+}
+
+TEST(Layer, OutOfPlace)
+{
+    Negate layer;
+    CountingAllocator counter;
+    Option opt;
+    opt.blob_allocator = &counter;
+    Tensor x = Tensor::randn(Shape(4, 8));
+    Tensor ref = x.Clone();
+
+    // in place through a new Tensor
+    Tensor blob = x.Clone();
+    layer.Forward(blob, opt);
+    EXPECT_EQ(counter.count, 1);
+    for (int i = 0; i < 32; i++) EXPECT_EQ(blob[i], -ref[i]);
+
+    // straight into a row of a larger Tensor
+    Tensor big = Tensor::zeros(Shape(3, 32));
+    Tensor row = big.row(1);
+    layer.Forward(Tensor(Shape(32), Depth::D4, Packing::CHW, x.data), row, opt);
+    EXPECT_EQ(row.data, (float*)big.data + 32);
+    EXPECT_EQ(counter.count, 1);
+    for (int i = 0; i < 32; i++)
+    {
+        EXPECT_EQ(big[i], 0.f);
+        EXPECT_EQ(big[32 + i], -ref[i]);
+    }
+
+    // a blob given up is released after the forward
+    Tensor y;
+    Tensor moved = x;
+    layer.Forward(std::move(moved), y, opt);
+    EXPECT_TRUE(moved.empty());
+    EXPECT_EQ(counter.count, 2);
+    for (int i = 0; i < 32; i++) EXPECT_EQ(y[i], -ref[i]);
+
+    std::vector<Tensor> outputs;
+    layer.Forward(std::vector<Tensor>{ x, ref }, outputs, opt);
+    ASSERT_EQ(outputs.size(), 2u);
+    for (int i = 0; i < 32; i++) EXPECT_EQ(outputs[1][i], -ref[i]);
+}
+
+TEST(Layer, Batch)
+{
+    std::vector<Tensor> frames;
+    for (int i = 0; i < 7; i++) frames.push_back(Tensor::randn(Shape(3, 5)));
+    ThreadPool pool(3);
+    Option opt;
+    opt.thread_pool = &pool;
+
+    // stacked into one [7, 3, 5] blob, the frames themselves are left alone
+    AddOneBatch stacked;
+    std::vector<Tensor> outputs;
+    stacked.ForwardBatch(frames, outputs, opt);
+    ASSERT_EQ(outputs.size(), frames.size());
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        ASSERT_EQ(outputs[i].shape, frames[i].shape);
+        for (int j = 0; j < 15; j++) EXPECT_FLOAT_EQ(outputs[i][j], frames[i][j] + 1);
+    }
+    // the outputs are views into one stack, it lives until the last of them is gone
+    EXPECT_EQ(static_cast<float*>(outputs[0].data) + 15, outputs[1].data);
+    EXPECT_EQ(*outputs[0].ref_cnt, 7);
+    Tensor last = outputs[6];
+    outputs.clear();
+    for (int j = 0; j < 15; j++) EXPECT_FLOAT_EQ(last[j], frames[6][j] + 1);
+    last.Release();
+
+    // the stack of an in-place layer becomes the outputs, it is not taken from the scratch workspace
+    {
+        ArenaAllocator arena;
+        Option scratch = opt;
+        scratch.workspace_allocator = &arena;
+        {
+            ArenaScope scope(arena);
+            stacked.ForwardBatch(frames, outputs, scratch);
+        }
+        Tensor later = Tensor(Shape(7, 3, 5), Depth::D4, Packing::CHW, &arena);
+        for (int i = 0; i < 7 * 15; i++) later[i] = 42.f;
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            for (int j = 0; j < 15; j++) ASSERT_FLOAT_EQ(outputs[i][j], frames[i][j] + 1);
+        }
+        outputs.clear();
+    }
+
+    // the outputs given by the caller are written
+    outputs = { Tensor::zeros(Shape(3, 5)), Tensor(), Tensor::zeros(Shape(2, 5)) };
+    void* given = outputs[0].data;
+    stacked.ForwardBatch({ frames[0], frames[1], frames[2] }, outputs, opt);
+    EXPECT_EQ(outputs[0].data, given);
+    EXPECT_EQ(*outputs[1].ref_cnt, 2);
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_EQ(outputs[i].shape, Shape(3, 5));
+        for (int j = 0; j < 15; j++) EXPECT_FLOAT_EQ(outputs[i][j], frames[i][j] + 1);
+    }
+
+    // one part per thread, each with its own workspace
+    Workspaces layer;
+    ArenaAllocator arenas[3];
+    opt.workspace_allocators = { &arenas[0], &arenas[1], &arenas[2] };
+    layer.ForwardBatch(frames, outputs, opt);
+    EXPECT_EQ(layer.seen, std::set<Allocator*>({ &arenas[0], &arenas[1], &arenas[2] }));
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        for (int j = 0; j < 15; j++) EXPECT_EQ(outputs[i][j], -frames[i][j]);
+    }
+
+    // without them each part gets an arena of its own
+    layer.seen.clear();
+    opt.workspace_allocators.clear();
+    layer.ForwardBatch(frames, outputs, opt);
+    EXPECT_EQ(layer.seen.size(), 3u);
+    EXPECT_EQ(layer.seen.count(nullptr), 0u);
+
+    // shapes that differ are never stacked
+    frames[3] = Tensor::randn(Shape(4, 5));
+    stacked.ForwardBatch(frames, outputs, opt);
+    ASSERT_EQ(outputs[3].shape, Shape(4, 5));
+    for (int j = 0; j < 20; j++) EXPECT_FLOAT_EQ(outputs[3][j], frames[3][j] + 1);
+}
\ No newline at end of file
@@ -0,0 +1,218 @@
+#include "testutil.hpp"
+#include <dnn/net.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace chaos::dnn;
+
+// x + value in place, counting its runs
+class AddValue : public Layer
+{
+public:
+    AddValue(float value, int sleep_ms = 0) : Layer("AddValue"), value(value), sleep_ms(sleep_ms) { support_inplace = true; }
+
+    void Forward(Tensor& blob, const Option&) const override
+    {
+        int now = ++active;
+        for (int seen = max_active; now > seen && not max_active.compare_exchange_weak(seen, now);) {}
+        if (sleep_ms) std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms));
+        for (int i = 0; i < blob.shape.total(); i++) blob[i] += value;
+        data = blob.data;
+        runs++;
+        order = ++finished;
+        active--;
+    }
+    using Layer::Forward;
+
+    float value;
+    int sleep_ms;
+    mutable void* data = nullptr;
+    mutable std::atomic<int> runs = 0;
+    // when the last run finished among all layers
+    mutable std::atomic<int> order = 0;
+
+    static inline std::atomic<int> active = 0;
+    static inline std::atomic<int> finished = 0;
+    static inline std::atomic<int> max_active = 0;
+};
+
+// the sum of the bottoms
+class Sum : public Layer
+{
+public:
+    Sum() : Layer("Sum") {}
+
+    void Forward(const std::vector<Tensor>& bottoms, std::vector<Tensor>& tops, const Option& opt) const override
+    {
+        tops.resize(1);
+        tops[0] = bottoms[0].Clone(opt.blob_allocator);
+        for (size_t b = 1; b < bottoms.size(); b++)
+        {
+            for (int i = 0; i < tops[0].shape.total(); i++) tops[0][i] += bottoms[b][i];
+        }
+    }
+    using Layer::Forward;
+};
+
+struct Branches
+{
+    // in -> a -> (b, c) -> s
+    Branches(int sleep_ms = 0) :
+        A(std::make_shared<AddValue>(1.f)), B(std::make_shared<AddValue>(2.f, sleep_ms)), C(std::make_shared<AddValue>(3.f, sleep_ms))
+    {
+        net.AddLayer(A, { "in" }, { "a" });
+        net.AddLayer(B, { "a" }, { "b" });
+        net.AddLayer(C, { "a" }, { "c" });
+        net.AddLayer(std::make_shared<Sum>(), { "b", "c" }, { "s" });
+    }
+
+    Net net;
+    std::shared_ptr<AddValue> A, B, C;
+};
+
+TEST(Net, Extract)
+{
+    Branches g;
+    EXPECT_EQ(g.net.num_layers(), 4u);
+    EXPECT_EQ(g.net.num_blobs(), 5u);
+    EXPECT_EQ(g.net.blob_name(g.net.FindBlob("c")), "c");
+    EXPECT_EQ(g.net.FindBlob("d"), -1);
+
+    Tensor x = Tensor::randn(Shape(3, 7));
+    Tensor input = x.Clone();
+    Extractor ex = g.net.CreateExtractor();
+    ex.Input("in", input);
+    Tensor s;
+    ex.Extract("s", s);
+    ASSERT_EQ(s.shape, x.shape);
+    for (int i = 0; i < x.shape.total(); i++)
+    {
+        EXPECT_FLOAT_EQ(s[i], 2 * x[i] + 7);
+        // the input is never written in place
+        EXPECT_EQ(input[i], x[i]);
+    }
+    EXPECT_EQ(g.A->runs, 1);
+
+    // only the layers b depends on
+    Extractor only = g.net.CreateExtractor();
+    only.Input("in", input);
+    Tensor b;
+    only.Extract("b", b);
+    for (int i = 0; i < x.shape.total(); i++) EXPECT_FLOAT_EQ(b[i], x[i] + 3);
+    EXPECT_EQ(g.A->runs, 2);
+    EXPECT_EQ(g.B->runs, 2);
+    EXPECT_EQ(g.C->runs, 1);
+
+    // a blob set as input skips its layers
+    Extractor skip = g.net.CreateExtractor();
+    skip.Input("a", input);
+    skip.Extract("c", b);
+    for (int i = 0; i < x.shape.total(); i++) EXPECT_FLOAT_EQ(b[i], x[i] + 3);
+    EXPECT_EQ(g.A->runs, 2);
+}
+
+TEST(Net, LightMode)
+{
+    Tensor x = Tensor::randn(Shape(64));
+    {
+        // the last reader of a blob takes it over
+        Net net;
+        auto A = std::make_shared<AddValue>(1.f);
+        auto B = std::make_shared<AddValue>(2.f);
+        net.AddLayer(A, { "in" }, { "a" });
+        net.AddLayer(B, { "a" }, { "b" });
+        Extractor ex = net.CreateExtractor();
+        ex.Input("in", x);
+        Tensor b;
+        ex.Extract("b", b);
+        EXPECT_NE(A->data, x.data);
+        EXPECT_EQ(B->data, A->data);
+        EXPECT_EQ(b.data, A->data);
+
+        // a was released, so it runs again
+        Tensor a;
+        ex.Extract("a", a);
+        EXPECT_EQ(A->runs, 2);
+        for (int i = 0; i < x.shape.total(); i++) EXPECT_FLOAT_EQ(a[i], x[i] + 1);
+
+        // an extracted blob is shared with the caller and never written in place
+        Extractor other = net.CreateExtractor();
+        other.Input("in", x);
+        other.Extract("a", a);
+        other.Extract("b", b);
+        EXPECT_EQ(A->runs, 3);
+        EXPECT_NE(B->data, a.data);
+        for (int i = 0; i < x.shape.total(); i++)
+        {
+            EXPECT_FLOAT_EQ(a[i], x[i] + 1);
+            EXPECT_FLOAT_EQ(b[i], x[i] + 3);
+        }
+    }
+    {
+        Branches g;
+        g.net.opt.light_mode = false;
+        Extractor ex = g.net.CreateExtractor();
+        ex.Input("in", x);
+        Tensor s, c;
+        ex.Extract("s", s);
+        ex.Extract("c", c);
+        EXPECT_EQ(g.C->runs, 1);
+
+        // a new input drops the blobs computed before
+        ex.Input("in", s);
+        ex.Extract("c", c);
+        EXPECT_EQ(g.C->runs, 2);
+        for (int i = 0; i < x.shape.total(); i++) EXPECT_FLOAT_EQ(c[i], s[i] + 4);
+    }
+}
+
+TEST(Net, Branches)
+{
+    Branches g(50);
+    ThreadPool pool(2);
+    g.net.opt.thread_pool = &pool;
+    Extractor ex = g.net.CreateExtractor();
+    ex.Input("in", Tensor::zeros(Shape(16)));
+    AddValue::max_active = 0;
+    std::vector<Tensor> tops;
+    ex.Extract({ "b", "c", "s" }, tops);
+    ASSERT_EQ(tops.size(), 3u);
+    EXPECT_FLOAT_EQ(tops[0][0], 3.f);
+    EXPECT_FLOAT_EQ(tops[1][0], 4.f);
+    EXPECT_FLOAT_EQ(tops[2][0], 7.f);
+    // b and c are independent and run together
+    EXPECT_EQ(AddValue::max_active, 2);
+
+    Extractor one = g.net.CreateExtractor();
+    one.opt.num_threads = 1;
+    one.Input("in", Tensor::zeros(Shape(16)));
+    AddValue::max_active = 0;
+    one.Extract({ "s" }, tops);
+    EXPECT_EQ(AddValue::max_active, 1);
+    EXPECT_FLOAT_EQ(tops[0][0], 7.f);
+}
+
+TEST(Net, Schedule)
+{
+    // in -> x, in -> y1 -> y2 -> y3, (x, y3) -> s: the chain runs while the slow x does
+    Net net;
+    auto X = std::make_shared<AddValue>(1.f, 100);
+    std::vector<std::shared_ptr<AddValue>> Y;
+    for (int i = 0; i < 3; i++) Y.push_back(std::make_shared<AddValue>(1.f, 5));
+    net.AddLayer(X, { "in" }, { "x" });
+    net.AddLayer(Y[0], { "in" }, { "y1" });
+    net.AddLayer(Y[1], { "y1" }, { "y2" });
+    net.AddLayer(Y[2], { "y2" }, { "y3" });
+    net.AddLayer(std::make_shared<Sum>(), { "x", "y3" }, { "s" });
+
+    ThreadPool pool(2);
+    net.opt.thread_pool = &pool;
+    Extractor ex = net.CreateExtractor();
+    ex.Input("in", Tensor::zeros(Shape(16)));
+    Tensor s;
+    ex.Extract("s", s);
+    EXPECT_FLOAT_EQ(s[0], 4.f);
+    for (const auto& y : Y) EXPECT_LT(y->order, X->order);
+}
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "testutil.hpp"
+#include <core/parallel.hpp>
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+TEST(Parallel, ParallelFor)
+{
+    ThreadPool pool(4);
+    EXPECT_EQ(pool.num_threads(), 4);
+
+    std::vector<int> hits(10007, 0);
+    pool.ParallelFor(0, static_cast<int64_t>(hits.size()), [&](int64_t begin, int64_t end) {
+        for (int64_t i = begin; i < end; i++) hits[i]++;
+    });
+    for (int hit : hits) EXPECT_EQ(hit, 1);
+
+    // empty and single-thread ranges run on the caller
+    std::thread::id caller = std::this_thread::get_id();
+    pool.ParallelFor(0, 100, [&](int64_t begin, int64_t end) {
+        EXPECT_EQ(std::this_thread::get_id(), caller);
+        EXPECT_EQ(end - begin, 100);
+    }, 1, 1);
+    pool.ParallelFor(5, 5, [&](int64_t, int64_t) { FAIL(); });
+}
+
+TEST(Parallel, Nested)
+{
+    ThreadPool pool(3);
+    std::atomic<int64_t> total = 0;
+    pool.ParallelFor(0, 16, [&](int64_t begin, int64_t end) {
+        for (int64_t i = begin; i < end; i++)
+        {
+            pool.ParallelFor(0, 1000, [&](int64_t b, int64_t e) {
+                total += e - b;
+            });
+        }
+    });
+    EXPECT_EQ(total.load(), 16 * 1000);
+}
+
+TEST(Parallel, TaskGroup)
+{
+    ThreadPool pool(3);
+    std::atomic<int> runs = 0;
+    {
+        // each task adds the next ones, Wait also waits for those
+        TaskGroup group(&pool);
+        std::function<void(int)> spawn = [&](int depth) {
+            runs++;
+            if (depth == 0) return;
+            for (int i = 0; i < 2; i++) group.Run([&, depth]() { spawn(depth - 1); });
+        };
+        group.Run([&]() { spawn(6); });
+        group.Wait();
+        EXPECT_EQ(runs, 127);
+
+        // a ParallelFor inside a task
+        std::atomic<int64_t> total = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            group.Run([&]() {
+                pool.ParallelFor(0, 1000, [&](int64_t b, int64_t e) { total += e - b; });
+            });
+        }
+        group.Wait();
+        EXPECT_EQ(total.load(), 8 * 1000);
+    }
+}
+
+TEST(Parallel, ParallelFor2D)
+{
+    constexpr int rows = 37;
+    constexpr int cols = 53;
+    std::vector<int> hits(rows * cols, 0);
+    ParallelFor2D(rows, cols, 8, 16, [&](int64_t r0, int64_t r1, int64_t c0, int64_t c1) {
+        EXPECT_LE(r1 - r0, 8);
+        EXPECT_LE(c1 - c0, 16);
+        for (int64_t r = r0; r < r1; r++)
+            for (int64_t c = c0; c < c1; c++)
+                hits[r * cols + c]++;
+    });
+    for (int hit : hits) EXPECT_EQ(hit, 1);
+}
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
\ No newline at end of file
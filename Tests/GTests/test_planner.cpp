@@ -0,0 +1,188 @@
+#include "testutil.hpp"
+#include <dnn/net.hpp>
+#include <dnn/planner.hpp>
+
+#include <random>
+
+using namespace chaos::dnn;
+
+TEST(Planner, PlanMemory)
+{
+    // a chain: each buffer lives with the next one only
+    std::vector<BufferLife> chain;
+    for (int i = 0; i < 10; i++) chain.push_back(BufferLife{ 1000, i, i + 1 });
+    std::vector<size_t> offsets;
+    size_t size = PlanMemory(chain, offsets, 64);
+    EXPECT_EQ(size, 2 * AlignSize(1000, 64));
+
+    std::mt19937 rng(3);
+    for (int trial = 0; trial < 20; trial++)
+    {
+        std::vector<BufferLife> buffers;
+        size_t peak = 0;
+        for (int i = 0; i < 60; i++)
+        {
+            int first = rng() % 30;
+            buffers.push_back(BufferLife{ 1 + rng() % 5000, first, first + static_cast<int>(rng() % 6) });
+        }
+        for (int step = 0; step < 36; step++)
+        {
+            size_t live = 0;
+            for (const auto& b : buffers) live += b.first <= step && step <= b.last ? AlignSize(b.size, 64) : 0;
+            peak = std::max(peak, live);
+        }
+
+        size = PlanMemory(buffers, offsets, 64);
+        EXPECT_GE(size, peak);
+        for (size_t i = 0; i < buffers.size(); i++)
+        {
+            EXPECT_EQ(offsets[i] % 64, 0u);
+            EXPECT_LE(offsets[i] + buffers[i].size, size);
+            for (size_t j = i + 1; j < buffers.size(); j++)
+            {
+                bool together = !(buffers[i].last < buffers[j].first || buffers[j].last < buffers[i].first);
+                bool apart = offsets[i] + buffers[i].size <= offsets[j] || offsets[j] + buffers[j].size <= offsets[i];
+                EXPECT_TRUE(not together || apart) << i << " and " << j;
+            }
+        }
+    }
+}
+
+// x * scale + shift into a new blob
+class Affine : public Layer
+{
+public:
+    Affine(float scale, float shift) : Layer("Affine"), scale(scale), shift(shift) { support_outplace = true; }
+
+    void Forward(const Tensor& bottom, Tensor& top, const Option& opt) const override
+    {
+        CreateOutput(top, bottom.shape, bottom.depth, bottom.packing, opt);
+        for (int i = 0; i < bottom.shape.total(); i++) top[i] = bottom[i] * scale + shift;
+    }
+    using Layer::Forward;
+
+    float scale;
+    float shift;
+};
+
+class Concat : public Layer
+{
+public:
+    Concat() : Layer("Concat") { support_outplace = true; }
+
+    void Forward(const std::vector<Tensor>& bottoms, std::vector<Tensor>& tops, const Option& opt) const override
+    {
+        int n = 0;
+        for (const auto& b : bottoms) n += b.shape[0];
+        tops.resize(1);
+        tops[0] = Tensor(Shape(n), Depth::D4, Packing::CHW, opt.blob_allocator);
+        size_t at = 0;
+        for (const auto& b : bottoms)
+        {
+            for (int i = 0; i < b.shape.total(); i++) tops[0][at++] = b[i];
+        }
+    }
+    using Layer::Forward;
+};
+
+TEST(Planner, Chain)
+{
+    constexpr int n = 4096;
+    Net net;
+    net.AddLayer(std::make_shared<Affine>(2.f, 0.f), { "in" }, { "x0" });
+    for (int i = 1; i < 12; i++) net.AddLayer(std::make_shared<Affine>(1.f, 1.f), { "x" + std::to_string(i - 1) }, { "x" + std::to_string(i) });
+
+    CountingAllocator counter;
+    net.opt.blob_allocator = &counter;
+    Extractor ex = net.CreateExtractor();
+    Tensor x = Tensor::randn(Shape(n));
+    ex.Input("in", x);
+    size_t slab = ex.Plan({ "x11" });
+    EXPECT_EQ(counter.count, 12);
+    // 2 live blobs at a time, the last one is extracted and not in the slab
+    size_t blob = AlignSize(n * sizeof(float), GetDefaultAlignment()) + sizeof(int);
+    EXPECT_LE(slab, 2 * AlignSize(blob, GetDefaultAlignment()));
+    EXPECT_LT(slab * 5, counter.bytes);
+
+    Tensor kept;
+    ex.Extract("x11", kept);
+    for (int round = 0; round < 3; round++)
+    {
+        Tensor y = Tensor::randn(Shape(n));
+        ex.Input("in", y);
+        counter.count = 0;
+        Tensor out;
+        ex.Extract("x11", out);
+        // only the extracted blob is allocated
+        EXPECT_EQ(counter.count, 1);
+        for (int i = 0; i < n; i++) ASSERT_FLOAT_EQ(out[i], 2 * y[i] + 11);
+        for (int i = 0; i < n; i++) ASSERT_FLOAT_EQ(kept[i], 2 * x[i] + 11);
+    }
+
+    // other targets run without the plan
+    ex.Input("in", x);
+    counter.count = 0;
+    Tensor mid;
+    ex.Extract("x5", mid);
+    EXPECT_EQ(counter.count, 6);
+    for (int i = 0; i < n; i++) ASSERT_FLOAT_EQ(mid[i], 2 * x[i] + 5);
+
+    // a larger input does not fit the slab and falls back to the allocator
+    Tensor large = Tensor::randn(Shape(2 * n));
+    ex.Input("in", large);
+    Tensor out;
+    ex.Extract("x11", out);
+    ASSERT_EQ(out.shape, large.shape);
+    for (int i = 0; i < 2 * n; i++) ASSERT_FLOAT_EQ(out[i], 2 * large[i] + 11);
+
+    // the extracted blobs outlive their Extractor
+    Tensor planned, run;
+    {
+        Extractor other = net.CreateExtractor();
+        other.Input("in", x);
+        other.Plan({ "x11" });
+        other.Extract("x11", planned);
+        other.Input("in", large);
+        other.Extract("x11", run);
+    }
+    EXPECT_EQ(planned.allocator, &counter);
+    EXPECT_EQ(run.allocator, &counter);
+    for (int i = 0; i < n; i++) ASSERT_FLOAT_EQ(planned[i], 2 * x[i] + 11);
+    for (int i = 0; i < 2 * n; i++) ASSERT_FLOAT_EQ(run[i], 2 * large[i] + 11);
+}
+
+TEST(Planner, Branches)
+{
+    // in -> a -> (b -> d, c) -> concat, the branches run together
+    Net net;
+    net.AddLayer(std::make_shared<Affine>(1.f, 1.f), { "in" }, { "a" });
+    net.AddLayer(std::make_shared<Affine>(2.f, 0.f), { "a" }, { "b" });
+    net.AddLayer(std::make_shared<Affine>(3.f, 0.f), { "a" }, { "c" });
+    net.AddLayer(std::make_shared<Affine>(1.f, -1.f), { "b" }, { "d" });
+    net.AddLayer(std::make_shared<Concat>(), { "d", "c" }, { "out" });
+
+    ThreadPool pool(3);
+    net.opt.thread_pool = &pool;
+    Tensor x = Tensor::randn(Shape(1000));
+    for (bool light : { true, false })
+    {
+        net.opt.light_mode = light;
+        Extractor ex = net.CreateExtractor();
+        ex.Input("in", x);
+        EXPECT_GT(ex.Plan({ "out", "b" }), 0u);
+        for (int round = 0; round < 3; round++)
+        {
+            Tensor y = Tensor::randn(Shape(1000));
+            ex.Input("in", y);
+            std::vector<Tensor> tops;
+            ex.Extract({ "out", "b" }, tops);
+            ASSERT_EQ(tops[0].shape[0], 2000);
+            for (int i = 0; i < 1000; i++)
+            {
+                ASSERT_FLOAT_EQ(tops[0][i], 2 * (y[i] + 1) - 1);
+                ASSERT_FLOAT_EQ(tops[0][1000 + i], 3 * (y[i] + 1));
+                ASSERT_FLOAT_EQ(tops[1][i], 2 * (y[i] + 1));
+            }
+        }
+    }
+}
\ No newline at end of file
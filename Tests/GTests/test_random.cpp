@@ -0,0 +1,112 @@
+#include "testutil.hpp"
+#include <core/random.hpp>
+#include <core/tensor.hpp>
+
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+TEST(Random, Philox)
+{
+    // known answers of Philox4x32-10
+    auto zero = Philox::Block(0, 0, 0);
+    EXPECT_EQ(zero[0], 0x6627e8d5u);
+    EXPECT_EQ(zero[1], 0xe169c58du);
+    EXPECT_EQ(zero[2], 0xbc57ac4cu);
+    EXPECT_EQ(zero[3], 0x9b00dbd8u);
+    auto ones = Philox::Block(~0ull, ~0ull, ~0ull);
+    EXPECT_EQ(ones[0], 0x408f276du);
+    EXPECT_EQ(ones[1], 0x41c83b0eu);
+    EXPECT_EQ(ones[2], 0xa20bc7c6u);
+    EXPECT_EQ(ones[3], 0x6d5451fdu);
+
+    // value j is word j % 4 of block j / 4, on every path and past a carry of the counter
+    Philox rng(42, 3);
+    rng.Skip((0xffffffffull - 5) * 4);
+    std::vector<float> values(1003);
+    rng.Uniform(values.data(), values.size(), -2.f, 6.f);
+    for (size_t j = 0; j < values.size(); j++)
+    {
+        uint32_t word = Philox::Block(42, 3, 0xffffffffull - 5 + j / 4)[j % 4];
+        float expect = std::fma(static_cast<float>(word >> 8) * 0x1p-24f, 8.f, -2.f);
+        ASSERT_EQ(values[j], expect) << "at " << j;
+    }
+    EXPECT_EQ(rng.position(), 0xffffffffull - 5 + 251);
+}
+
+TEST(Random, Reproducible)
+{
+    size_t n = 100003;
+    std::vector<float> one(n), many(n), split(n);
+    ThreadPool single(1);
+    ThreadPool pool(4);
+    Philox(7).Normal(one.data(), n, 1.f, 2.f, 0, &single);
+    Philox(7).Normal(many.data(), n, 1.f, 2.f, 0, &pool);
+    EXPECT_EQ(one, many);
+
+    // fills of whole blocks continue the stream
+    Philox rng(7);
+    rng.Normal(split.data(), 4096, 1.f, 2.f);
+    rng.Normal(split.data() + 4096, n - 4096, 1.f, 2.f);
+    EXPECT_EQ(one, split);
+
+    // another stream or seed gives other values
+    Philox(7, 1).Normal(split.data(), n, 1.f, 2.f);
+    EXPECT_NE(one, split);
+
+    // the same generator shared by threads: the fills never overlap
+    Philox shared(11);
+    std::vector<std::vector<float>> parts(4, std::vector<float>(1000));
+    std::vector<std::thread> threads;
+    for (auto& part : parts) threads.emplace_back([&]() { shared.Uniform(part.data(), part.size()); });
+    for (auto& thread : threads) thread.join();
+    EXPECT_EQ(shared.position(), 1000u);
+    std::vector<float> all(4000);
+    Philox(11).Uniform(all.data(), all.size());
+    std::sort(all.begin(), all.end());
+    for (const auto& part : parts)
+    {
+        for (float v : part) EXPECT_TRUE(std::binary_search(all.begin(), all.end(), v));
+    }
+}
+
+TEST(Random, Moments)
+{
+    Philox rng(2024);
+    Tensor normal = Tensor::randn(Shape(1 << 20), rng, 3.f, 0.5f);
+    Tensor uniform = Tensor::randu(Shape(1 << 20), rng, -1.f, 1.f);
+    double sum = 0, sq = 0, usum = 0;
+    float lo = 1.f, hi = -1.f;
+    for (int i = 0; i < (1 << 20); i++)
+    {
+        double x = normal[i] - 3.;
+        sum += x;
+        sq += x * x;
+        usum += uniform[i];
+        lo = std::min(lo, uniform[i]);
+        hi = std::max(hi, uniform[i]);
+        ASSERT_TRUE(std::isfinite(normal[i]));
+    }
+    EXPECT_NEAR(sum / (1 << 20), 0., 2e-3);
+    EXPECT_NEAR(sq / (1 << 20), 0.25, 2e-3);
+    EXPECT_NEAR(usum / (1 << 20), 0., 3e-3);
+    EXPECT_GE(lo, -1.f);
+    EXPECT_LT(hi, 1.f);
+
+    // Box-Muller on the word pairs against the libm functions
+    std::vector<float> z(8);
+    Philox(5).Normal(z.data(), z.size());
+    for (int b = 0; b < 2; b++)
+    {
+        auto w = Philox::Block(5, 0, b);
+        for (int i = 0; i < 4; i += 2)
+        {
+            double u1 = ((w[i] >> 8) + 1) * 0x1p-24;
+            double u2 = (w[i + 1] >> 8) * 0x1p-24;
+            double r = std::sqrt(-2 * std::log(u1));
+            EXPECT_NEAR(z[b * 4 + i], r * std::cos(2 * M_PI * u2), 1e-5);
+            EXPECT_NEAR(z[b * 4 + i + 1], r * std::sin(2 * M_PI * u2), 1e-5);
+        }
+    }
+}
\ No newline at end of file
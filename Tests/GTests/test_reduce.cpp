@@ -0,0 +1,142 @@
+#include "testutil.hpp"
+#include <core/reduce.hpp>
+#include <core/expr.hpp>
+
+#include <cmath>
+#include <limits>
+
+TEST(Reduce, Full)
+{
+    Tensor a = Tensor::randn(Shape(3, 17, 29));
+    const float* data = (const float*)a.data;
+    size_t n = a.shape.total();
+
+    double s = 0, s1 = 0, s2 = 0, d = 0;
+    int64_t imin = 0, imax = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        s += data[i];
+        s1 += std::abs(data[i]);
+        s2 += (double)data[i] * data[i];
+        d += (double)data[i] * (2 * data[i] + 1);
+        if (data[i] < data[imin]) imin = i;
+        if (data[i] > data[imax]) imax = i;
+    }
+    EXPECT_NEAR(sum(a), s, 1e-3);
+    EXPECT_NEAR(mean(a), s / n, 1e-5);
+    EXPECT_NEAR(norm(a, NormType::L1), s1, 1e-2);
+    EXPECT_NEAR(norm(a), std::sqrt(s2), 1e-3);
+    EXPECT_NEAR(dot(a, Eval(a * 2.f + 1.f)), d, 1e-2);
+    EXPECT_EQ(argmin(a), imin);
+    EXPECT_EQ(argmax(a), imax);
+    EXPECT_EQ(min(a), data[imin]);
+    EXPECT_EQ(max(a), data[imax]);
+
+    // NaN are skipped, ties keep the first
+    Tensor b = Tensor(Shape(40), Depth::D4, Packing::CHW);
+    float* bd = (float*)b.data;
+    for (int i = 0; i < 40; i++) bd[i] = (float)(i % 7);
+    bd[0] = std::numeric_limits<float>::quiet_NaN();
+    EXPECT_EQ(argmin(b), 7);
+    EXPECT_EQ(argmax(b), 6);
+    EXPECT_EQ(min(b), 0.f);
+
+    // Array sum and dot go through the same kernels
+    Array<float> arr(1000);
+    for (int i = 0; i < 1000; i++) arr[i] = (float)i;
+    EXPECT_EQ(sum(arr), 499500.f);
+    EXPECT_EQ(dot(arr, Array<float>(1000, 1.f)), 499500.f);
+}
+
+TEST(Reduce, Accuracy)
+{
+    // 2^24 + 1 is not a float, a naive sum of ones gets stuck at 2^24
+    size_t n = (1 << 24) + 1000;
+    Tensor ones = Tensor(Shape((int)n), Depth::D4, Packing::CHW);
+    float* data = (float*)ones.data;
+    for (size_t i = 0; i < n; i++) data[i] = 1.f;
+    EXPECT_EQ(sum(ones), (float)n);
+
+    Tensor a = Tensor::randn(Shape(1 << 22));
+    data = (float*)a.data;
+    double s = 0;
+    for (size_t i = 0; i < (1 << 22); i++) s += (double)data[i] * data[i];
+    EXPECT_NEAR(norm(a) * norm(a) / s, 1., 1e-6);
+    EXPECT_EQ(sum(a), sum(a)); // reproducible
+}
+
+TEST(Reduce, Strided)
+{
+    Tensor a = Tensor::randn(Shape(4, 6, 5));
+    Tensor col = a.col(1);
+    Tensor dense = col.Clone();
+    EXPECT_NEAR(sum(col), sum(dense), 1e-5);
+    EXPECT_EQ(max(col), max(dense));
+    EXPECT_EQ(argmin(col), argmin(dense));
+    EXPECT_NEAR(dot(col, dense), norm(dense) * norm(dense), 1e-4);
+
+    // packed lanes count as scalars, a Cut of a packed Tensor is walked element by element
+    Tensor packed = a.Repack(Packing::C4HW4);
+    EXPECT_NEAR(sum(packed), sum(a), 1e-4);
+    EXPECT_EQ(max(packed), max(a));
+    Tensor pcol = packed.col(1);
+    EXPECT_NEAR(sum(pcol), sum(pcol.Clone()), 1e-5);
+}
+
+TEST(Reduce, Axis)
+{
+    Tensor a = Tensor::randn(Shape(5, 3, 70));
+
+    // reduce the outer dim, adjacent outputs are summed as columns
+    Tensor s0 = sum(a, { 0 });
+    EXPECT_EQ(s0.shape, Shape(3, 70));
+    Tensor m2 = mean(a, { -1 }, true);
+    EXPECT_EQ(m2.shape, Shape(5, 3, 1));
+    Tensor n02 = norm(a, NormType::L2, { 0, 2 });
+    EXPECT_EQ(n02.shape, Shape(3));
+    Tensor all = max(a, { 0, 1, 2 });
+    EXPECT_EQ(all.shape, Shape(1));
+    EXPECT_EQ(all.At(0), max(a));
+
+    for (int h = 0; h < 3; h++)
+    {
+        double sq = 0;
+        for (int w = 0; w < 70; w++)
+        {
+            double s = 0;
+            for (int c = 0; c < 5; c++)
+            {
+                s += a.At(c, h, w);
+                sq += (double)a.At(c, h, w) * a.At(c, h, w);
+            }
+            EXPECT_NEAR(s0.At(h, w), s, 1e-5);
+        }
+        EXPECT_NEAR(n02.At(h), std::sqrt(sq), 1e-4);
+        for (int c = 0; c < 5; c++)
+        {
+            double s = 0;
+            for (int w = 0; w < 70; w++) s += a.At(c, h, w);
+            EXPECT_NEAR(m2.At(c, h, 0), s / 70, 1e-5);
+        }
+    }
+
+    Tensor am = argmin(a, 1);
+    Tensor mn = min(a, { 1 });
+    EXPECT_EQ(am.shape, Shape(5, 70));
+    for (int c = 0; c < 5; c++)
+    {
+        for (int w = 0; w < 70; w++)
+        {
+            int idx = am.At<int>(c, w);
+            EXPECT_EQ(a.At(c, idx, w), mn.At(c, w));
+            for (int h = 0; h < 3; h++) EXPECT_LE(mn.At(c, w), a.At(c, h, w));
+        }
+    }
+
+    // a strided input
+    Tensor col = a.col(2);
+    Tensor sc = sum(col, { 0 });
+    EXPECT_EQ(sc.shape, Shape(1));
+    EXPECT_FLOAT_EQ(sc.At(0), sum(col.Clone()));
+    EXPECT_FLOAT_EQ(max(col, { 0 }).At(0), max(col));
+}
\ No newline at end of file
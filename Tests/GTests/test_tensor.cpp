@@ -1,5 +1,7 @@
 #include "testutil.hpp"
 #include <core/tensor.hpp>
+#include <cmath>
+#include <algorithm>
 
 TEST(Tensor, Create)
 {
@@ -42,6 +44,28 @@ TEST(Tensor, CopyTo)
     {
         EXPECT_FLOAT_EQ(t4[i], arr1[i]);
     }
+
+    // strided in every dim, e.g. a channel of HWC data
+    Tensor hwc = Tensor::randn(Shape({ 5,6,7,3 }));
+    for (int c = 0; c < 3; c++)
+    {
+        Tensor ch = hwc.Cut({ 5,6,7,1 }, c).Clone();
+        EXPECT_EQ(ch.shape, Shape(5, 6, 7));
+        for (int i = 0; i < 5; i++)
+            for (int j = 0; j < 6; j++)
+                for (int k = 0; k < 7; k++)
+                    EXPECT_FLOAT_EQ(ch.At(i, j, k), hwc.At(i, j, k, c));
+    }
+
+    // element step 2 on uchar
+    Array<uchar> arr3 = { 1,2,3,4,5,6,7,8,9,10,11,12 };
+    Tensor t5 = Tensor(Shape(2, 3), Depth::D1, Packing::CHW, arr3.data(), Steps(6, 2));
+    Tensor t6 = t5.Clone();
+    uchar expected[] = { 1,3,5,7,9,11 };
+    for (int i = 0; i < 6; i++)
+    {
+        EXPECT_EQ(static_cast<uchar*>(t6.data)[i], expected[i]);
+    }
 }
 
 TEST(Tensor, Cut)
@@ -73,6 +97,189 @@ TEST(Tensor, Cut)
     }
 }
 
+TEST(Tensor, Map)
+{
+    const char* path = "test_tensor_map.bin";
+    Array<float> arr = { 0,0,1,2,3,4,5,6 };
+    FILE* fp = fopen(path, "wb");
+    ASSERT_TRUE(fp != nullptr);
+    fwrite(arr.data(), sizeof(float), arr.size(), fp);
+    fclose(fp);
+
+    Tensor t1 = Tensor::Map(path, Shape(2, 3), Depth::D4, Packing::CHW, 2 * sizeof(float));
+    ASSERT_FALSE(t1.empty());
+    EXPECT_EQ(*t1.ref_cnt, 1);
+    for (int i = 0; i < 6; i++)
+    {
+        EXPECT_FLOAT_EQ(t1[i], i + 1.f);
+    }
+
+    Tensor t2 = t1;
+    EXPECT_EQ(*t1.ref_cnt, 2);
+    t1.Release();
+    EXPECT_FLOAT_EQ(t2.At(1, 2), 6.f);
+    t2.Release();
+
+    // too large for the file
+    Tensor t3 = Tensor::Map(path, Shape(3, 3), Depth::D4, Packing::CHW, 2 * sizeof(float));
+    EXPECT_TRUE(t3.empty());
+
+    remove(path);
+}
+
+TEST(Tensor, Move)
+{
+    Tensor t1 = Tensor(Shape(3, 5), Depth::D4, Packing::CHW);
+    void* data = t1.data;
+
+    Tensor t2 = std::move(t1);
+    EXPECT_TRUE(t1.empty());
+    EXPECT_EQ(t2.data, data);
+    EXPECT_EQ(*t2.ref_cnt, 1);
+    EXPECT_EQ(t2.shape, Shape(3, 5));
+
+    Tensor t3 = Tensor(Shape(2), Depth::D4, Packing::CHW);
+    t3 = std::move(t2);
+    EXPECT_EQ(t3.data, data);
+    EXPECT_EQ(*t3.ref_cnt, 1);
+
+    Tensor t4 = Tensor(Shape(7), Depth::D1, Packing::CHW);
+    swap(t3, t4);
+    EXPECT_EQ(t4.data, data);
+    EXPECT_EQ(t3.shape, Shape(7));
+
+    // vector growth moves the tensors
+    std::vector<Tensor> tensors;
+    for (int i = 0; i < 17; i++) tensors.push_back(Tensor(Shape(4), Depth::D4, Packing::CHW));
+    for (const auto& tensor : tensors) EXPECT_EQ(*tensor.ref_cnt, 1);
+
+    Tensor borrowed = t4.Borrow();
+    EXPECT_EQ(borrowed.data, data);
+    EXPECT_TRUE(borrowed.ref_cnt == nullptr);
+    EXPECT_EQ(*t4.ref_cnt, 1);
+    borrowed.Release();
+    EXPECT_EQ(*t4.ref_cnt, 1);
+}
+
+TEST(Tensor, Repack)
+{
+    // channels 10 is not a multiple of 4 or 8, the transposes run on 5x7 planes with a tail
+    Tensor chw = Tensor(Shape({ 2,10,5,7 }), Depth::D4, Packing::CHW);
+    float* data = (float*)chw.data;
+    for (int i = 0; i < chw.shape.total(); i++) data[i] = static_cast<float>(i + 1);
+
+    for (Packing packing : { Packing::C2HW2, Packing::C3HW3, Packing::C4HW4, Packing::C8HW8 })
+    {
+        int lanes = static_cast<int>(packing);
+        Tensor packed = chw.Repack(packing);
+        EXPECT_EQ(packed.shape, Shape({ 2,(10 + lanes - 1) / lanes,5,7 }));
+        EXPECT_EQ(packed.packing, packing);
+
+        const float* p = (const float*)packed.data;
+        for (int n = 0; n < 2; n++)
+        {
+            for (int g = 0; g < packed.shape[1]; g++)
+            {
+                for (int i = 0; i < 35; i++)
+                {
+                    for (int k = 0; k < lanes; k++)
+                    {
+                        int c = g * lanes + k;
+                        float expect = c < 10 ? data[(n * 10 + c) * 35 + i] : 0.f;
+                        EXPECT_EQ(p[((n * packed.shape[1] + g) * 35 + i) * lanes + k], expect);
+                    }
+                }
+            }
+        }
+
+        Tensor unpacked = packed.Repack(Packing::CHW, 10);
+        EXPECT_EQ(unpacked.shape, chw.shape);
+        EXPECT_EQ(memcmp(unpacked.data, chw.data, chw.shape.total() * sizeof(float)), 0);
+
+        // packed to packed goes lane by lane
+        Tensor repacked = packed.Repack(Packing::C4HW4, 10).Repack(packing, 10);
+        EXPECT_EQ(memcmp(repacked.data, packed.data, packed.shape.total() * lanes * sizeof(float)), 0);
+    }
+
+    // nothing to do
+    EXPECT_EQ(chw.Repack(Packing::CHW).data, chw.data);
+
+    // a 1 dim tensor packs dim 0, a non-dense source is compacted first
+    Tensor vec = Tensor(Shape(12), Depth::D1, Packing::CHW);
+    for (int i = 0; i < 12; i++) ((uchar*)vec.data)[i] = static_cast<uchar>(i);
+    Tensor odd = Tensor(Shape(6), Depth::D1, Packing::CHW, vec.data, Steps(2));
+    Tensor c4 = odd.Repack(Packing::C4HW4);
+    EXPECT_EQ(c4.shape, Shape(2));
+    const uchar expect[8] = { 0,2,4,6,8,10,0,0 };
+    EXPECT_EQ(memcmp(c4.data, expect, 8), 0);
+}
+
+TEST(Tensor, Convert)
+{
+    // u8 [N,C,H,W] to float with a scale and a shift per channel, 37 is not a multiple of the vector width
+    Tensor frame = Tensor(Shape({ 2,3,4,37 }), Depth::D1, Packing::CHW);
+    uchar* pixels = (uchar*)frame.data;
+    for (int i = 0; i < frame.shape.total(); i++) pixels[i] = static_cast<uchar>(i * 7);
+
+    Array<float> scale = { 1.f / 255, 2.f / 255, 4.f / 255 };
+    Array<float> shift = { -0.5f, 0.f, 0.5f };
+    Tensor norm = frame.Convert(DataType::U8, DataType::F32, scale, shift);
+    EXPECT_EQ(norm.depth, Depth::D4);
+    EXPECT_EQ(norm.shape, frame.shape);
+    const float* values = (const float*)norm.data;
+    for (int i = 0; i < frame.shape.total(); i++)
+    {
+        int c = i / (4 * 37) % 3;
+        EXPECT_NEAR(values[i], pixels[i] * scale[c] + shift[c], 1e-6f);
+    }
+
+    // float to u8 and s8 round to nearest even and saturate, nan goes to the low end
+    Tensor real = Tensor(Shape(11), Depth::D4, Packing::CHW);
+    const float src[11] = { -300.f, -1.5f, -0.5f, 0.5f, 1.5f, 2.5f, 127.6f, 254.5f, 300.f, NAN, 3.f };
+    memcpy(real.data, src, sizeof(src));
+    const uchar expect_u8[11] = { 0,0,0,0,2,2,128,254,255,0,3 };
+    const int8_t expect_s8[11] = { -128,-2,0,0,2,2,127,127,127,-128,3 };
+    Tensor u8 = real.Convert(DataType::F32, DataType::U8);
+    Tensor s8 = real.Convert(DataType::F32, DataType::S8);
+    EXPECT_EQ(memcmp(u8.data, expect_u8, 11), 0);
+    EXPECT_EQ(memcmp(s8.data, expect_s8, 11), 0);
+
+    // fp16 round trip is exact for halves, the scalar and the vector paths agree
+    Tensor halves = Tensor(Shape(21), Depth::D4, Packing::CHW);
+    const float half_values[7] = { 0.f, -2.f, 0.333251953125f, 65504.f, 6.103515625e-05f, 5.960464477539063e-08f, -1000.5f };
+    for (int i = 0; i < 21; i++) ((float*)halves.data)[i] = half_values[i % 7];
+    Tensor f16 = halves.Convert(DataType::F32, DataType::F16);
+    EXPECT_EQ(f16.depth, Depth::D2);
+    EXPECT_EQ(((uint16_t*)f16.data)[3], 0x7bff);
+    EXPECT_EQ(((uint16_t*)f16.data)[17], 0x7bff);
+    Tensor back = f16.Convert(DataType::F16, DataType::F32);
+    EXPECT_EQ(memcmp(back.data, halves.data, 21 * sizeof(float)), 0);
+
+    // a Cut channel is strided, doubles keep their precision
+    Tensor wide = Tensor(Shape({ 3,5,6 }), Depth::D8, Packing::CHW);
+    for (int i = 0; i < 90; i++) ((double*)wide.data)[i] = 1.0 + i * 1e-9;
+    Tensor col = wide.Cut(Shape({ 3,5,1 }), 4);
+    Tensor narrow = col.Convert(DataType::F64, DataType::F64, { 2.f }, { -1.f });
+    EXPECT_EQ(narrow.shape, Shape(3, 5));
+    for (int c = 0; c < 3; c++)
+    {
+        for (int h = 0; h < 5; h++)
+        {
+            EXPECT_DOUBLE_EQ(narrow.At<double>(c, h), wide.At<double>(c, h, 4) * 2 - 1);
+        }
+    }
+
+    // the lanes of a packed Tensor are channels too
+    Tensor rgb = Tensor(Shape(2, 20), Depth::D1, Packing::C3HW3);
+    for (int i = 0; i < 120; i++) ((uchar*)rgb.data)[i] = static_cast<uchar>(i);
+    Tensor bgr = rgb.Convert(DataType::U8, DataType::S8, { 1.f, 1.f, -1.f }, { 0.f, -100.f, 0.f });
+    for (int i = 0; i < 120; i++)
+    {
+        int expect = i % 3 == 0 ? i : i % 3 == 1 ? i - 100 : -i;
+        EXPECT_EQ(((int8_t*)bgr.data)[i], std::clamp(expect, -128, 127));
+    }
+}
+
 int main(int argc, char* argv[])
 {
     testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,62 @@
+#include "testutil.hpp"
+#include <core/view.hpp>
+
+TEST(View, Index)
+{
+    Tensor tensor = Tensor::randn(Shape(3, 4, 5));
+    TensorView<float, 3> view(tensor);
+    EXPECT_TRUE(view.contiguous());
+    EXPECT_EQ(view.total(), 60);
+    for (int c = 0; c < 3; c++)
+    {
+        for (int h = 0; h < 4; h++)
+        {
+            const float* row = view.row(c, h);
+            for (int w = 0; w < 5; w++)
+            {
+                EXPECT_FLOAT_EQ(view(c, h, w), tensor.At(c, h, w));
+                EXPECT_FLOAT_EQ(row[w], tensor.At(c, h, w));
+            }
+        }
+    }
+
+    view(1, 2, 3) = 42.f;
+    EXPECT_FLOAT_EQ(tensor.At(1, 2, 3), 42.f);
+
+    static constexpr float data[6] = {};
+    constexpr TensorView<const float, 2> fixed(data, { 2,3 }, { 3,1 });
+    static_assert(fixed.offset(1, 2) == 5);
+}
+
+TEST(View, Iterator)
+{
+    Tensor tensor = Tensor::randn(Shape(3, 4, 5));
+
+    // strided view of a column
+    Tensor col = tensor.col(2);
+    TensorView<float, 1> cview(col);
+    EXPECT_FALSE(cview.contiguous());
+    int i = 0;
+    for (float v : cview)
+    {
+        EXPECT_FLOAT_EQ(v, tensor.At(0, i++, 2));
+    }
+    EXPECT_EQ(i, 4);
+
+    // transposed steps, the end must not stop at an element with the same address
+    Array<float> arr = { 0,1,2,3,4,5 };
+    TensorView<float, 2> transposed(arr.data(), { 3,2 }, { 1,3 });
+    float expected[] = { 0,3,1,4,2,5 };
+    i = 0;
+    for (float v : transposed)
+    {
+        EXPECT_FLOAT_EQ(v, expected[i++]);
+    }
+    EXPECT_EQ(i, 6);
+}
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -3,4 +3,22 @@
 #include <core/core.hpp>
 #include "gtest/gtest.h"
 
-using namespace chaos;
\ No newline at end of file
+#include <atomic>
+
+using namespace chaos;
+
+// counts the allocations and the bytes they asked for
+class CountingAllocator : public Allocator
+{
+public:
+    void* FastMalloc(size_t size) override
+    {
+        count++;
+        bytes += size;
+        return chaos::FastMalloc(size);
+    }
+    void FastFree(void* ptr) override { chaos::FastFree(ptr); }
+
+    std::atomic<int> count = 0;
+    std::atomic<size_t> bytes = 0;
+};
\ No newline at end of file